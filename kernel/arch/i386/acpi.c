@@ -0,0 +1,117 @@
+/**
+ * Minimal ACPI table discovery
+ *
+ * Locates the RSDP in the BIOS areas below 1MB and walks the RSDT to find
+ * individual tables. Only what is needed to enumerate CPUs is implemented.
+ */
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include <kernel/kernel.h>
+
+#include <arch/i386/acpi.h>
+#include <arch/i386/paging.h>
+
+// Location of the EBDA segment in the BIOS data area
+static uint16_t * volatile acpi_bda_ebda = (uint16_t *)0x40E;
+
+// Root System Description Table, mapped by acpi_init
+static acpi_sdt_header_t *acpi_rsdt = NULL;
+
+static bool acpi_checksum_ok(void *table, uint32_t length) {
+    uint8_t *bytes = (uint8_t *)table;
+    uint8_t sum = 0;
+    uint32_t i;
+    for (i=0; i<length; i++) {
+        sum += bytes[i];
+    }
+    return sum == 0;
+}
+
+/**
+ * Search a region of low memory for the RSDP. It is always 16 byte aligned.
+ */
+static acpi_rsdp_t *acpi_scan_rsdp(uintptr_t start, uintptr_t end) {
+    uintptr_t cur;
+    for (cur = start; cur + sizeof(acpi_rsdp_t) <= end; cur += 16) {
+        acpi_rsdp_t *rsdp = (acpi_rsdp_t *)cur;
+        if (!memcmp(rsdp->signature, ACPI_RSDP_SIGNATURE, 8)
+                && acpi_checksum_ok(rsdp, sizeof(acpi_rsdp_t))) {
+            return rsdp;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Map a whole table given its physical address
+ * @return mapped table, or NULL if it couldn't be mapped or is corrupt
+ */
+static acpi_sdt_header_t *acpi_map_table(uint32_t phys) {
+    // Map the header first to find out how long the table is
+    acpi_sdt_header_t *header = i386_map_phys(phys, sizeof(acpi_sdt_header_t), PT_PRESENT);
+    if (!header) return NULL;
+    uint32_t length = header->length;
+    i386_unmap_phys(header, sizeof(acpi_sdt_header_t));
+
+    header = i386_map_phys(phys, length, PT_PRESENT);
+    if (!header) return NULL;
+    if (!acpi_checksum_ok(header, length)) {
+        i386_unmap_phys(header, length);
+        return NULL;
+    }
+    return header;
+}
+
+/**
+ * Find the RSDP and map the RSDT. Low memory must be identity mapped.
+ * @return K_SUCCESS, K_NOTSUP if the firmware doesn't provide ACPI tables,
+ *         or K_OOM if the RSDT couldn't be mapped
+ */
+k_return_t acpi_init() {
+    // The first KB of the EBDA, whose segment is stored in the BDA
+    uintptr_t ebda = (uintptr_t)(*acpi_bda_ebda) << 4;
+    acpi_rsdp_t *rsdp = NULL;
+    if (ebda) {
+        rsdp = acpi_scan_rsdp(ebda, ebda + 1024);
+    }
+
+    // The BIOS read-only area
+    if (!rsdp) {
+        rsdp = acpi_scan_rsdp(0xE0000, 0x100000);
+    }
+    if (!rsdp) return K_NOTSUP;
+
+    acpi_rsdt = acpi_map_table(rsdp->rsdt_address);
+    if (!acpi_rsdt) return K_OOM;
+
+    return K_SUCCESS;
+}
+
+/**
+ * Find and map an ACPI table
+ * @param signature 4 character table signature, e.g. "APIC"
+ * @return mapped table, or NULL if not present
+ */
+acpi_sdt_header_t *acpi_find_table(const char *signature) {
+    if (!acpi_rsdt) return NULL;
+
+    uint32_t *entries = (uint32_t *)(acpi_rsdt + 1);
+    uint32_t n_entries = (acpi_rsdt->length - sizeof(acpi_sdt_header_t)) / sizeof(uint32_t);
+    uint32_t i;
+
+    for (i=0; i<n_entries; i++) {
+        acpi_sdt_header_t *header = i386_map_phys(entries[i], sizeof(acpi_sdt_header_t), PT_PRESENT);
+        if (!header) return NULL;
+        bool match = !memcmp(header->signature, signature, 4);
+        i386_unmap_phys(header, sizeof(acpi_sdt_header_t));
+
+        if (match) {
+            return acpi_map_table(entries[i]);
+        }
+    }
+
+    return NULL;
+}
@@ -0,0 +1,145 @@
+/**
+ * Local APIC driver
+ *
+ * Used to start and signal the other CPUs and to give each application
+ * processor its own scheduler tick. Legacy device IRQs keep going through
+ * the PIC to the bootstrap processor.
+ */
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#include <kernel/kernel.h>
+#include <kernel/sched.h>
+
+#include <arch/i386/cpu.h>
+#include <arch/i386/apic.h>
+#include <arch/i386/interrupt.h>
+#include <arch/i386/mem.h>
+#include <arch/i386/paging.h>
+#include <drivers/pc/pit.h>
+
+volatile uint32_t *lapic_base = NULL;
+
+// Timer counts per PIT tick, at a divider of 16
+static uint32_t lapic_timer_ticks = 0;
+
+static bool lapic_timer_handler(i386_registers_t *r, void *data) {
+    r = r;
+    data = data;
+    sched_tick();
+    return true;
+}
+
+static bool lapic_spurious_handler(i386_registers_t *r, void *data) {
+    r = r;
+    data = data;
+    // Spurious interrupts must not be acknowledged
+    return true;
+}
+
+/**
+ * Map the local APIC registers and set up its vectors. Called once on the BSP.
+ * @param phys physical address of the local APIC registers
+ * @return K_SUCCESS or K_OOM if the registers couldn't be mapped
+ */
+k_return_t lapic_init(uint32_t phys) {
+    lapic_base = i386_map_phys(phys, PAGE_SIZE, PT_PRESENT | PT_RW | PT_DISABLECACHE);
+    if (!lapic_base) return K_OOM;
+
+    interrupt_register(INTERRUPT_APIC_TIMER, lapic_timer_handler, NULL, 0);
+    interrupt_set_eoi(INTERRUPT_APIC_TIMER, lapic_eoi);
+    interrupt_register(INTERRUPT_APIC_SPURIOUS, lapic_spurious_handler, NULL, 0);
+    return K_SUCCESS;
+}
+
+/**
+ * Enable the calling CPU's local APIC
+ */
+void lapic_enable() {
+    lapic_write(LAPIC_TPR, 0);
+    lapic_write(LAPIC_LVT_ERROR, LAPIC_LVT_MASKED);
+    lapic_write(LAPIC_SVR, LAPIC_SVR_ENABLE | INTERRUPT_APIC_SPURIOUS);
+
+    // Clear any errors latched before we were enabled
+    lapic_write(LAPIC_ESR, 0);
+    lapic_write(LAPIC_ESR, 0);
+}
+
+/**
+ * Acknowledge an interrupt delivered by the local APIC
+ */
+void lapic_eoi(uint8_t vector) {
+    vector = vector;
+    lapic_write(LAPIC_EOI, 0);
+}
+
+static void lapic_wait_icr() {
+    while (lapic_read(LAPIC_ICR_LOW) & LAPIC_ICR_PENDING) {
+        cpu_relax();
+    }
+}
+
+/**
+ * Send an inter-processor interrupt to a single CPU
+ * @param apic_id APIC ID of the target CPU
+ * @param icr     delivery mode and vector (LAPIC_ICR_*)
+ */
+void lapic_send_ipi(uint8_t apic_id, uint32_t icr) {
+    uint32_t eflags = cpu_irq_save();
+    lapic_wait_icr();
+    lapic_write(LAPIC_ICR_HIGH, (uint32_t)apic_id << 24);
+    lapic_write(LAPIC_ICR_LOW, icr);
+    lapic_wait_icr();
+    cpu_irq_restore(eflags);
+}
+
+/**
+ * Send an inter-processor interrupt to every CPU but the calling one
+ * @param icr delivery mode and vector (LAPIC_ICR_*)
+ */
+void lapic_broadcast_ipi(uint32_t icr) {
+    uint32_t eflags = cpu_irq_save();
+    lapic_wait_icr();
+    lapic_write(LAPIC_ICR_HIGH, 0);
+    lapic_write(LAPIC_ICR_LOW, icr | LAPIC_ICR_ALL_BUT_SELF);
+    lapic_wait_icr();
+    cpu_irq_restore(eflags);
+}
+
+/**
+ * Measure the local APIC timer against the PIT.
+ * Must be called on the BSP with interrupts enabled.
+ */
+void lapic_timer_calibrate() {
+    const uint32_t sample_ticks = 10;
+
+    lapic_write(LAPIC_TIMER_DIV, LAPIC_TIMER_DIV_16);
+    lapic_write(LAPIC_LVT_TIMER, LAPIC_LVT_MASKED);
+
+    // Start on a tick boundary
+    uint32_t start = pit_get_total_ticks();
+    while (pit_get_total_ticks() == start) {
+        cpu_relax();
+    }
+
+    start = pit_get_total_ticks();
+    lapic_write(LAPIC_TIMER_INIT, 0xFFFFFFFF);
+    while (pit_get_total_ticks() - start < sample_ticks) {
+        cpu_relax();
+    }
+    uint32_t elapsed = 0xFFFFFFFF - lapic_read(LAPIC_TIMER_CUR);
+    lapic_write(LAPIC_TIMER_INIT, 0);
+
+    lapic_timer_ticks = elapsed / sample_ticks;
+}
+
+/**
+ * Start the calling CPU's local APIC timer, firing at the PIT tick rate
+ */
+void lapic_timer_start() {
+    ASSERT(lapic_timer_ticks);
+    lapic_write(LAPIC_TIMER_DIV, LAPIC_TIMER_DIV_16);
+    lapic_write(LAPIC_LVT_TIMER, INTERRUPT_APIC_TIMER | LAPIC_TIMER_PERIODIC);
+    lapic_write(LAPIC_TIMER_INIT, lapic_timer_ticks);
+}
@@ -2,28 +2,36 @@
 
 #include <arch/i386/descriptors/gdt.h>
 #include <arch/i386/descriptors/tss.h>
+#include <arch/i386/smp.h>
+#include <arch/i386/percpu.h>
 
-struct gdt_entry gdt[5];
-struct gdt_ptr gp;
+// Each CPU has its own GDT so that it can have its own TSS descriptor
+struct gdt_entry gdt[SMP_MAX_CPUS][GDT_ENTRIES];
+struct gdt_ptr gp[SMP_MAX_CPUS];
 
-extern void _gdt_flush();
+extern void _gdt_flush(struct gdt_ptr *ptr);
+extern void _tss_flush(uint16_t selector);
 
-void _gdt_set_gate(int32_t num, uint64_t base, uint64_t limit,
+void _gdt_set_gate(uint32_t cpu, int32_t num, uint64_t base, uint64_t limit,
     uint8_t access, uint8_t gran) {
-        gdt[num].base_low = (base & 0xFFFF);
-        gdt[num].base_middle = (base >> 16) & 0xFF;
-        gdt[num].base_high = (base >> 24) & 0xFF;
+        gdt[cpu][num].base_low = (base & 0xFFFF);
+        gdt[cpu][num].base_middle = (base >> 16) & 0xFF;
+        gdt[cpu][num].base_high = (base >> 24) & 0xFF;
 
-        gdt[num].limit_low = (limit & 0xFFFF);
-        gdt[num].granularity = ((limit >> 16) & 0x0F);
+        gdt[cpu][num].limit_low = (limit & 0xFFFF);
+        gdt[cpu][num].granularity = ((limit >> 16) & 0x0F);
 
-        gdt[num].granularity |= (gran & 0xF0);
-        gdt[num].access = access;
+        gdt[cpu][num].granularity |= (gran & 0xF0);
+        gdt[cpu][num].access = access;
     }
 
-void gdt_install() {
-    gp.limit = (sizeof(struct gdt_entry) * 3) - 1;
-    gp.base = (unsigned int)&gdt;
+/**
+ * Build and load the GDT and TSS of the calling CPU
+ * @param cpu logical index of the calling CPU
+ */
+void gdt_install_cpu(uint32_t cpu) {
+    gp[cpu].limit = (sizeof(struct gdt_entry) * GDT_ENTRIES) - 1;
+    gp[cpu].base = (unsigned int)&gdt[cpu];
 
     /**
     * Load up GDT with required gates
@@ -32,17 +40,38 @@ void gdt_install() {
     * gate 2 - kernel data segment descriptor
     * gate 3 - user mode code segment descriptor
     * gate 4 - user mode data segment descriptor
-    * TODO: gate * - TSS segment descriptor
+    * gate 5 - TSS segment descriptor
+    * gate 6 - per-CPU data segment descriptor
     */
-    _gdt_set_gate(0, 0, 0, 0, 0);
-    _gdt_set_gate(1, 0, 0xFFFFFFFF, 0x9A, 0xCF);
-    _gdt_set_gate(2, 0, 0xFFFFFFFF, 0x92, 0xCF);
-    _gdt_set_gate(3, 0, 0xFFFFFFFF, 0xFA, 0xCF);
-    _gdt_set_gate(4, 0, 0xFFFFFFFF, 0xF2, 0xCF);
+    _gdt_set_gate(cpu, 0, 0, 0, 0, 0);
+    _gdt_set_gate(cpu, 1, 0, 0xFFFFFFFF, 0x9A, 0xCF);
+    _gdt_set_gate(cpu, 2, 0, 0xFFFFFFFF, 0x92, 0xCF);
+    _gdt_set_gate(cpu, 3, 0, 0xFFFFFFFF, 0xFA, 0xCF);
+    _gdt_set_gate(cpu, 4, 0, 0xFFFFFFFF, 0xF2, 0xCF);
+
+    //TSS, byte granular
+    struct tss *tss = tss_install(cpu);
+    _gdt_set_gate(cpu, 5, (uint32_t)tss, sizeof(struct tss) - 1, 0x89, 0x00);
 
-    //TSS
-    //uint32_t tss = (uint32_t)tss_return();
-    //_gdt_set_gate(3, tss, sizeof(struct tss), 0x89, 0xCF);
+    // Per-CPU data. The base wraps around so that template addresses land in
+    // the CPU's own copy; it is 0 (the template itself) until percpu_alloc.
+    _gdt_set_gate(cpu, 6, percpu_offsets[cpu], 0xFFFFFFFF, 0x92, 0xCF);
+
+    _gdt_flush(&gp[cpu]);
+    _tss_flush(GDT_TSS);
+    __asm__ __volatile__ ("movw %0, %%gs" : : "r" ((uint16_t)GDT_PERCPU) : "memory");
+}
 
-    _gdt_flush();
+/**
+ * Change the base of a CPU's per-CPU data descriptor. The new base only takes
+ * effect once GS is reloaded.
+ * @param cpu  logical index of the CPU
+ * @param base new segment base
+ */
+void gdt_set_percpu_base(uint32_t cpu, uint32_t base) {
+    _gdt_set_gate(cpu, 6, base, 0xFFFFFFFF, 0x92, 0xCF);
+}
+
+void gdt_install() {
+    gdt_install_cpu(0);
 }
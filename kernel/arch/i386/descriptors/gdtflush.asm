@@ -1,9 +1,10 @@
 section .text
 
 global _gdt_flush
-extern gp
+global _tss_flush
 _gdt_flush:
-    lgdt [gp]
+    mov eax, [esp+4] ; Pointer to the gdt_ptr to load
+    lgdt [eax]
     jmp reloadSegments
 
 reloadSegments:
@@ -19,3 +20,8 @@ reload_CS:
     mov   gs, ax
     mov   ss, ax
     ret
+
+_tss_flush:
+    mov ax, [esp+4] ; Selector of the TSS descriptor
+    ltr ax
+    ret
@@ -50,3 +50,10 @@ void idt_install() {
     //Install IDT
     _idt_flush();
 }
+
+/**
+ * Load the already populated IDT on the calling CPU
+ */
+void idt_load() {
+    _idt_flush();
+}
@@ -1,15 +1,39 @@
+#include <stdint.h>
+#include <string.h>
+
+#include <arch/i386/descriptors/gdt.h>
 #include <arch/i386/descriptors/tss.h>
+#include <arch/i386/smp.h>
+
+// One TSS per CPU, each CPU needs its own ring 0 stack
+static struct tss tss[SMP_MAX_CPUS];
 
-struct tss *tss;
+/**
+ * Initialize the TSS of a CPU
+ * @param cpu logical index of the CPU
+ * @return pointer to the TSS, to be installed in the CPU's GDT
+ */
+struct tss *tss_install(uint32_t cpu) {
+  memset(&tss[cpu], 0, sizeof(struct tss));
 
-void tss_install() {
   //Kernel datasegment descriptor in GDT
-  tss->ss0 = 0x08;
+  tss[cpu].ss0 = GDT_KERNEL_DATA;
+
+  //No I/O permission bitmap
+  tss[cpu].bitmap = sizeof(struct tss);
+
+  return &tss[cpu];
+}
 
-  //TODO: Initialize esp0 in tss
-  //tss->esp0
+/**
+ * Set the stack a CPU switches to when entering ring 0 from user mode
+ * @param cpu  logical index of the CPU
+ * @param esp0 top of the kernel stack
+ */
+void tss_set_kernel_stack(uint32_t cpu, void *esp0) {
+  tss[cpu].esp0 = esp0;
 }
 
-struct tss * tss_return() {
-  return tss;
+struct tss *tss_return(uint32_t cpu) {
+  return &tss[cpu];
 }
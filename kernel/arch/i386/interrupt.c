@@ -0,0 +1,361 @@
+/**
+ * Table-driven interrupt dispatch
+ *
+ * Every IDT vector enters through a generated stub in interruptstub.asm and
+ * ends up in interrupt_dispatch(), which walks the chain of handlers
+ * registered for that vector and then acknowledges the interrupt controller.
+ */
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <kernel/kernel.h>
+#include <kernel/kernel_thread.h>
+#include <kernel/atomic.h>
+#include <kernel/sched.h>
+#include <kernel/spinlock.h>
+
+#include <arch/i386/cpu.h>
+#include <arch/i386/descriptors/idt.h>
+#include <arch/i386/isr.h>
+#include <arch/i386/interrupt.h>
+#include <arch/i386/percpu.h>
+#include <arch/i386/smp.h>
+
+// Entry points of the generated stubs, indexed by vector
+extern uint32_t _interrupt_stub_table[INTERRUPT_VECTORS];
+
+interrupt_vector_t interrupt_vectors[INTERRUPT_VECTORS];
+
+// Serializes changes to the handler chains, the action pool and vector
+// reservations. Dispatch walks the chains without it.
+static spinlock_t interrupt_lock = SPINLOCK_INIT;
+
+// Bumped when a CPU enters and leaves interrupt_dispatch(), so it is odd
+// while the CPU may be walking a handler chain
+static DEFINE_PER_CPU(uint32_t, interrupt_dispatch_seq);
+
+// Statistics for each vector, updated on every dispatch. Every CPU keeps its
+// own copy so that dispatch never touches another CPU's cache lines.
+static DEFINE_PER_CPU(interrupt_stats_t, interrupt_stats[INTERRUPT_VECTORS]);
+
+// Statically allocated pool of handler entries, so that handlers can be
+// registered before the kernel heap is available
+static interrupt_action_t interrupt_action_pool[INTERRUPT_MAX_ACTIONS];
+static interrupt_action_t *interrupt_action_free = NULL;
+static bool interrupt_action_pool_ready = false;
+
+// Must be called with interrupt_lock held
+static interrupt_action_t *interrupt_action_get() {
+    if (!interrupt_action_pool_ready) {
+        uint32_t i;
+        for (i=0; i<INTERRUPT_MAX_ACTIONS; i++) {
+            interrupt_action_pool[i].next = interrupt_action_free;
+            interrupt_action_free = &interrupt_action_pool[i];
+        }
+        interrupt_action_pool_ready = true;
+    }
+
+    interrupt_action_t *res = interrupt_action_free;
+    if (res) {
+        interrupt_action_free = res->next;
+    }
+    return res;
+}
+
+// Must be called with interrupt_lock held
+static void interrupt_action_put(interrupt_action_t *action) {
+    action->next = interrupt_action_free;
+    interrupt_action_free = action;
+}
+
+/**
+ * Wait until every CPU that may still see a handler just removed from a
+ * chain has left interrupt_dispatch()
+ */
+static void interrupt_synchronize() {
+    uint32_t cpu;
+
+    // Order the unlink before reading the sequence counts
+    smp_mb();
+    for (cpu=0; cpu<smp_num_cpus; cpu++) {
+        if (cpu && !percpu_offsets[cpu]) continue;
+        uint32_t *seq = per_cpu_ptr(interrupt_dispatch_seq, cpu);
+        uint32_t start = atomic_load_acquire(seq);
+        if (!(start & 1)) continue;
+        while (atomic_load_acquire(seq) == start) {
+            cpu_relax();
+        }
+    }
+}
+
+/**
+ * Point every IDT gate at its generated entry stub
+ */
+void interrupt_install_gates() {
+    uint32_t i;
+    for (i=0; i<INTERRUPT_VECTORS; i++) {
+        _idt_set_gate(i, _interrupt_stub_table[i], 0x08, 0x8E);
+    }
+}
+
+/**
+ * Register a handler on an interrupt vector
+ * @param vector  vector to handle
+ * @param handler function to call when the vector fires
+ * @param data    context pointer passed to handler
+ * @param flags   registration flags (INTERRUPT_SHARED)
+ * @return K_SUCCESS, K_INVALOP if the vector is in use and can't be shared,
+ *         or K_OOM if no handler entries are left
+ */
+k_return_t interrupt_register(uint8_t vector, interrupt_handler_t handler, void *data,
+                              uint32_t flags) {
+    interrupt_vector_t *v = &interrupt_vectors[vector];
+    k_return_t ret = K_SUCCESS;
+    uint32_t eflags = spin_lock_irqsave(&interrupt_lock);
+
+    // A vector can only have multiple handlers if all of them agree to share it
+    if (v->actions && !(v->actions->flags & flags & INTERRUPT_SHARED)) {
+        ret = K_INVALOP;
+        goto out;
+    }
+
+    interrupt_action_t *action = interrupt_action_get();
+    if (!action) {
+        ret = K_OOM;
+        goto out;
+    }
+    action->handler = handler;
+    action->data = data;
+    action->flags = flags;
+    action->next = NULL;
+
+    // Append to the end of the chain so handlers run in registration order.
+    // Dispatch may be walking the chain, so the entry is published last.
+    interrupt_action_t **cur = &v->actions;
+    while (*cur) {
+        cur = &(*cur)->next;
+    }
+    atomic_store_release(cur, action);
+
+out:
+    spin_unlock_irqrestore(&interrupt_lock, eflags);
+    return ret;
+}
+
+/**
+ * Remove a handler from an interrupt vector. Once this returns the handler
+ * is no longer running on any CPU. Must not be called from an interrupt
+ * handler.
+ * @param vector  vector the handler was registered on
+ * @param handler handler to remove
+ * @param data    context pointer the handler was registered with
+ * @return K_SUCCESS or K_INVALOP if no such handler is registered
+ */
+k_return_t interrupt_unregister(uint8_t vector, interrupt_handler_t handler, void *data) {
+    interrupt_vector_t *v = &interrupt_vectors[vector];
+    interrupt_action_t *action = NULL;
+    ASSERT(!in_interrupt());
+    uint32_t eflags = spin_lock_irqsave(&interrupt_lock);
+
+    interrupt_action_t **cur = &v->actions;
+    while (*cur) {
+        if ((*cur)->handler == handler && (*cur)->data == data) {
+            action = *cur;
+            atomic_store_release(cur, action->next);
+            break;
+        }
+        cur = &(*cur)->next;
+    }
+
+    spin_unlock_irqrestore(&interrupt_lock, eflags);
+    if (!action) {
+        return K_INVALOP;
+    }
+
+    // Another CPU may still be running the handler or about to follow
+    // action->next, so it can't be reused until they're done
+    interrupt_synchronize();
+
+    eflags = spin_lock_irqsave(&interrupt_lock);
+    interrupt_action_put(action);
+    spin_unlock_irqrestore(&interrupt_lock, eflags);
+    return K_SUCCESS;
+}
+
+/**
+ * Set the routine used to acknowledge a vector at its interrupt controller
+ * @param vector vector to act on
+ * @param eoi    acknowledge routine, or NULL if none is required
+ */
+void interrupt_set_eoi(uint8_t vector, interrupt_eoi_t eoi) {
+    interrupt_vectors[vector].eoi = eoi;
+}
+
+/**
+ * Reserve an unused vector from the dynamic range (e.g. for an MSI)
+ * @param[out] out allocated vector
+ * @return K_SUCCESS or K_NOSPACE if all dynamic vectors are in use
+ */
+k_return_t interrupt_alloc_vector(uint8_t *out) {
+    k_return_t ret = K_NOSPACE;
+    uint32_t eflags = spin_lock_irqsave(&interrupt_lock);
+
+    uint32_t i;
+    for (i=INTERRUPT_DYNAMIC_BASE; i<=INTERRUPT_DYNAMIC_END; i++) {
+        if (!interrupt_vectors[i].reserved && !interrupt_vectors[i].actions) {
+            interrupt_vectors[i].reserved = true;
+            *out = i;
+            ret = K_SUCCESS;
+            break;
+        }
+    }
+
+    spin_unlock_irqrestore(&interrupt_lock, eflags);
+    return ret;
+}
+
+/**
+ * Release a vector obtained from interrupt_alloc_vector()
+ * @param vector vector to release
+ */
+void interrupt_free_vector(uint8_t vector) {
+    interrupt_vectors[vector].reserved = false;
+}
+
+/**
+ * Common interrupt entry, called from interrupt_common_stub
+ * @param r saved register state of the interrupted context
+ */
+void interrupt_dispatch(i386_registers_t *r) {
+    uint8_t vector = r->int_no & 0xFF;
+    interrupt_vector_t *v = &interrupt_vectors[vector];
+    interrupt_stats_t *stats = this_cpu_ptr(interrupt_stats[vector]);
+    bool handled = false;
+    uint64_t start = cpu_rdtsc();
+
+    // Exceptions raised by a handler nest inside the outer dispatch, which
+    // covers them. The increment is a full barrier, so the chain can't be
+    // read before it's visible to interrupt_synchronize().
+    bool outermost = !in_interrupt();
+    uint32_t *seq = this_cpu_ptr(interrupt_dispatch_seq);
+    if (outermost) {
+        atomic_inc(seq);
+    }
+
+    // Handlers must not be preempted, and preempt_enable() in them mustn't switch
+    this_cpu_add(sched_preempt_count, SCHED_HARDIRQ_OFFSET);
+
+    // Run every handler on the chain. Level-triggered lines may be asserted by
+    // several devices at once, so we can't stop at the first one that claims it.
+    interrupt_action_t *action;
+    for (action = atomic_load_acquire(&v->actions); action;
+            action = atomic_load_acquire(&action->next)) {
+        if (action->handler(r, action->data)) {
+            handled = true;
+        }
+    }
+
+    if (!handled) {
+        if (vector < INTERRUPT_PIC_BASE) {
+            // Unhandled CPU exception
+            _fault_handler(r);
+        } else if (stats->unhandled++ == 0) {
+            // Only report the first occurrence, the rest show up in the stats
+            printk_debug("Don't know how to handle interrupt vector #%d", vector);
+        }
+    }
+
+    // Account the time spent in the handlers
+    uint64_t cycles = cpu_rdtsc() - start;
+    stats->count++;
+    stats->cycles += cycles;
+    if (cycles > stats->max_cycles) {
+        stats->max_cycles = cycles;
+    }
+    uint32_t bucket = 0;
+    if (cycles >> 32) {
+        bucket = INTERRUPT_HIST_BUCKETS - 1;
+    } else if (cycles) {
+        bucket = cpu_bsr((uint32_t)cycles);
+    }
+    stats->hist[bucket]++;
+
+    if (v->eoi) {
+        v->eoi(r->int_no);
+    }
+    this_cpu_add(sched_preempt_count, -SCHED_HARDIRQ_OFFSET);
+    if (outermost) {
+        atomic_store_release(seq, *seq + 1);
+    }
+
+    // The interrupt has been acknowledged, it's now safe to switch threads
+    kernel_thread_preempt();
+}
+
+/**
+ * Get a snapshot of the statistics for an interrupt vector, summed over all
+ * CPUs. Other CPUs may be updating their copies while they are read, so the
+ * totals are only approximate.
+ * @param vector vector to query
+ * @param[out] out pointer to interrupt_stats_t to copy statistics to
+ */
+void interrupt_stats_get(uint8_t vector, interrupt_stats_t *out) {
+    uint32_t cpu, j;
+
+    memset(out, 0, sizeof(interrupt_stats_t));
+    for (cpu=0; cpu<smp_num_cpus; cpu++) {
+        if (cpu && !percpu_offsets[cpu]) continue;
+        interrupt_stats_t *stats = per_cpu_ptr(interrupt_stats[vector], cpu);
+
+        out->count += stats->count;
+        out->unhandled += stats->unhandled;
+        out->cycles += stats->cycles;
+        if (stats->max_cycles > out->max_cycles) {
+            out->max_cycles = stats->max_cycles;
+        }
+        for (j=0; j<INTERRUPT_HIST_BUCKETS; j++) {
+            out->hist[j] += stats->hist[j];
+        }
+    }
+}
+
+/**
+ * Reset the statistics of all interrupt vectors on all CPUs
+ */
+void interrupt_stats_reset() {
+    uint32_t cpu;
+    for (cpu=0; cpu<smp_num_cpus; cpu++) {
+        if (cpu && !percpu_offsets[cpu]) continue;
+        memset(per_cpu_ptr(interrupt_stats, cpu), 0, sizeof(interrupt_stats));
+    }
+}
+
+/**
+ * Print the statistics of every vector that has fired to the console
+ */
+void interrupt_stats_dump() {
+    interrupt_stats_t stats;
+    uint32_t i, j;
+
+    for (i=0; i<INTERRUPT_VECTORS; i++) {
+        interrupt_stats_get(i, &stats);
+        if (!stats.count) {
+            continue;
+        }
+
+        printf("vector %u: count %u, unhandled %u, avg %u cycles, max %u cycles\n", i, (uint32_t)stats.count, (uint32_t)stats.unhandled,
+               (uint32_t)(stats.cycles / stats.count), (uint32_t)stats.max_cycles);
+
+        // Print the non-empty histogram buckets as 2^n:count pairs
+        printf("    hist:");
+        for (j=0; j<INTERRUPT_HIST_BUCKETS; j++) {
+            if (stats.hist[j]) {
+                printf(" 2^%u:%u", j, stats.hist[j]);
+            }
+        }
+        printf("\n");
+    }
+}
@@ -0,0 +1,80 @@
+section .text
+align 4
+
+; Entry stubs for all 256 IDT vectors.
+; Each stub pushes a dummy error code (if the CPU didn't push one) and its
+; vector number, then jumps to interrupt_common_stub which hands the saved
+; register frame to interrupt_dispatch().
+;
+; All gates are installed as interrupt gates, so the CPU has already cleared
+; IF by the time a stub runs; no explicit cli is needed.
+
+; Exceptions for which the CPU pushes an error code
+%macro INTERRUPT_STUB 1
+_interrupt_stub%+%1:
+%if %1 == 8 || (%1 >= 10 && %1 <= 14) || %1 == 17 || %1 == 21 || %1 == 29 || %1 == 30
+    push dword %1
+%else
+    push byte 0
+    push dword %1
+%endif
+    jmp interrupt_common_stub
+%endmacro
+
+%assign i 0
+%rep 256
+INTERRUPT_STUB i
+%assign i i+1
+%endrep
+
+extern interrupt_dispatch
+interrupt_common_stub:
+    pusha
+    cld            ; C code expects DF clear, we may have interrupted memmove
+    push ds
+    push es
+    push fs
+    push gs
+
+    ; The data segments only need to be reloaded if we interrupted ring 3.
+    ; [esp+60] is the CS the CPU pushed for the interrupted context.
+    test byte [esp+60], 3
+    jz .from_kernel
+    mov ax, 0x10   ; Load the Kernel Data Segment descriptor
+    mov ds, ax
+    mov es, ax
+    mov fs, ax
+    mov ax, 0x30   ; GS addresses this CPU's per-CPU area
+    mov gs, ax
+.from_kernel:
+    push esp       ; i386_registers_t *
+    call interrupt_dispatch
+    add esp, 4
+
+    test byte [esp+60], 3
+    jz .to_kernel
+    pop gs
+    pop fs
+    pop es
+    pop ds
+    popa
+    add esp, 8     ; Clean up the pushed error code and vector number
+    iret
+
+.to_kernel:
+    ; Segments weren't touched, skip the (slow) segment register loads
+    add esp, 16
+    popa
+    add esp, 8
+    iret
+
+; Table of stub entry points, indexed by vector number
+section .rodata
+align 4
+global _interrupt_stub_table
+_interrupt_stub_table:
+%assign i 0
+%rep 256
+    dd _interrupt_stub%+i
+%assign i i+1
+%endrep
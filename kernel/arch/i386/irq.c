@@ -3,6 +3,7 @@
  * Adapted from: http://www.osdever.net/bkerndev/Docs/irqs.htm
  */
 #include <stdint.h>
+#include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -13,36 +14,31 @@
 #include <arch/i386/descriptors/idt.h>
 #include <arch/i386/isr.h>
 #include <arch/i386/irq.h>
+#include <arch/i386/interrupt.h>
 
-extern void _irq0();
-extern void _irq1();
-extern void _irq2();
-extern void _irq3();
-extern void _irq4();
-extern void _irq5();
-extern void _irq6();
-extern void _irq7();
-extern void _irq8();
-extern void _irq9();
-extern void _irq10();
-extern void _irq11();
-extern void _irq12();
-extern void _irq13();
-extern void _irq14();
-extern void _irq15();
-
-void *irq_routines[16] =
-{
-    0, 0, 0, 0, 0, 0, 0, 0,
-    0, 0, 0, 0, 0, 0, 0, 0
-};
-
-void irq_install_handler(int32_t irq, void (*handler)(i386_registers_t *r)) {
-    irq_routines[irq] = handler;
+/**
+ * Register a handler for a legacy PIC IRQ
+ * @param irq     IRQ line (0-15)
+ * @param handler function to call when the IRQ fires
+ * @param data    context pointer passed to handler
+ * @param flags   registration flags (INTERRUPT_SHARED for shared lines)
+ * @return kernel result code
+ */
+k_return_t irq_install_handler(int32_t irq, bool (*handler)(i386_registers_t *r, void *data),
+                               void *data, uint32_t flags) {
+    return interrupt_register(INTERRUPT_PIC_BASE + irq, handler, data, flags);
 }
 
-void irq_uninstall_handler(int32_t irq) {
-    irq_routines[irq] = 0;
+/**
+ * Remove a handler from a legacy PIC IRQ
+ * @param irq     IRQ line (0-15)
+ * @param handler handler to remove
+ * @param data    context pointer the handler was registered with
+ * @return kernel result code
+ */
+k_return_t irq_uninstall_handler(int32_t irq, bool (*handler)(i386_registers_t *r, void *data),
+                                 void *data) {
+    return interrupt_unregister(INTERRUPT_PIC_BASE + irq, handler, data);
 }
 
 /* Remap IRQs to ISR gates 32-47 */
@@ -59,55 +55,19 @@ void __irq_remap() {
     outportb(0xA1, 0x0);
 }
 
-/* We first remap the interrupt controllers, and then we install
-*  the appropriate ISRs to the correct entries in the IDT. This
-*  is just like installing the exception handlers */
-void _irq_install() {
-    __irq_remap();
-
-    _idt_set_gate(32, (unsigned)_irq0, 0x08, 0x8E);
-    _idt_set_gate(33, (unsigned)_irq1, 0x08, 0x8E);
-    _idt_set_gate(34, (unsigned)_irq2, 0x08, 0x8E);
-    _idt_set_gate(35, (unsigned)_irq3, 0x08, 0x8E);
-    _idt_set_gate(36, (unsigned)_irq4, 0x08, 0x8E);
-    _idt_set_gate(37, (unsigned)_irq5, 0x08, 0x8E);
-    _idt_set_gate(38, (unsigned)_irq6, 0x08, 0x8E);
-    _idt_set_gate(39, (unsigned)_irq7, 0x08, 0x8E);
-    _idt_set_gate(40, (unsigned)_irq8, 0x08, 0x8E);
-    _idt_set_gate(41, (unsigned)_irq9, 0x08, 0x8E);
-    _idt_set_gate(42, (unsigned)_irq10, 0x08, 0x8E);
-    _idt_set_gate(43, (unsigned)_irq11, 0x08, 0x8E);
-    _idt_set_gate(44, (unsigned)_irq12, 0x08, 0x8E);
-    _idt_set_gate(45, (unsigned)_irq13, 0x08, 0x8E);
-    _idt_set_gate(46, (unsigned)_irq14, 0x08, 0x8E);
-    _idt_set_gate(47, (unsigned)_irq15, 0x08, 0x8E);
-}
-
-/* Each of the IRQ ISRs point to this function, rather than
-*  the 'fault_handler' in 'isrs.c'. The IRQ Controllers need
-*  to be told when you are done servicing them, so you need
-*  to send them an "End of Interrupt" command (0x20). There
-*  are two 8259 chips: The first exists at 0x20, the second
-*  exists at 0xA0. If the second controller (an IRQ from 8 to
-*  15) gets an interrupt, you need to acknowledge the
+/* The IRQ Controllers need to be told when you are done
+*  servicing them, so you need to send them an "End of Interrupt"
+*  command (0x20). There are two 8259 chips: The first exists at
+*  0x20, the second exists at 0xA0. If the second controller (an
+*  IRQ from 8 to 15) gets an interrupt, you need to acknowledge the
 *  interrupt at BOTH controllers, otherwise, you only send
 *  an EOI command to the first controller. If you don't send
 *  an EOI, you won't raise any more IRQs */
-void _irq_handler(i386_registers_t *r) {
-    void (*handler)(i386_registers_t *r);
-
-    handler = irq_routines[r->int_no - 32];
-    if (handler) {
-        handler(r);
-    } else {
-        //Until all IRQs are supported, print out debug message
-        printk_debug("Don't know how to handle IRQ #%d", r->int_no-32);
-    }
-
+static void __irq_pic_eoi(uint8_t vector) {
     /* If the IDT entry that was invoked was greater than 40
     *  (meaning IRQ8 - 15), then we need to send an EOI to
     *  the slave controller */
-    if (r->int_no >= 40) {
+    if (vector >= 40) {
         outportb(0xA0, 0x20);
     }
 
@@ -115,3 +75,15 @@ void _irq_handler(i386_registers_t *r) {
     *  interrupt controller too */
     outportb(0x20, 0x20);
 }
+
+/* We first remap the interrupt controllers, and then we tell the
+*  dispatcher how to acknowledge the vectors they now occupy.
+*  The IDT gates themselves are installed by _isr_install */
+void _irq_install() {
+    __irq_remap();
+
+    uint8_t i;
+    for (i=0; i<16; i++) {
+        interrupt_set_eoi(INTERRUPT_PIC_BASE + i, __irq_pic_eoi);
+    }
+}
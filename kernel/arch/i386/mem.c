@@ -224,7 +224,7 @@ void _i386_print_reserved() {
     while (cur_mmap_addr < mmap_end_addr) {
         multiboot_memory_map_t *current_entry = (multiboot_memory_map_t *)cur_mmap_addr;
 
-        printf("[mem] addr: 0x%lx len: 0x%lx reserved: %u\n", current_entry->addr,
+        printf("[mem] addr: 0x%llx len: 0x%llx reserved: %u\n", current_entry->addr,
                 current_entry->len, current_entry->type);
 
         cur_mmap_addr += current_entry->size + sizeof(uintptr_t);
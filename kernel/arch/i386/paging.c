@@ -13,6 +13,7 @@
 #include <mm/alloc.h>
 #include <mm/asa.h>
 #include <kernel/bitset.h>
+#include <arch/i386/cpu.h>
 #include <arch/i386/mem.h>
 #include <arch/i386/isr.h>
 #include <arch/i386/multiboot.h>
@@ -51,6 +52,9 @@ const kpaging_interface_t i386_paging_interface = {
  */
 bool early_init_done = false;
 
+// Whether PT_WRITECOMBINE may be used
+bool i386_pat_enabled = false;
+
 /**
  * Initalize an empty i386_paging_data struct.
  * Must be called before the struct is used.
@@ -90,11 +94,12 @@ void i386_paging_init() {
     }
 
     // Install page fault handler
-    isr_install_handler(14, __i386_page_fault_handler);
+    isr_install_handler(14, __i386_page_fault_handler, NULL);
 
     // Enable paging
     load_page_dir((uint32_t *)i386_kernel_mmu_data.page_directory);
     enable_paging();
+    i386_pat_init();
 
     /**
      * Install paging functions into kernel paging interface
@@ -125,6 +130,22 @@ void i386_paging_init() {
     early_init_done = true;
 }
 
+/**
+ * Program the Page Attribute Table so that PT_WRITECOMBINE selects
+ * write-combining. Must be run on every CPU before it touches a
+ * write-combining mapping, and with the same result on each.
+ */
+void i386_pat_init() {
+    uint32_t regs[4];
+    cpu_cpuid(1, regs);
+    if (!(regs[3] & CPUID_1_EDX_MSR) || !(regs[3] & CPUID_1_EDX_PAT)) {
+        return;
+    }
+
+    cpu_wrmsr(MSR_IA32_PAT, PAT_VALUE);
+    i386_pat_enabled = true;
+}
+
 /**
  * Helper function to get a virtual pointer to a given physical address.
  * Generally used to obtain a virtual pointer to a paging structure in memory (hence the return type).
@@ -271,44 +292,36 @@ k_return_t i386_allocate_page(i386_mmu_data_t *this, uint32_t address, uint32_t
  * @return K_SUCCESS or K_INVALOP if page is already free
  */
 k_return_t i386_free_page(i386_mmu_data_t *this, uint32_t address) {
-    ASSERT(address % PAGE_SIZE == 0);
-    uint32_t page_index = address / PAGE_SIZE;
-    uint32_t table_index = page_index / 1024;
-    uint32_t page_index_in_table = page_index % 1024;
-
-    // Skip request if its table does not exist
-    uint32_t *pd_virt = get_virt_ptr(this->page_directory);
-    if ((pd_virt[table_index] & PD_PRESENT) == 0) {
+    uint32_t phys = i386_page_get_phys(this, address);
+    if (!phys) {
         return K_INVALOP;
     }
 
-    // Get frame address and set page to not present, read/write, supervisor
-    uint32_t *pt_virt = get_virt_ptr(TABLE_IN_DIR(table_index, pd_virt));
-    uint32_t phys_addr_index = pt_virt[page_index_in_table] / PAGE_SIZE;
-    pt_virt[page_index_in_table] = PT_RW;
+    k_return_t ret = i386_unmap_page(this, address);
+    if (K_FAILED(ret)) return ret;
 
     // Free page frame
-    bitset_clear_bit(&i386_mem_frame_bitset, phys_addr_index);
-
-    // Invalidate the address
-    invlpg((void *)address);
+    bitset_clear_bit(&i386_mem_frame_bitset, phys / PAGE_SIZE);
 
     return K_SUCCESS;
 }
 
 /**
- * Identity map a page so that it corresponds with physical memory
- * @param address virtual address that corresponds to page to allocate
+ * Map a page to the given physical address without touching the frame allocator.
+ * Will overwrite any current page.
+ * @param address virtual address that corresponds to page to map
+ * @param phys physical address to map the page to
  * @param pt_flags page table entry flags to be used
  * @param pd_flags page directory entry flags to be used if the page directory entry does not exist
- * @return the created page table entry
+ * @return kernel return code
  */
-uint32_t i386_identity_map_page(i386_mmu_data_t *this, uint32_t address, uint32_t pt_flags, uint32_t pd_flags) {
+k_return_t i386_map_page(i386_mmu_data_t *this, uint32_t address, uint32_t phys, uint32_t pt_flags,
+                         uint32_t pd_flags) {
     ASSERT(address % PAGE_SIZE == 0);
+    ASSERT(phys % PAGE_SIZE == 0);
     uint32_t page_index = address / PAGE_SIZE;
     uint32_t table_index = page_index / 1024;
     uint32_t page_index_in_table = page_index % 1024;
-    uint32_t page;
     k_return_t ret;
 
     // Check if this table is present and allocate it if not
@@ -327,13 +340,126 @@ uint32_t i386_identity_map_page(i386_mmu_data_t *this, uint32_t address, uint32_
     uint32_t *pt_virt = get_virt_ptr((uint32_t)TABLE_IN_DIR(table_index, pd_virt));
 
     // Update page in page table
-    page = (page_index * PAGE_SIZE) | pt_flags;
-    pt_virt[page_index_in_table] = page;
+    pt_virt[page_index_in_table] = phys | pt_flags;
 
-    // Mark this page frame as allocated in the bitset
-    bitset_set_bit(&i386_mem_frame_bitset, page_index);
+    // The address may have been mapped elsewhere before
+    if (early_init_done) {
+        invlpg((void *)address);
+    }
 
-    return page;
+    return K_SUCCESS;
+}
+
+/**
+ * Unmap the page at the specified address without freeing its frame
+ * @param  address virtual address that corresponds to page to unmap
+ * @return K_SUCCESS or K_INVALOP if the page's table does not exist
+ */
+k_return_t i386_unmap_page(i386_mmu_data_t *this, uint32_t address) {
+    ASSERT(address % PAGE_SIZE == 0);
+    uint32_t page_index = address / PAGE_SIZE;
+    uint32_t table_index = page_index / 1024;
+    uint32_t page_index_in_table = page_index % 1024;
+
+    // Skip request if its table does not exist
+    uint32_t *pd_virt = get_virt_ptr(this->page_directory);
+    if ((pd_virt[table_index] & PD_PRESENT) == 0) {
+        return K_INVALOP;
+    }
+
+    // Set page to not present, read/write, supervisor
+    uint32_t *pt_virt = get_virt_ptr(TABLE_IN_DIR(table_index, pd_virt));
+    pt_virt[page_index_in_table] = PT_RW;
+
+    // Invalidate the address
+    invlpg((void *)address);
+
+    return K_SUCCESS;
+}
+
+/**
+ * Identity map a page so that it corresponds with physical memory
+ * @param address virtual address that corresponds to page to allocate
+ * @param pt_flags page table entry flags to be used
+ * @param pd_flags page directory entry flags to be used if the page directory entry does not exist
+ * @return the created page table entry, or 0 on failure
+ */
+uint32_t i386_identity_map_page(i386_mmu_data_t *this, uint32_t address, uint32_t pt_flags, uint32_t pd_flags) {
+    k_return_t ret = i386_map_page(this, address, address, pt_flags, pd_flags);
+    if (K_FAILED(ret)) return 0;
+
+    // Mark this page frame as allocated in the bitset. MMIO regions lie
+    // beyond the end of RAM and have no entry.
+    uint32_t page_index = address / PAGE_SIZE;
+    if (page_index < i386_mem_frame_bitset.length) {
+        bitset_set_bit(&i386_mem_frame_bitset, page_index);
+    }
+
+    return address | pt_flags;
+}
+
+/**
+ * Map a range of physical memory (e.g. MMIO or firmware tables) into the kernel's address space.
+ * Must be called after paging is enabled.
+ * @param phys     physical address to map, need not be page aligned
+ * @param size     number of bytes to map
+ * @param pt_flags page table entry flags to be used
+ * @return virtual address corresponding to phys, or NULL if out of memory
+ */
+void *i386_map_phys(uint32_t phys, uint32_t size, uint32_t pt_flags) {
+    uint32_t start = phys & 0xFFFFF000;
+    uint32_t n_pages = DIV_ROUND_UP(phys + size - start, PAGE_SIZE);
+    uint32_t virt;
+    uint32_t i;
+
+    if (start + n_pages * PAGE_SIZE <= KVIRT_RESERVED) {
+        // Already identity mapped during early init
+        return (void *)phys;
+    } else if (start > KVIRT_MAX) {
+        // Above the kernel address space, identity map it
+        virt = start;
+    } else {
+        virt = (uint32_t)asa_alloc(n_pages);
+        if (!virt) return NULL;
+    }
+
+    for (i=0; i<n_pages; i++) {
+        k_return_t ret = i386_map_page(&i386_kernel_mmu_data, virt + i * PAGE_SIZE, start + i * PAGE_SIZE,
+                                       pt_flags, PD_PRESENT | PD_RW);
+        if (K_FAILED(ret)) {
+            while (i-- > 0) {
+                i386_unmap_page(&i386_kernel_mmu_data, virt + i * PAGE_SIZE);
+            }
+            if (virt <= KVIRT_MAX) {
+                asa_free((void *)virt, n_pages);
+            }
+            return NULL;
+        }
+    }
+
+    return (void *)(virt + (phys - start));
+}
+
+/**
+ * Release a mapping created by i386_map_phys
+ * @param virt address returned by i386_map_phys
+ * @param size size passed to i386_map_phys
+ */
+void i386_unmap_phys(void *virt, uint32_t size) {
+    uint32_t start = (uint32_t)virt & 0xFFFFF000;
+    uint32_t n_pages = DIV_ROUND_UP((uint32_t)virt + size - start, PAGE_SIZE);
+    uint32_t i;
+
+    if (start + n_pages * PAGE_SIZE <= KVIRT_RESERVED) {
+        return;
+    }
+
+    for (i=0; i<n_pages; i++) {
+        i386_unmap_page(&i386_kernel_mmu_data, start + i * PAGE_SIZE);
+    }
+    if (start <= KVIRT_MAX) {
+        asa_free((void *)start, n_pages);
+    }
 }
 
 /**
@@ -357,7 +483,9 @@ uintptr_t __i386_kpage_get_phys(uintptr_t addr) {
     return i386_page_get_phys(&i386_kernel_mmu_data, addr);
 }
 
-void __i386_page_fault_handler(i386_registers_t *r) {
+bool __i386_page_fault_handler(i386_registers_t *r, void *data) {
+    data = data;
+
     // Get faulting address
     uint32_t faulting_address = get_faulting_address();
 
@@ -376,4 +504,5 @@ void __i386_page_fault_handler(i386_registers_t *r) {
     if (us) printf("Page not writable from user-mode\n");
     if (reserved) printf("Page reserved bits overwitten\n");
     abort();
+    return true;
 }
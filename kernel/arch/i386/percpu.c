@@ -0,0 +1,91 @@
+/**
+ * Per-CPU data areas
+ *
+ * Each CPU gets a page-aligned copy of the .percpu template, reached through
+ * the per-CPU GS descriptor in its GDT.
+ */
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+#include <kernel/kernel.h>
+#include <kernel/atomic.h>
+#include <kernel/printk.h>
+#include <mm/alloc.h>
+
+#include <arch/i386/percpu.h>
+#include <arch/i386/smp.h>
+#include <arch/i386/descriptors/gdt.h>
+
+// Bounds of the per-CPU template, set by linker.ld
+extern uint8_t __percpu_start[];
+extern uint8_t __percpu_end[];
+
+uintptr_t percpu_offsets[SMP_MAX_CPUS];
+
+DEFINE_PER_CPU(uintptr_t, this_cpu_off);
+DEFINE_PER_CPU(uint32_t, cpu_number);
+
+/**
+ * Allocate and initialize a CPU's per-CPU area from the template.
+ * Must be called before the CPU is started.
+ * @param cpu logical index of the CPU
+ * @return K_SUCCESS or K_OOM
+ */
+k_return_t percpu_alloc(uint32_t cpu) {
+    uint32_t size = (uintptr_t)__percpu_end - (uintptr_t)__percpu_start;
+
+    uint8_t *area = kmalloc_a(size, KALLOC_GENERAL);
+    if (!area) return K_OOM;
+    memcpy(area, __percpu_start, size);
+
+    uintptr_t offset = (uintptr_t)area - (uintptr_t)__percpu_start;
+    if (cpu) {
+        // Don't hand the APs what the boot CPU logged to the template
+        // before percpu_init
+        printk_percpu_init(offset);
+    }
+
+    // Readers like printk walk every CPU with an offset, so only publish
+    // the area once it's ready
+    *(uintptr_t *)((uintptr_t)&this_cpu_off + offset) = offset;
+    *(uint32_t *)((uintptr_t)&cpu_number + offset) = cpu;
+    atomic_store_release(&percpu_offsets[cpu], offset);
+
+    return K_SUCCESS;
+}
+
+/**
+ * Point the calling CPU's GS at its per-CPU area
+ * @param cpu logical index of the calling CPU
+ */
+void percpu_load(uint32_t cpu) {
+    gdt_set_percpu_base(cpu, percpu_offsets[cpu]);
+    __asm__ __volatile__ ("movw %0, %%gs" : : "r" ((uint16_t)GDT_PERCPU) : "memory");
+}
+
+/**
+ * Set up the boot CPU's per-CPU area. Must be called once the heap is available.
+ */
+void percpu_init() {
+    if (K_FAILED(percpu_alloc(0))) {
+        PANIC("Unable to allocate per-CPU area!");
+    }
+    percpu_load(0);
+}
+
+/**
+ * Sum the copies of a per-CPU counter on all CPUs
+ * @param counter template address of the counter
+ * @return total
+ */
+uint64_t percpu_counter_sum_real(uint64_t *counter) {
+    uint64_t sum = 0;
+    uint32_t i;
+    for (i=0; i<smp_num_cpus; i++) {
+        // Skip CPUs that never got an area of their own
+        if (i && !percpu_offsets[i]) continue;
+        sum += *(uint64_t *)((uintptr_t)counter + percpu_offsets[i]);
+    }
+    return sum;
+}
@@ -0,0 +1,255 @@
+/**
+ * Symmetric multiprocessing bring-up
+ *
+ * CPUs are enumerated from the ACPI MADT. Each application processor is
+ * started with the INIT-SIPI-SIPI sequence and enters the kernel through the
+ * real-mode trampoline in smpboot.asm, after which it loads its own GDT/TSS
+ * and per-CPU area, enables its local APIC and becomes an idle thread of the
+ * scheduler.
+ */
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include <kernel/kernel.h>
+#include <kernel/kernel_thread.h>
+#include <mm/alloc.h>
+
+#include <arch/i386/cpu.h>
+#include <arch/i386/acpi.h>
+#include <arch/i386/apic.h>
+#include <arch/i386/interrupt.h>
+#include <arch/i386/paging.h>
+#include <arch/i386/percpu.h>
+#include <arch/i386/smp.h>
+#include <arch/i386/descriptors/gdt.h>
+#include <arch/i386/descriptors/idt.h>
+#include <drivers/pc/pit.h>
+
+// Trampoline code and parameters, see smpboot.asm
+extern uint8_t _smp_trampoline_start[];
+extern uint8_t _smp_trampoline_end[];
+extern uint32_t _smp_trampoline_cr3;
+extern uint32_t _smp_trampoline_stack;
+extern uint32_t _smp_trampoline_cpu;
+extern uint32_t _smp_trampoline_ack;
+
+// Location of a trampoline symbol once copied to SMP_TRAMPOLINE_ADDR
+#define TRAMPOLINE_PARAM(sym) \
+    ((volatile uint32_t *)(SMP_TRAMPOLINE_ADDR + ((uintptr_t)&(sym) - (uintptr_t)_smp_trampoline_start)))
+
+smp_cpu_t smp_cpus[SMP_MAX_CPUS];
+uint32_t smp_num_cpus = 1;
+
+// Set once the local APIC is mapped and IPIs can be sent
+static bool smp_apic_ready = false;
+
+static bool smp_reschedule_handler(i386_registers_t *r, void *data) {
+    r = r;
+    data = data;
+    // Nothing to do, the pending reschedule is picked up on the way out
+    return true;
+}
+
+static bool smp_halt_handler(i386_registers_t *r, void *data) {
+    r = r;
+    data = data;
+    for (;;) {
+        __asm__ __volatile__ ("cli; hlt");
+    }
+    return true;
+}
+
+/**
+ * Busy-wait for a number of PIT ticks. Interrupts must be enabled.
+ */
+static void smp_wait_ticks(uint32_t ticks) {
+    uint32_t start = pit_get_total_ticks();
+    while (pit_get_total_ticks() - start < ticks) {
+        cpu_relax();
+    }
+}
+
+/**
+ * Find the CPUs in the MADT and map the local APIC
+ * @return K_SUCCESS, or K_NOTSUP if there is no usable MADT
+ */
+static k_return_t smp_parse_madt() {
+    acpi_madt_t *madt = (acpi_madt_t *)acpi_find_table(ACPI_MADT_SIGNATURE);
+    if (!madt) return K_NOTSUP;
+
+    uintptr_t end = (uintptr_t)madt + madt->header.length;
+    uintptr_t cur;
+    uint32_t lapic_phys = madt->lapic_address;
+
+    // The address in the header may be overridden by an entry
+    for (cur = (uintptr_t)(madt + 1); cur < end; cur += ((acpi_madt_entry_t *)cur)->length) {
+        acpi_madt_entry_t *entry = (acpi_madt_entry_t *)cur;
+        if (entry->length == 0) break;
+        if (entry->type == ACPI_MADT_LAPIC_OVERRIDE) {
+            lapic_phys = (uint32_t)((acpi_madt_lapic_override_t *)entry)->lapic_address;
+        }
+    }
+
+    k_return_t ret = lapic_init(lapic_phys);
+    if (K_FAILED(ret)) return ret;
+
+    // We're running on the BSP, which is always CPU 0
+    smp_cpus[0].apic_id = lapic_id();
+
+    for (cur = (uintptr_t)(madt + 1); cur < end; cur += ((acpi_madt_entry_t *)cur)->length) {
+        acpi_madt_entry_t *entry = (acpi_madt_entry_t *)cur;
+        if (entry->length == 0) break;
+        if (entry->type != ACPI_MADT_LAPIC) continue;
+
+        acpi_madt_lapic_t *lapic = (acpi_madt_lapic_t *)entry;
+        if (!(lapic->flags & ACPI_MADT_LAPIC_ENABLED) || lapic->apic_id == smp_cpus[0].apic_id) {
+            continue;
+        }
+        if (smp_num_cpus == SMP_MAX_CPUS) {
+            printk_debug("SMP: ignoring CPU with APIC ID %u, too many CPUs", lapic->apic_id);
+            continue;
+        }
+
+        smp_cpu_t *cpu = &smp_cpus[smp_num_cpus];
+        cpu->id = smp_num_cpus;
+        cpu->apic_id = lapic->apic_id;
+        smp_num_cpus++;
+    }
+
+    return K_SUCCESS;
+}
+
+/**
+ * Start an application processor and wait for it to come online
+ */
+static void smp_boot_ap(smp_cpu_t *cpu) {
+    cpu->stack = kmalloc(KTHREAD_STACK_SIZE, KALLOC_GENERAL);
+    if (!cpu->stack || K_FAILED(percpu_alloc(cpu->id))) {
+        printk_debug("SMP: out of memory starting CPU %u", cpu->id);
+        if (cpu->stack) {
+            kfree((uintptr_t *)cpu->stack);
+            cpu->stack = NULL;
+        }
+        return;
+    }
+
+    *TRAMPOLINE_PARAM(_smp_trampoline_stack) = (uint32_t)cpu->stack + KTHREAD_STACK_SIZE;
+    *TRAMPOLINE_PARAM(_smp_trampoline_cpu) = cpu->id;
+    *TRAMPOLINE_PARAM(_smp_trampoline_ack) = 0;
+
+    // INIT, then two startup IPIs pointing at the trampoline page
+    lapic_send_ipi(cpu->apic_id, LAPIC_ICR_INIT | LAPIC_ICR_ASSERT);
+    smp_wait_ticks(10);
+
+    uint32_t i;
+    for (i=0; i<2 && !cpu->online; i++) {
+        lapic_send_ipi(cpu->apic_id, LAPIC_ICR_STARTUP | (SMP_TRAMPOLINE_ADDR >> 12));
+        smp_wait_ticks(1);
+    }
+
+    // Give it up to a second to finish starting
+    uint32_t start = pit_get_total_ticks();
+    while (!cpu->online && pit_get_total_ticks() - start < PIT_TIMER_CONSTANT) {
+        cpu_relax();
+    }
+
+    if (cpu->online) return;
+    printk_debug("SMP: CPU %u (APIC ID %u) failed to start", cpu->id, cpu->apic_id);
+
+    // An AP that hasn't read its parameters yet could still get to the
+    // trampoline later and pick up the next AP's. Hold it in INIT instead,
+    // where it stays until another startup IPI, and its stack is unused.
+    if (!*TRAMPOLINE_PARAM(_smp_trampoline_ack)) {
+        lapic_send_ipi(cpu->apic_id, LAPIC_ICR_INIT | LAPIC_ICR_ASSERT);
+        kfree((uintptr_t *)cpu->stack);
+        cpu->stack = NULL;
+    }
+}
+
+/**
+ * Enumerate and start all CPUs.
+ * Must be called on the BSP after threading is set up, with interrupts enabled.
+ */
+void smp_init() {
+    smp_cpus[0].id = 0;
+    smp_cpus[0].online = true;
+
+    if (K_FAILED(acpi_init()) || K_FAILED(smp_parse_madt())) {
+        printk_debug("SMP: no MADT found, running on the boot CPU only");
+        return;
+    }
+
+    lapic_enable();
+    smp_apic_ready = true;
+
+    interrupt_register(INTERRUPT_IPI_RESCHEDULE, smp_reschedule_handler, NULL, 0);
+    interrupt_set_eoi(INTERRUPT_IPI_RESCHEDULE, lapic_eoi);
+    interrupt_register(INTERRUPT_IPI_HALT, smp_halt_handler, NULL, 0);
+
+    if (smp_num_cpus == 1) return;
+
+    // The APs take their scheduler ticks from their local APIC timers
+    lapic_timer_calibrate();
+
+    // Install the trampoline. Low memory is identity mapped and reserved
+    // by paging init, and the multiboot information has been consumed by now.
+    memcpy((void *)SMP_TRAMPOLINE_ADDR, _smp_trampoline_start,
+           (uintptr_t)_smp_trampoline_end - (uintptr_t)_smp_trampoline_start);
+    *TRAMPOLINE_PARAM(_smp_trampoline_cr3) = i386_kernel_mmu_data.page_directory;
+
+    // Start the APs one at a time, they share the trampoline parameters.
+    // smp_boot_ap() doesn't return until they are free for the next AP.
+    uint32_t i;
+    for (i=1; i<smp_num_cpus; i++) {
+        smp_boot_ap(&smp_cpus[i]);
+    }
+
+    printk_debug("SMP: %u of %u CPUs online", smp_num_online(), smp_num_cpus);
+}
+
+/**
+ * C entry point of application processors, called from the trampoline
+ * @param cpu logical index of the calling CPU
+ */
+void smp_ap_entry(uint32_t cpu) {
+    gdt_install_cpu(cpu);
+    idt_load();
+    i386_pat_init();
+    lapic_enable();
+    lapic_timer_start();
+
+    smp_cpus[cpu].online = true;
+
+    // Become this CPU's idle thread
+    kernel_thread_init_ap(cpu, smp_cpus[cpu].stack);
+}
+
+/**
+ * Get the number of CPUs that are up and running
+ */
+uint32_t smp_num_online() {
+    uint32_t i, n = 0;
+    for (i=0; i<smp_num_cpus; i++) {
+        if (smp_cpus[i].online) n++;
+    }
+    return n;
+}
+
+/**
+ * Interrupt a CPU so that it notices a pending reschedule
+ * @param cpu logical index of the target CPU
+ */
+void smp_send_reschedule(uint32_t cpu) {
+    if (!smp_apic_ready || cpu == smp_cpu_id()) return;
+    lapic_send_ipi(smp_cpus[cpu].apic_id, LAPIC_ICR_FIXED | INTERRUPT_IPI_RESCHEDULE);
+}
+
+/**
+ * Stop every other CPU, e.g. before printing a fatal error
+ */
+void smp_halt_others() {
+    if (!smp_apic_ready) return;
+    lapic_broadcast_ipi(LAPIC_ICR_FIXED | INTERRUPT_IPI_HALT);
+}
@@ -0,0 +1,93 @@
+; Application processor startup trampoline
+;
+; The code between _smp_trampoline_start and _smp_trampoline_end is copied to
+; TRAMPOLINE_ADDR below 1MB, where the APs start executing it in real mode
+; after receiving a startup IPI. It switches to protected mode, enables paging
+; with the kernel's page directory and calls smp_ap_entry(cpu) on the stack
+; supplied by the BSP. The BSP fills in the parameters at the end before
+; starting each AP, and the AP sets _smp_trampoline_ack once it has read
+; them so they can be reused for the next one.
+
+; Must match SMP_TRAMPOLINE_ADDR in smp.h
+TRAMPOLINE_ADDR equ 0x8000
+
+; Address of a trampoline label once copied to TRAMPOLINE_ADDR
+%define TRAMPOLINE_REL(x) (TRAMPOLINE_ADDR + (x) - _smp_trampoline_start)
+
+section .text
+
+global _smp_trampoline_start
+global _smp_trampoline_end
+global _smp_trampoline_cr3
+global _smp_trampoline_stack
+global _smp_trampoline_cpu
+global _smp_trampoline_ack
+extern smp_ap_entry
+
+align 16
+bits 16
+_smp_trampoline_start:
+    cli
+    cld
+
+    ; CS is TRAMPOLINE_ADDR >> 4, address our data relative to it
+    mov ax, cs
+    mov ds, ax
+    o32 lgdt [_smp_trampoline_gdtr - _smp_trampoline_start]
+
+    ; Enable protected mode
+    mov eax, cr0
+    or eax, 1
+    mov cr0, eax
+    jmp dword 0x08:TRAMPOLINE_REL(_smp_trampoline_pm)
+
+bits 32
+_smp_trampoline_pm:
+    mov ax, 0x10
+    mov ds, ax
+    mov es, ax
+    mov fs, ax
+    mov gs, ax
+    mov ss, ax
+
+    ; Enable paging with the kernel's page directory. The trampoline is
+    ; identity mapped so execution continues normally.
+    mov eax, [TRAMPOLINE_REL(_smp_trampoline_cr3)]
+    mov cr3, eax
+    mov eax, cr0
+    or eax, 0x80000000
+    mov cr0, eax
+
+    mov esp, [TRAMPOLINE_REL(_smp_trampoline_stack)]
+    push dword [TRAMPOLINE_REL(_smp_trampoline_cpu)]
+    mov dword [TRAMPOLINE_REL(_smp_trampoline_ack)], 1
+    mov eax, smp_ap_entry
+    call eax
+
+    ; smp_ap_entry doesn't return
+.hang:
+    cli
+    hlt
+    jmp .hang
+
+; Temporary flat GDT, replaced by the CPU's own in smp_ap_entry
+align 8
+_smp_trampoline_gdt:
+    dq 0x0000000000000000 ; NULL
+    dq 0x00CF9A000000FFFF ; Kernel code
+    dq 0x00CF92000000FFFF ; Kernel data
+_smp_trampoline_gdtr:
+    dw _smp_trampoline_gdtr - _smp_trampoline_gdt - 1
+    dd TRAMPOLINE_REL(_smp_trampoline_gdt)
+
+; Parameters filled in by the BSP
+align 4
+_smp_trampoline_cr3:
+    dd 0
+_smp_trampoline_stack:
+    dd 0
+_smp_trampoline_cpu:
+    dd 0
+_smp_trampoline_ack:
+    dd 0
+_smp_trampoline_end:
@@ -0,0 +1,26 @@
+section .text
+
+; void _thread_switch(uint32_t *old_esp, uint32_t new_esp)
+; Save the callee-saved registers and EFLAGS of the current thread on its
+; stack, store its stack pointer to *old_esp, then restore the thread whose
+; stack pointer is new_esp. The stack layout must match the initial stack
+; built by kernel_thread_create.
+global _thread_switch
+_thread_switch:
+    mov eax, [esp+4]  ; old_esp
+    mov edx, [esp+8]  ; new_esp
+
+    pushfd
+    push ebp
+    push ebx
+    push esi
+    push edi
+    mov [eax], esp
+
+    mov esp, edx
+    pop edi
+    pop esi
+    pop ebx
+    pop ebp
+    popfd
+    ret
@@ -11,13 +11,21 @@
 #include <pc.h>
 
 #include <kernel/kernel.h>
+#include <kernel/kernel_stdio.h>
+#include <kernel/console.h>
 #include <arch/i386/isr.h>
 #include <arch/i386/irq.h>
 #include <drivers/pc/pckbd.h>
 
+// Scancodes of extended keys, sent after a 0xE0 prefix
+#define PCKBD_EXTENDED_PREFIX 0xE0
+#define PCKBD_EXT_PAGE_UP     0x49
+#define PCKBD_EXT_PAGE_DOWN   0x51
+
 struct pckbd_driver *pckbd_selected_driver;
 bool pckbd_is_capslock = false;
 bool pckbd_is_shift = false;
+bool pckbd_is_extended = false;
 
 static inline bool set_contains_sc(pckbd_scancode_set_t *scs, int i) {
 	size_t s;
@@ -27,7 +35,9 @@ static inline bool set_contains_sc(pckbd_scancode_set_t *scs, int i) {
 	return false;
 }
 
-void pckbd_irq_input_handler(i386_registers_t *r) {
+bool pckbd_irq_input_handler(i386_registers_t *r, void *data) {
+    data = data;
+
     if ((r->int_no-32) != 1) {
         printf("ERROR: this routine needs to be triggered from IRQ 1\n");
         abort();
@@ -38,6 +48,24 @@ void pckbd_irq_input_handler(i386_registers_t *r) {
     // Read from PS/2 buffer
     cur_scancode = inportb(0x60);
 
+    if (cur_scancode == PCKBD_EXTENDED_PREFIX) {
+        pckbd_is_extended = true;
+        return true;
+    }
+
+    if (pckbd_is_extended) {
+        // Page up/down scroll the console. Other extended keys aren't
+        // supported yet, in particular the fake shifts some of them send
+        // mustn't toggle shift.
+        pckbd_is_extended = false;
+        if (cur_scancode == PCKBD_EXT_PAGE_UP) {
+            console_page_up();
+        } else if (cur_scancode == PCKBD_EXT_PAGE_DOWN) {
+            console_page_down();
+        }
+        return true;
+    }
+
     if (cur_scancode & 0x80) {
         // Key has just been released
 
@@ -73,15 +101,19 @@ void pckbd_irq_input_handler(i386_registers_t *r) {
             cur_char = pckbd_selected_driver->pckbd_sc->scancode_arr[cur_scancode];
         }
 
-        //For now, just print out debug to screen
         if (cur_char) {
+            kernel_buffer_stdin_writechar(cur_char);
+
+            //For now, also echo it to screen
             printf("%c", cur_char);
         }
     }
+
+    return true;
 }
 
 // Install pckbd handler with specificed scancode table to IRQ1
 void pckbd_install_irq(struct pckbd_driver *d) {
 	pckbd_selected_driver = d;
-    irq_install_handler(1, pckbd_irq_input_handler);
+    irq_install_handler(1, pckbd_irq_input_handler, NULL, 0);
 }
@@ -6,6 +6,8 @@
  */
 
 #include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <pc.h>
@@ -14,6 +16,7 @@
 #include <arch/i386/irq.h>
 
 #include <drivers/pc/pit.h>
+#include <kernel/timer.h>
 
 /**
  * Array containing pit_routine structs to be checked at each
@@ -62,7 +65,9 @@ void pit_set_timer_phase(int16_t hz) {
 volatile uint32_t pit_total_timer_ticks = 0;
 
 // IRQ routine to handle PIT tick
-void pit_irq_timer_handler(i386_registers_t *r) {
+bool pit_irq_timer_handler(i386_registers_t *r, void *data) {
+    data = data;
+
     if ((r->int_no-32) != 0) {
         printf("ERROR: this routine needs to be triggered from IRQ 0\n");
         abort();
@@ -81,12 +86,14 @@ void pit_irq_timer_handler(i386_registers_t *r) {
             __current_routine();
         }
     }
+
+    return true;
 }
 
 // Set the PIT Tick rate and install IRQ handler
 void pit_timer_install_irq() {
     pit_set_timer_phase(PIT_TIMER_CONSTANT);
-    irq_install_handler(0, pit_irq_timer_handler);
+    irq_install_handler(0, pit_irq_timer_handler, NULL, 0);
 }
 
 // Return total number of ticks passed
@@ -94,18 +101,12 @@ uint32_t pit_get_total_ticks() {
     return pit_total_timer_ticks;
 }
 
-// Wait specified number of seconds
+// Wait specified number of seconds. Blocks the calling thread, see msleep()
 void pit_timer_wait(uint32_t seconds) {
-    uint32_t desired_ticks = pit_total_timer_ticks + (seconds * PIT_TIMER_CONSTANT);
-    while (desired_ticks > pit_total_timer_ticks) {
-        __asm__ __volatile__ ("sti//hlt//cli");
-    }
+    nsleep(seconds * NSEC_PER_SEC);
 }
 
-// Wait specified number of milliseconds
+// Wait specified number of milliseconds. Blocks the calling thread.
 void pit_timer_wait_ms(uint32_t ms) {
-    uint32_t desired_ticks = pit_total_timer_ticks + (ms * (PIT_TIMER_CONSTANT/1000));
-    while (desired_ticks > pit_total_timer_ticks) {
-        __asm__ __volatile__ ("sti//hlt//cli");
-    }
+    msleep(ms);
 }
@@ -0,0 +1,260 @@
+/**
+ * Driver for the 16550 UART found at COM1 on PCs
+ *
+ * Output is copied into a transmit ring and fed to the 16-byte FIFO from
+ * the transmitter-empty interrupt, so writers only ever wait for the UART
+ * when the ring is full. Once the kernel is going down output switches to
+ * uart_write_polled(), which talks to the hardware directly. Console
+ * colours are sent to the terminal as ANSI escape sequences.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <pc.h>
+
+#include <kernel/kernel.h>
+#include <kernel/console.h>
+#include <kernel/kernel_stdio.h>
+#include <kernel/spinlock.h>
+#include <arch/i386/isr.h>
+#include <arch/i386/irq.h>
+#include <drivers/pc/uart.h>
+
+#define UART_PORT UART_COM1_PORT
+
+static char uart_tx_ring[UART_TX_RING_SIZE];
+static uint32_t uart_tx_head = 0; // Next byte written by uart_write()
+static uint32_t uart_tx_tail = 0; // Next byte sent to the FIFO
+static spinlock_t uart_tx_lock = SPINLOCK_INIT;
+
+static bool uart_present = false;
+
+// Colour asked for by the console, and the one the terminal was last sent
+static uint8_t uart_color = CONSOLE_COLOR_DEFAULT;
+static uint8_t uart_color_sent = CONSOLE_COLOR_DEFAULT;
+
+// ANSI colour number of each VGA colour
+static const uint8_t uart_ansi_colors[8] = { 0, 4, 2, 6, 1, 5, 3, 7 };
+
+static void uart_set_color(uint8_t color);
+
+static console_sink_t uart_console = {
+    .name = "uart",
+    .write = uart_write,
+    .write_panic = uart_write_polled,
+    .page_up = NULL,
+    .page_down = NULL,
+    .set_color = uart_set_color
+};
+
+static inline uint8_t uart_in(uint16_t reg) {
+    return inportb(UART_PORT + reg);
+}
+
+static inline void uart_out(uint16_t reg, uint8_t value) {
+    outportb(UART_PORT + reg, value);
+}
+
+/**
+ * Move bytes from the ring into the FIFO. The FIFO must be empty.
+ * Must be called with uart_tx_lock held.
+ */
+static void uart_tx_fill() {
+    uint32_t n = 0;
+    while (uart_tx_tail != uart_tx_head && n < UART_FIFO_SIZE) {
+        uart_out(UART_REG_DATA, uart_tx_ring[uart_tx_tail & (UART_TX_RING_SIZE - 1)]);
+        uart_tx_tail++;
+        n++;
+    }
+
+    // Only ask for the transmitter-empty interrupt while there's more to send
+    uart_out(UART_REG_IER, UART_IER_RDI | (uart_tx_tail != uart_tx_head ? UART_IER_THRI : 0));
+}
+
+static inline void uart_tx_wait_empty() {
+    while (!(uart_in(UART_REG_LSR) & UART_LSR_THRE));
+}
+
+/**
+ * The terminal only gets the new colour with the next write
+ */
+static void uart_set_color(uint8_t color) {
+    uart_color = color;
+}
+
+/**
+ * Build the ANSI escape sequence selecting the foreground of uart_color if
+ * the terminal hasn't been sent it yet
+ * @param[out] buf at least 5 bytes
+ * @return length of the sequence, 0 if none is needed
+ */
+static size_t uart_color_escape(char *buf) {
+    uint8_t color = uart_color;
+    if (color == uart_color_sent)
+        return 0;
+    uart_color_sent = color;
+
+    buf[0] = '\033';
+    buf[1] = '[';
+    if (color == CONSOLE_COLOR_DEFAULT) {
+        buf[2] = '0';
+        buf[3] = 'm';
+        return 4;
+    }
+    buf[2] = (color & 0x08) ? '9' : '3'; // Bright colours are 90-97
+    buf[3] = '0' + uart_ansi_colors[color & 0x07];
+    buf[4] = 'm';
+    return 5;
+}
+
+/**
+ * Copy characters to the transmit ring, translating "\n" to "\r\n".
+ * Must be called with uart_tx_lock held.
+ */
+static void uart_tx_queue(const char *data, size_t length) {
+    size_t i;
+    for (i=0; i<length; i++) {
+        // Need room for a '\r' as well
+        if (uart_tx_head - uart_tx_tail >= UART_TX_RING_SIZE - 1) {
+            // Ring full, push some of it out by hand. Nobody else can touch
+            // the FIFO while we hold the lock.
+            uart_tx_wait_empty();
+            uart_tx_fill();
+        }
+        if (data[i] == '\n') {
+            uart_tx_ring[uart_tx_head++ & (UART_TX_RING_SIZE - 1)] = '\r';
+        }
+        uart_tx_ring[uart_tx_head++ & (UART_TX_RING_SIZE - 1)] = data[i];
+    }
+}
+
+static void uart_put_polled(const char *data, size_t length) {
+    size_t i;
+    for (i=0; i<length; i++) {
+        if (data[i] == '\n') {
+            uart_tx_wait_empty();
+            uart_out(UART_REG_DATA, '\r');
+        }
+        uart_tx_wait_empty();
+        uart_out(UART_REG_DATA, data[i]);
+    }
+}
+
+/**
+ * Set up COM1 for 115200 8N1 with FIFOs and install it as a console sink
+ * @return K_SUCCESS, or K_IO if no UART answers at COM1
+ */
+k_return_t uart_init() {
+    uint16_t divisor = UART_CLOCK / UART_BAUD;
+
+    uart_out(UART_REG_IER, 0);
+    uart_out(UART_REG_LCR, UART_LCR_DLAB);
+    uart_out(UART_REG_DATA, divisor & 0xFF);
+    uart_out(UART_REG_IER, divisor >> 8);
+    uart_out(UART_REG_LCR, UART_LCR_8N1);
+    uart_out(UART_REG_FCR, UART_FCR_ENABLE | UART_FCR_CLEAR_RX | UART_FCR_CLEAR_TX |
+                           UART_FCR_TRIGGER_14);
+
+    // Check that something is there by looping a byte back
+    uart_out(UART_REG_MCR, UART_MCR_LOOP | UART_MCR_RTS | UART_MCR_OUT2);
+    uart_out(UART_REG_DATA, 0xAE);
+    uint32_t timeout = 100000;
+    while (!(uart_in(UART_REG_LSR) & UART_LSR_DR) && --timeout);
+    if (!timeout || uart_in(UART_REG_DATA) != 0xAE) {
+        return K_IO;
+    }
+
+    uart_out(UART_REG_MCR, UART_MCR_DTR | UART_MCR_RTS | UART_MCR_OUT2);
+
+    k_return_t ret = irq_install_handler(UART_COM1_IRQ, uart_irq_handler, NULL, 0);
+    if (K_FAILED(ret))
+        return ret;
+    uart_out(UART_REG_IER, UART_IER_RDI);
+
+    uart_present = true;
+    return console_register(&uart_console);
+}
+
+/**
+ * Queue characters for transmission, translating "\n" to "\r\n". Only
+ * waits for the UART if the transmit ring is full.
+ * @param data   characters to write
+ * @param length number of characters
+ */
+void uart_write(const char *data, size_t length) {
+    if (!uart_present)
+        return;
+
+    char escape[6];
+    uint32_t eflags = spin_lock_irqsave(&uart_tx_lock);
+    uart_tx_queue(escape, uart_color_escape(escape));
+    uart_tx_queue(data, length);
+
+    // Start sending straight away if the FIFO is empty, otherwise make sure
+    // the transmitter-empty interrupt is on to pick the data up
+    if (uart_in(UART_REG_LSR) & UART_LSR_THRE) {
+        uart_tx_fill();
+    } else {
+        uart_out(UART_REG_IER, UART_IER_RDI | UART_IER_THRI);
+    }
+    spin_unlock_irqrestore(&uart_tx_lock, eflags);
+}
+
+/**
+ * Write characters without interrupts or locks, after sending whatever
+ * was still queued
+ * @param data   characters to write
+ * @param length number of characters
+ */
+void uart_write_polled(const char *data, size_t length) {
+    if (!uart_present)
+        return;
+
+    uart_out(UART_REG_IER, 0);
+    while (uart_tx_tail != uart_tx_head) {
+        uart_tx_wait_empty();
+        uart_out(UART_REG_DATA, uart_tx_ring[uart_tx_tail++ & (UART_TX_RING_SIZE - 1)]);
+    }
+
+    char escape[6];
+    uart_put_polled(escape, uart_color_escape(escape));
+    uart_put_polled(data, length);
+}
+
+bool uart_irq_handler(i386_registers_t *r, void *data) {
+    r = r;
+    data = data;
+
+    uint8_t iir;
+    bool handled = false;
+    while (!((iir = uart_in(UART_REG_IIR)) & UART_IIR_NO_INT)) {
+        handled = true;
+        switch (iir & UART_IIR_ID) {
+            case UART_IIR_THRI:
+                spin_lock(&uart_tx_lock);
+                uart_tx_fill();
+                spin_unlock(&uart_tx_lock);
+                break;
+
+            case UART_IIR_RDI:
+            case UART_IIR_TIMEOUT:
+                // Input from the serial line goes to stdin like the keyboard's
+                while (uart_in(UART_REG_LSR) & UART_LSR_DR) {
+                    char c = uart_in(UART_REG_DATA);
+                    kernel_buffer_stdin_writechar(c == '\r' ? '\n' : c);
+                }
+                break;
+
+            case UART_IIR_RLSI:
+                uart_in(UART_REG_LSR);
+                break;
+
+            case UART_IIR_MSI:
+                uart_in(UART_REG_MSR);
+                break;
+        }
+    }
+
+    return handled;
+}
@@ -12,6 +12,8 @@
 #include <kernel/kernel_stdio.h>
 #include <kernel/kernel_terminal.h>
 #include <kernel/kernel_thread.h>
+#include <kernel/radix_tree.h>
+#include <mm/alloc.h>
 
 const char* PCI_CLASS_IDS[18] =
 {
@@ -35,8 +37,8 @@ const char* PCI_CLASS_IDS[18] =
     "Data Acquisition and Signal Processing Controller"
 };
 
-pci_device_t pci_devices[16];
-uint32_t pci_devices_size = 0;
+// Every function found by pci_probe, indexed by PCI_DEVFN
+radix_tree_t pci_devices = RADIX_TREE_INIT;
 
 /**
  * Read word at offset from pci device at bus `bus`, device `slot`, and function `func` (for multifunc device)
@@ -109,30 +111,48 @@ void pci_init() {
 }
 
 /**
- * Loop through PCI devices and print out information for the first 16 devices
+ * Loop through PCI devices, print out information and add them to pci_devices
  */
 void pci_probe() {
     for(uint16_t bus = 0; bus < 256; bus++) {
         for (uint16_t slot = 0; slot < 32; slot++) {
             for(uint16_t function = 0; function < 8; function++) {
-                if(pci_devices_size > 15) {
-                    printf("[pci] not adding above device... limit reached\n");
-                    return;
-                }
-
                 uint16_t vendor_id = pci_get_vendor_id(bus, slot, function);
                 if(vendor_id == 0xFFFF) continue;
                 uint16_t device_id = pci_get_device_id(bus, slot, function);
                 uint16_t class_id = pci_get_device_class_id(bus, slot, function);
-                printf("[pci] %x:%x - %s\n", vendor_id, device_id, PCI_CLASS_IDS[class_id]);
+                printf("[pci] %x:%x - %s\n", vendor_id, device_id,
+                       class_id < 18 ? PCI_CLASS_IDS[class_id] : "unknown class");
 
-                // Add current device to local pci_devices array
-                pci_devices[pci_devices_size].vendor = vendor_id;
-                pci_devices[pci_devices_size].device = device_id;
-                pci_devices[pci_devices_size].func = function;
+                // Rescanning finds the devices that are already known
+                if (pci_get_device(bus, slot, function)) continue;
 
-                ++pci_devices_size;
+                pci_device_t *dev = (pci_device_t *)kmalloc(sizeof(pci_device_t), KALLOC_GENERAL);
+                if (!dev) {
+                    printf("[pci] out of memory, not adding above device\n");
+                    return;
+                }
+                dev->vendor = vendor_id;
+                dev->device = device_id;
+                dev->bus = bus;
+                dev->slot = slot;
+                dev->func = function;
+                dev->class_id = class_id;
+
+                if (K_FAILED(radix_tree_insert(&pci_devices, PCI_DEVFN(bus, slot, function), dev))) {
+                    printf("[pci] out of memory, not adding above device\n");
+                    kfree((uintptr_t *)dev);
+                    return;
+                }
             }
         }
     }
 }
+
+/**
+ * Get a device found by pci_probe
+ * @return device, or NULL if there is no function at bus:slot.func
+ */
+pci_device_t *pci_get_device(uint16_t bus, uint16_t slot, uint16_t func) {
+    return (pci_device_t *)radix_tree_lookup(&pci_devices, PCI_DEVFN(bus, slot, func));
+}
@@ -0,0 +1,403 @@
+/**
+ * Framebuffer console on the Bochs/QEMU VBE DISPI interface
+ *
+ * The console keeps a shadow copy of the screen as VGA text cells and only
+ * ever writes to the framebuffer, which is mapped write-combining. Writes
+ * mark a dirty rectangle of cells and fbcon_flush() redraws just that, one
+ * scanline at a time so that the write-combining buffers see long runs of
+ * sequential stores. Glyphs are expanded once at init into one mask per
+ * pixel, so drawing a cell is a select per pixel with no bit twiddling.
+ *
+ * The virtual framebuffer is as tall as video memory allows. Scrolling
+ * moves the visible window down one text row with the DISPI Y offset and
+ * only draws the new row. When the window reaches the end of video memory
+ * the screen is redrawn from the shadow at the top. The rows above the
+ * window double as scrollback for console_page_up().
+ *
+ * Nothing describes the font in use, so it is copied from VGA plane 2,
+ * where the BIOS loaded it for text mode, before the mode is switched.
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <string.h>
+#include <pc.h>
+
+#include <kernel/kernel.h>
+#include <kernel/console.h>
+#include <kernel/spinlock.h>
+#include <mm/alloc.h>
+#include <arch/i386/io.h>
+#include <arch/i386/paging.h>
+#include <drivers/pci/pci.h>
+#include <drivers/vga/textmode.h>
+#include <drivers/vga/fbcon.h>
+
+#define FBCON_GLYPH_PIXELS (FBCON_FONT_WIDTH * FBCON_FONT_HEIGHT)
+#define FBCON_BYTES_PP     (FBCON_BPP / 8)
+
+// VGA registers used to read the font out of plane 2
+#define VGA_SEQ_INDEX  0x3C4
+#define VGA_SEQ_DATA   0x3C5
+#define VGA_GC_INDEX   0x3CE
+#define VGA_GC_DATA    0x3CF
+#define VGA_CRTC_INDEX 0x3D4
+#define VGA_CRTC_DATA  0x3D5
+#define VGA_PLANE_WINDOW 0xA0000
+#define VGA_FONT_STRIDE  32     // Bytes per character in plane 2
+
+// The 16 text mode colors as xRGB
+static const uint32_t fbcon_palette[16] = {
+    0x000000, 0x0000AA, 0x00AA00, 0x00AAAA, 0xAA0000, 0xAA00AA, 0xAA5500, 0xAAAAAA,
+    0x555555, 0x5555FF, 0x55FF55, 0x55FFFF, 0xFF5555, 0xFF55FF, 0xFFFF55, 0xFFFFFF
+};
+
+static uint8_t *fbcon_fb;           // Write-combining mapping of the virtual framebuffer
+static uint32_t fbcon_pitch;        // Bytes per scanline
+static uint32_t fbcon_ncols;        // Size of the screen in text cells
+static uint32_t fbcon_nrows;
+static uint32_t fbcon_vram_rows;    // Text rows that fit in the virtual framebuffer
+static uint32_t fbcon_top;          // Row of the virtual framebuffer at the top of the screen
+static uint32_t fbcon_view;         // Row shown at the top of the screen, < fbcon_top in scrollback
+
+static uint16_t *fbcon_cells;       // Shadow of the screen, fbcon_nrows * fbcon_ncols cells
+static uint32_t *fbcon_glyphs;      // 256 expanded glyphs, one mask per pixel
+
+static uint32_t fbcon_x, fbcon_y;   // Cursor
+
+// Cells that differ from the framebuffer, empty if x0 >= x1
+static uint32_t fbcon_dirty_x0, fbcon_dirty_y0, fbcon_dirty_x1, fbcon_dirty_y1;
+
+static spinlock_t fbcon_lock = SPINLOCK_INIT;
+
+static void fbcon_write(const char *data, size_t length);
+static void fbcon_write_panic(const char *data, size_t length);
+static void fbcon_page_up();
+static void fbcon_page_down();
+
+static console_sink_t fbcon_console = {
+    .name = "fbcon",
+    .write = fbcon_write,
+    .write_panic = fbcon_write_panic,
+    .page_up = fbcon_page_up,
+    .page_down = fbcon_page_down,
+    // Cells are drawn in the text mode colour
+    .set_color = vga_textmode_setcolor
+};
+
+static inline void dispi_write(uint16_t index, uint16_t value) {
+    IoWrite16(VBE_DISPI_IOPORT_INDEX, index);
+    IoWrite16(VBE_DISPI_IOPORT_DATA, value);
+}
+
+static inline uint16_t dispi_read(uint16_t index) {
+    IoWrite16(VBE_DISPI_IOPORT_INDEX, index);
+    return IoRead16(VBE_DISPI_IOPORT_DATA);
+}
+
+static inline uint8_t vga_reg_read(uint16_t index_port, uint8_t index) {
+    outportb(index_port, index);
+    return inportb(index_port + 1);
+}
+
+static inline void vga_reg_write(uint16_t index_port, uint8_t index, uint8_t value) {
+    outportb(index_port, index);
+    outportb(index_port + 1, value);
+}
+
+/**
+ * Copy the text mode font out of VGA plane 2 and expand it into
+ * fbcon_glyphs. Must be called while still in text mode.
+ * @return true if a usable font was found
+ */
+static bool fbcon_load_font() {
+    volatile uint8_t *plane = (volatile uint8_t *)VGA_PLANE_WINDOW;
+    uint32_t c, row, i;
+
+    // Only 8x16 fonts are supported
+    if ((vga_reg_read(VGA_CRTC_INDEX, 9) & 0x1F) + 1 != FBCON_FONT_HEIGHT) {
+        return false;
+    }
+
+    uint8_t seq4 = vga_reg_read(VGA_SEQ_INDEX, 4);
+    uint8_t gc4 = vga_reg_read(VGA_GC_INDEX, 4);
+    uint8_t gc5 = vga_reg_read(VGA_GC_INDEX, 5);
+    uint8_t gc6 = vga_reg_read(VGA_GC_INDEX, 6);
+
+    // Sequential addressing, read plane 2, mapped at 0xA0000
+    vga_reg_write(VGA_SEQ_INDEX, 4, 0x06);
+    vga_reg_write(VGA_GC_INDEX, 4, 0x02);
+    vga_reg_write(VGA_GC_INDEX, 5, 0x00);
+    vga_reg_write(VGA_GC_INDEX, 6, 0x04);
+
+    bool found = false;
+    for (c=0; c<256; c++) {
+        for (row=0; row<FBCON_FONT_HEIGHT; row++) {
+            uint8_t bits = plane[c * VGA_FONT_STRIDE + row];
+            uint32_t *mask = &fbcon_glyphs[c * FBCON_GLYPH_PIXELS + row * FBCON_FONT_WIDTH];
+            for (i=0; i<FBCON_FONT_WIDTH; i++) {
+                mask[i] = (bits & (0x80 >> i)) ? 0xFFFFFFFF : 0;
+            }
+            if (c == 'A' && bits) found = true;
+        }
+    }
+
+    vga_reg_write(VGA_SEQ_INDEX, 4, seq4);
+    vga_reg_write(VGA_GC_INDEX, 4, gc4);
+    vga_reg_write(VGA_GC_INDEX, 5, gc5);
+    vga_reg_write(VGA_GC_INDEX, 6, gc6);
+
+    return found;
+}
+
+/**
+ * Find the physical address of the linear framebuffer from the BAR of the
+ * Bochs/QEMU display adapter
+ */
+static uint32_t fbcon_find_lfb() {
+    uint16_t slot;
+    for (slot=0; slot<32; slot++) {
+        if (pci_get_vendor_id(0, slot, 0) == VBE_DISPI_PCI_VENDOR &&
+            pci_get_device_id(0, slot, 0) == VBE_DISPI_PCI_DEVICE) {
+            uint32_t bar = pci_config_read_word(0, slot, 0, 0x10) |
+                           (uint32_t)pci_config_read_word(0, slot, 0, 0x12) << 16;
+            return bar & 0xFFFFFFF0;
+        }
+    }
+    return VBE_DISPI_LFB_PHYSICAL_ADDRESS;
+}
+
+static inline void fbcon_mark_dirty(uint32_t x0, uint32_t y0, uint32_t x1, uint32_t y1) {
+    if (fbcon_dirty_x0 >= fbcon_dirty_x1) {
+        fbcon_dirty_x0 = x0;
+        fbcon_dirty_y0 = y0;
+        fbcon_dirty_x1 = x1;
+        fbcon_dirty_y1 = y1;
+        return;
+    }
+    if (x0 < fbcon_dirty_x0) fbcon_dirty_x0 = x0;
+    if (y0 < fbcon_dirty_y0) fbcon_dirty_y0 = y0;
+    if (x1 > fbcon_dirty_x1) fbcon_dirty_x1 = x1;
+    if (y1 > fbcon_dirty_y1) fbcon_dirty_y1 = y1;
+}
+
+/**
+ * Draw the dirty rectangle from the shadow into the framebuffer
+ */
+static void fbcon_flush() {
+    uint32_t x, y, row, i;
+
+    if (fbcon_dirty_x0 >= fbcon_dirty_x1)
+        return;
+
+    for (y=fbcon_dirty_y0; y<fbcon_dirty_y1; y++) {
+        const uint16_t *cells = &fbcon_cells[y * fbcon_ncols];
+        uint8_t *line = fbcon_fb + (fbcon_top + y) * FBCON_FONT_HEIGHT * fbcon_pitch +
+                        fbcon_dirty_x0 * FBCON_FONT_WIDTH * FBCON_BYTES_PP;
+
+        for (row=0; row<FBCON_FONT_HEIGHT; row++) {
+            uint32_t *dst = (uint32_t *)line;
+            for (x=fbcon_dirty_x0; x<fbcon_dirty_x1; x++) {
+                uint16_t cell = cells[x];
+                uint32_t fg = fbcon_palette[(cell >> 8) & 0x0F];
+                uint32_t bg = fbcon_palette[(cell >> 12) & 0x0F];
+                const uint32_t *mask = &fbcon_glyphs[(cell & 0xFF) * FBCON_GLYPH_PIXELS +
+                                                     row * FBCON_FONT_WIDTH];
+                for (i=0; i<FBCON_FONT_WIDTH; i++) {
+                    *dst++ = (mask[i] & fg) | (~mask[i] & bg);
+                }
+            }
+            line += fbcon_pitch;
+        }
+    }
+
+    fbcon_dirty_x0 = fbcon_dirty_x1 = 0;
+}
+
+/**
+ * Show the screen starting at fbcon_view
+ */
+static inline void fbcon_pan() {
+    dispi_write(VBE_DISPI_INDEX_Y_OFFSET, fbcon_view * FBCON_FONT_HEIGHT);
+}
+
+static void fbcon_clear_row(uint32_t y) {
+    uint16_t blank = make_vgaentry(' ', vga_textmode_color);
+    uint32_t x;
+    for (x=0; x<fbcon_ncols; x++) {
+        fbcon_cells[y * fbcon_ncols + x] = blank;
+    }
+    fbcon_mark_dirty(0, y, fbcon_ncols, y + 1);
+}
+
+static void fbcon_scroll() {
+    bool live = fbcon_view == fbcon_top;
+
+    // Pending cells belong to the old row positions
+    fbcon_flush();
+    memmove(fbcon_cells, fbcon_cells + fbcon_ncols,
+            (fbcon_nrows - 1) * fbcon_ncols * sizeof(uint16_t));
+
+    if (fbcon_top + fbcon_nrows < fbcon_vram_rows) {
+        // Everything but the new row is already in the framebuffer
+        fbcon_top++;
+        if (live) fbcon_view = fbcon_top;
+        fbcon_clear_row(fbcon_nrows - 1);
+    } else {
+        // Out of video memory, start again at the top. This overwrites
+        // the scrollback.
+        fbcon_top = fbcon_view = 0;
+        fbcon_mark_dirty(0, 0, fbcon_ncols, fbcon_nrows - 1);
+        fbcon_clear_row(fbcon_nrows - 1);
+    }
+
+    // Draw before panning so the new row never shows stale pixels
+    fbcon_flush();
+    fbcon_pan();
+}
+
+static void fbcon_write_locked(const char *data, size_t length) {
+    size_t i;
+    for (i=0; i<length; i++) {
+        if (data[i] == '\n') {
+            fbcon_x = 0;
+            fbcon_y++;
+        } else {
+            fbcon_cells[fbcon_y * fbcon_ncols + fbcon_x] = make_vgaentry(data[i], vga_textmode_color);
+            fbcon_mark_dirty(fbcon_x, fbcon_y, fbcon_x + 1, fbcon_y + 1);
+            if (++fbcon_x == fbcon_ncols) {
+                fbcon_x = 0;
+                fbcon_y++;
+            }
+        }
+
+        if (fbcon_y == fbcon_nrows) {
+            fbcon_scroll();
+            fbcon_y = fbcon_nrows - 1;
+        }
+    }
+    fbcon_flush();
+}
+
+static void fbcon_write(const char *data, size_t length) {
+    uint32_t eflags = spin_lock_irqsave(&fbcon_lock);
+    fbcon_write_locked(data, length);
+    spin_unlock_irqrestore(&fbcon_lock, eflags);
+}
+
+// Whoever held the lock when the kernel went down won't be back
+static void fbcon_write_panic(const char *data, size_t length) {
+    fbcon_view = fbcon_top;
+    fbcon_write_locked(data, length);
+    fbcon_pan();
+}
+
+static void fbcon_page_up() {
+    uint32_t eflags = spin_lock_irqsave(&fbcon_lock);
+    fbcon_view = fbcon_view > fbcon_nrows ? fbcon_view - fbcon_nrows : 0;
+    fbcon_pan();
+    spin_unlock_irqrestore(&fbcon_lock, eflags);
+}
+
+static void fbcon_page_down() {
+    uint32_t eflags = spin_lock_irqsave(&fbcon_lock);
+    fbcon_view = fbcon_view + fbcon_nrows < fbcon_top ? fbcon_view + fbcon_nrows : fbcon_top;
+    fbcon_pan();
+    spin_unlock_irqrestore(&fbcon_lock, eflags);
+}
+
+/**
+ * Switch to a FBCON_WIDTH x FBCON_HEIGHT graphics mode and take the console
+ * over from the VGA text console. Must be called after paging and the
+ * kernel heap are set up.
+ * @return K_SUCCESS, K_NOTSUP if there is no DISPI adapter or no usable
+ *         font, or K_OOM. The text console is left alone on failure.
+ */
+k_return_t fbcon_init() {
+    k_return_t ret = K_OOM;
+    uint16_t id = dispi_read(VBE_DISPI_INDEX_ID);
+    if (id < VBE_DISPI_ID0 || id > VBE_DISPI_ID0 + 0xF) {
+        return K_NOTSUP;
+    }
+
+    fbcon_ncols = FBCON_WIDTH / FBCON_FONT_WIDTH;
+    fbcon_nrows = FBCON_HEIGHT / FBCON_FONT_HEIGHT;
+    fbcon_pitch = FBCON_WIDTH * FBCON_BYTES_PP;
+
+    // Make the virtual framebuffer as tall as video memory allows
+    uint32_t vram = id >= VBE_DISPI_ID5 ? dispi_read(VBE_DISPI_INDEX_VIDEO_MEMORY_64K) * 0x10000
+                                         : 4 * 1024 * 1024;
+    uint32_t virt_height = vram / fbcon_pitch;
+    if (virt_height > 0xFFFF) virt_height = 0xFFFF;
+    if (virt_height < FBCON_HEIGHT) {
+        return K_NOTSUP;
+    }
+
+    fbcon_glyphs = kmalloc(256 * FBCON_GLYPH_PIXELS * sizeof(uint32_t), KALLOC_GENERAL);
+    fbcon_cells = kmalloc(fbcon_nrows * fbcon_ncols * sizeof(uint16_t), KALLOC_GENERAL);
+    if (!fbcon_glyphs || !fbcon_cells) {
+        goto fail;
+    }
+
+    if (!fbcon_load_font()) {
+        ret = K_NOTSUP;
+        goto fail;
+    }
+
+    uint32_t fb_size = virt_height * fbcon_pitch;
+    fbcon_fb = i386_map_phys(fbcon_find_lfb(), fb_size,
+                             PT_PRESENT | PT_RW | (i386_pat_enabled ? PT_WRITECOMBINE : 0));
+    if (!fbcon_fb) {
+        goto fail;
+    }
+
+    dispi_write(VBE_DISPI_INDEX_ENABLE, VBE_DISPI_DISABLED);
+    dispi_write(VBE_DISPI_INDEX_XRES, FBCON_WIDTH);
+    dispi_write(VBE_DISPI_INDEX_YRES, FBCON_HEIGHT);
+    dispi_write(VBE_DISPI_INDEX_BPP, FBCON_BPP);
+    dispi_write(VBE_DISPI_INDEX_VIRT_WIDTH, FBCON_WIDTH);
+    dispi_write(VBE_DISPI_INDEX_VIRT_HEIGHT, virt_height);
+    dispi_write(VBE_DISPI_INDEX_X_OFFSET, 0);
+    dispi_write(VBE_DISPI_INDEX_Y_OFFSET, 0);
+    dispi_write(VBE_DISPI_INDEX_ENABLE, VBE_DISPI_ENABLED | VBE_DISPI_LFB_ENABLED);
+
+    // The adapter may have settled on a smaller virtual height
+    uint16_t actual_height = dispi_read(VBE_DISPI_INDEX_VIRT_HEIGHT);
+    if (actual_height >= FBCON_HEIGHT && actual_height < virt_height) {
+        virt_height = actual_height;
+    }
+    fbcon_vram_rows = virt_height / FBCON_FONT_HEIGHT;
+
+    fbcon_top = fbcon_view = 0;
+    fbcon_x = fbcon_y = 0;
+    uint32_t y;
+    for (y=0; y<fbcon_nrows; y++) {
+        fbcon_clear_row(y);
+    }
+    fbcon_flush();
+
+    return console_replace(&console_vga, &fbcon_console);
+
+fail:
+    if (fbcon_glyphs) kfree((uintptr_t *)fbcon_glyphs);
+    if (fbcon_cells) kfree((uintptr_t *)fbcon_cells);
+    fbcon_glyphs = NULL;
+    fbcon_cells = NULL;
+    fbcon_ncols = fbcon_nrows = 0;
+    return ret;
+}
+
+/**
+ * Get the width of the framebuffer console in characters, 0 if it isn't in use
+ */
+uint32_t fbcon_columns() {
+    return fbcon_ncols;
+}
+
+/**
+ * Get the height of the framebuffer console in characters, 0 if it isn't in use
+ */
+uint32_t fbcon_rows() {
+    return fbcon_nrows;
+}
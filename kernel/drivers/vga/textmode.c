@@ -13,11 +13,32 @@
  static const size_t VGA_WIDTH = 80;
  static const size_t VGA_HEIGHT = 25;
 
+ // Rows of text that fit in the 32KiB of video memory at 0xB8000
+ #define VGA_VRAM_ROWS 204
+ // The screen scrolls through rows [0, VGA_LIVE_ROWS) of video memory,
+ // the rows after that hold the page shown while viewing scrollback
+ #define VGA_LIVE_ROWS (VGA_VRAM_ROWS - 25)
+
+ // Lines kept after they scroll off the top of the screen
+ #define VGA_SCROLLBACK_LINES 256
+
  size_t vga_textmode_row;
  size_t vga_textmode_column;
  uint8_t vga_textmode_color;
  uint16_t* vga_textmode_buffer;
 
+ // Row of video memory currently shown at the top of the screen
+ static size_t vga_textmode_top;
+
+ // Ring of lines that scrolled off the screen, oldest first from
+ // vga_textmode_history_head - vga_textmode_history_count
+ static uint16_t vga_textmode_history[VGA_SCROLLBACK_LINES][80];
+ static size_t vga_textmode_history_head;
+ static size_t vga_textmode_history_count;
+
+ // Lines above the live screen that the scrollback view shows, 0 when live
+ static size_t vga_textmode_view_offset;
+
 /* Hardware text mode color constants. */
 enum vga_color {
 	COLOR_BLACK = 0,
@@ -68,6 +89,27 @@ void vga_textmode_setcolor(uint8_t color) {
 	vga_textmode_color = color;
 }
 
+/**
+ * Point the CRTC at the row of video memory to show at the top of the screen
+ * @param row row of video memory
+ */
+static void vga_textmode_set_start(size_t row) {
+    size_t start = row * VGA_WIDTH;
+
+    // Start address high and low, index 12 and 13 of VGA CRT control register
+    outportb(0x3D4, 12);
+    outportb(0x3D5, start >> 8);
+    outportb(0x3D4, 13);
+    outportb(0x3D5, start);
+}
+
+/**
+ * Get a row of the live screen in video memory
+ */
+static uint16_t *vga_textmode_screen_row(size_t y) {
+    return &vga_textmode_buffer[(vga_textmode_top + y) * VGA_WIDTH];
+}
+
 /**
  * Initialize text-mode buffer terminal
  */
@@ -76,6 +118,11 @@ void vga_textmode_initialize() {
 	vga_textmode_column = 0;
 	vga_textmode_setcolor(make_color(COLOR_LIGHT_GREY, COLOR_BLACK));
 	vga_textmode_buffer = (uint16_t*) 0xB8000;
+	vga_textmode_top = 0;
+	vga_textmode_history_head = 0;
+	vga_textmode_history_count = 0;
+	vga_textmode_view_offset = 0;
+	vga_textmode_set_start(0);
 	for (size_t y = 0; y < VGA_HEIGHT; y++) {
 		for (size_t x = 0; x < VGA_WIDTH; x++) {
 			const size_t index = y * VGA_WIDTH + x;
@@ -92,29 +139,114 @@ void vga_textmode_initialize() {
  * @param y     y coordinate of character
  */
 void vga_textmode_putentryat(char c, uint8_t color, size_t x, size_t y) {
-	const size_t index = y * VGA_WIDTH + x;
-	vga_textmode_buffer[index] = make_vgaentry(c, color);
+	vga_textmode_screen_row(y)[x] = make_vgaentry(c, color);
 }
 
 /**
  * Scrolls textmode buffer up one
+ *
+ * Instead of moving the whole screen, the CRTC start address is advanced by
+ * one row through a larger area of video memory. Only when the screen
+ * reaches the end of that area is it copied back to the beginning, once
+ * every VGA_LIVE_ROWS - VGA_HEIGHT lines.
  */
 void vga_textmode_scroll() {
-    for (size_t y = 0; y < VGA_HEIGHT; y++) {
-        for (size_t x = 0; x < VGA_WIDTH; x++) {
-            const size_t index = y * VGA_WIDTH + x;
-            const size_t nextrow_index = index + VGA_WIDTH;
-
-            if (y == VGA_HEIGHT) //Last line, make it blank
-                vga_textmode_buffer[index] = make_vgaentry(' ', vga_textmode_color);
-            else
-                vga_textmode_buffer[index] = vga_textmode_buffer[nextrow_index];
-        }
+    // Keep the line that is about to disappear for the scrollback view
+    memcpy(vga_textmode_history[vga_textmode_history_head], vga_textmode_screen_row(0),
+           VGA_WIDTH * sizeof(uint16_t));
+    vga_textmode_history_head = (vga_textmode_history_head + 1) % VGA_SCROLLBACK_LINES;
+    if (vga_textmode_history_count < VGA_SCROLLBACK_LINES)
+        vga_textmode_history_count++;
+
+    if (vga_textmode_top + VGA_HEIGHT >= VGA_LIVE_ROWS) {
+        // Wrap around, the rows that stay on screen move to the start
+        memcpy(vga_textmode_buffer, vga_textmode_screen_row(1),
+               (VGA_HEIGHT - 1) * VGA_WIDTH * sizeof(uint16_t));
+        vga_textmode_top = 0;
+    } else {
+        vga_textmode_top++;
+    }
+
+    // Last line, make it blank
+    uint16_t *last = vga_textmode_screen_row(VGA_HEIGHT - 1);
+    for (size_t x = 0; x < VGA_WIDTH; x++) {
+        last[x] = make_vgaentry(' ', vga_textmode_color);
+    }
+
+    // The scrollback view stays put until it is left with page down
+    if (!vga_textmode_view_offset) {
+        vga_textmode_set_start(vga_textmode_top);
     }
     vga_textmode_row = VGA_HEIGHT-1;
     vga_textmode_column = 0;
 }
 
+/**
+ * Draw the part of the scrollback selected by vga_textmode_view_offset into
+ * the view page and show it
+ */
+static void vga_textmode_show_view() {
+    size_t first = vga_textmode_history_count - vga_textmode_view_offset;
+    for (size_t y = 0; y < VGA_HEIGHT; y++) {
+        size_t line = first + y;
+        const uint16_t *src;
+        if (line < vga_textmode_history_count) {
+            size_t back = vga_textmode_history_count - line;
+            src = vga_textmode_history[(vga_textmode_history_head + VGA_SCROLLBACK_LINES - back) % VGA_SCROLLBACK_LINES];
+        } else {
+            src = vga_textmode_screen_row(line - vga_textmode_history_count);
+        }
+        memcpy(&vga_textmode_buffer[(VGA_LIVE_ROWS + y) * VGA_WIDTH], src,
+               VGA_WIDTH * sizeof(uint16_t));
+    }
+    vga_textmode_set_start(VGA_LIVE_ROWS);
+}
+
+/**
+ * Show the previous page of scrollback
+ */
+void vga_textmode_page_up() {
+    size_t offset = vga_textmode_view_offset + VGA_HEIGHT - 1;
+    if (offset > vga_textmode_history_count)
+        offset = vga_textmode_history_count;
+    if (offset == vga_textmode_view_offset)
+        return;
+
+    vga_textmode_view_offset = offset;
+    vga_textmode_show_view();
+}
+
+/**
+ * Show the next page of scrollback, or the live screen after the last one
+ */
+void vga_textmode_page_down() {
+    if (!vga_textmode_view_offset)
+        return;
+
+    if (vga_textmode_view_offset > VGA_HEIGHT - 1) {
+        vga_textmode_view_offset -= VGA_HEIGHT - 1;
+        vga_textmode_show_view();
+    } else {
+        vga_textmode_view_offset = 0;
+        vga_textmode_set_start(vga_textmode_top);
+    }
+}
+
+/**
+ * Move the hardware cursor
+ * @param x column of the cursor
+ * @param y row of the cursor
+ */
+void vga_textmode_set_cursor(size_t x, size_t y) {
+  size_t cur_pos = (vga_textmode_top + y) * VGA_WIDTH + x;
+
+  // Write position to index 14 and 15 of VGA CRT control register
+  outportb(0x3D4, 14);
+  outportb(0x3D5, cur_pos >> 8);
+  outportb(0x3D4, 15);
+  outportb(0x3D5, cur_pos);
+}
+
 /**
  * Put character in text-mode buffer
  * @param c character
@@ -141,13 +273,7 @@ void vga_textmode_putchar(char c) {
   }
 
   // Update cursor position
-  size_t cur_pos = vga_textmode_row * 80 + vga_textmode_column;
-
-  // Write position to index 14 and 15 of VGA CRT control register
-  outportb(0x3D4, 14);
-  outportb(0x3D5, cur_pos >> 8);
-  outportb(0x3D4, 15);
-  outportb(0x3D5, cur_pos);
+  vga_textmode_set_cursor(vga_textmode_column, vga_textmode_row);
 }
 
 /**
@@ -168,25 +294,28 @@ void vga_textmode_clear() {
  vga_textmode_column = 0;
  vga_textmode_setcolor(make_color(COLOR_LIGHT_GREY, COLOR_BLACK));
  for (size_t y = 0; y < VGA_HEIGHT; y++) {
+   uint16_t *row = vga_textmode_screen_row(y);
    for (size_t x = 0; x < VGA_WIDTH; x++) {
-     const size_t index = y * VGA_WIDTH + x;
-     vga_textmode_buffer[index] = make_vgaentry(' ', vga_textmode_color);
+     row[x] = make_vgaentry(' ', vga_textmode_color);
    }
  }
 
  // Reset cursor position
- size_t cur_pos = 0;
-
- // Write position to index 14 and 15 of VGA CRT control register
- outportb(0x3D4, 14);
- outportb(0x3D5, cur_pos >> 8);
- outportb(0x3D4, 15);
- outportb(0x3D5, cur_pos);
+ vga_textmode_set_cursor(0, 0);
 }
 
 void vga_textmode_writebuffer(uint16_t* newbuffer, uint16_t newbuffer_length) {
-  uint16_t i;
-  for (i=0; i<newbuffer_length; i++) {
-    vga_textmode_buffer[i] = newbuffer[i];
-  }
+  memcpy(vga_textmode_screen_row(0), newbuffer, newbuffer_length * sizeof(uint16_t));
+}
+
+/**
+ * Copy a run of entries into one row of the text-mode buffer
+ * @param cells entries to copy
+ * @param x     column of the first entry
+ * @param y     row to write to
+ * @param count number of entries, must not run past the end of the row
+ */
+void vga_textmode_writespan(const uint16_t *cells, size_t x, size_t y, size_t count) {
+  // Video memory is uncached, so one bulk copy beats storing cells one by one
+  memcpy(&vga_textmode_screen_row(y)[x], cells, count * sizeof(uint16_t));
 }
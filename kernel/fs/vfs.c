@@ -7,57 +7,105 @@
 #include <stdlib.h>
 
 #include <kernel/kernel.h>
+#include <kernel/atomic.h>
+#include <kernel/hashtable.h>
+#include <kernel/mutex.h>
+#include <kernel/rcu.h>
 #include <fs/vfs.h>
 #include <mm/alloc.h>
 
-// Array containing all mounted superblocks
-static vfs_superblock_t *vfs_superblocks[VFS_MAX_SUPERBLOCKS];
-uint32_t vfs_superblocks_size = 0;
+/**
+ * The driver table and mount table are read far more often than they change,
+ * so readers walk them under rcu_read_lock() only. Writers serialize on
+ * vfs_lock, publish changes with rcu_assign_pointer() and free replaced
+ * memory after a grace period.
+ */
+
+// Mount table, replaced as a whole whenever a filesystem is (un)mounted
+static vfs_mount_table_t *vfs_mounts = NULL;
 
-// Linked list containing all installed drivers
-fs_driver_t *vfs_drivers_head;
+// All installed drivers, keyed by name
+static htable_t vfs_drivers = HTABLE_INIT;
+
+// Serializes changes to the driver list and mount table
+static mutex_t vfs_lock = MUTEX_INIT;
 
 // Current filesystem root
 fs_inode_t *vfs_root = NULL;
 
-// Refcount lock
-SPINLOCK_DECLARE(vfs_refcount);
-
 /**
  * Internal functions
  */
 
+static bool vfs_driver_match(htable_node_t *node, const void *key) {
+    return strcmp(container_of(node, fs_driver_t, node)->name, (const char *)key) == 0;
+}
+
 /**
- * Return a pointer to the driver for the requested filesystem
+ * Return a pointer to the driver for the requested filesystem.
+ * Must be called inside an RCU read-side critical section.
  * @param  driver name of filesystem driver
  * @return        pointer to driver, or NULL if no driver exists
  */
 static inline fs_driver_t *vfs_get_driver(char *driver) {
-    // Search installed drivers linked list for requested driver
-    fs_driver_t *cur = vfs_drivers_head;
-    while (cur) {
-        if (strcmp(driver, cur->name) == 0) {
-            return cur;
-        }
-        cur = cur->next;
-    }
-    return NULL;
+    htable_node_t *node = htable_lookup(&vfs_drivers, hash_fnv1a_str(driver), vfs_driver_match, driver);
+    return node ? container_of(node, fs_driver_t, node) : NULL;
+}
+
+static void vfs_free_rcu(rcu_head_t *head) {
+    kfree((uintptr_t *)head);
 }
 
 
 /**
  * Interface for installing drivers
  */
-void vfs_install_driver(fs_driver_t *driver) {
+
+/**
+ * Install a filesystem driver
+ * @param driver driver to install, copied
+ * @return K_SUCCESS or K_OOM
+ */
+k_return_t vfs_install_driver(fs_driver_t *driver) {
     // Allocate space for a the new driver
     fs_driver_t *new = (fs_driver_t *)kmalloc(sizeof(fs_driver_t), KALLOC_GENERAL);
+    if (!new) return K_OOM;
 
     // Copy the driver into newly allocated memory
     memcpy(new, driver, sizeof(fs_driver_t));
 
-    // Set new driver to the head of the vfs_drivers linked list
-    new->next = vfs_drivers_head;
-    vfs_drivers_head = new;
+    // Add the new driver to the table. A driver with the same name is
+    // shadowed until the new one is uninstalled.
+    mutex_lock(&vfs_lock);
+    k_return_t ret = htable_insert(&vfs_drivers, &new->node, hash_fnv1a_str(new->name));
+    mutex_unlock(&vfs_lock);
+
+    if (K_FAILED(ret)) {
+        kfree((uintptr_t *)new);
+    }
+    return ret;
+}
+
+/**
+ * Remove an installed driver. Filesystems mounted with it stay mounted.
+ * @param name name of the driver to remove
+ * @return K_SUCCESS or K_INVALOP if no such driver is installed
+ */
+k_return_t vfs_uninstall_driver(char *name) {
+    k_return_t ret = K_INVALOP;
+
+    mutex_lock(&vfs_lock);
+    rcu_read_lock();
+    fs_driver_t *driver = vfs_get_driver(name);
+    rcu_read_unlock();
+    if (driver && htable_remove(&vfs_drivers, &driver->node)) {
+        // Readers may still be looking at it until the grace period ends
+        call_rcu(&driver->rcu, vfs_free_rcu);
+        ret = K_SUCCESS;
+    }
+    mutex_unlock(&vfs_lock);
+
+    return ret;
 }
 
 
@@ -75,27 +123,51 @@ void vfs_install_driver(fs_driver_t *driver) {
  */
 k_return_t vfs_mount(char *driver, uint32_t device, fs_inode_t *mount_point,
                      char *options) {
-    // Get the driver struct for the requested driver
+    // Get the driver struct for the requested driver. Mounting may block,
+    // so only the mount function is kept past the read-side section.
+    rcu_read_lock();
     fs_driver_t *driver_info = vfs_get_driver(driver);
-    if (!driver_info) {
+    k_return_t (*fs_mount)(uint32_t, fs_inode_t *, char *, vfs_superblock_t *) =
+        driver_info ? driver_info->fs_mount : NULL;
+    rcu_read_unlock();
+    if (!fs_mount) {
         // No driver installed for requested filesystem
         return K_NOTSUP;
     }
 
     // Call driver's mount_fs and get returned superblock
     vfs_superblock_t *newsuper = (vfs_superblock_t *)kmalloc(sizeof(vfs_superblock_t), KALLOC_GENERAL);
-    k_return_t res = driver_info->fs_mount(device, mount_point, options, newsuper);
+    k_return_t res = fs_mount(device, mount_point, options, newsuper);
     if (res < 0) {
         // Driver failed to mount filesystem
+        kfree((uintptr_t *)newsuper);
         return res;
     }
 
-    // Add superblock to internal list
-    if (vfs_superblocks_size + 1 > VFS_MAX_SUPERBLOCKS) {
+    // Publish a copy of the mount table with the new superblock added
+    vfs_mount_table_t *table = (vfs_mount_table_t *)kmalloc(sizeof(vfs_mount_table_t), KALLOC_GENERAL);
+    mutex_lock(&vfs_lock);
+    vfs_mount_table_t *old = vfs_mounts;
+    if (old) {
+        memcpy(table, old, sizeof(vfs_mount_table_t));
+    } else {
+        table->size = 0;
+    }
+
+    if (table->size + 1 > VFS_MAX_SUPERBLOCKS) {
         // Not enough space in superblocks list
+        mutex_unlock(&vfs_lock);
+        kfree((uintptr_t *)table);
+        kfree((uintptr_t *)newsuper);
         return K_OOM;
     }
-    vfs_superblocks[vfs_superblocks_size++] = newsuper;
+    table->superblocks[table->size++] = newsuper;
+
+    rcu_assign_pointer(vfs_mounts, table);
+    if (old) {
+        call_rcu(&old->rcu, vfs_free_rcu);
+    }
+    mutex_unlock(&vfs_lock);
 
     // Mount filesystem
     /*
@@ -113,6 +185,60 @@ k_return_t vfs_mount(char *driver, uint32_t device, fs_inode_t *mount_point,
     return K_SUCCESS;
 }
 
+/**
+ * Remove a mounted filesystem instance from the mount table. The superblock
+ * is freed once no reader can be using it any more.
+ * @param superblock superblock of the filesystem instance
+ * @return K_SUCCESS or K_INVALOP if it isn't mounted
+ */
+k_return_t vfs_umount(vfs_superblock_t *superblock) {
+    k_return_t ret = K_INVALOP;
+    vfs_mount_table_t *table = (vfs_mount_table_t *)kmalloc(sizeof(vfs_mount_table_t), KALLOC_GENERAL);
+
+    mutex_lock(&vfs_lock);
+    vfs_mount_table_t *old = vfs_mounts;
+    table->size = 0;
+    uint32_t i;
+    for (i=0; old && i<old->size; i++) {
+        if (old->superblocks[i] == superblock) {
+            ret = K_SUCCESS;
+        } else {
+            table->superblocks[table->size++] = old->superblocks[i];
+        }
+    }
+
+    if (K_FAILED(ret)) {
+        mutex_unlock(&vfs_lock);
+        kfree((uintptr_t *)table);
+        return ret;
+    }
+
+    rcu_assign_pointer(vfs_mounts, table);
+    call_rcu(&old->rcu, vfs_free_rcu);
+    call_rcu(&superblock->rcu, vfs_free_rcu);
+    mutex_unlock(&vfs_lock);
+
+    return K_SUCCESS;
+}
+
+/**
+ * Find the filesystem instance mounted at an inode.
+ * Must be called inside an RCU read-side critical section, the result is
+ * only valid until it ends.
+ * @param mount_point mountpoint to look up, or NULL for /
+ * @return superblock of the filesystem mounted there, or NULL if none
+ */
+vfs_superblock_t *vfs_find_mount(fs_inode_t *mount_point) {
+    vfs_mount_table_t *table = rcu_dereference(vfs_mounts);
+    uint32_t i;
+    for (i=0; table && i<table->size; i++) {
+        if (table->superblocks[i]->mount_point == mount_point) {
+            return table->superblocks[i];
+        }
+    }
+    return NULL;
+}
+
 
 /**
  * Interfaces to read inodes
@@ -161,9 +287,7 @@ k_return_t vfs_inode_open(fs_inode_t *node) {
     // Make sure this inode has the requested operation
     if (ops && ops->open) {
         // Increase refcount
-        SPINLOCK_LOCK(vfs_refcount);
-        node->refcount++;
-        SPINLOCK_UNLOCK(vfs_refcount);
+        atomic_inc(&node->refcount);
         return ops->open(node);
     }
     return K_UNIMPL;
@@ -179,9 +303,7 @@ k_return_t vfs_inode_close(fs_inode_t *node) {
     // Make sure this inode has the requested operation
     if (ops && ops->close) {
         // Decrease refcount
-        SPINLOCK_LOCK(vfs_refcount);
-        node->refcount--;
-        SPINLOCK_UNLOCK(vfs_refcount);
+        atomic_dec(&node->refcount);
         return ops->close(node);
     }
     return K_UNIMPL;
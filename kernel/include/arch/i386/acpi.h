@@ -0,0 +1,74 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include <kernel/kernel.h>
+
+/**
+ * Minimal ACPI table discovery
+ */
+
+#define ACPI_RSDP_SIGNATURE "RSD PTR "
+#define ACPI_MADT_SIGNATURE "APIC"
+
+// MADT entry types
+#define ACPI_MADT_LAPIC          0
+#define ACPI_MADT_IOAPIC         1
+#define ACPI_MADT_LAPIC_OVERRIDE 5
+
+// MADT local APIC flags
+#define ACPI_MADT_LAPIC_ENABLED  (1<<0)
+
+struct acpi_rsdp {
+    char signature[8];
+    uint8_t checksum;
+    char oem_id[6];
+    uint8_t revision;
+    uint32_t rsdt_address;
+} __attribute__((packed));
+typedef struct acpi_rsdp acpi_rsdp_t;
+
+struct acpi_sdt_header {
+    char signature[4];
+    uint32_t length;
+    uint8_t revision;
+    uint8_t checksum;
+    char oem_id[6];
+    char oem_table_id[8];
+    uint32_t oem_revision;
+    uint32_t creator_id;
+    uint32_t creator_revision;
+} __attribute__((packed));
+typedef struct acpi_sdt_header acpi_sdt_header_t;
+
+struct acpi_madt {
+    acpi_sdt_header_t header;
+    uint32_t lapic_address;
+    uint32_t flags;
+} __attribute__((packed));
+typedef struct acpi_madt acpi_madt_t;
+
+struct acpi_madt_entry {
+    uint8_t type;
+    uint8_t length;
+} __attribute__((packed));
+typedef struct acpi_madt_entry acpi_madt_entry_t;
+
+struct acpi_madt_lapic {
+    acpi_madt_entry_t entry;
+    uint8_t processor_id;
+    uint8_t apic_id;
+    uint32_t flags;
+} __attribute__((packed));
+typedef struct acpi_madt_lapic acpi_madt_lapic_t;
+
+struct acpi_madt_lapic_override {
+    acpi_madt_entry_t entry;
+    uint16_t reserved;
+    uint64_t lapic_address;
+} __attribute__((packed));
+typedef struct acpi_madt_lapic_override acpi_madt_lapic_override_t;
+
+k_return_t acpi_init();
+acpi_sdt_header_t *acpi_find_table(const char *signature);
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include <kernel/kernel.h>
+
+/**
+ * Local APIC driver
+ */
+
+// Local APIC register offsets
+#define LAPIC_ID           0x020
+#define LAPIC_VERSION      0x030
+#define LAPIC_TPR          0x080
+#define LAPIC_EOI          0x0B0
+#define LAPIC_SVR          0x0F0
+#define LAPIC_ESR          0x280
+#define LAPIC_ICR_LOW      0x300
+#define LAPIC_ICR_HIGH     0x310
+#define LAPIC_LVT_TIMER    0x320
+#define LAPIC_LVT_LINT0    0x350
+#define LAPIC_LVT_LINT1    0x360
+#define LAPIC_LVT_ERROR    0x370
+#define LAPIC_TIMER_INIT   0x380
+#define LAPIC_TIMER_CUR    0x390
+#define LAPIC_TIMER_DIV    0x3E0
+
+// Spurious interrupt vector register
+#define LAPIC_SVR_ENABLE   (1<<8)
+
+// Interrupt command register
+#define LAPIC_ICR_FIXED    (0<<8)
+#define LAPIC_ICR_INIT     (5<<8)
+#define LAPIC_ICR_STARTUP  (6<<8)
+#define LAPIC_ICR_PENDING  (1<<12)
+#define LAPIC_ICR_ASSERT   (1<<14)
+#define LAPIC_ICR_ALL_BUT_SELF (3<<18)
+
+// Local vector table
+#define LAPIC_LVT_MASKED   (1<<16)
+#define LAPIC_TIMER_PERIODIC (1<<17)
+#define LAPIC_TIMER_DIV_16 0x3
+
+extern volatile uint32_t *lapic_base;
+
+static inline uint32_t lapic_read(uint32_t reg) {
+    return lapic_base[reg / 4];
+}
+
+static inline void lapic_write(uint32_t reg, uint32_t value) {
+    lapic_base[reg / 4] = value;
+}
+
+/**
+ * Get the APIC ID of the calling CPU
+ */
+static inline uint8_t lapic_id() {
+    return lapic_read(LAPIC_ID) >> 24;
+}
+
+k_return_t lapic_init(uint32_t phys);
+void lapic_enable();
+void lapic_eoi(uint8_t vector);
+void lapic_send_ipi(uint8_t apic_id, uint32_t icr);
+void lapic_broadcast_ipi(uint32_t icr);
+void lapic_timer_calibrate();
+void lapic_timer_start();
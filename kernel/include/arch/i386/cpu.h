@@ -0,0 +1,152 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/**
+ * Inline helpers for i386 CPU control instructions
+ */
+
+#define EFLAGS_IF (1<<9) // Interrupt enable flag
+
+/**
+ * Disable interrupts and return the previous EFLAGS
+ * @return EFLAGS before interrupts were disabled
+ */
+static inline uint32_t cpu_irq_save() {
+    uint32_t flags;
+    __asm__ __volatile__ ("pushfl; popl %0; cli" : "=r" (flags) : : "memory");
+    return flags;
+}
+
+/**
+ * Restore the interrupt flag saved by cpu_irq_save()
+ * @param flags EFLAGS returned by cpu_irq_save()
+ */
+static inline void cpu_irq_restore(uint32_t flags) {
+    if (flags & EFLAGS_IF) {
+        __asm__ __volatile__ ("sti" : : : "memory");
+    }
+}
+
+/**
+ * Read the CPU timestamp counter
+ * @return number of cycles since reset
+ */
+static inline uint64_t cpu_rdtsc() {
+    uint32_t lo, hi;
+    __asm__ __volatile__ ("rdtsc" : "=a" (lo), "=d" (hi));
+    return ((uint64_t)hi << 32) | lo;
+}
+
+/**
+ * Find the index of the most significant set bit
+ * @param x value to scan, must not be 0
+ * @return index of the highest set bit
+ */
+static inline uint32_t cpu_bsr(uint32_t x) {
+    uint32_t res;
+    __asm__ ("bsrl %1, %0" : "=r" (res) : "rm" (x));
+    return res;
+}
+
+/**
+ * Find the index of the least significant set bit
+ * @param x value to scan, must not be 0
+ * @return index of the lowest set bit
+ */
+static inline uint32_t cpu_bsf(uint32_t x) {
+    uint32_t res;
+    __asm__ ("bsfl %1, %0" : "=r" (res) : "rm" (x));
+    return res;
+}
+
+/**
+ * Hint to the CPU that we are in a spin-wait loop
+ */
+static inline void cpu_relax() {
+    __asm__ __volatile__ ("pause" : : : "memory");
+}
+
+// CPUID feature bits
+#define CPUID_1_ECX_MONITOR (1<<3)  // Leaf 1: MONITOR/MWAIT supported
+#define CPUID_5_ECX_EMX     (1<<0)  // Leaf 5: MWAIT extensions enumerated
+#define CPUID_1_EDX_MSR     (1<<5)  // Leaf 1: RDMSR/WRMSR supported
+#define CPUID_1_EDX_PAT     (1<<16) // Leaf 1: Page Attribute Table supported
+
+// Model-specific registers
+#define MSR_IA32_PAT 0x277
+
+/**
+ * Execute CPUID
+ * @param leaf value of EAX to query
+ * @param[out] regs EAX, EBX, ECX and EDX returned by the CPU, in that order
+ */
+static inline void cpu_cpuid(uint32_t leaf, uint32_t regs[4]) {
+    __asm__ __volatile__ ("cpuid" : "=a" (regs[0]), "=b" (regs[1]), "=c" (regs[2]), "=d" (regs[3])
+                          : "a" (leaf), "c" (0));
+}
+
+/**
+ * Read a model-specific register
+ * @param msr register number
+ * @return value of the register
+ */
+static inline uint64_t cpu_rdmsr(uint32_t msr) {
+    uint32_t lo, hi;
+    __asm__ __volatile__ ("rdmsr" : "=a" (lo), "=d" (hi) : "c" (msr));
+    return ((uint64_t)hi << 32) | lo;
+}
+
+/**
+ * Write a model-specific register
+ * @param msr   register number
+ * @param value value to write
+ */
+static inline void cpu_wrmsr(uint32_t msr, uint64_t value) {
+    __asm__ __volatile__ ("wrmsr" : : "c" (msr), "a" ((uint32_t)value), "d" ((uint32_t)(value >> 32))
+                          : "memory");
+}
+
+/**
+ * Enable interrupts and halt until the next one arrives. The interrupt
+ * shadow of sti guarantees no interrupt is taken between the two instructions,
+ * so a wakeup can't be missed after checking for work with interrupts disabled.
+ */
+static inline void cpu_halt_irq_enable() {
+    __asm__ __volatile__ ("sti; hlt" : : : "memory");
+}
+
+/**
+ * Arm address monitoring hardware on the cache line containing addr
+ * @param addr address to monitor
+ */
+static inline void cpu_monitor(const volatile void *addr) {
+    __asm__ __volatile__ ("monitor" : : "a" (addr), "c" (0), "d" (0) : "memory");
+}
+
+/**
+ * Enable interrupts and wait until the monitored cache line is written or an
+ * interrupt arrives. Like cpu_halt_irq_enable(), the two can't be separated.
+ * @param hints target C-state, 0 for C1
+ */
+static inline void cpu_mwait_irq_enable(uint32_t hints) {
+    __asm__ __volatile__ ("sti; mwait" : : "a" (hints), "c" (0) : "memory");
+}
+
+/**
+ * Atomically compare and exchange 8 bytes. If *ptr equals *expected, store
+ * desired and return true. Otherwise copy the current value to *expected
+ * and return false.
+ * @param ptr      8-byte aligned location to act on
+ * @param expected value *ptr is expected to hold
+ * @param desired  value to store
+ */
+static inline bool cpu_cmpxchg8b(volatile uint64_t *ptr, uint64_t *expected, uint64_t desired) {
+    bool success;
+    __asm__ __volatile__ ("lock cmpxchg8b %1; sete %0"
+                          : "=q" (success), "+m" (*ptr), "+A" (*expected)
+                          : "b" ((uint32_t)desired), "c" ((uint32_t)(desired >> 32))
+                          : "memory", "cc");
+    return success;
+}
@@ -1,5 +1,15 @@
 #include <stdint.h>
 
+// GDT selectors
+#define GDT_KERNEL_CODE 0x08
+#define GDT_KERNEL_DATA 0x10
+#define GDT_USER_CODE   0x18
+#define GDT_USER_DATA   0x20
+#define GDT_TSS         0x28
+#define GDT_PERCPU      0x30 // Loaded into GS, based at the CPU's per-CPU area
+
+#define GDT_ENTRIES 7
+
 struct gdt_entry {
     uint16_t limit_low;
     uint16_t base_low;
@@ -14,4 +24,8 @@ struct gdt_ptr {
     uint32_t base;
 } __attribute__((packed));
 
+void _gdt_set_gate(uint32_t cpu, int32_t num, uint64_t base, uint64_t limit,
+    uint8_t access, uint8_t gran);
 void gdt_install();
+void gdt_install_cpu(uint32_t cpu);
+void gdt_set_percpu_base(uint32_t cpu, uint32_t base);
@@ -19,5 +19,6 @@ struct idt_gate_debug {
 };
 
 void idt_install();
+void idt_load();
 void _idt_set_gate(uint8_t num, uint32_t base, uint16_t sel,
                    uint8_t flags);
@@ -23,4 +23,6 @@ struct tss {
   uint16_t trace, bitmap;
 };
 
-struct tss * tss_return();
+struct tss *tss_install(uint32_t cpu);
+void tss_set_kernel_stack(uint32_t cpu, void *esp0);
+struct tss *tss_return(uint32_t cpu);
@@ -0,0 +1,98 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include <kernel/kernel.h>
+#include <arch/i386/isr.h>
+
+#define INTERRUPT_VECTORS 256
+
+// Vectors 0-31 are CPU exceptions, 32-47 are the remapped legacy PIC IRQs
+#define INTERRUPT_EXCEPTION_BASE 0
+#define INTERRUPT_PIC_BASE       32
+
+// Range of vectors that can be handed out dynamically (e.g. for MSI)
+#define INTERRUPT_DYNAMIC_BASE   48
+#define INTERRUPT_DYNAMIC_END    0xEF
+
+// Fixed vectors used by the local APIC
+#define INTERRUPT_APIC_TIMER     0xF0
+#define INTERRUPT_IPI_RESCHEDULE 0xF1
+#define INTERRUPT_IPI_HALT       0xF2
+#define INTERRUPT_APIC_SPURIOUS  0xFF
+
+// Maximum number of handlers registered across all vectors
+#define INTERRUPT_MAX_ACTIONS    128
+
+// Number of buckets in each handler latency histogram (log2 of cycles)
+#define INTERRUPT_HIST_BUCKETS   32
+
+// Interrupt registration flags
+#define INTERRUPT_SHARED   (1<<0) // Handler may share the vector with others (level-triggered)
+
+/**
+ * Function to handle an interrupt
+ * @param r    saved register state of the interrupted context
+ * @param data context pointer given at registration
+ * @return true if the interrupt was raised by this handler's device, otherwise false
+ */
+typedef bool (*interrupt_handler_t)(i386_registers_t *r, void *data);
+
+/**
+ * Function to acknowledge an interrupt at its controller (EOI)
+ * @param vector vector that was serviced
+ */
+typedef void (*interrupt_eoi_t)(uint8_t vector);
+
+/**
+ * Single handler registered on a vector.
+ * Handlers sharing a vector form a linked list.
+ */
+struct interrupt_action {
+    interrupt_handler_t handler;
+    void *data;
+    uint32_t flags;
+    struct interrupt_action *next;
+};
+typedef struct interrupt_action interrupt_action_t;
+
+/**
+ * Entry in the interrupt vector table
+ */
+struct interrupt_vector {
+    interrupt_action_t *actions; // Chain of handlers, or NULL if unused
+    interrupt_eoi_t eoi;         // Controller acknowledge routine, or NULL
+    bool reserved;               // Vector has been handed out by interrupt_alloc_vector
+};
+typedef struct interrupt_vector interrupt_vector_t;
+
+/**
+ * Per-vector interrupt statistics
+ */
+struct interrupt_stats {
+    uint64_t count;      // Number of times the vector fired
+    uint64_t unhandled;  // Number of times no handler claimed it
+    uint64_t cycles;     // Cumulative cycles spent in handlers
+    uint64_t max_cycles; // Longest single run of the handlers
+    /**
+     * Histogram of handler run time. Bucket n counts the interrupts that took
+     * between 2^n and 2^(n+1)-1 cycles.
+     */
+    uint32_t hist[INTERRUPT_HIST_BUCKETS];
+};
+typedef struct interrupt_stats interrupt_stats_t;
+
+extern interrupt_vector_t interrupt_vectors[INTERRUPT_VECTORS];
+
+k_return_t interrupt_register(uint8_t vector, interrupt_handler_t handler, void *data,
+                              uint32_t flags);
+k_return_t interrupt_unregister(uint8_t vector, interrupt_handler_t handler, void *data);
+void interrupt_set_eoi(uint8_t vector, interrupt_eoi_t eoi);
+k_return_t interrupt_alloc_vector(uint8_t *out);
+void interrupt_free_vector(uint8_t vector);
+void interrupt_install_gates();
+void interrupt_dispatch(i386_registers_t *r);
+void interrupt_stats_get(uint8_t vector, interrupt_stats_t *out);
+void interrupt_stats_reset();
+void interrupt_stats_dump();
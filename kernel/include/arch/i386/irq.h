@@ -1,10 +1,14 @@
 #pragma once
 
 #include <stdint.h>
+#include <stdbool.h>
 
+#include <kernel/kernel.h>
 #include <arch/i386/isr.h>
 
-void irq_install_handler(int32_t irq, void (*handler)(i386_registers_t *r));
-void irq_uninstall_handler(int32_t irq);
+k_return_t irq_install_handler(int32_t irq, bool (*handler)(i386_registers_t *r, void *data),
+                               void *data, uint32_t flags);
+k_return_t irq_uninstall_handler(int32_t irq, bool (*handler)(i386_registers_t *r, void *data),
+                                 void *data);
 void _irq_install();
 void __irq_remap();
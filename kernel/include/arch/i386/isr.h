@@ -1,6 +1,9 @@
 #pragma once
 
 #include <stdint.h>
+#include <stdbool.h>
+
+#include <kernel/kernel.h>
 
 void _isr_install();
 
@@ -13,4 +16,6 @@ struct i386_registers {
 };
 typedef struct i386_registers i386_registers_t;
 
-void isr_install_handler(int32_t isr, void (*handler)(i386_registers_t *r));
+k_return_t isr_install_handler(int32_t isr, bool (*handler)(i386_registers_t *r, void *data),
+                               void *data);
+void _fault_handler(i386_registers_t *r);
@@ -10,6 +10,24 @@
 #define PT_RW (1<<1)           // Is the page read/write?
 #define PT_USER (1<<2)         // Is the page user-mode?
 #define PT_WRITETHROUGH (1<<3) // Is writethrough enabled for the page?
+#define PT_DISABLECACHE (1<<4) // Is caching disabled for the page? (MMIO)
+#define PT_PAT (1<<7)          // Selects the upper half of the PAT with PT_WRITETHROUGH/PT_DISABLECACHE
+
+// Memory types programmed into the PAT by i386_pat_init(). The lower half keeps
+// the power-on defaults, so PT_WRITETHROUGH and PT_DISABLECACHE mean the same
+// with or without PAT.
+#define PAT_TYPE_UC  0x00   // Uncacheable
+#define PAT_TYPE_WC  0x01   // Write-combining
+#define PAT_TYPE_WT  0x04   // Write-through
+#define PAT_TYPE_WB  0x06   // Write-back
+#define PAT_TYPE_UCM 0x07   // Uncacheable, overridable by MTRRs (UC-)
+#define PAT_VALUE ((uint64_t)PAT_TYPE_WB         | (uint64_t)PAT_TYPE_WT << 8  | \
+                   (uint64_t)PAT_TYPE_UCM << 16  | (uint64_t)PAT_TYPE_UC << 24 | \
+                   (uint64_t)PAT_TYPE_WC << 32   | (uint64_t)PAT_TYPE_WT << 40 | \
+                   (uint64_t)PAT_TYPE_UCM << 48  | (uint64_t)PAT_TYPE_UC << 56)
+
+// Write-combining, for framebuffers. Only valid if i386_pat_enabled.
+#define PT_WRITECOMBINE PT_PAT
 
 // Page Directory Entry flags
 #define PD_PRESENT (1<<0)
@@ -41,16 +59,23 @@ struct i386_mmu_data {
 typedef struct i386_mmu_data i386_mmu_data_t;
 
 extern i386_mmu_data_t i386_kernel_mmu_data;
+extern bool i386_pat_enabled;
 
 void i386_paging_init();
+void i386_pat_init();
 uint32_t i386_page_get_phys(i386_mmu_data_t *this, uint32_t address);
 k_return_t i386_allocate_empty_pages(i386_mmu_data_t *this, uint32_t n_pages, uintptr_t *phys_out,
                                      uintptr_t *virt_out);
 k_return_t i386_allocate_page(i386_mmu_data_t *this, uint32_t address, uint32_t pt_flags, uint32_t pd_flags,
                               uint32_t *out);
 k_return_t i386_free_page(i386_mmu_data_t *this, uint32_t address);
+k_return_t i386_map_page(i386_mmu_data_t *this, uint32_t address, uint32_t phys, uint32_t pt_flags,
+                         uint32_t pd_flags);
+k_return_t i386_unmap_page(i386_mmu_data_t *this, uint32_t address);
 uint32_t i386_identity_map_page(i386_mmu_data_t *this, uint32_t address, uint32_t pt_flags, uint32_t pd_flags);
-void __i386_page_fault_handler(i386_registers_t *r);
+void *i386_map_phys(uint32_t phys, uint32_t size, uint32_t pt_flags);
+void i386_unmap_phys(void *virt, uint32_t size);
+bool __i386_page_fault_handler(i386_registers_t *r, void *data);
 
 // Kernel paging interface implementation
 k_return_t __i386_kpage_allocate(uintptr_t addr, uint32_t flags);
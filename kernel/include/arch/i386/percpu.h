@@ -0,0 +1,95 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include <kernel/kernel.h>
+
+/**
+ * Per-CPU data
+ *
+ * Variables defined with DEFINE_PER_CPU are placed in the .percpu section,
+ * which serves as a template. Each CPU gets a page-aligned copy of it, and the
+ * GS segment of each CPU has its base set to (copy - template), so that a
+ * variable is reached on the current CPU by its template address through GS.
+ * Until a CPU's area is set up, GS has base 0 and accesses the template.
+ *
+ * Per-CPU variables must not be accessed directly, only through the
+ * accessors below.
+ */
+
+#define PERCPU_SECTION __attribute__((section(".percpu")))
+
+// Define a per-CPU variable, e.g. DEFINE_PER_CPU(uint32_t, counter)
+#define DEFINE_PER_CPU(type, name) PERCPU_SECTION type name
+
+// Declare a per-CPU variable defined in another file
+#define DECLARE_PER_CPU(type, name) extern PERCPU_SECTION type name
+
+// Offset from the template to the copy of each CPU, 0 until set up
+extern uintptr_t percpu_offsets[];
+
+// Offset from the template to the current CPU's copy
+DECLARE_PER_CPU(uintptr_t, this_cpu_off);
+
+// Logical index of the current CPU
+DECLARE_PER_CPU(uint32_t, cpu_number);
+
+// Compile time check that a per-CPU variable can be moved with one instruction
+#define __PERCPU_CHECK_SIZE(var) ((void)sizeof(char[(sizeof(var) == 4) ? 1 : -1]))
+
+/**
+ * Single instruction accessors for 32-bit per-CPU variables. They can't be
+ * torn by interrupts, but the caller must make sure it doesn't migrate
+ * between reading and acting on the value.
+ */
+#define this_cpu_read(var) ({                                              \
+    uint32_t __pcpu_val;                                                   \
+    __PERCPU_CHECK_SIZE(var);                                              \
+    __asm__ __volatile__ ("movl %%gs:%1, %0" : "=r" (__pcpu_val) : "m" (var)); \
+    (__typeof__(var))__pcpu_val;                                           \
+})
+
+#define this_cpu_write(var, val) do {                                      \
+    __PERCPU_CHECK_SIZE(var);                                              \
+    __asm__ __volatile__ ("movl %1, %%gs:%0" : "=m" (var) : "ri" ((uint32_t)(val))); \
+} while (0)
+
+#define this_cpu_add(var, val) do {                                        \
+    __PERCPU_CHECK_SIZE(var);                                              \
+    __asm__ __volatile__ ("addl %1, %%gs:%0" : "+m" (var) : "ri" ((uint32_t)(val))); \
+} while (0)
+
+#define this_cpu_inc(var) this_cpu_add(var, 1)
+
+// Pointer to a CPU's copy of a per-CPU variable
+#define per_cpu_ptr(var, cpu) \
+    ((__typeof__(&(var)))((uintptr_t)&(var) + percpu_offsets[(cpu)]))
+
+// Pointer to the current CPU's copy of a per-CPU variable
+#define this_cpu_ptr(var) \
+    ((__typeof__(&(var)))((uintptr_t)&(var) + this_cpu_read(this_cpu_off)))
+
+/**
+ * Per-CPU counters. Each CPU only ever adds to its own copy, readers sum
+ * all copies when they need the total.
+ */
+#define DEFINE_PER_CPU_COUNTER(name) DEFINE_PER_CPU(uint64_t, name)
+#define DECLARE_PER_CPU_COUNTER(name) DECLARE_PER_CPU(uint64_t, name)
+
+// Add to the current CPU's copy of a counter. Interrupts save the carry flag,
+// so the add/adc pair doesn't need them disabled.
+#define this_cpu_counter_add(name, val) do {                               \
+    __asm__ __volatile__ ("addl %1, %%gs:%0\n\t"                           \
+                          "adcl $0, %%gs:4+%0"                             \
+                          : "+m" (name) : "ri" ((uint32_t)(val)) : "cc");  \
+} while (0)
+
+#define this_cpu_counter_inc(name) this_cpu_counter_add(name, 1)
+
+#define percpu_counter_sum(name) percpu_counter_sum_real(&(name))
+
+k_return_t percpu_alloc(uint32_t cpu);
+void percpu_load(uint32_t cpu);
+void percpu_init();
+uint64_t percpu_counter_sum_real(uint64_t *counter);
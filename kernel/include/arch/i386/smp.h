@@ -0,0 +1,41 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include <kernel/kernel.h>
+#include <arch/i386/percpu.h>
+
+#define SMP_MAX_CPUS 16
+
+// Physical address the AP startup trampoline is copied to. Must be page
+// aligned, below 1MB and match TRAMPOLINE_ADDR in smpboot.asm.
+#define SMP_TRAMPOLINE_ADDR 0x8000
+
+/**
+ * Struct describing a single CPU
+ */
+struct smp_cpu {
+    uint32_t id;              // Logical index, 0 is the BSP
+    uint8_t apic_id;          // Local APIC ID
+    volatile bool online;     // CPU has finished starting up
+    void *stack;              // AP boot stack, becomes the AP's idle thread stack
+};
+typedef struct smp_cpu smp_cpu_t;
+
+extern smp_cpu_t smp_cpus[SMP_MAX_CPUS];
+extern uint32_t smp_num_cpus;
+
+/**
+ * Get the logical index of the calling CPU
+ */
+static inline uint32_t smp_cpu_id() {
+    return this_cpu_read(cpu_number);
+}
+
+void smp_init();
+uint32_t smp_num_online();
+void smp_send_reschedule(uint32_t cpu);
+void smp_halt_others();
+__attribute__((__noreturn__))
+void smp_ap_entry(uint32_t cpu);
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <stdint.h>
+#include <stdbool.h>
 
 #include <arch/i386/isr.h>
 
@@ -20,7 +21,7 @@ uint16_t pit_install_scheduler_routine(struct pit_routine r);
 void pit_uninstall_scheduler_routine(uint16_t index);
 
 void pit_set_timer_phase(int16_t hz);
-void pit_irq_timer_handler(i386_registers_t *r);
+bool pit_irq_timer_handler(i386_registers_t *r, void *data);
 void pit_timer_install_irq();
 uint32_t pit_get_total_ticks();
 void pit_timer_wait(uint32_t seconds);
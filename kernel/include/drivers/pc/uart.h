@@ -0,0 +1,61 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#include <kernel/kernel.h>
+#include <arch/i386/isr.h>
+
+#define UART_COM1_PORT 0x3F8
+#define UART_COM1_IRQ  4
+
+#define UART_CLOCK     115200   // Base baud rate, divided by the divisor latch
+#define UART_BAUD      115200
+#define UART_FIFO_SIZE 16       // Bytes the transmitter FIFO can take at once
+
+#define UART_TX_RING_SIZE 8192  // Must be a power of two
+
+/**
+ * Registers, as offsets from the port base
+ */
+#define UART_REG_DATA 0     // RBR/THR, or divisor latch low with LCR_DLAB
+#define UART_REG_IER  1     // Interrupt enable, or divisor latch high with LCR_DLAB
+#define UART_REG_IIR  2     // Interrupt identification (read)
+#define UART_REG_FCR  2     // FIFO control (write)
+#define UART_REG_LCR  3     // Line control
+#define UART_REG_MCR  4     // Modem control
+#define UART_REG_LSR  5     // Line status
+#define UART_REG_MSR  6     // Modem status
+
+#define UART_IER_RDI   (1<<0)   // Received data available
+#define UART_IER_THRI  (1<<1)   // Transmitter holding register empty
+
+#define UART_IIR_NO_INT (1<<0)
+#define UART_IIR_ID     0x0E
+#define UART_IIR_MSI    0x00
+#define UART_IIR_THRI   0x02
+#define UART_IIR_RDI    0x04
+#define UART_IIR_RLSI   0x06
+#define UART_IIR_TIMEOUT 0x0C
+
+#define UART_FCR_ENABLE    (1<<0)
+#define UART_FCR_CLEAR_RX  (1<<1)
+#define UART_FCR_CLEAR_TX  (1<<2)
+#define UART_FCR_TRIGGER_14 0xC0
+
+#define UART_LCR_8N1  0x03
+#define UART_LCR_DLAB (1<<7)
+
+#define UART_MCR_DTR  (1<<0)
+#define UART_MCR_RTS  (1<<1)
+#define UART_MCR_OUT2 (1<<3)    // Gates the interrupt line on PCs
+#define UART_MCR_LOOP (1<<4)
+
+#define UART_LSR_DR   (1<<0)    // Data ready
+#define UART_LSR_THRE (1<<5)    // Transmitter holding register (and FIFO) empty
+
+k_return_t uart_init();
+void uart_write(const char *data, size_t length);
+void uart_write_polled(const char *data, size_t length);
+bool uart_irq_handler(i386_registers_t *r, void *data);
@@ -2,13 +2,21 @@
 
 #include <stdint.h>
 
+#include <kernel/radix_tree.h>
+
 #define PCI_CONFIG_ADDR     0xCF8
 #define PCI_CONFIG_DATA     0xCFC
 
+// Index of a function in pci_devices, bus:slot.func packed like the config address
+#define PCI_DEVFN(bus, slot, func) (((uint32_t)(bus) << 8) | ((uint32_t)(slot) << 3) | (uint32_t)(func))
+
 struct pci_device {
     uint32_t vendor;
     uint32_t device;
+    uint32_t bus;
+    uint32_t slot;
     uint32_t func;
+    uint32_t class_id;
 };
 typedef struct pci_device pci_device_t;
 
@@ -19,5 +27,8 @@ uint16_t pci_get_device_class_id(uint16_t bus, uint16_t slot, uint16_t func);
 uint16_t pci_get_device_subclass_id(uint16_t bus, uint16_t slot, uint16_t func);
 void pci_probe();
 void pci_init();
+pci_device_t *pci_get_device(uint16_t bus, uint16_t slot, uint16_t func);
+
+extern radix_tree_t pci_devices;
 
 extern const char* PCI_CLASS_IDS[18];
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include <kernel/kernel.h>
+
+// Mode set through the Bochs/QEMU VBE DISPI interface
+#define FBCON_WIDTH  1024
+#define FBCON_HEIGHT 768
+#define FBCON_BPP    32
+
+#define FBCON_FONT_WIDTH  8
+#define FBCON_FONT_HEIGHT 16
+
+/**
+ * Bochs/QEMU VBE DISPI interface
+ */
+#define VBE_DISPI_IOPORT_INDEX 0x01CE
+#define VBE_DISPI_IOPORT_DATA  0x01CF
+
+#define VBE_DISPI_INDEX_ID          0x0
+#define VBE_DISPI_INDEX_XRES        0x1
+#define VBE_DISPI_INDEX_YRES        0x2
+#define VBE_DISPI_INDEX_BPP         0x3
+#define VBE_DISPI_INDEX_ENABLE      0x4
+#define VBE_DISPI_INDEX_BANK        0x5
+#define VBE_DISPI_INDEX_VIRT_WIDTH  0x6
+#define VBE_DISPI_INDEX_VIRT_HEIGHT 0x7
+#define VBE_DISPI_INDEX_X_OFFSET    0x8
+#define VBE_DISPI_INDEX_Y_OFFSET    0x9
+#define VBE_DISPI_INDEX_VIDEO_MEMORY_64K 0xA
+
+#define VBE_DISPI_ID0 0xB0C0
+#define VBE_DISPI_ID5 0xB0C5    // First version reporting the amount of video memory
+
+#define VBE_DISPI_DISABLED    0x00
+#define VBE_DISPI_ENABLED     0x01
+#define VBE_DISPI_LFB_ENABLED 0x40
+
+#define VBE_DISPI_LFB_PHYSICAL_ADDRESS 0xE0000000 // Used if the PCI device isn't found
+#define VBE_DISPI_PCI_VENDOR 0x1234
+#define VBE_DISPI_PCI_DEVICE 0x1111
+
+k_return_t fbcon_init();
+uint32_t fbcon_columns();
+uint32_t fbcon_rows();
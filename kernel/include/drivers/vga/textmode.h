@@ -32,6 +32,9 @@
  	COLOR_WHITE = 15,
  };
 
+ // Color used for new characters, see vga_textmode_setcolor()
+ extern uint8_t vga_textmode_color;
+
  /**
   * Use fancy bit operations to make color
   * @param  fg foreground color
@@ -73,6 +76,23 @@
   */
  void vga_textmode_scroll();
 
+ /**
+  * Show the previous page of scrollback
+  */
+ void vga_textmode_page_up();
+
+ /**
+  * Show the next page of scrollback, or the live screen after the last one
+  */
+ void vga_textmode_page_down();
+
+ /**
+  * Move the hardware cursor
+  * @param x column of the cursor
+  * @param y row of the cursor
+  */
+ void vga_textmode_set_cursor(size_t x, size_t y);
+
  /**
   * Put character in text-mode buffer
   * @param c character
@@ -92,4 +112,13 @@
 
  void vga_textmode_writebuffer(uint16_t* newbuffer, uint16_t newbuffer_length);
 
+ /**
+  * Copy a run of entries into one row of the text-mode buffer
+  * @param cells entries to copy
+  * @param x     column of the first entry
+  * @param y     row to write to
+  * @param count number of entries, must not run past the end of the row
+  */
+ void vga_textmode_writespan(const uint16_t *cells, size_t x, size_t y, size_t count);
+
  #endif
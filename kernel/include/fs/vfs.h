@@ -4,6 +4,8 @@
 #include <stddef.h>
 
 #include <kernel/kernel.h>
+#include <kernel/hashtable.h>
+#include <kernel/rcu.h>
 
 // fs_inode flags
 #define VFS_FILE        (1<<0)
@@ -106,18 +108,31 @@ typedef struct fs_inode_ops fs_inode_ops_t;
  * Struct that defines a superblock, an instance of a mounted filesystem.
  */
 struct vfs_superblock {
+    rcu_head_t rcu;         // Must be first, used to free the superblock after unmounting
     uint32_t device;        // Device number of filesystem instance
     fs_inode_t *mount_point; // Mountpoint of filesystem instance, or NULL for /
     fs_inode_t *root;       // Root inode of filesystem instance
 };
 typedef struct vfs_superblock vfs_superblock_t;
 
+/**
+ * Snapshot of all mounted filesystem instances. Never modified once
+ * published, changes install a new copy.
+ */
+struct vfs_mount_table {
+    rcu_head_t rcu; // Must be first, used to free the table once replaced
+    uint32_t size;
+    vfs_superblock_t *superblocks[VFS_MAX_SUPERBLOCKS];
+};
+typedef struct vfs_mount_table vfs_mount_table_t;
+
 /**
  * Struct that defines an installed filesystem driver.
- * Used in linked list of all installed fs drivers.
+ * Kept in a hash table of all installed fs drivers, keyed by name.
  */
 struct fs_driver {
-    struct fs_driver *next;
+    rcu_head_t rcu; // Must be first, used to free the driver after uninstalling
+    htable_node_t node;
     /**
      * Name of filesystem driver
      */
@@ -135,7 +150,10 @@ struct fs_driver {
 };
 typedef struct fs_driver fs_driver_t;
 
-void vfs_install_driver(fs_driver_t *driver);
+k_return_t vfs_install_driver(fs_driver_t *driver);
+k_return_t vfs_uninstall_driver(char *name);
 k_return_t vfs_mount(char *driver, uint32_t device, fs_inode_t *mount_point,
                      char *options);
+k_return_t vfs_umount(vfs_superblock_t *superblock);
+vfs_superblock_t *vfs_find_mount(fs_inode_t *mount_point);
 k_return_t vfs_inode_read(fs_inode_t *node, uint32_t offset, uint32_t size, uint8_t *buf);
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/**
+ * Atomic operations with explicit memory ordering
+ *
+ * Thin wrappers around the compiler's __atomic builtins, which follow the
+ * C11 memory model. They work on any naturally aligned integer or pointer
+ * of up to 4 bytes (8 bytes for loads, stores and cmpxchg).
+ *
+ * On i386, plain loads already have acquire and plain stores release
+ * semantics, so the acquire/release variants only constrain the compiler.
+ */
+
+// Compiler-only barrier
+#define barrier() __asm__ __volatile__ ("" : : : "memory")
+
+// Full CPU memory barriers
+#define smp_mb()  __atomic_thread_fence(__ATOMIC_SEQ_CST)
+#define smp_rmb() __atomic_thread_fence(__ATOMIC_ACQUIRE)
+#define smp_wmb() __atomic_thread_fence(__ATOMIC_RELEASE)
+
+#define atomic_load_relaxed(ptr)       __atomic_load_n((ptr), __ATOMIC_RELAXED)
+#define atomic_load_acquire(ptr)       __atomic_load_n((ptr), __ATOMIC_ACQUIRE)
+#define atomic_store_relaxed(ptr, val) __atomic_store_n((ptr), (val), __ATOMIC_RELAXED)
+#define atomic_store_release(ptr, val) __atomic_store_n((ptr), (val), __ATOMIC_RELEASE)
+
+// Read-modify-write operations are fully ordered, returning the old value
+#define atomic_fetch_add(ptr, val) __atomic_fetch_add((ptr), (val), __ATOMIC_SEQ_CST)
+#define atomic_fetch_sub(ptr, val) __atomic_fetch_sub((ptr), (val), __ATOMIC_SEQ_CST)
+#define atomic_fetch_or(ptr, val)  __atomic_fetch_or((ptr), (val), __ATOMIC_SEQ_CST)
+#define atomic_fetch_and(ptr, val) __atomic_fetch_and((ptr), (val), __ATOMIC_SEQ_CST)
+#define atomic_xchg(ptr, val)      __atomic_exchange_n((ptr), (val), __ATOMIC_SEQ_CST)
+
+// Same as above, returning the new value
+#define atomic_add_return(ptr, val) __atomic_add_fetch((ptr), (val), __ATOMIC_SEQ_CST)
+#define atomic_sub_return(ptr, val) __atomic_sub_fetch((ptr), (val), __ATOMIC_SEQ_CST)
+
+#define atomic_inc(ptr) ((void)atomic_fetch_add((ptr), 1))
+#define atomic_dec(ptr) ((void)atomic_fetch_sub((ptr), 1))
+
+// Decrement and return true if the result is 0, e.g. when dropping a reference
+#define atomic_dec_and_test(ptr) (atomic_sub_return((ptr), 1) == 0)
+
+/**
+ * Compare and exchange. If *ptr equals *expected, store desired and return
+ * true. Otherwise copy the current value to *expected and return false.
+ */
+#define atomic_cmpxchg(ptr, expected, desired) \
+    __atomic_compare_exchange_n((ptr), (expected), (desired), false, \
+                                __ATOMIC_SEQ_CST, __ATOMIC_RELAXED)
+
+// Same as atomic_cmpxchg, with acquire ordering on success
+#define atomic_cmpxchg_acquire(ptr, expected, desired) \
+    __atomic_compare_exchange_n((ptr), (expected), (desired), false, \
+                                __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)
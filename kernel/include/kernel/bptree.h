@@ -0,0 +1,68 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include <kernel/kernel.h>
+#include <kernel/ordered_array.h>
+
+/**
+ * B+-tree of objects ordered by a comparator
+ *
+ * Drop-in alternative to ordered_array for sets that grow past a few hundred
+ * objects. Every node holds up to BPTREE_MAX_KEYS keys in a flat array that
+ * is binary searched, so a lookup touches one or two cache lines per level
+ * and the tree stays 3-4 levels deep for any realistic size. All objects live
+ * in the leaves, which are linked together for in-order iteration.
+ *
+ * Keys must be unique under the comparator. The tree only stores pointers and
+ * never frees the objects themselves.
+ */
+
+#define BPTREE_MAX_KEYS 31 // Keys per node, the key array fills two cache lines
+#define BPTREE_MIN_KEYS (BPTREE_MAX_KEYS / 2)
+
+struct bptree_node {
+    bool leaf;
+    uint32_t nr_keys;
+    // One extra slot each so that a node can overflow before it is split
+    void *keys[BPTREE_MAX_KEYS + 1];
+    struct bptree_node *children[BPTREE_MAX_KEYS + 2]; // Internal nodes only
+    struct bptree_node *next;                          // Leaves only, next leaf in order
+};
+typedef struct bptree_node bptree_node_t;
+
+struct bptree {
+    bptree_node_t *root;
+    uint32_t size;          // Number of objects in the tree
+    comparator_t comparator;
+};
+typedef struct bptree bptree_t;
+
+/**
+ * Position of an object in the tree. Invalidated by any insert or remove.
+ */
+struct bptree_iter {
+    bptree_node_t *leaf;
+    uint32_t index;
+};
+typedef struct bptree_iter bptree_iter_t;
+
+void bptree_init(bptree_t *tree, comparator_t comparator);
+void bptree_destroy(bptree_t *tree);
+k_return_t bptree_insert(bptree_t *tree, void *object);
+void *bptree_find(bptree_t *tree, void *key);
+void *bptree_remove(bptree_t *tree, void *key);
+void *bptree_first(bptree_t *tree, bptree_iter_t *iter);
+void *bptree_lower_bound(bptree_t *tree, void *key, bptree_iter_t *iter);
+void *bptree_next(bptree_iter_t *iter);
+k_return_t bptree_verify(bptree_t *tree);
+
+/**
+ * Iterate over every object in the tree in order
+ * @param tree bptree_t to walk
+ * @param iter bptree_iter_t to use as the cursor
+ * @param obj  variable to assign each object to
+ */
+#define bptree_for_each(tree, iter, obj) \
+    for ((obj) = bptree_first((tree), (iter)); (obj); (obj) = bptree_next((iter)))
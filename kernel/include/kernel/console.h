@@ -0,0 +1,48 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#include <kernel/kernel.h>
+
+/**
+ * Console output
+ *
+ * Everything written to stdout by the kernel is passed to every registered
+ * sink. The VGA text console is registered from the start, other sinks
+ * (e.g. a serial port) are added by their drivers once the hardware is set
+ * up, and a sink that takes over the screen replaces it.
+ */
+
+#define CONSOLE_MAX_SINKS 4
+
+// Colours are VGA text attributes, see make_color()
+#define CONSOLE_COLOR_DEFAULT 0x07 // Light grey on black
+
+struct console_sink {
+    const char *name;
+    // Write characters. May be called from any context, but must not block.
+    void (*write)(const char *data, size_t length);
+    // Write characters without relying on interrupts or locks, used once the
+    // kernel is going down. NULL if write() already works that way.
+    void (*write_panic)(const char *data, size_t length);
+    // Scroll back through and forward again through past output, NULL if
+    // the sink has no scrollback
+    void (*page_up)();
+    void (*page_down)();
+    // Set the colour of the characters written after this, NULL if the
+    // sink can't show colours
+    void (*set_color)(uint8_t color);
+};
+typedef struct console_sink console_sink_t;
+
+extern console_sink_t console_vga;
+
+k_return_t console_register(console_sink_t *sink);
+k_return_t console_replace(console_sink_t *old, console_sink_t *sink);
+void console_write(const char *data, size_t length);
+void console_write_color(const char *data, size_t length, uint8_t color);
+void console_page_up();
+void console_page_down();
+void console_panic();
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include <kernel/kernel.h>
+#include <kernel/rbtree.h>
+
+/**
+ * Tree of non-overlapping regions [start, end) in an address range
+ *
+ * Every region records the size of the free gap before it, and the tree is
+ * augmented with the largest gap in each subtree. Both finding the region
+ * containing an address (e.g. on a fault) and finding the lowest free gap
+ * that fits an allocation take O(log n).
+ */
+
+struct gap_node {
+    rb_node_t rb;
+    uint32_t start;         // First address of the region
+    uint32_t end;           // First address after the region
+    uint32_t gap;           // Free space between the previous region (or base) and start
+    uint32_t subtree_gap;   // Largest gap in this subtree, maintained by the tree
+};
+typedef struct gap_node gap_node_t;
+
+struct gap_tree {
+    rb_root_t root;
+    uint32_t base;          // First address regions may use
+    uint32_t limit;         // First address after the range, 0 for the end of the address space
+};
+typedef struct gap_tree gap_tree_t;
+
+void gap_tree_init(gap_tree_t *tree, uint32_t base, uint32_t limit);
+k_return_t gap_tree_insert(gap_tree_t *tree, gap_node_t *node);
+void gap_tree_remove(gap_tree_t *tree, gap_node_t *node);
+gap_node_t *gap_tree_find(gap_tree_t *tree, uint32_t addr);
+k_return_t gap_tree_alloc(gap_tree_t *tree, gap_node_t *node, uint32_t size, uint32_t align);
+k_return_t gap_tree_verify(gap_tree_t *tree);
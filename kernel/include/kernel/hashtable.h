@@ -0,0 +1,80 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#include <kernel/kernel.h>
+#include <kernel/rcu.h>
+#include <kernel/spinlock.h>
+
+/**
+ * Resizable intrusive hash table with chained buckets
+ *
+ * Objects embed an htable_node_t and are hashed by the caller. The bucket
+ * array doubles when the average chain grows past HTABLE_MAX_LOAD and halves
+ * when the table gets sparse. Instead of rehashing everything at once, the
+ * old array is kept next to the new one and a few buckets are moved over on
+ * every insert or remove, so no single update pays for the whole resize.
+ *
+ * Lookups only take rcu_read_lock() and may run alongside any update.
+ * Moving a node between arrays, or swapping in a new array, bumps a sequence
+ * count that makes concurrent lookups retry. Removed objects must not be freed until a grace period has
+ * passed, e.g. with call_rcu().
+ */
+
+#define HTABLE_MIN_SIZE     8 // Smallest bucket array, must be a power of two
+#define HTABLE_MAX_LOAD     2 // Grow when there are more entries than this per bucket
+#define HTABLE_MIGRATE_STEP 4 // Old buckets moved to the new array per update
+
+struct htable_node {
+    struct htable_node *next;
+    uint32_t hash;
+};
+typedef struct htable_node htable_node_t;
+
+struct htable_array {
+    rcu_head_t rcu;                     // Must be first, used to free a replaced array
+    uint32_t mask;                      // Number of buckets - 1
+    htable_node_t *buckets[];
+};
+typedef struct htable_array htable_array_t;
+
+struct htable {
+    spinlock_t lock;                    // Serializes updates
+    volatile uint32_t seq;              // Odd while nodes are being moved between arrays
+    htable_array_t *array;              // Current bucket array, NULL until the first insert
+    htable_array_t *old;                // Array being migrated from, or NULL
+    uint32_t migrate_pos;               // Next bucket of old to move
+    uint32_t count;                     // Number of entries
+};
+typedef struct htable htable_t;
+
+#define HTABLE_INIT { .lock = SPINLOCK_INIT, .seq = 0, .array = NULL, .old = NULL, .migrate_pos = 0, .count = 0 }
+
+/**
+ * Function used by lookups to tell whether a node with a matching hash is
+ * the one being looked for
+ * @param node candidate node
+ * @param key  key passed to htable_lookup()
+ * @return true if the node matches the key
+ */
+typedef bool (*htable_match_t)(htable_node_t *node, const void *key);
+
+void htable_init(htable_t *ht);
+void htable_destroy(htable_t *ht);
+k_return_t htable_insert(htable_t *ht, htable_node_t *node, uint32_t hash);
+bool htable_remove(htable_t *ht, htable_node_t *node);
+htable_node_t *htable_lookup(htable_t *ht, uint32_t hash, htable_match_t match, const void *key);
+
+uint32_t hash_fnv1a(const void *data, size_t length);
+uint32_t hash_fnv1a_str(const char *str);
+
+/**
+ * Hash a 32-bit integer by Fibonacci multiplication. The high bits are the
+ * well-mixed ones, so they are folded down into the bits used for indexing.
+ */
+static inline uint32_t hash_u32(uint32_t x) {
+    x *= 0x9E3779B9;
+    return x ^ (x >> 16);
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include <kernel/kernel.h>
+#include <kernel/rbtree.h>
+
+/**
+ * Interval tree of closed ranges [start, last], which may overlap
+ *
+ * Nodes are ordered by start and augmented with the highest last in their
+ * subtree, which lets queries skip every subtree that ends before the range
+ * being looked for. Finding the overlapping intervals takes O(log n) plus
+ * O(log n) per interval returned.
+ */
+
+struct interval_node {
+    rb_node_t rb;
+    uint32_t start;         // First value covered
+    uint32_t last;          // Last value covered
+    uint32_t subtree_last;  // Highest last in this subtree, maintained by the tree
+};
+typedef struct interval_node interval_node_t;
+
+void interval_tree_insert(rb_root_t *root, interval_node_t *node);
+void interval_tree_remove(rb_root_t *root, interval_node_t *node);
+interval_node_t *interval_tree_iter_first(rb_root_t *root, uint32_t start, uint32_t last);
+interval_node_t *interval_tree_iter_next(interval_node_t *node, uint32_t start, uint32_t last);
+k_return_t interval_tree_verify(rb_root_t *root);
+
+// Iterate over every interval overlapping [start, last], in order of start
+#define interval_tree_for_each(pos, root, start, last)              \
+    for ((pos) = interval_tree_iter_first((root), (start), (last)); \
+         (pos);                                                     \
+         (pos) = interval_tree_iter_next((pos), (start), (last)))
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <stdint.h>
+#include <stddef.h>
 #include <stdlib.h>
 
 /**
@@ -21,22 +22,18 @@ typedef int32_t k_return_t;
 
 
 /**
- * Spinlock macros
- * See: wiki.osdev.org/Spinlock
+ * Math macros
  */
-#define SPINLOCK_DECLARE(name) volatile int name ## Locked
-#define SPINLOCK_LOCK(name) \
-	while (!__sync_bool_compare_and_swap(& name ## Locked, 0, 1)); \
-	__sync_synchronize();
-#define SPINLOCK_UNLOCK(name) \
-	__sync_synchronize(); \
-	name ## Locked = 0;
-
+#define DIV_ROUND_UP(a,b) ((((a) - 1) / (b)) + 1)
 
 /**
- * Math macros
+ * Get a pointer to the structure containing a member
+ * @param ptr    pointer to the member
+ * @param type   type of the containing structure
+ * @param member name of the member within the structure
  */
-#define DIV_ROUND_UP(a,b) ((((a) - 1) / (b)) + 1)
+#define container_of(ptr, type, member) \
+    ((type *)((uintptr_t)(ptr) - offsetof(type, member)))
 
 // "Beautiful" C11 generic MAX() macro implementation
 #define max_impl_custom(T, name) \
@@ -79,6 +76,7 @@ max_impl_custom(unsigned long long, ulonglong)
     do {                       \
         if (!(x)) {            \
             printk_debug("ASSERT failed: %s at %s:%d", #x, __FILE__, __LINE__);\
+            printk_panic();    \
             abort();           \
         }                      \
     } while (0)
@@ -86,6 +84,7 @@ max_impl_custom(unsigned long long, ulonglong)
 #define PANIC(reason)                   \
     do {                                \
         printk_debug("PANIC: %s at %s:%d\n", reason, __FILE__, __LINE__); \
+        printk_panic();                 \
         abort();                        \
     } while (0)
 
@@ -103,3 +102,4 @@ max_impl_custom(unsigned long long, ulonglong)
 
 void kernel_task();
 void printk_debug(char *fmt, ...);
+void printk_panic();
@@ -3,8 +3,12 @@
 #include <stdint.h>
 #include <stddef.h>
 
-#define STDIN_MAX_BUFFER 256
-#define STDOUT_MAX_BUFFER 256
+#define STDIN_RING_SIZE 256    // Must be a power of two
+#define STDOUT_RING_SIZE 4096  // Must be a power of two
+#define STDOUT_MAX_BUFFER 256  // Most returned by one kernel_buffer_stdout_get()
+
+extern uint32_t kernel_buffer_stdin_dropped;
+extern uint32_t kernel_buffer_stdout_dropped;
 
 /**
  * Get stdout buffer and flush
@@ -14,6 +18,8 @@
 uint16_t kernel_buffer_stdout_get(char *buffer);
 
 void kernel_buffer_stdin_writechar(char c);
+char kernel_buffer_stdin_getchar();
+size_t kernel_buffer_stdin_read(char *buffer, size_t length);
 void kernel_buffer_stdout_writechar(char c);
 
 void kernel_buffer_stdout_writestring(char *str, size_t length);
@@ -1 +1,61 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include <kernel/kernel.h>
+#include <kernel/sched.h>
+
+#define KTHREAD_STACK_SIZE 0x4000 // Size of each kernel thread's stack
+#define KTHREAD_NAME_LENGTH 16
+
+// Kernel thread flags
+#define KTHREAD_DETACHED (1<<0) // Thread will be reaped on exit instead of joined
+#define KTHREAD_IDLE     (1<<1) // Thread is the idle thread
+
+enum kthread_state {
+    KTHREAD_RUNNING, // Currently executing
+    KTHREAD_READY,   // Waiting on the run queue
+    KTHREAD_BLOCKED, // Waiting for an event, not on the run queue
+    KTHREAD_ZOMBIE   // Exited, waiting to be joined/reaped
+};
+
+/**
+ * Struct that defines a single kernel thread
+ */
+struct kthread {
+    uint32_t tid;                  // Unique thread ID
+    enum kthread_state state;      // Current scheduling state
+    uint32_t flags;                // KTHREAD_* flags
+    char name[KTHREAD_NAME_LENGTH];
+
+    uint32_t esp;                  // Saved stack pointer while switched out
+    void *stack;                   // Base of stack allocation, or NULL for the boot thread
+
+    void *(*entry)(void *);        // Thread entry point
+    void *arg;                     // Argument passed to entry point
+    void *retval;                  // Value returned by entry point or passed to kernel_thread_exit
+
+    sched_info_t sched;            // Scheduling state and accounting
+
+    struct kthread *joiner;        // Thread blocked in kernel_thread_join on this thread
+    struct kthread *next;          // Link in run queue/zombie list
+};
+typedef struct kthread kthread_t;
+
+void kernel_thread_init();
+__attribute__((__noreturn__))
+void kernel_thread_init_ap(uint32_t cpu, void *stack);
+kthread_t *kernel_thread_create(const char *name, void *(*entry)(void *), void *arg);
+kthread_t *kernel_thread_create_on(uint32_t cpu, const char *name, void *(*entry)(void *), void *arg);
+__attribute__((__noreturn__))
+void kernel_thread_exit(void *retval);
+k_return_t kernel_thread_join(kthread_t *thread, void **retval);
+void kernel_thread_detach(kthread_t *thread);
+kthread_t *kernel_thread_current();
+void kernel_thread_yield();
+void kernel_thread_block();
+void kernel_thread_wake(kthread_t *thread);
+void kernel_thread_preempt();
 void kernel_thread_sleep(uint32_t seconds);
+void kernel_thread_sleep_ms(uint32_t ms);
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include <kernel/kernel.h>
+
+/**
+ * Lock-free LIFO of intrusive nodes
+ *
+ * The top pointer is paired with a tag that changes on every update, and
+ * both are swapped together with cmpxchg8b. A pop that read top == A and
+ * A->next == B therefore fails if A was popped and pushed back in between,
+ * instead of installing a stale B (the ABA problem).
+ *
+ * A pop may still read ->next of a node another CPU has just popped, so
+ * nodes must stay mapped while the stack is in use, e.g. by only ever
+ * recycling them through stacks.
+ */
+
+struct lfstack_node {
+    struct lfstack_node *next;
+};
+typedef struct lfstack_node lfstack_node_t;
+
+union lfstack {
+    struct {
+        lfstack_node_t *top;
+        uint32_t tag;
+    };
+    uint64_t value;
+} __attribute__((aligned(8)));
+typedef union lfstack lfstack_t;
+
+#define LFSTACK_INIT { .value = 0 }
+
+void lfstack_init(lfstack_t *stack);
+void lfstack_push(lfstack_t *stack, lfstack_node_t *node);
+lfstack_node_t *lfstack_pop(lfstack_t *stack);
+lfstack_node_t *lfstack_pop_all(lfstack_t *stack);
+
+static inline bool lfstack_empty(lfstack_t *stack) {
+    return ((volatile lfstack_t *)stack)->top == NULL;
+}
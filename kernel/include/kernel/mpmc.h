@@ -0,0 +1,37 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include <kernel/kernel.h>
+
+/**
+ * Bounded lock-free multi-producer/multi-consumer queue of pointers
+ *
+ * Every slot carries a sequence number telling whose turn it is. A producer
+ * owns slot pos once its sequence equals pos and hands it to consumers by
+ * setting it to pos + 1. A consumer owns it at pos + 1 and gives it back
+ * for the next lap by setting it to pos + size. Producers and consumers only
+ * contend on their own position counter.
+ */
+
+#define MPMC_CACHELINE 64
+
+struct mpmc_cell {
+    volatile uint32_t seq;
+    void *data;
+};
+
+struct mpmc_queue {
+    struct mpmc_cell *cells;
+    uint32_t mask; // Size - 1
+
+    volatile uint32_t enqueue_pos __attribute__((aligned(MPMC_CACHELINE)));
+    volatile uint32_t dequeue_pos __attribute__((aligned(MPMC_CACHELINE)));
+} __attribute__((aligned(MPMC_CACHELINE)));
+typedef struct mpmc_queue mpmc_queue_t;
+
+k_return_t mpmc_queue_init(mpmc_queue_t *q, uint32_t size);
+void mpmc_queue_destroy(mpmc_queue_t *q);
+bool mpmc_enqueue(mpmc_queue_t *q, void *data);
+bool mpmc_dequeue(mpmc_queue_t *q, void **out);
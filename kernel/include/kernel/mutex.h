@@ -0,0 +1,34 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include <kernel/kernel.h>
+#include <kernel/wait.h>
+
+#define MUTEX_PRIO_INHERIT // Change to undef to disable priority inheritance
+
+#define MUTEX_SPIN_LIMIT 1000 // Spins to wait for a running owner before sleeping
+
+/**
+ * Sleeping mutex. Callers spin for a short while if the owner is running on
+ * another CPU and sleep otherwise. Ownership is handed directly to the
+ * longest waiting thread, so waiters acquire the mutex in FIFO order.
+ *
+ * With MUTEX_PRIO_INHERIT, the owner runs at the priority of its highest
+ * priority waiter until it unlocks. Boosts don't follow chains of mutexes,
+ * and releasing a mutex drops any boost the owner had.
+ */
+struct mutex {
+    struct kthread *owner;  // Thread holding the mutex, NULL if unlocked
+    wait_queue_t waiters;   // Threads sleeping on the mutex, its lock serializes hand-over
+};
+typedef struct mutex mutex_t;
+
+#define MUTEX_INIT { .owner = NULL, .waiters = WAIT_QUEUE_INIT }
+
+void mutex_init(mutex_t *mutex);
+void mutex_lock(mutex_t *mutex);
+bool mutex_trylock(mutex_t *mutex);
+void mutex_unlock(mutex_t *mutex);
+bool mutex_is_locked(mutex_t *mutex);
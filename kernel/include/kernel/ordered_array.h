@@ -21,6 +21,8 @@ typedef struct ordered_array ordered_array_t;
 
 int32_t comparator_default(void *a, void *b);
 ordered_array_t ordered_array_create(void *addr, uint32_t max_size, comparator_t comparator);
+uint32_t ordered_array_lower_bound(ordered_array_t *array, void *key);
+bool ordered_array_find(ordered_array_t *array, void *key, uint32_t *index);
 bool ordered_array_insert(ordered_array_t *array, void *object);
 void *ordered_array_get(ordered_array_t *array, uint32_t index);
 bool ordered_array_remove(ordered_array_t *array, uint32_t index);
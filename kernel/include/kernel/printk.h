@@ -0,0 +1,75 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdarg.h>
+
+#include <kernel/kernel.h>
+#include <kernel/timer.h>
+
+/**
+ * Kernel log
+ *
+ * printk() formats a message into a record in the calling CPU's log ring
+ * and returns, without touching the console. Writers never take a lock: a
+ * ring only has writers on its own CPU, and the console consumer detects
+ * records that were overwritten while it read them. When a ring is full
+ * the oldest records are overwritten, so the rings always hold the most
+ * recent history for printk_dump().
+ *
+ * Once printk_start_consumer() has run, a kernel thread drains the rings to
+ * the console in timestamp order, rate limited so that a flood of messages
+ * can't monopolize the console. Before that, and after printk_panic(),
+ * every printk() is printed synchronously.
+ */
+
+#define LOG_RING_RECORDS   64   // Records per CPU, must be a power of two
+#define LOG_TEXT_MAX       112  // Longest message kept, including the NUL
+#define LOG_SUBSYS_MAX     8    // Longest subsystem name kept, including the NUL
+
+#define LOG_CONSOLE_POLL_MS 20  // How often the consumer checks for new records
+#define LOG_CONSOLE_RATE    100 // Records per second printed once the burst is used up
+#define LOG_CONSOLE_BURST   200 // Records that may be printed back to back
+
+enum log_level {
+    LOG_EMERG,   // System is unusable
+    LOG_ALERT,
+    LOG_CRIT,
+    LOG_ERR,     // Records up to here are never rate limited
+    LOG_WARNING,
+    LOG_NOTICE,
+    LOG_INFO,
+    LOG_DEBUG
+};
+
+struct log_record {
+    volatile uint32_t seq;      // Slot number + 1 once written, 0 while being written
+    uint8_t level;              // enum log_level
+    uint8_t cpu;                // CPU that logged the message
+    uint16_t length;            // Length of text
+    ktime_t timestamp;          // ktime_get() when the message was logged
+    char subsys[LOG_SUBSYS_MAX];
+    char text[LOG_TEXT_MAX];
+};
+typedef struct log_record log_record_t;
+
+/**
+ * Log ring of one CPU
+ */
+struct log_ring {
+    volatile uint32_t head;     // Number of slots ever reserved by writers
+    uint32_t tail;              // Next slot for the console consumer
+    log_record_t records[LOG_RING_RECORDS];
+};
+typedef struct log_ring log_ring_t;
+
+extern uint32_t printk_dropped;     // Records overwritten before the console saw them
+extern uint32_t printk_suppressed;  // Records skipped by console rate limiting
+
+void printk(uint32_t level, const char *subsys, const char *fmt, ...);
+void vprintk(uint32_t level, const char *subsys, const char *fmt, va_list args);
+void printk_start_consumer();
+void printk_percpu_init(uintptr_t offset);
+void printk_flush();
+void printk_dump();
+void printk_panic();
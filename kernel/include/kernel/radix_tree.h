@@ -0,0 +1,88 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include <kernel/kernel.h>
+#include <kernel/rcu.h>
+#include <kernel/spinlock.h>
+
+/**
+ * Radix tree mapping 32-bit indices to pointers
+ *
+ * Every node covers 6 bits of the index with 64 slots, so a lookup walks at
+ * most 6 levels and the tree only grows as tall as the largest index needs.
+ * Nodes are allocated on demand and freed as soon as they are empty, so
+ * memory use follows the number of populated entries rather than the range
+ * of indices.
+ *
+ * Entries can carry RADIX_TREE_MAX_TAGS independent marks. Every node keeps
+ * a bitmap per tag of the slots below it that contain a tagged entry, which
+ * lets tagged iteration skip whole untagged subtrees.
+ *
+ * Lookups and iteration only need rcu_read_lock() and may run alongside any
+ * update. Updates are serialized by the tree's lock. Entries must not be
+ * NULL, and a removed entry may still be returned to concurrent readers
+ * until the end of the current grace period.
+ */
+
+#define RADIX_TREE_MAP_SHIFT 6
+#define RADIX_TREE_MAP_SIZE  (1 << RADIX_TREE_MAP_SHIFT)
+#define RADIX_TREE_MAP_MASK  (RADIX_TREE_MAP_SIZE - 1)
+
+#define RADIX_TREE_TAG_DIRTY     0
+#define RADIX_TREE_TAG_WRITEBACK 1
+#define RADIX_TREE_MAX_TAGS      2
+
+struct radix_tree_node {
+    rcu_head_t rcu;                     // Used to free the node after readers are done
+    struct radix_tree_node *parent;
+    uint8_t shift;                      // Index bits below this level, 0 for leaves
+    uint8_t offset;                     // Slot in the parent
+    uint8_t count;                      // Number of non-NULL slots
+    uint64_t tags[RADIX_TREE_MAX_TAGS]; // Slots with a tagged entry somewhere below
+    void *slots[RADIX_TREE_MAP_SIZE];   // Child nodes, or entries in leaves
+};
+typedef struct radix_tree_node radix_tree_node_t;
+
+struct radix_tree {
+    spinlock_t lock;                    // Serializes updates
+    radix_tree_node_t *root;            // NULL while the tree is empty
+};
+typedef struct radix_tree radix_tree_t;
+
+#define RADIX_TREE_INIT { .lock = SPINLOCK_INIT, .root = NULL }
+
+void radix_tree_init(radix_tree_t *tree);
+k_return_t radix_tree_insert(radix_tree_t *tree, uint32_t index, void *entry);
+void *radix_tree_lookup(radix_tree_t *tree, uint32_t index);
+void *radix_tree_delete(radix_tree_t *tree, uint32_t index);
+void *radix_tree_tag_set(radix_tree_t *tree, uint32_t index, uint32_t tag);
+void *radix_tree_tag_clear(radix_tree_t *tree, uint32_t index, uint32_t tag);
+bool radix_tree_tag_get(radix_tree_t *tree, uint32_t index, uint32_t tag);
+bool radix_tree_tagged(radix_tree_t *tree, uint32_t tag);
+void *radix_tree_next(radix_tree_t *tree, uint32_t *index, uint32_t last);
+void *radix_tree_next_tagged(radix_tree_t *tree, uint32_t *index, uint32_t last, uint32_t tag);
+
+/**
+ * Iterate over the entries with indices in [first, last] in order. Must be
+ * used inside rcu_read_lock() or with the tree's lock held.
+ * @param tree  radix_tree_t to walk
+ * @param index uint32_t variable set to each entry's index
+ * @param entry variable to assign each entry to
+ * @param first first index to visit
+ * @param last  last index to visit, may be UINT32_MAX
+ */
+#define radix_tree_for_each(tree, index, entry, first, last)                    \
+    for (bool __rt_more = ((index) = (first), true);                            \
+         __rt_more && ((entry) = radix_tree_next((tree), &(index), (last)));    \
+         __rt_more = (index)++ != (last))
+
+/**
+ * Iterate over the entries carrying a tag with indices in [first, last]
+ */
+#define radix_tree_for_each_tagged(tree, index, entry, first, last, tag)        \
+    for (bool __rt_more = ((index) = (first), true);                            \
+         __rt_more &&                                                           \
+         ((entry) = radix_tree_next_tagged((tree), &(index), (last), (tag)));   \
+         __rt_more = (index)++ != (last))
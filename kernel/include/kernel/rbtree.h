@@ -0,0 +1,81 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#include <kernel/kernel.h>
+
+/**
+ * Intrusive red-black tree
+ *
+ * Objects embed an rb_node_t. The tree doesn't know how they are ordered:
+ * callers walk down from the root to find where a new node belongs, link it
+ * there with rb_link_node() and then rebalance with rb_insert_color().
+ *
+ * Augmented trees keep a value in every node that summarizes its subtree,
+ * e.g. the maximum end of an interval tree. The rb_augment_t passed to
+ * insert/erase recomputes it from the node and its children and is called
+ * on every node whose subtree changes.
+ */
+
+struct rb_node {
+    struct rb_node *parent;
+    struct rb_node *left;
+    struct rb_node *right;
+    bool red;
+};
+typedef struct rb_node rb_node_t;
+
+struct rb_root {
+    rb_node_t *node;
+};
+typedef struct rb_root rb_root_t;
+
+#define RB_ROOT_INIT { .node = NULL }
+
+#define rb_entry(ptr, type, member) container_of(ptr, type, member)
+
+/**
+ * Recompute a node's augmented value from itself and its children
+ * @param node node to act on
+ * @return true if the value changed
+ */
+typedef bool (*rb_augment_t)(rb_node_t *node);
+
+/**
+ * Order two nodes, for rb_verify()
+ * @return <0, 0 or >0 if a sorts before, equal to or after b
+ */
+typedef int (*rb_cmp_t)(const rb_node_t *a, const rb_node_t *b);
+
+void rb_insert_color(rb_root_t *root, rb_node_t *node, rb_augment_t augment);
+void rb_erase(rb_root_t *root, rb_node_t *node, rb_augment_t augment);
+void rb_augment_propagate(rb_node_t *node, rb_augment_t augment);
+rb_node_t *rb_first(const rb_root_t *root);
+rb_node_t *rb_last(const rb_root_t *root);
+rb_node_t *rb_next(const rb_node_t *node);
+rb_node_t *rb_prev(const rb_node_t *node);
+k_return_t rb_verify(const rb_root_t *root, rb_cmp_t cmp, rb_augment_t augment);
+
+/**
+ * Link a new node into the tree as a leaf, before rb_insert_color()
+ * @param node   node to link
+ * @param parent node it becomes a child of, or NULL if the tree is empty
+ * @param link   &parent->left, &parent->right or &root->node
+ */
+static inline void rb_link_node(rb_node_t *node, rb_node_t *parent, rb_node_t **link) {
+    node->parent = parent;
+    node->left = NULL;
+    node->right = NULL;
+    node->red = true;
+    *link = node;
+}
+
+static inline bool rb_empty(const rb_root_t *root) {
+    return root->node == NULL;
+}
+
+// Iterate in order over every node of a tree. The current node must not be erased.
+#define rb_for_each(pos, root) \
+    for ((pos) = rb_first(root); (pos); (pos) = rb_next(pos))
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include <kernel/kernel.h>
+#include <kernel/atomic.h>
+#include <kernel/sched.h>
+
+/**
+ * Read-copy-update
+ *
+ * Readers of RCU-protected data only disable preemption. Writers publish new
+ * versions with rcu_assign_pointer() and free old ones with call_rcu() or
+ * after synchronize_rcu(), once every CPU has passed through a quiescent
+ * state (a context switch, or a timer tick outside a read-side section),
+ * at which point no reader can still hold a reference.
+ */
+
+/**
+ * Callback queued by call_rcu, usually embedded in the object to free
+ */
+struct rcu_head {
+    struct rcu_head *next;
+    void (*func)(struct rcu_head *head);
+};
+typedef struct rcu_head rcu_head_t;
+
+/**
+ * Begin a read-side critical section. Nests. Must not block inside.
+ */
+static inline void rcu_read_lock() {
+    preempt_disable();
+}
+
+static inline void rcu_read_unlock() {
+    preempt_enable();
+}
+
+// Read an RCU-protected pointer inside a read-side critical section
+#define rcu_dereference(p) atomic_load_acquire(&(p))
+
+// Publish a new version of an RCU-protected pointer
+#define rcu_assign_pointer(p, v) atomic_store_release(&(p), (v))
+
+DECLARE_PER_CPU(uint32_t, rcu_passed_qs);
+
+/**
+ * Record a quiescent state on the calling CPU
+ */
+static inline void rcu_note_qs() {
+    this_cpu_write(rcu_passed_qs, 1);
+}
+
+void call_rcu(rcu_head_t *head, void (*func)(rcu_head_t *head));
+void synchronize_rcu();
+void rcu_tick(bool quiescent);
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#include <kernel/kernel.h>
+#include <kernel/atomic.h>
+
+/**
+ * Lock-free single-producer/single-consumer byte ring buffer
+ *
+ * One context may write and one other context may read at the same time
+ * without any locking, e.g. an interrupt handler feeding a thread. Several
+ * producers or several consumers must serialize among themselves.
+ *
+ * head and tail are free-running counters, only reduced modulo the size when
+ * indexing, so a full buffer can be told apart from an empty one. Each side
+ * owns one of them, on its own cache line, and only reads the other.
+ */
+
+#define RINGBUF_CACHELINE 64
+
+struct ringbuf;
+typedef void (*ringbuf_notify_t)(struct ringbuf *rb);
+
+struct ringbuf {
+    // Read-only after ringbuf_init()
+    uint8_t *data;
+    uint32_t mask;              // Size - 1
+    ringbuf_notify_t on_data;   // Called by the producer after adding data, or NULL
+    ringbuf_notify_t on_space;  // Called by the consumer after removing data, or NULL
+    void *priv;                 // For use by the hooks
+
+    // Written by the producer only
+    volatile uint32_t head __attribute__((aligned(RINGBUF_CACHELINE)));
+
+    // Written by the consumer only
+    volatile uint32_t tail __attribute__((aligned(RINGBUF_CACHELINE)));
+} __attribute__((aligned(RINGBUF_CACHELINE)));
+typedef struct ringbuf ringbuf_t;
+
+k_return_t ringbuf_init(ringbuf_t *rb, void *buffer, uint32_t size);
+void ringbuf_set_hooks(ringbuf_t *rb, ringbuf_notify_t on_data, ringbuf_notify_t on_space, void *priv);
+uint32_t ringbuf_write(ringbuf_t *rb, const void *src, uint32_t len);
+uint32_t ringbuf_read(ringbuf_t *rb, void *dst, uint32_t len);
+void ringbuf_discard(ringbuf_t *rb);
+
+static inline uint32_t ringbuf_size(ringbuf_t *rb) {
+    return rb->mask + 1;
+}
+
+/**
+ * Number of bytes waiting to be read. Exact for the consumer, a lower bound
+ * for anyone else.
+ */
+static inline uint32_t ringbuf_count(ringbuf_t *rb) {
+    return atomic_load_acquire(&rb->head) - atomic_load_acquire(&rb->tail);
+}
+
+/**
+ * Number of bytes that can be written. Exact for the producer, a lower bound
+ * for anyone else.
+ */
+static inline uint32_t ringbuf_space(ringbuf_t *rb) {
+    return ringbuf_size(rb) - ringbuf_count(rb);
+}
+
+static inline bool ringbuf_empty(ringbuf_t *rb) {
+    return ringbuf_count(rb) == 0;
+}
+
+/**
+ * Write a single byte
+ * @return true if written, false if the buffer is full
+ */
+static inline bool ringbuf_put(ringbuf_t *rb, uint8_t c) {
+    return ringbuf_write(rb, &c, 1) == 1;
+}
+
+/**
+ * Read a single byte
+ * @param[out] out byte read
+ * @return true if a byte was read, false if the buffer is empty
+ */
+static inline bool ringbuf_get(ringbuf_t *rb, uint8_t *out) {
+    return ringbuf_read(rb, out, 1) == 1;
+}
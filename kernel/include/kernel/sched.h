@@ -0,0 +1,205 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include <kernel/kernel.h>
+#include <kernel/atomic.h>
+#include <kernel/spinlock.h>
+
+#include <arch/i386/percpu.h>
+
+/**
+ * O(1) priority scheduler
+ *
+ * Priorities range from 0 (highest) to SCHED_PRIO_MAX-1 (lowest). Each
+ * priority level has its own FIFO run queue, and a bitmap of non-empty queues
+ * lets the next thread be found with a single bsf, independent of the number
+ * of runnable threads.
+ *
+ * Every CPU has its own run queue. Threads are placed on the least loaded CPU
+ * when created and stay there for the rest of their life.
+ */
+
+#define SCHED_PRIO_MAX       32 // Number of priority levels (one bitmap word)
+#define SCHED_RT_PRIO_MAX    16 // Priorities 0-15 are reserved for real-time threads
+#define SCHED_FAIR_PRIO_MIN  16 // Priorities 16-31 are used by fair threads
+#define SCHED_DEFAULT_PRIO   24 // Default priority of new fair threads
+
+#define SCHED_RR_TIMESLICE   10 // Timer ticks per round-robin slice
+
+// Fair time slice for a priority: 32 ticks at priority 16 down to 2 at 31
+#define SCHED_FAIR_TIMESLICE(prio) ((SCHED_PRIO_MAX - (prio)) * 2)
+
+// Layout of the per-CPU preemption count
+#define SCHED_PREEMPT_MASK   0x0000FFFF // Nesting depth of preempt_disable()
+#define SCHED_HARDIRQ_OFFSET 0x00010000 // Added while running an interrupt handler
+
+enum sched_policy {
+    SCHED_POLICY_FIFO, // Real-time, runs until it blocks or yields
+    SCHED_POLICY_RR,   // Real-time, round-robin among equal priorities
+    SCHED_POLICY_FAIR  // Time-sliced, lower priorities get shorter slices
+};
+
+struct kthread;
+struct sched_rq;
+
+/**
+ * Per-thread scheduling state and accounting
+ */
+struct sched_info {
+    enum sched_policy policy;
+    uint32_t prio;                  // Current priority
+    enum sched_policy normal_policy; // Policy and priority set for the thread,
+    uint32_t normal_prio;            // without any priority inheritance boost
+    const struct sched_class *class;
+    uint32_t timeslice;             // Remaining ticks in current slice
+    bool expired;                   // Fair thread used up its slice and belongs on the expired array
+    uint32_t cpu;                   // CPU whose run queue the thread belongs to
+    volatile bool on_cpu;           // Thread's context is in use by a CPU, its stack can't be freed
+    bool wakeup_pending;            // Woken while still running, the next block returns immediately
+
+    // Accounting, in TSC cycles
+    uint64_t last_ts;               // When the thread last started running or waiting
+    uint64_t runtime;               // Total time spent running
+    uint64_t wait_time;             // Total time spent runnable but not running
+    uint32_t nr_switches;           // Number of times the thread was switched in
+    uint32_t nr_voluntary;          // Times it gave up the CPU by blocking/exiting
+    uint32_t nr_involuntary;        // Times it was preempted or yielded while runnable
+};
+typedef struct sched_info sched_info_t;
+
+/**
+ * Scheduling policy interface. Classes are consulted in priority order
+ * and the first one with a runnable thread wins.
+ */
+struct sched_class {
+    const char *name;
+    const struct sched_class *next;
+
+    /**
+     * Add a runnable thread to the class's queues
+     * @param rq     run queue to act on
+     * @param thread thread to add
+     */
+    void (*enqueue)(struct sched_rq *rq, struct kthread *thread);
+
+    /**
+     * Remove and return the next thread to run
+     * @param rq run queue to act on
+     * @return next thread, or NULL if the class has nothing runnable
+     */
+    struct kthread *(*pick_next)(struct sched_rq *rq);
+
+    /**
+     * Remove a queued thread, e.g. to change its priority
+     * @param rq     run queue to act on
+     * @param thread thread to remove
+     */
+    void (*dequeue)(struct sched_rq *rq, struct kthread *thread);
+
+    /**
+     * Timer tick while one of this class's threads is running
+     * @param rq     run queue to act on
+     * @param thread currently running thread
+     * @return true if the thread should be preempted
+     */
+    bool (*tick)(struct sched_rq *rq, struct kthread *thread);
+};
+typedef struct sched_class sched_class_t;
+
+/**
+ * FIFO queue of threads sharing a priority
+ */
+struct sched_queue {
+    struct kthread *head;
+    struct kthread *tail;
+};
+
+/**
+ * Set of per-priority queues with a bitmap of the non-empty ones
+ */
+struct sched_prio_array {
+    uint32_t bitmap;
+    uint32_t nr_running;
+    struct sched_queue queues[SCHED_PRIO_MAX];
+};
+typedef struct sched_prio_array sched_prio_array_t;
+
+/**
+ * Run queue
+ */
+struct sched_rq {
+    spinlock_t lock;                     // Protects the queues and all thread states on this CPU
+    uint32_t cpu;                        // CPU this run queue belongs to
+
+    sched_prio_array_t rt;               // Real-time threads
+    sched_prio_array_t fair[2];          // Fair threads, active and expired arrays
+    sched_prio_array_t *fair_active;
+    sched_prio_array_t *fair_expired;
+    uint32_t nr_running;                 // Number of queued threads, excluding current
+
+    struct kthread *current;             // Currently running thread
+    struct kthread *idle;                // Thread to run when nothing else is runnable
+    struct kthread *prev;                // Thread switched away from, released by sched_finish_switch
+    volatile bool need_resched;          // Current thread should be switched out
+    volatile bool polling;               // Idle thread is in MWAIT on need_resched, no IPI needed
+    uint64_t start_ts;                   // When the CPU started scheduling, in TSC cycles
+};
+typedef struct sched_rq sched_rq_t;
+
+// Preemption is only allowed while this CPU's count is 0
+DECLARE_PER_CPU(uint32_t, sched_preempt_count);
+
+extern const sched_class_t sched_rt_class;
+extern const sched_class_t sched_fair_class;
+
+void sched_init(struct kthread *boot, struct kthread *idle);
+void sched_init_cpu(uint32_t cpu, struct kthread *current, struct kthread *idle);
+void sched_info_init(struct kthread *thread, enum sched_policy policy, uint32_t prio);
+struct kthread *sched_current();
+void sched_enqueue(struct kthread *thread);
+void sched_enqueue_on(struct kthread *thread, uint32_t cpu);
+void sched_schedule();
+void sched_finish_switch();
+void sched_yield();
+void sched_block();
+void sched_wake(struct kthread *thread);
+void sched_tick();
+void sched_preempt();
+k_return_t sched_set_policy(struct kthread *thread, enum sched_policy policy, uint32_t prio);
+void sched_boost_prio(struct kthread *thread, uint32_t prio);
+void sched_dump_thread(struct kthread *thread);
+uint64_t sched_total_switches();
+void sched_preempt_resume();
+__attribute__((__noreturn__))
+void sched_idle();
+void sched_cpu_times(uint32_t cpu, uint64_t *idle, uint64_t *busy);
+void sched_dump_cpus();
+
+/**
+ * Keep the current thread from being preempted. Nests. The thread must not
+ * block until preemption is enabled again.
+ */
+static inline void preempt_disable() {
+    this_cpu_inc(sched_preempt_count);
+    barrier();
+}
+
+/**
+ * Undo preempt_disable(), switching threads if a reschedule became pending
+ */
+static inline void preempt_enable() {
+    barrier();
+    this_cpu_add(sched_preempt_count, -1);
+    if (!this_cpu_read(sched_preempt_count)) {
+        sched_preempt_resume();
+    }
+}
+
+/**
+ * Check whether the calling CPU is running an interrupt handler
+ */
+static inline bool in_interrupt() {
+    return this_cpu_read(sched_preempt_count) >= SCHED_HARDIRQ_OFFSET;
+}
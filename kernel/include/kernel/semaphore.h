@@ -0,0 +1,26 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include <kernel/kernel.h>
+#include <kernel/wait.h>
+
+#define SEMAPHORE_SPIN_LIMIT 100 // Spins to wait for a unit before sleeping
+
+/**
+ * Counting semaphore. Units released while threads are waiting are handed
+ * to the longest waiting thread, so waiters are served in FIFO order.
+ */
+struct semaphore {
+    int32_t count;          // Available units
+    wait_queue_t waiters;   // Threads sleeping in sem_down
+};
+typedef struct semaphore semaphore_t;
+
+#define SEMAPHORE_INIT(n) { .count = (n), .waiters = WAIT_QUEUE_INIT }
+
+void sem_init(semaphore_t *sem, int32_t count);
+void sem_down(semaphore_t *sem);
+bool sem_trydown(semaphore_t *sem);
+void sem_up(semaphore_t *sem);
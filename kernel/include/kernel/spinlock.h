@@ -0,0 +1,99 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include <kernel/atomic.h>
+
+#undef SPINLOCK_STATS // Change to define to record acquisition and hold time statistics
+
+/**
+ * Statistics kept by each lock when SPINLOCK_STATS is defined
+ */
+struct lock_stats {
+    uint32_t acquisitions;  // Number of times the lock was taken
+    uint32_t contentions;   // Number of times a taker had to wait
+    uint64_t max_hold;      // Longest time the lock was held, in TSC cycles
+    uint64_t hold_start;    // When the current holder took the lock
+};
+typedef struct lock_stats lock_stats_t;
+
+/**
+ * Ticket spinlock. Waiters are served in the order they arrived.
+ */
+struct spinlock {
+    union {
+        uint32_t value;
+        struct {
+            uint16_t owner; // Ticket currently holding the lock
+            uint16_t next;  // Next ticket to hand out
+        } tickets;
+    };
+#ifdef SPINLOCK_STATS
+    lock_stats_t stats;
+#endif
+};
+typedef struct spinlock spinlock_t;
+
+/**
+ * Node of an MCS queue lock. Every waiter spins on its own node, so a
+ * contended lock only causes cache traffic when it's handed over.
+ * Nodes usually live on the stack of the thread taking the lock.
+ */
+struct mcs_node {
+    struct mcs_node *volatile next;
+    volatile bool locked;
+};
+typedef struct mcs_node mcs_node_t;
+
+struct mcs_lock {
+    mcs_node_t *tail; // Last waiter in the queue, NULL if unlocked
+#ifdef SPINLOCK_STATS
+    lock_stats_t stats;
+#endif
+};
+typedef struct mcs_lock mcs_lock_t;
+
+/**
+ * Reader-writer spinlock. A waiting writer keeps new readers out, so
+ * writers can't be starved by a steady stream of readers.
+ */
+#define RWLOCK_WRITER (1U<<31) // Set while a writer holds or waits for the lock
+
+struct rwlock {
+    uint32_t value; // RWLOCK_WRITER and number of active readers
+#ifdef SPINLOCK_STATS
+    lock_stats_t stats;
+#endif
+};
+typedef struct rwlock rwlock_t;
+
+// Static initializers. Zeroed memory is also a valid unlocked lock.
+#define SPINLOCK_INIT { .value = 0 }
+#define MCS_LOCK_INIT { .tail = NULL }
+#define RWLOCK_INIT { .value = 0 }
+
+void spin_lock_init(spinlock_t *lock);
+void spin_lock(spinlock_t *lock);
+bool spin_trylock(spinlock_t *lock);
+void spin_unlock(spinlock_t *lock);
+bool spin_is_locked(spinlock_t *lock);
+uint32_t spin_lock_irqsave(spinlock_t *lock);
+void spin_unlock_irqrestore(spinlock_t *lock, uint32_t flags);
+
+void mcs_lock_init(mcs_lock_t *lock);
+void mcs_lock(mcs_lock_t *lock, mcs_node_t *node);
+bool mcs_trylock(mcs_lock_t *lock, mcs_node_t *node);
+void mcs_unlock(mcs_lock_t *lock, mcs_node_t *node);
+
+void rwlock_init(rwlock_t *lock);
+void read_lock(rwlock_t *lock);
+void read_unlock(rwlock_t *lock);
+void write_lock(rwlock_t *lock);
+void write_unlock(rwlock_t *lock);
+uint32_t read_lock_irqsave(rwlock_t *lock);
+void read_unlock_irqrestore(rwlock_t *lock, uint32_t flags);
+uint32_t write_lock_irqsave(rwlock_t *lock);
+void write_unlock_irqrestore(rwlock_t *lock, uint32_t flags);
+
+void lock_stats_print(const char *name, lock_stats_t *stats);
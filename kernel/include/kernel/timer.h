@@ -0,0 +1,47 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include <kernel/kernel.h>
+#include <kernel/rbtree.h>
+#include <drivers/pc/pit.h>
+
+/**
+ * One-shot kernel timers and sleeping
+ *
+ * Time is kept in nanoseconds since boot. Expiry times are absolute, and
+ * timers fire on the first timer tick at or after their expiry. Callbacks
+ * run from the timer interrupt on the boot CPU, so they must not block.
+ */
+
+#define NSEC_PER_USEC 1000ULL
+#define NSEC_PER_MSEC 1000000ULL
+#define NSEC_PER_SEC  1000000000ULL
+#define NSEC_PER_TICK (NSEC_PER_SEC / PIT_TIMER_CONSTANT)
+
+typedef uint64_t ktime_t; // Nanoseconds since boot
+
+struct ktimer {
+    ktime_t expires;                // Time the timer fires at
+    void (*func)(struct ktimer *timer);
+    volatile bool pending;          // Timer is armed and hasn't fired yet
+    rb_node_t rb;                   // Link in the tree of armed timers
+};
+typedef struct ktimer ktimer_t;
+
+void ktimer_install();
+ktime_t ktime_get();
+void ktimer_init(ktimer_t *timer, void (*func)(ktimer_t *timer));
+void ktimer_add(ktimer_t *timer, ktime_t expires);
+ktime_t ktimer_add_range(ktimer_t *timer, ktime_t earliest, ktime_t latest);
+bool ktimer_cancel(ktimer_t *timer);
+bool ktimer_cancel_sync(ktimer_t *timer);
+bool ktimer_pending(ktimer_t *timer);
+void ktimer_tick();
+
+void sleep_until(ktime_t deadline);
+void sleep_until_range(ktime_t earliest, ktime_t latest);
+void nsleep(uint64_t ns);
+void msleep(uint32_t ms);
+void usleep_range(uint32_t min_us, uint32_t max_us);
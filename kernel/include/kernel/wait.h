@@ -0,0 +1,69 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include <kernel/kernel.h>
+#include <kernel/sched.h>
+#include <kernel/spinlock.h>
+
+#include <arch/i386/cpu.h>
+
+/**
+ * Wait queues
+ *
+ * A wait queue is a FIFO list of threads sleeping until some event happens.
+ * Waiters are woken in the order they arrived.
+ */
+
+/**
+ * A single waiting thread. Usually lives on the waiter's stack.
+ */
+struct wait_entry {
+    struct kthread *thread;
+    volatile bool woken;     // Set once the entry was taken off the queue by a waker
+    bool queued;             // Entry is on a wait queue
+    struct wait_entry *next;
+};
+typedef struct wait_entry wait_entry_t;
+
+struct wait_queue {
+    spinlock_t lock;
+    wait_entry_t *head;
+    wait_entry_t *tail;
+};
+typedef struct wait_queue wait_queue_t;
+
+#define WAIT_QUEUE_INIT { .lock = SPINLOCK_INIT, .head = NULL, .tail = NULL }
+
+void wait_queue_init(wait_queue_t *wq);
+void wait_entry_init(wait_entry_t *entry);
+void wait_queue_add_locked(wait_queue_t *wq, wait_entry_t *entry);
+void wait_queue_remove_locked(wait_queue_t *wq, wait_entry_t *entry);
+wait_entry_t *wait_queue_pop_locked(wait_queue_t *wq);
+void wait_entry_wake(wait_entry_t *entry);
+void wait_queue_prepare(wait_queue_t *wq, wait_entry_t *entry);
+void wait_queue_finish(wait_queue_t *wq, wait_entry_t *entry);
+bool wait_queue_wake_one(wait_queue_t *wq);
+uint32_t wait_queue_wake_all(wait_queue_t *wq);
+
+/**
+ * Sleep on a wait queue until a condition becomes true.
+ * The condition is evaluated with interrupts disabled, after the caller is
+ * on the queue, so a wake-up between the check and going to sleep can't be
+ * lost. Must be called from thread context.
+ * @param wq        wait_queue_t * to sleep on
+ * @param condition expression to wait for
+ */
+#define wait_event(wq, condition) do {                  \
+    wait_entry_t __wait;                                \
+    wait_entry_init(&__wait);                           \
+    uint32_t __wait_eflags = cpu_irq_save();            \
+    for (;;) {                                          \
+        wait_queue_prepare((wq), &__wait);              \
+        if (condition) break;                           \
+        sched_block();                                  \
+    }                                                   \
+    wait_queue_finish((wq), &__wait);                   \
+    cpu_irq_restore(__wait_eflags);                     \
+} while (0)
@@ -0,0 +1,123 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include <kernel/kernel.h>
+#include <kernel/spinlock.h>
+#include <kernel/timer.h>
+#include <kernel/wait.h>
+
+/**
+ * Workqueues
+ *
+ * Work items are functions deferred to thread context. Each CPU has a pool
+ * of worker threads that run the items queued on that CPU in FIFO order.
+ * A pool starts with one worker; when queued work stops making progress
+ * because every worker is busy or blocked, another worker is started, and
+ * workers left idle for WQ_IDLE_TIMEOUT exit again.
+ */
+
+#define WQ_MIN_WORKERS    1    // Workers each pool keeps around
+#define WQ_MAX_WORKERS    16   // Most workers a pool will start
+#define WQ_WATCHDOG_MS    10   // How often pools are checked for stalls
+#define WQ_IDLE_TIMEOUT   5000 // Milliseconds an extra worker stays idle before exiting
+
+// Work item flags
+#define WORK_PENDING (1<<0) // Queued, or waiting for its delay to expire
+#define WORK_QUEUED  (1<<1) // On a pool's list of items to run
+
+struct work;
+struct worker_pool;
+typedef void (*work_func_t)(struct work *work);
+
+/**
+ * A single deferred function call. Usually embedded in a larger structure
+ * and recovered in the callback with container_of.
+ */
+struct work {
+    work_func_t func;
+    uint32_t flags;               // WORK_* flags
+    struct worker_pool *pool;     // Pool the item was last queued on
+    struct workqueue *wq;         // Workqueue the item was last queued on
+    struct work *next;
+};
+typedef struct work work_t;
+
+/**
+ * Work item that is queued after a delay
+ */
+struct delayed_work {
+    work_t work;
+    ktimer_t timer;
+};
+typedef struct delayed_work delayed_work_t;
+
+/**
+ * Handle used to queue and flush a group of related work items
+ */
+struct workqueue {
+    const char *name;
+    uint32_t nr_active;         // Items queued or running
+    wait_queue_t flush_wait;    // Threads waiting for nr_active to drop to 0
+};
+typedef struct workqueue workqueue_t;
+
+/**
+ * Worker thread of a pool
+ */
+struct worker {
+    struct kthread *thread;
+    struct worker_pool *pool;
+    work_t *current;            // Item being run, or NULL
+    ktime_t idle_since;         // Time the worker went idle at
+    bool idle;                  // Worker is on the pool's idle list
+    bool exit;                  // Worker should exit once woken
+    struct worker *next;        // Link in the pool's idle list
+    struct worker *next_all;    // Link in the pool's list of all workers
+};
+typedef struct worker worker_t;
+
+/**
+ * Per-CPU pool of worker threads
+ */
+struct worker_pool {
+    spinlock_t lock;
+    uint32_t cpu;
+    bool ready;
+
+    work_t *head;               // Queued items, oldest first
+    work_t *tail;
+
+    worker_t *idle;             // Idle workers, most recently idle first
+    worker_t *workers;          // All workers
+    uint32_t nr_workers;
+    uint32_t nr_idle;
+    uint32_t nr_completed;      // Items run so far, used to detect stalls
+    uint32_t watchdog_completed;
+
+    bool need_worker;           // Manager should start another worker
+    struct kthread *manager;    // Thread that starts new workers
+    wait_queue_t manager_wait;
+    wait_queue_t done_wait;     // Woken whenever an item finishes
+    ktimer_t watchdog;
+};
+typedef struct worker_pool worker_pool_t;
+
+extern workqueue_t *system_wq;
+
+void workqueue_init();
+workqueue_t *workqueue_create(const char *name);
+void work_init(work_t *work, work_func_t func);
+void delayed_work_init(delayed_work_t *dwork, work_func_t func);
+bool queue_work(workqueue_t *wq, work_t *work);
+bool queue_work_on(uint32_t cpu, workqueue_t *wq, work_t *work);
+bool queue_delayed_work(workqueue_t *wq, delayed_work_t *dwork, uint32_t delay_ms);
+bool queue_delayed_work_on(uint32_t cpu, workqueue_t *wq, delayed_work_t *dwork, uint32_t delay_ms);
+bool cancel_work(work_t *work);
+bool cancel_work_sync(work_t *work);
+bool cancel_delayed_work(delayed_work_t *dwork);
+bool cancel_delayed_work_sync(delayed_work_t *dwork);
+void flush_work(work_t *work);
+void flush_delayed_work(delayed_work_t *dwork);
+void flush_workqueue(workqueue_t *wq);
@@ -0,0 +1,519 @@
+/**
+ * B+-tree of objects ordered by a comparator
+ *
+ * Every internal node's keys[i] is the smallest object in the subtree at
+ * children[i+1], so separators always point at objects that are still in the
+ * tree and the comparator never sees a removed object.
+ */
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include <kernel/kernel.h>
+#include <kernel/bptree.h>
+#include <mm/alloc.h>
+
+// Deepest a tree can get. Every non-root node is at least half full, so eight
+// levels already hold far more objects than fit in the address space.
+#define BPTREE_MAX_DEPTH 8
+
+/**
+ * Nodes allocated up front for the splits an insert is going to need, so
+ * that running out of memory never leaves a half split tree behind
+ */
+struct bptree_spare {
+    bptree_node_t *nodes[BPTREE_MAX_DEPTH + 1];
+    uint32_t count;
+};
+
+static bptree_node_t *bptree_node_alloc(bool leaf) {
+    bptree_node_t *node = (bptree_node_t *)kmalloc(sizeof(bptree_node_t), KALLOC_GENERAL);
+    if (!node) return NULL;
+    memset(node, 0, sizeof(bptree_node_t));
+    node->leaf = leaf;
+    return node;
+}
+
+static void bptree_node_free(bptree_node_t *node) {
+    kfree((uintptr_t *)node);
+}
+
+/**
+ * Find the number of keys in a node that are <= key. For an internal node
+ * this is the index of the child whose subtree key belongs in.
+ */
+static uint32_t bptree_upper_bound(bptree_t *tree, bptree_node_t *node, void *key) {
+    uint32_t low = 0, high = node->nr_keys;
+    while (low < high) {
+        uint32_t mid = low + (high - low) / 2;
+        if (tree->comparator(node->keys[mid], key) <= 0) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    return low;
+}
+
+/**
+ * Find the number of keys in a node that are < key
+ */
+static uint32_t bptree_lower_bound_node(bptree_t *tree, bptree_node_t *node, void *key) {
+    uint32_t low = 0, high = node->nr_keys;
+    while (low < high) {
+        uint32_t mid = low + (high - low) / 2;
+        if (tree->comparator(node->keys[mid], key) < 0) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    return low;
+}
+
+static void *bptree_subtree_min(bptree_node_t *node) {
+    while (!node->leaf) {
+        node = node->children[0];
+    }
+    return node->keys[0];
+}
+
+/**
+ * Initialize an empty tree
+ * @param tree       tree to initialize
+ * @param comparator function used to order objects
+ */
+void bptree_init(bptree_t *tree, comparator_t comparator) {
+    tree->root = NULL;
+    tree->size = 0;
+    tree->comparator = comparator;
+}
+
+static void bptree_destroy_node(bptree_node_t *node) {
+    if (!node->leaf) {
+        uint32_t i;
+        for (i=0; i<=node->nr_keys; i++) {
+            bptree_destroy_node(node->children[i]);
+        }
+    }
+    bptree_node_free(node);
+}
+
+/**
+ * Free every node of a tree, leaving it empty. The objects are not touched.
+ * @param tree tree to act on
+ */
+void bptree_destroy(bptree_t *tree) {
+    if (tree->root) {
+        bptree_destroy_node(tree->root);
+    }
+    tree->root = NULL;
+    tree->size = 0;
+}
+
+/**
+ * Insert into the subtree at node. If node overflows it is split in two.
+ * @param[out] sep smallest object in the new right sibling
+ * @param[out] right new right sibling, or NULL if node wasn't split
+ */
+static k_return_t bptree_insert_node(bptree_t *tree, bptree_node_t *node, void *object,
+                                     struct bptree_spare *spare, void **sep,
+                                     bptree_node_t **right) {
+    uint32_t i = bptree_upper_bound(tree, node, object);
+    *right = NULL;
+
+    if (node->leaf) {
+        if (i && tree->comparator(node->keys[i - 1], object) == 0)
+            return K_INVALOP;
+
+        memmove(&node->keys[i + 1], &node->keys[i], (node->nr_keys - i) * sizeof(void *));
+        node->keys[i] = object;
+        node->nr_keys++;
+    } else {
+        void *child_sep;
+        bptree_node_t *child_right;
+        k_return_t ret = bptree_insert_node(tree, node->children[i], object, spare,
+                                            &child_sep, &child_right);
+        if (ret != K_SUCCESS || !child_right)
+            return ret;
+
+        // Child was split, add the new sibling after it
+        memmove(&node->keys[i + 1], &node->keys[i], (node->nr_keys - i) * sizeof(void *));
+        memmove(&node->children[i + 2], &node->children[i + 1],
+                (node->nr_keys - i) * sizeof(bptree_node_t *));
+        node->keys[i] = child_sep;
+        node->children[i + 1] = child_right;
+        node->nr_keys++;
+    }
+
+    if (node->nr_keys <= BPTREE_MAX_KEYS)
+        return K_SUCCESS;
+
+    // Split the overflowing node
+    ASSERT(spare->count);
+    bptree_node_t *new = spare->nodes[--spare->count];
+    new->leaf = node->leaf;
+
+    uint32_t mid = node->nr_keys / 2;
+    if (node->leaf) {
+        // Leaves keep every object, the separator is a copy of the right half's first
+        new->nr_keys = node->nr_keys - mid;
+        memcpy(new->keys, &node->keys[mid], new->nr_keys * sizeof(void *));
+        node->nr_keys = mid;
+        new->next = node->next;
+        node->next = new;
+        *sep = new->keys[0];
+    } else {
+        // The middle key moves up, it's the smallest object under its right child
+        new->nr_keys = node->nr_keys - mid - 1;
+        memcpy(new->keys, &node->keys[mid + 1], new->nr_keys * sizeof(void *));
+        memcpy(new->children, &node->children[mid + 1], (new->nr_keys + 1) * sizeof(bptree_node_t *));
+        *sep = node->keys[mid];
+        node->nr_keys = mid;
+    }
+    *right = new;
+    return K_SUCCESS;
+}
+
+/**
+ * Insert an object into a tree
+ * @param tree   tree to act on
+ * @param object object to insert
+ * @return K_SUCCESS, K_INVALOP if an equal object is already in the tree,
+ *         or K_OOM
+ */
+k_return_t bptree_insert(bptree_t *tree, void *object) {
+    if (!tree->root) {
+        tree->root = bptree_node_alloc(true);
+        if (!tree->root) return K_OOM;
+    }
+
+    // A full node splits if the child below it splits, so the number of
+    // splits is the length of the run of full nodes ending at the leaf. If
+    // that run reaches the root, a new root is needed as well.
+    struct bptree_spare spare;
+    uint32_t depth = 0, needed = 0;
+    bptree_node_t *node = tree->root;
+    for (;;) {
+        needed = node->nr_keys == BPTREE_MAX_KEYS ? needed + 1 : 0;
+        depth++;
+        if (node->leaf) break;
+        node = node->children[bptree_upper_bound(tree, node, object)];
+    }
+    if (needed == depth) {
+        needed++;
+    }
+
+    for (spare.count=0; spare.count<needed; spare.count++) {
+        spare.nodes[spare.count] = bptree_node_alloc(false);
+        if (!spare.nodes[spare.count]) break;
+    }
+
+    void *sep;
+    bptree_node_t *right = NULL;
+    k_return_t ret = K_OOM;
+    if (spare.count == needed) {
+        ret = bptree_insert_node(tree, tree->root, object, &spare, &sep, &right);
+    }
+    if (ret == K_SUCCESS) {
+        tree->size++;
+    }
+
+    if (right) {
+        // The root was split, grow the tree by one level
+        ASSERT(spare.count);
+        bptree_node_t *root = spare.nodes[--spare.count];
+        root->nr_keys = 1;
+        root->keys[0] = sep;
+        root->children[0] = tree->root;
+        root->children[1] = right;
+        tree->root = root;
+    }
+
+    // Nodes left over when inserting a duplicate or after a failed allocation
+    while (spare.count) {
+        bptree_node_free(spare.nodes[--spare.count]);
+    }
+    return ret;
+}
+
+/**
+ * Find the leaf that an object equal to key would be in
+ */
+static bptree_node_t *bptree_find_leaf(bptree_t *tree, void *key) {
+    bptree_node_t *node = tree->root;
+    while (node && !node->leaf) {
+        node = node->children[bptree_upper_bound(tree, node, key)];
+    }
+    return node;
+}
+
+/**
+ * Find the object equal to a key
+ * @param tree tree to search
+ * @param key  object to compare against
+ * @return object in the tree, or NULL if there is none
+ */
+void *bptree_find(bptree_t *tree, void *key) {
+    bptree_node_t *leaf = bptree_find_leaf(tree, key);
+    if (!leaf) return NULL;
+
+    uint32_t i = bptree_lower_bound_node(tree, leaf, key);
+    if (i < leaf->nr_keys && tree->comparator(leaf->keys[i], key) == 0)
+        return leaf->keys[i];
+    return NULL;
+}
+
+/**
+ * Refill children[i] of node after it dropped below BPTREE_MIN_KEYS, by
+ * borrowing from a sibling or merging with one
+ */
+static void bptree_rebalance(bptree_node_t *node, uint32_t i) {
+    bptree_node_t *child = node->children[i];
+    bptree_node_t *left = i ? node->children[i - 1] : NULL;
+    bptree_node_t *right = i < node->nr_keys ? node->children[i + 1] : NULL;
+
+    if (left && left->nr_keys > BPTREE_MIN_KEYS) {
+        // Move the last entry of the left sibling to the front of child
+        memmove(&child->keys[1], &child->keys[0], child->nr_keys * sizeof(void *));
+        if (child->leaf) {
+            child->keys[0] = left->keys[left->nr_keys - 1];
+            node->keys[i - 1] = child->keys[0];
+        } else {
+            memmove(&child->children[1], &child->children[0],
+                    (child->nr_keys + 1) * sizeof(bptree_node_t *));
+            child->keys[0] = node->keys[i - 1];
+            child->children[0] = left->children[left->nr_keys];
+            node->keys[i - 1] = left->keys[left->nr_keys - 1];
+        }
+        child->nr_keys++;
+        left->nr_keys--;
+    } else if (right && right->nr_keys > BPTREE_MIN_KEYS) {
+        // Move the first entry of the right sibling to the end of child
+        if (child->leaf) {
+            child->keys[child->nr_keys] = right->keys[0];
+            memmove(&right->keys[0], &right->keys[1], (right->nr_keys - 1) * sizeof(void *));
+            node->keys[i] = right->keys[0];
+        } else {
+            child->keys[child->nr_keys] = node->keys[i];
+            child->children[child->nr_keys + 1] = right->children[0];
+            node->keys[i] = right->keys[0];
+            memmove(&right->keys[0], &right->keys[1], (right->nr_keys - 1) * sizeof(void *));
+            memmove(&right->children[0], &right->children[1],
+                    right->nr_keys * sizeof(bptree_node_t *));
+        }
+        child->nr_keys++;
+        right->nr_keys--;
+    } else {
+        // Both siblings are minimal, merge child with one of them
+        if (left) {
+            right = child;
+            i--;
+        } else {
+            left = child;
+        }
+
+        if (left->leaf) {
+            memcpy(&left->keys[left->nr_keys], right->keys, right->nr_keys * sizeof(void *));
+            left->next = right->next;
+        } else {
+            left->keys[left->nr_keys] = node->keys[i];
+            memcpy(&left->keys[left->nr_keys + 1], right->keys, right->nr_keys * sizeof(void *));
+            memcpy(&left->children[left->nr_keys + 1], right->children,
+                   (right->nr_keys + 1) * sizeof(bptree_node_t *));
+            left->nr_keys++;
+        }
+        left->nr_keys += right->nr_keys;
+        bptree_node_free(right);
+
+        // Drop the separator and pointer of the merged away node
+        memmove(&node->keys[i], &node->keys[i + 1], (node->nr_keys - i - 1) * sizeof(void *));
+        memmove(&node->children[i + 1], &node->children[i + 2],
+                (node->nr_keys - i - 1) * sizeof(bptree_node_t *));
+        node->nr_keys--;
+    }
+}
+
+/**
+ * Remove the object equal to key from the subtree at node
+ * @return removed object, or NULL if there was none
+ */
+static void *bptree_remove_node(bptree_t *tree, bptree_node_t *node, void *key) {
+    uint32_t i;
+
+    if (node->leaf) {
+        i = bptree_lower_bound_node(tree, node, key);
+        if (i == node->nr_keys || tree->comparator(node->keys[i], key) != 0)
+            return NULL;
+
+        void *object = node->keys[i];
+        memmove(&node->keys[i], &node->keys[i + 1], (node->nr_keys - i - 1) * sizeof(void *));
+        node->nr_keys--;
+        return object;
+    }
+
+    i = bptree_upper_bound(tree, node, key);
+    void *object = bptree_remove_node(tree, node->children[i], key);
+    if (!object)
+        return NULL;
+
+    // The removed object may have been the smallest in its subtree, in which
+    // case the separator pointing at it has to be replaced. This has to happen
+    // before rebalancing, which can move separators down into the child.
+    if (i && node->keys[i - 1] == object) {
+        node->keys[i - 1] = bptree_subtree_min(node->children[i]);
+    }
+
+    if (node->children[i]->nr_keys < BPTREE_MIN_KEYS) {
+        bptree_rebalance(node, i);
+    }
+    return object;
+}
+
+/**
+ * Remove the object equal to a key from a tree
+ * @param tree tree to act on
+ * @param key  object to compare against
+ * @return removed object, or NULL if there was none
+ */
+void *bptree_remove(bptree_t *tree, void *key) {
+    if (!tree->root) return NULL;
+
+    void *object = bptree_remove_node(tree, tree->root, key);
+    if (!object)
+        return NULL;
+    tree->size--;
+
+    // Shrink the tree when the root runs out of keys
+    bptree_node_t *root = tree->root;
+    if (!root->leaf && !root->nr_keys) {
+        tree->root = root->children[0];
+        bptree_node_free(root);
+    } else if (root->leaf && !root->nr_keys) {
+        tree->root = NULL;
+        bptree_node_free(root);
+    }
+    return object;
+}
+
+/**
+ * Start iterating at the smallest object in a tree
+ * @param tree tree to walk
+ * @param[out] iter cursor to initialize
+ * @return smallest object, or NULL if the tree is empty
+ */
+void *bptree_first(bptree_t *tree, bptree_iter_t *iter) {
+    bptree_node_t *node = tree->root;
+    while (node && !node->leaf) {
+        node = node->children[0];
+    }
+    iter->leaf = node;
+    iter->index = 0;
+    return (node && node->nr_keys) ? node->keys[0] : NULL;
+}
+
+/**
+ * Start iterating at the smallest object not less than a key
+ * @param tree tree to walk
+ * @param key  object to compare against
+ * @param[out] iter cursor to initialize
+ * @return first object >= key, or NULL if there is none
+ */
+void *bptree_lower_bound(bptree_t *tree, void *key, bptree_iter_t *iter) {
+    bptree_node_t *leaf = bptree_find_leaf(tree, key);
+    iter->leaf = leaf;
+    if (!leaf) return NULL;
+
+    iter->index = bptree_lower_bound_node(tree, leaf, key);
+    if (iter->index < leaf->nr_keys)
+        return leaf->keys[iter->index];
+
+    // Every object in this leaf is smaller, the answer starts the next one
+    iter->index--;
+    return bptree_next(iter);
+}
+
+/**
+ * Advance a cursor to the next object in order
+ * @param iter cursor to advance
+ * @return next object, or NULL at the end of the tree
+ */
+void *bptree_next(bptree_iter_t *iter) {
+    if (!iter->leaf) return NULL;
+
+    if (++iter->index >= iter->leaf->nr_keys) {
+        iter->leaf = iter->leaf->next;
+        iter->index = 0;
+        if (!iter->leaf) return NULL;
+    }
+    return iter->leaf->keys[iter->index];
+}
+
+/**
+ * Check the ordering, separator and fill invariants of a subtree
+ * @return depth of the subtree's leaves, or -1 if an invariant is broken
+ */
+static int32_t bptree_verify_node(bptree_t *tree, bptree_node_t *node, bool root,
+                                  void *low, void *high, uint32_t *count) {
+    uint32_t i;
+
+    if (node->nr_keys > BPTREE_MAX_KEYS || (!root && node->nr_keys < BPTREE_MIN_KEYS))
+        return -1;
+    for (i=0; i<node->nr_keys; i++) {
+        if (i && tree->comparator(node->keys[i - 1], node->keys[i]) >= 0)
+            return -1;
+        if (low && tree->comparator(node->keys[i], low) < 0)
+            return -1;
+        if (high && tree->comparator(node->keys[i], high) >= 0)
+            return -1;
+    }
+
+    if (node->leaf) {
+        *count += node->nr_keys;
+        return 0;
+    }
+
+    if (!node->nr_keys)
+        return -1;
+
+    int32_t depth = -1;
+    for (i=0; i<=node->nr_keys; i++) {
+        void *child_low = i ? node->keys[i - 1] : low;
+        void *child_high = i < node->nr_keys ? node->keys[i] : high;
+        if (i && bptree_subtree_min(node->children[i]) != node->keys[i - 1])
+            return -1;
+
+        int32_t d = bptree_verify_node(tree, node->children[i], false, child_low, child_high, count);
+        if (d < 0 || (depth >= 0 && d != depth))
+            return -1;
+        depth = d;
+    }
+    return depth + 1;
+}
+
+/**
+ * Check every invariant of a tree, for debugging
+ * @param tree tree to check
+ * @return K_SUCCESS or K_INVALOP if the tree is corrupt
+ */
+k_return_t bptree_verify(bptree_t *tree) {
+    if (!tree->root)
+        return tree->size ? K_INVALOP : K_SUCCESS;
+
+    uint32_t count = 0;
+    if (bptree_verify_node(tree, tree->root, true, NULL, NULL, &count) < 0 || count != tree->size)
+        return K_INVALOP;
+
+    // The leaf chain has to visit every object in order
+    bptree_iter_t iter;
+    void *prev = NULL, *obj;
+    count = 0;
+    bptree_for_each(tree, &iter, obj) {
+        if (count && tree->comparator(prev, obj) >= 0)
+            return K_INVALOP;
+        prev = obj;
+        count++;
+    }
+    return count == tree->size ? K_SUCCESS : K_INVALOP;
+}
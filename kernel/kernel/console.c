@@ -0,0 +1,188 @@
+/**
+ * Console sink registry
+ */
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#include <kernel/kernel.h>
+#include <kernel/atomic.h>
+#include <kernel/console.h>
+#include <kernel/spinlock.h>
+#include <drivers/vga/textmode.h>
+
+#include <arch/i386/cpu.h>
+
+static void console_vga_write(const char *data, size_t length) {
+    size_t i;
+    for (i=0; i<length; i++) {
+        vga_textmode_putchar(data[i]);
+    }
+}
+
+console_sink_t console_vga = {
+    .name = "vga",
+    .write = console_vga_write,
+    .write_panic = NULL,
+    .page_up = vga_textmode_page_up,
+    .page_down = vga_textmode_page_down,
+    .set_color = vga_textmode_setcolor
+};
+
+// Sinks are only ever added or swapped in place, so writers can walk the
+// array without holding console_register_lock
+static console_sink_t *console_sinks[CONSOLE_MAX_SINKS] = { &console_vga };
+static volatile uint32_t console_nr_sinks = 1;
+static spinlock_t console_register_lock = SPINLOCK_INIT;
+
+// Serializes calls into the sinks, which keep cursor and scroll state
+static spinlock_t console_lock = SPINLOCK_INIT;
+
+static volatile bool console_panicking = false;
+
+/**
+ * Take console_lock with interrupts disabled. Once the kernel is panicking
+ * the holder may never release it, so only try once and carry on anyway.
+ * @param[out] locked whether the lock was taken
+ * @return EFLAGS to pass to console_unlock_irqrestore
+ */
+static uint32_t console_lock_irqsave(bool *locked) {
+    if (!console_panicking) {
+        *locked = true;
+        return spin_lock_irqsave(&console_lock);
+    }
+
+    uint32_t eflags = cpu_irq_save();
+    *locked = spin_trylock(&console_lock);
+    return eflags;
+}
+
+static void console_unlock_irqrestore(bool locked, uint32_t eflags) {
+    if (locked) {
+        spin_unlock(&console_lock);
+    }
+    cpu_irq_restore(eflags);
+}
+
+/**
+ * Start passing console output to a sink
+ * @param sink sink to add, must stay valid forever
+ * @return K_SUCCESS, or K_NOSPACE if CONSOLE_MAX_SINKS are registered
+ */
+k_return_t console_register(console_sink_t *sink) {
+    uint32_t eflags = spin_lock_irqsave(&console_register_lock);
+    uint32_t n = console_nr_sinks;
+    if (n == CONSOLE_MAX_SINKS) {
+        spin_unlock_irqrestore(&console_register_lock, eflags);
+        return K_NOSPACE;
+    }
+    console_sinks[n] = sink;
+    atomic_store_release(&console_nr_sinks, n + 1);
+    spin_unlock_irqrestore(&console_register_lock, eflags);
+    return K_SUCCESS;
+}
+
+/**
+ * Pass console output to a sink instead of another one, e.g. when a
+ * framebuffer console takes over the screen from the VGA text console
+ * @param old  registered sink to replace
+ * @param sink sink to use instead, must stay valid forever
+ * @return K_SUCCESS, or K_INVALOP if old isn't registered
+ */
+k_return_t console_replace(console_sink_t *old, console_sink_t *sink) {
+    k_return_t ret = K_INVALOP;
+    uint32_t eflags = spin_lock_irqsave(&console_register_lock);
+    uint32_t i;
+    for (i=0; i<console_nr_sinks; i++) {
+        if (console_sinks[i] == old) {
+            atomic_store_release(&console_sinks[i], sink);
+            ret = K_SUCCESS;
+            break;
+        }
+    }
+    spin_unlock_irqrestore(&console_register_lock, eflags);
+    return ret;
+}
+
+static inline void console_sink_write(console_sink_t *sink, const char *data, size_t length) {
+    if (console_panicking && sink->write_panic) {
+        sink->write_panic(data, length);
+    } else {
+        sink->write(data, length);
+    }
+}
+
+/**
+ * Write characters to every console sink
+ * @param data   characters to write
+ * @param length number of characters
+ */
+void console_write(const char *data, size_t length) {
+    bool locked;
+    uint32_t eflags = console_lock_irqsave(&locked);
+    uint32_t n = atomic_load_acquire(&console_nr_sinks);
+    uint32_t i;
+    for (i=0; i<n; i++) {
+        console_sink_write(atomic_load_acquire(&console_sinks[i]), data, length);
+    }
+    console_unlock_irqrestore(locked, eflags);
+}
+
+/**
+ * Write characters to every console sink in a colour, then go back to
+ * CONSOLE_COLOR_DEFAULT
+ * @param data   characters to write
+ * @param length number of characters
+ * @param color  VGA text attribute to write them in
+ */
+void console_write_color(const char *data, size_t length, uint8_t color) {
+    bool locked;
+    uint32_t eflags = console_lock_irqsave(&locked);
+    uint32_t n = atomic_load_acquire(&console_nr_sinks);
+    uint32_t i;
+    for (i=0; i<n; i++) {
+        console_sink_t *sink = atomic_load_acquire(&console_sinks[i]);
+        if (sink->set_color) sink->set_color(color);
+        console_sink_write(sink, data, length);
+        if (sink->set_color) sink->set_color(CONSOLE_COLOR_DEFAULT);
+    }
+    console_unlock_irqrestore(locked, eflags);
+}
+
+/**
+ * Scroll every sink with scrollback one page back
+ */
+void console_page_up() {
+    bool locked;
+    uint32_t eflags = console_lock_irqsave(&locked);
+    uint32_t n = atomic_load_acquire(&console_nr_sinks);
+    uint32_t i;
+    for (i=0; i<n; i++) {
+        console_sink_t *sink = atomic_load_acquire(&console_sinks[i]);
+        if (sink->page_up) sink->page_up();
+    }
+    console_unlock_irqrestore(locked, eflags);
+}
+
+/**
+ * Scroll every sink with scrollback one page forward
+ */
+void console_page_down() {
+    bool locked;
+    uint32_t eflags = console_lock_irqsave(&locked);
+    uint32_t n = atomic_load_acquire(&console_nr_sinks);
+    uint32_t i;
+    for (i=0; i<n; i++) {
+        console_sink_t *sink = atomic_load_acquire(&console_sinks[i]);
+        if (sink->page_down) sink->page_down();
+    }
+    console_unlock_irqrestore(locked, eflags);
+}
+
+/**
+ * Switch every sink to its polled output path. Called when the kernel is
+ * going down and interrupts may never be serviced again.
+ */
+void console_panic() {
+    console_panicking = true;
+}
@@ -0,0 +1,208 @@
+/**
+ * Region tree augmented with the largest free gap, for address allocators
+ */
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#include <kernel/kernel.h>
+#include <kernel/rbtree.h>
+#include <kernel/gap_tree.h>
+
+/**
+ * Internal functions
+ */
+
+static inline gap_node_t *gap_entry(rb_node_t *rb) {
+    return rb ? rb_entry(rb, gap_node_t, rb) : NULL;
+}
+
+static bool gap_augment(rb_node_t *rb) {
+    gap_node_t *node = gap_entry(rb);
+    uint32_t max = node->gap;
+    if (rb->left && gap_entry(rb->left)->subtree_gap > max) {
+        max = gap_entry(rb->left)->subtree_gap;
+    }
+    if (rb->right && gap_entry(rb->right)->subtree_gap > max) {
+        max = gap_entry(rb->right)->subtree_gap;
+    }
+
+    if (node->subtree_gap == max) return false;
+    node->subtree_gap = max;
+    return true;
+}
+
+static int gap_cmp(const rb_node_t *a, const rb_node_t *b) {
+    uint32_t sa = rb_entry(a, gap_node_t, rb)->start;
+    uint32_t sb = rb_entry(b, gap_node_t, rb)->start;
+    return sa < sb ? -1 : sa > sb;
+}
+
+/**
+ * Recompute the gap before a region from its predecessor
+ */
+static void gap_update(gap_tree_t *tree, gap_node_t *node) {
+    gap_node_t *prev = gap_entry(rb_prev(&node->rb));
+    node->gap = node->start - (prev ? prev->end : tree->base);
+    rb_augment_propagate(&node->rb, gap_augment);
+}
+
+/**
+ * Free space after the last region
+ */
+static uint32_t gap_tail_start(gap_tree_t *tree) {
+    gap_node_t *last = gap_entry(rb_last(&tree->root));
+    return last ? last->end : tree->base;
+}
+
+/**
+ * Interfaces
+ */
+
+/**
+ * Initialize an empty tree
+ * @param tree  tree to act on
+ * @param base  first address regions may use
+ * @param limit first address after the usable range, 0 for 4GiB
+ */
+void gap_tree_init(gap_tree_t *tree, uint32_t base, uint32_t limit) {
+    tree->root.node = NULL;
+    tree->base = base;
+    tree->limit = limit;
+}
+
+/**
+ * Add a region at a fixed address. node->start and node->end must be set.
+ * @param tree tree to act on
+ * @param node region to add
+ * @return K_SUCCESS or K_INVALOP if it overlaps another region or the bounds
+ */
+k_return_t gap_tree_insert(gap_tree_t *tree, gap_node_t *node) {
+    if (node->start < tree->base || node->end <= node->start) return K_INVALOP;
+    if (tree->limit && node->end > tree->limit) return K_INVALOP;
+
+    rb_node_t **link = &tree->root.node;
+    rb_node_t *parent = NULL;
+    gap_node_t *prev = NULL, *next = NULL;
+
+    while (*link) {
+        parent = *link;
+        gap_node_t *cur = gap_entry(parent);
+        if (node->start < cur->start) {
+            next = cur;
+            link = &parent->left;
+        } else {
+            prev = cur;
+            link = &parent->right;
+        }
+    }
+    if ((prev && prev->end > node->start) || (next && node->end > next->start)) {
+        return K_INVALOP;
+    }
+
+    node->gap = node->start - (prev ? prev->end : tree->base);
+    node->subtree_gap = node->gap;
+    rb_link_node(&node->rb, parent, link);
+    rb_insert_color(&tree->root, &node->rb, gap_augment);
+
+    // The gap before the next region shrank
+    if (next) {
+        gap_update(tree, next);
+    }
+    return K_SUCCESS;
+}
+
+/**
+ * Remove a region, merging the space it used with the gaps around it
+ * @param tree tree to act on
+ * @param node region to remove
+ */
+void gap_tree_remove(gap_tree_t *tree, gap_node_t *node) {
+    gap_node_t *next = gap_entry(rb_next(&node->rb));
+    rb_erase(&tree->root, &node->rb, gap_augment);
+    if (next) {
+        gap_update(tree, next);
+    }
+}
+
+/**
+ * Find the region containing an address
+ * @param tree tree to search
+ * @param addr address to look up
+ * @return region containing addr, or NULL if it is free
+ */
+gap_node_t *gap_tree_find(gap_tree_t *tree, uint32_t addr) {
+    rb_node_t *rb = tree->root.node;
+    while (rb) {
+        gap_node_t *cur = gap_entry(rb);
+        if (addr < cur->start) {
+            rb = rb->left;
+        } else if (addr >= cur->end) {
+            rb = rb->right;
+        } else {
+            return cur;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Place a region of a given size at the lowest free address that fits it
+ * @param tree  tree to act on
+ * @param node  region to add, start and end are set on success
+ * @param size  size of the region
+ * @param align required alignment of the start, a power of two
+ * @return K_SUCCESS or K_NOSPACE if no gap is large enough
+ */
+k_return_t gap_tree_alloc(gap_tree_t *tree, gap_node_t *node, uint32_t size, uint32_t align) {
+    if (!size || !align || (align & (align - 1))) return K_INVALOP;
+
+    // Any gap of size + align - 1 fits whatever its alignment. Smaller
+    // aligned fits are missed in exchange for never backtracking.
+    uint32_t need = size + align - 1;
+    if (need < size) return K_NOSPACE;
+
+    uint32_t start = 0;
+    bool found = false;
+    rb_node_t *rb = tree->root.node;
+    if (rb && gap_entry(rb)->subtree_gap >= need) {
+        for (;;) {
+            gap_node_t *cur = gap_entry(rb);
+            if (rb->left && gap_entry(rb->left)->subtree_gap >= need) {
+                rb = rb->left;
+            } else if (cur->gap >= need) {
+                start = cur->start - cur->gap;
+                found = true;
+                break;
+            } else {
+                // Must be on the right, subtree_gap said so
+                rb = rb->right;
+            }
+        }
+    }
+
+    if (!found) {
+        // Try the space after the last region
+        start = gap_tail_start(tree);
+        uint32_t end = tree->limit ? tree->limit : 0xFFFFFFFF;
+        if (end - start < need) return K_NOSPACE;
+    }
+
+    node->start = (start + align - 1) & ~(align - 1);
+    node->end = node->start + size;
+    return gap_tree_insert(tree, node);
+}
+
+/**
+ * Check a tree for consistency, see rb_verify()
+ */
+k_return_t gap_tree_verify(gap_tree_t *tree) {
+    rb_node_t *rb;
+    uint32_t prev_end = tree->base;
+    rb_for_each(rb, &tree->root) {
+        gap_node_t *cur = gap_entry(rb);
+        if (cur->start < prev_end || cur->gap != cur->start - prev_end) return K_INVALOP;
+        prev_end = cur->end;
+    }
+    return rb_verify(&tree->root, gap_cmp, gap_augment);
+}
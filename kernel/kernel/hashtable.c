@@ -0,0 +1,289 @@
+/**
+ * Resizable intrusive hash table with incremental rehashing
+ */
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include <kernel/kernel.h>
+#include <kernel/atomic.h>
+#include <kernel/hashtable.h>
+#include <kernel/rcu.h>
+#include <kernel/spinlock.h>
+#include <mm/alloc.h>
+
+#include <arch/i386/cpu.h>
+
+#define FNV1A_OFFSET_BASIS 2166136261u
+#define FNV1A_PRIME        16777619u
+
+/**
+ * Internal functions. Functions suffixed with _locked need ht->lock held.
+ */
+
+static htable_array_t *htable_array_alloc(uint32_t size) {
+    htable_array_t *array = (htable_array_t *)kmalloc(sizeof(htable_array_t) +
+                                                       size * sizeof(htable_node_t *), KALLOC_GENERAL);
+    if (!array) return NULL;
+    array->mask = size - 1;
+    memset(array->buckets, 0, size * sizeof(htable_node_t *));
+    return array;
+}
+
+static void htable_array_free_rcu(rcu_head_t *head) {
+    kfree((uintptr_t *)head);
+}
+
+static inline htable_node_t **htable_bucket(htable_array_t *array, uint32_t hash) {
+    return &array->buckets[hash & array->mask];
+}
+
+/**
+ * Find the link pointing at a node in a bucket
+ * @return address of the link, or NULL if the node isn't in the bucket
+ */
+static htable_node_t **htable_find_link(htable_array_t *array, htable_node_t *node) {
+    htable_node_t **cur = htable_bucket(array, node->hash);
+    while (*cur && *cur != node) {
+        cur = &(*cur)->next;
+    }
+    return *cur ? cur : NULL;
+}
+
+/**
+ * Move up to nr buckets from the old array to the current one, and retire
+ * the old array once it is empty
+ */
+static void htable_migrate_locked(htable_t *ht, uint32_t nr) {
+    htable_array_t *old = ht->old;
+    if (!old) return;
+
+    // Lookups that overlap this retry, since a node moved under a reader
+    // takes it off the chain it was walking
+    atomic_store_relaxed(&ht->seq, ht->seq + 1);
+    smp_wmb();
+
+    while (nr-- && ht->migrate_pos <= old->mask) {
+        htable_node_t **bucket = &old->buckets[ht->migrate_pos++];
+        while (*bucket) {
+            htable_node_t *node = *bucket;
+            rcu_assign_pointer(*bucket, node->next);
+
+            htable_node_t **dest = htable_bucket(ht->array, node->hash);
+            node->next = *dest;
+            rcu_assign_pointer(*dest, node);
+        }
+    }
+
+    smp_wmb();
+    atomic_store_relaxed(&ht->seq, ht->seq + 1);
+
+    if (ht->migrate_pos > old->mask) {
+        // Lookups may still be walking the empty array
+        rcu_assign_pointer(ht->old, NULL);
+        call_rcu(&old->rcu, htable_array_free_rcu);
+    }
+}
+
+/**
+ * Start moving to a bucket array of a new size. Does nothing if the
+ * allocation fails, the table keeps working at its current size.
+ */
+static void htable_resize_locked(htable_t *ht, uint32_t size) {
+    // Only one resize at a time, finish the previous one first
+    while (ht->old) {
+        htable_migrate_locked(ht, ht->old->mask + 1);
+    }
+
+    htable_array_t *array = htable_array_alloc(size);
+    if (!array) return;
+
+    // Lookups read old before array, and one that overlaps the swap could
+    // see neither with the entries in them, so make it retry
+    ht->migrate_pos = 0;
+    atomic_store_relaxed(&ht->seq, ht->seq + 1);
+    smp_wmb();
+    rcu_assign_pointer(ht->old, ht->array);
+    rcu_assign_pointer(ht->array, array);
+    smp_wmb();
+    atomic_store_relaxed(&ht->seq, ht->seq + 1);
+}
+
+/**
+ * Search one bucket array
+ */
+static htable_node_t *htable_search(htable_array_t *array, uint32_t hash,
+                                    htable_match_t match, const void *key) {
+    if (!array) return NULL;
+
+    htable_node_t *cur = rcu_dereference(*htable_bucket(array, hash));
+    while (cur) {
+        if (cur->hash == hash && match(cur, key)) {
+            return cur;
+        }
+        cur = rcu_dereference(cur->next);
+    }
+    return NULL;
+}
+
+/**
+ * Interfaces
+ */
+
+void htable_init(htable_t *ht) {
+    spin_lock_init(&ht->lock);
+    ht->seq = 0;
+    ht->array = NULL;
+    ht->old = NULL;
+    ht->migrate_pos = 0;
+    ht->count = 0;
+}
+
+/**
+ * Free a table's bucket arrays. The entries themselves are left alone.
+ * The table must no longer be in use.
+ * @param ht table to act on
+ */
+void htable_destroy(htable_t *ht) {
+    if (ht->old) {
+        kfree((uintptr_t *)ht->old);
+    }
+    if (ht->array) {
+        kfree((uintptr_t *)ht->array);
+    }
+    ht->array = NULL;
+    ht->old = NULL;
+    ht->count = 0;
+}
+
+/**
+ * Add an entry to a table. Duplicate keys are allowed, lookups return the
+ * most recently inserted one.
+ * @param ht   table to act on
+ * @param node node embedded in the entry
+ * @param hash hash of the entry's key
+ * @return K_SUCCESS, or K_OOM if the first bucket array can't be allocated
+ */
+k_return_t htable_insert(htable_t *ht, htable_node_t *node, uint32_t hash) {
+    uint32_t eflags = spin_lock_irqsave(&ht->lock);
+
+    if (!ht->array) {
+        htable_array_t *array = htable_array_alloc(HTABLE_MIN_SIZE);
+        if (!array) {
+            spin_unlock_irqrestore(&ht->lock, eflags);
+            return K_OOM;
+        }
+        rcu_assign_pointer(ht->array, array);
+    }
+
+    htable_migrate_locked(ht, HTABLE_MIGRATE_STEP);
+
+    node->hash = hash;
+    htable_node_t **bucket = htable_bucket(ht->array, hash);
+    node->next = *bucket;
+    rcu_assign_pointer(*bucket, node);
+    ht->count++;
+
+    if (!ht->old && ht->count > HTABLE_MAX_LOAD * (ht->array->mask + 1)) {
+        htable_resize_locked(ht, (ht->array->mask + 1) * 2);
+    }
+
+    spin_unlock_irqrestore(&ht->lock, eflags);
+    return K_SUCCESS;
+}
+
+/**
+ * Remove an entry from a table. Lookups may still return it until the end
+ * of the current grace period.
+ * @param ht   table to act on
+ * @param node node embedded in the entry
+ * @return true if removed, false if the entry isn't in the table
+ */
+bool htable_remove(htable_t *ht, htable_node_t *node) {
+    bool ret = false;
+    uint32_t eflags = spin_lock_irqsave(&ht->lock);
+    if (!ht->array) goto out;
+
+    htable_migrate_locked(ht, HTABLE_MIGRATE_STEP);
+
+    htable_node_t **link = htable_find_link(ht->array, node);
+    if (!link && ht->old) {
+        link = htable_find_link(ht->old, node);
+    }
+    if (!link) goto out;
+
+    // Readers on the node can still follow its next pointer
+    rcu_assign_pointer(*link, node->next);
+    ht->count--;
+    ret = true;
+
+    uint32_t size = ht->array->mask + 1;
+    if (!ht->old && size > HTABLE_MIN_SIZE && ht->count < size / 8) {
+        htable_resize_locked(ht, size / 2);
+    }
+
+out:
+    spin_unlock_irqrestore(&ht->lock, eflags);
+    return ret;
+}
+
+/**
+ * Find an entry. Must be called inside an RCU read-side critical section,
+ * the result is only valid until it ends.
+ * @param ht    table to act on
+ * @param hash  hash of the key to look for
+ * @param match function comparing a candidate against the key
+ * @param key   key to look for, passed to match
+ * @return node of the matching entry, or NULL if there is none
+ */
+htable_node_t *htable_lookup(htable_t *ht, uint32_t hash, htable_match_t match, const void *key) {
+    htable_node_t *res;
+    uint32_t seq;
+
+    do {
+        // Wait out a migration step in progress
+        while ((seq = atomic_load_acquire(&ht->seq)) & 1) {
+            cpu_relax();
+        }
+
+        // Entries not yet migrated are in the old array, the rest and all
+        // new ones in the current array
+        res = htable_search(rcu_dereference(ht->old), hash, match, key);
+        if (!res) {
+            res = htable_search(rcu_dereference(ht->array), hash, match, key);
+        }
+
+        smp_rmb();
+    } while (atomic_load_relaxed(&ht->seq) != seq);
+
+    return res;
+}
+
+/**
+ * Hash a buffer with 32-bit FNV-1a
+ * @param data   data to hash
+ * @param length number of bytes to hash
+ */
+uint32_t hash_fnv1a(const void *data, size_t length) {
+    const uint8_t *p = (const uint8_t *)data;
+    uint32_t hash = FNV1A_OFFSET_BASIS;
+    while (length--) {
+        hash ^= *p++;
+        hash *= FNV1A_PRIME;
+    }
+    return hash;
+}
+
+/**
+ * Hash a NUL-terminated string with 32-bit FNV-1a
+ * @param str string to hash
+ */
+uint32_t hash_fnv1a_str(const char *str) {
+    uint32_t hash = FNV1A_OFFSET_BASIS;
+    while (*str) {
+        hash ^= (uint8_t)*str++;
+        hash *= FNV1A_PRIME;
+    }
+    return hash;
+}
@@ -0,0 +1,148 @@
+/**
+ * Interval tree built on the augmented red-black tree
+ */
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#include <kernel/kernel.h>
+#include <kernel/rbtree.h>
+#include <kernel/interval_tree.h>
+
+/**
+ * Internal functions
+ */
+
+static inline interval_node_t *interval_entry(rb_node_t *rb) {
+    return rb ? rb_entry(rb, interval_node_t, rb) : NULL;
+}
+
+static bool interval_augment(rb_node_t *rb) {
+    interval_node_t *node = interval_entry(rb);
+    uint32_t max = node->last;
+    if (rb->left && interval_entry(rb->left)->subtree_last > max) {
+        max = interval_entry(rb->left)->subtree_last;
+    }
+    if (rb->right && interval_entry(rb->right)->subtree_last > max) {
+        max = interval_entry(rb->right)->subtree_last;
+    }
+
+    if (node->subtree_last == max) return false;
+    node->subtree_last = max;
+    return true;
+}
+
+static int interval_cmp(const rb_node_t *a, const rb_node_t *b) {
+    uint32_t sa = rb_entry(a, interval_node_t, rb)->start;
+    uint32_t sb = rb_entry(b, interval_node_t, rb)->start;
+    return sa < sb ? -1 : sa > sb;
+}
+
+/**
+ * Find the leftmost interval in a subtree overlapping [start, last].
+ * The subtree's subtree_last must be >= start.
+ */
+static interval_node_t *interval_subtree_search(interval_node_t *node, uint32_t start, uint32_t last) {
+    for (;;) {
+        // Anything overlapping on the left comes first
+        interval_node_t *left = interval_entry(node->rb.left);
+        if (left && left->subtree_last >= start) {
+            node = left;
+            continue;
+        }
+        if (node->start > last) {
+            // This and everything to the right starts too late
+            return NULL;
+        }
+        if (node->last >= start) {
+            return node;
+        }
+        node = interval_entry(node->rb.right);
+        if (!node || node->subtree_last < start) {
+            return NULL;
+        }
+    }
+}
+
+/**
+ * Interfaces
+ */
+
+/**
+ * Add an interval. node->start and node->last must be set.
+ * @param root tree to act on
+ * @param node interval to add
+ */
+void interval_tree_insert(rb_root_t *root, interval_node_t *node) {
+    rb_node_t **link = &root->node;
+    rb_node_t *parent = NULL;
+
+    while (*link) {
+        parent = *link;
+        if (node->start < interval_entry(parent)->start) {
+            link = &parent->left;
+        } else {
+            link = &parent->right;
+        }
+    }
+
+    node->subtree_last = node->last;
+    rb_link_node(&node->rb, parent, link);
+    rb_insert_color(root, &node->rb, interval_augment);
+}
+
+void interval_tree_remove(rb_root_t *root, interval_node_t *node) {
+    rb_erase(root, &node->rb, interval_augment);
+}
+
+/**
+ * Get the first interval overlapping [start, last]
+ * @param root  tree to search
+ * @param start first value of the range
+ * @param last  last value of the range
+ * @return interval with the lowest start overlapping the range, or NULL
+ */
+interval_node_t *interval_tree_iter_first(rb_root_t *root, uint32_t start, uint32_t last) {
+    interval_node_t *node = interval_entry(root->node);
+    if (!node || node->subtree_last < start) return NULL;
+    return interval_subtree_search(node, start, last);
+}
+
+/**
+ * Get the next interval overlapping [start, last]
+ * @param node  interval returned by the previous call
+ * @param start first value of the range
+ * @param last  last value of the range
+ * @return next overlapping interval in order of start, or NULL
+ */
+interval_node_t *interval_tree_iter_next(interval_node_t *node, uint32_t start, uint32_t last) {
+    rb_node_t *rb = node->rb.right;
+
+    for (;;) {
+        // Everything in the right subtree comes next
+        interval_node_t *right = interval_entry(rb);
+        if (right && right->subtree_last >= start) {
+            return interval_subtree_search(right, start, last);
+        }
+
+        // Otherwise go up until we come from a left child, that parent is next
+        rb_node_t *prev;
+        do {
+            rb = node->rb.parent;
+            if (!rb) return NULL;
+            prev = &node->rb;
+            node = interval_entry(rb);
+            rb = node->rb.right;
+        } while (prev == rb);
+
+        if (node->start > last) return NULL;
+        if (node->last >= start) return node;
+    }
+}
+
+/**
+ * Check an interval tree for consistency, see rb_verify()
+ */
+k_return_t interval_tree_verify(rb_root_t *root) {
+    return rb_verify(root, interval_cmp, interval_augment);
+}
@@ -16,6 +16,14 @@
 #include <kernel/kernel_stdio.h>
 #include <kernel/kernel_terminal.h>
 #include <kernel/bitset.h>
+#include <kernel/gap_tree.h>
+#include <kernel/interval_tree.h>
+#include <kernel/lfstack.h>
+#include <kernel/mpmc.h>
+#include <kernel/printk.h>
+#include <kernel/radix_tree.h>
+#include <kernel/timer.h>
+#include <kernel/workqueue.h>
 #include <mm/heap.h>
 #include <mm/paging.h>
 #include <mm/alloc.h>
@@ -23,12 +31,14 @@
 
 /* Driver includes */
 #include <drivers/vga/textmode.h>
+#include <drivers/vga/fbcon.h>
 #include <drivers/pci/pci.h>
 
 /* Architecture specific driver includes */
 #include <drivers/pc/pit.h>
 #include <drivers/pc/pckbd.h>
 #include <drivers/pc/pckbd_us.h>
+#include <drivers/pc/uart.h>
 
 /* Architecture specific includes */
 #include <pc.h>
@@ -39,8 +49,13 @@
 #include <arch/i386/io.h>
 #include <arch/i386/mem.h>
 #include <arch/i386/paging.h>
+#include <arch/i386/percpu.h>
+#include <arch/i386/smp.h>
 
 void kernel_early(uint32_t mboot_magic, multiboot_info_t *mboot_header) {
+    // Pick memcpy/memset variants for this CPU before anything big is copied
+    string_init();
+
     // Set up kernel terminal for early output
     //kernel_terminal_init(14);
     // Verify multiboot magic
@@ -67,9 +82,18 @@ void kernel_early(uint32_t mboot_magic, multiboot_info_t *mboot_header) {
     // Install kernel heap as default malloc/free provider
     kheap_kalloc_install();
 
+    // Move the boot CPU onto its own per-CPU area before anything uses one
+    percpu_init();
+
     // Install drivers
     pit_timer_install_irq(); // Install PIT driver
     pckbd_install_irq(&pckbd_us_qwerty); // Install US PS/2 driver
+    if (uart_init() == K_SUCCESS) { // Mirror the console to COM1
+        printk_debug("Serial console on COM1");
+    }
+    if (fbcon_init() == K_SUCCESS) { // Take the screen over from VGA text mode
+        printk_debug("Framebuffer console %ux%u", fbcon_columns(), fbcon_rows());
+    }
     //pci_init(); // Install PCI driver
 
     // Add kernel task to PIT
@@ -79,22 +103,97 @@ void kernel_early(uint32_t mboot_magic, multiboot_info_t *mboot_header) {
     };
     pit_install_scheduler_routine(kernel_task_pit_routine);
 
+    // Start the kernel timer queue
+    ktimer_install();
+
+    // Start threading, the boot context becomes the first thread
+    kernel_thread_init();
+
     //_i386_print_reserved();
 
     __asm__ __volatile__ ("sti");
     printk_debug("Interrupts Enabled!");
+
+    // Bring up the other CPUs
+    smp_init();
+
+    // Start worker pools on every CPU
+    workqueue_init();
+
+    // Hand console output over to the log consumer thread
+    printk_start_consumer();
+}
+
+#if 0 // Lock-free queue/stack stress test threads, see kernel_main
+#define LF_TEST_COUNT 100000 // Items per producer
+#define LF_TEST_NODES 64     // Nodes cycled through the stack
+
+static mpmc_queue_t lf_test_queue;
+static uint32_t lf_test_consumed = 0;
+static uint32_t lf_test_total = 0;
+static uint64_t lf_test_sum = 0;
+
+static lfstack_t lf_test_stack = LFSTACK_INIT;
+static lfstack_node_t lf_test_nodes[LF_TEST_NODES];
+
+static void *lf_test_producer(void *arg) {
+    uint32_t id = (uint32_t)arg;
+    uint32_t i;
+    for (i=1; i<=LF_TEST_COUNT; i++) {
+        // Entries encode producer and sequence number, never NULL
+        while (!mpmc_enqueue(&lf_test_queue, (void *)((id << 20) | i))) {
+            kernel_thread_yield();
+        }
+    }
+    return NULL;
+}
+
+static void *lf_test_consumer(void *arg) {
+    uint32_t last[SMP_MAX_CPUS] = { 0 };
+    uint64_t sum = 0;
+    arg = arg;
+
+    while (atomic_load_acquire(&lf_test_consumed) < lf_test_total) {
+        void *item;
+        if (!mpmc_dequeue(&lf_test_queue, &item)) {
+            kernel_thread_yield();
+            continue;
+        }
+        atomic_inc(&lf_test_consumed);
+
+        // Entries from one producer must come out in the order they went in
+        uint32_t id = (uint32_t)item >> 20;
+        uint32_t seq = (uint32_t)item & 0xFFFFF;
+        if (seq <= last[id]) {
+            PANIC("MPMC queue reordered entries of a producer!");
+        }
+        last[id] = seq;
+        sum += seq;
+    }
+    __atomic_fetch_add(&lf_test_sum, sum, __ATOMIC_SEQ_CST);
+
+    // Now hammer the stack, every node popped must be pushed back
+    uint32_t i;
+    for (i=0; i<LF_TEST_COUNT; i++) {
+        lfstack_node_t *node = lfstack_pop(&lf_test_stack);
+        if (node) {
+            lfstack_push(&lf_test_stack, node);
+        }
+    }
+    return NULL;
 }
+#endif
 
 void kernel_main() {
-    vga_textmode_writestring("Welcome to ");
+    printf("Welcome to ");
     vga_textmode_setcolor(COLOR_CYAN);
-    vga_textmode_writestring("ShawnOS ");
+    printf("ShawnOS ");
     vga_textmode_setcolor(make_color(COLOR_LIGHT_GREY, COLOR_BLACK));
-    vga_textmode_writestring("Version ");
+    printf("Version ");
     vga_textmode_setcolor(COLOR_RED);
-    vga_textmode_writestring("0.01 Alpha");
+    printf("0.01 Alpha");
     vga_textmode_setcolor(make_color(COLOR_LIGHT_GREY, COLOR_BLACK));
-    vga_textmode_writestring("!\n\n");
+    printf("!\n\n");
 
     /*
     for (;;) {
@@ -115,7 +214,7 @@ void kernel_main() {
     //i386_allocate_page(&i386_kernel_mmu_data, 0x400000, PT_PRESENT | PT_RW, PD_PRESENT | PD_RW, NULL);
     //memset((void *)0x400000, 0x00, 0x1000);
 
-#if 1 // Test page allocation
+#if 0 // Test page allocation
     k_return_t ret;
     for (;;) {
         void *tmp = asa_alloc(1);
@@ -146,6 +245,147 @@ void kernel_main() {
     }
 #endif
 
+#if 0 // Stress lock-free MPMC queue and stack with a producer and consumer per CPU
+    {
+        kthread_t *threads[SMP_MAX_CPUS * 2];
+        uint32_t cpu, nr_threads = 0, nr_producers = 0;
+
+        ASSERT(mpmc_queue_init(&lf_test_queue, 256) == K_SUCCESS);
+        for (cpu=0; cpu<LF_TEST_NODES; cpu++) {
+            lfstack_push(&lf_test_stack, &lf_test_nodes[cpu]);
+        }
+        for (cpu=0; cpu<smp_num_cpus; cpu++) {
+            if (smp_cpus[cpu].online) nr_producers++;
+        }
+        lf_test_total = nr_producers * LF_TEST_COUNT;
+
+        for (cpu=0; cpu<smp_num_cpus; cpu++) {
+            if (!smp_cpus[cpu].online) continue;
+            threads[nr_threads++] = kernel_thread_create_on(cpu, "lf-producer", lf_test_producer, (void *)cpu);
+            threads[nr_threads++] = kernel_thread_create_on(cpu, "lf-consumer", lf_test_consumer, NULL);
+        }
+        while (nr_threads) {
+            kernel_thread_join(threads[--nr_threads], NULL);
+        }
+
+        uint64_t expected = (uint64_t)nr_producers * LF_TEST_COUNT * (LF_TEST_COUNT + 1) / 2;
+        if (lf_test_sum != expected) {
+            PANIC("MPMC queue lost or duplicated entries!");
+        }
+
+        uint32_t nodes = 0;
+        lfstack_node_t *node;
+        for (node = lfstack_pop_all(&lf_test_stack); node; node = node->next) {
+            nodes++;
+        }
+        if (nodes != LF_TEST_NODES) {
+            PANIC("Lock-free stack lost or duplicated nodes!");
+        }
+        printk_debug("GOOD: lock-free queue and stack passed on %u CPUs", nr_producers);
+    }
+#endif
+
+#if 0 // Randomized red-black tree test, checks every tree after each change
+    {
+        static interval_node_t intervals[256];
+        static gap_node_t regions[256];
+        static bool used[256], allocated[256];
+        rb_root_t itree = RB_ROOT_INIT;
+        gap_tree_t gtree;
+        uint32_t seed = 12345;
+        uint32_t i;
+
+        gap_tree_init(&gtree, 0x1000, 0x1000000);
+        for (i=0; i<100000; i++) {
+            seed = seed * 1103515245 + 12345;
+            uint32_t n = (seed >> 16) & 0xFF;
+            uint32_t r = seed >> 8;
+
+            if (used[n]) {
+                interval_tree_remove(&itree, &intervals[n]);
+            } else {
+                intervals[n].start = r & 0xFFFF;
+                intervals[n].last = intervals[n].start + (r >> 16);
+                interval_tree_insert(&itree, &intervals[n]);
+            }
+            used[n] = !used[n];
+
+            if (allocated[n]) {
+                gap_tree_remove(&gtree, &regions[n]);
+                allocated[n] = false;
+            } else {
+                allocated[n] = !K_FAILED(gap_tree_alloc(&gtree, &regions[n], ((r & 0xF) + 1) * 0x1000, 0x1000));
+            }
+
+            if (K_FAILED(interval_tree_verify(&itree)) || K_FAILED(gap_tree_verify(&gtree))) {
+                PANIC("Red-black tree is inconsistent!");
+            }
+
+            // Every interval overlapping a random range must be found, in order
+            uint32_t start = r & 0xFFFF, last = start + 0x100, found = 0, expected = 0;
+            uint32_t j;
+            interval_node_t *node;
+            interval_tree_for_each(node, &itree, start, last) {
+                found++;
+            }
+            for (j=0; j<256; j++) {
+                if (used[j] && intervals[j].start <= last && intervals[j].last >= start) {
+                    expected++;
+                }
+            }
+            if (found != expected) {
+                PANIC("Interval tree query missed intervals!");
+            }
+        }
+        printk_debug("GOOD: red-black trees passed");
+    }
+#endif
+
+#if 0 // Test radix tree lookup, tags and range iteration on sparse indices
+    {
+        static uint32_t values[1024];
+        radix_tree_t tree = RADIX_TREE_INIT;
+        uint32_t i, index, found;
+        void *entry;
+
+        // Spread the entries over the whole index space
+        for (i=0; i<1024; i++) {
+            values[i] = i * 0x3FFFC1;
+            ASSERT(radix_tree_insert(&tree, values[i], &values[i]) == K_SUCCESS);
+            if (i & 1) {
+                radix_tree_tag_set(&tree, values[i], RADIX_TREE_TAG_DIRTY);
+            }
+        }
+        for (i=0; i<1024; i++) {
+            if (radix_tree_lookup(&tree, values[i]) != &values[i] || radix_tree_lookup(&tree, values[i] + 1)) {
+                PANIC("Radix tree lookup returned the wrong entry!");
+            }
+        }
+
+        found = 0;
+        radix_tree_for_each(&tree, index, entry, 0, UINT32_MAX) {
+            if (entry != &values[found++]) {
+                PANIC("Radix tree iteration out of order!");
+            }
+        }
+        found = 0;
+        radix_tree_for_each_tagged(&tree, index, entry, 0, UINT32_MAX, RADIX_TREE_TAG_DIRTY) {
+            found++;
+        }
+        if (found != 512) {
+            PANIC("Radix tree tagged iteration missed entries!");
+        }
+
+        for (i=0; i<1024; i++) {
+            ASSERT(radix_tree_delete(&tree, values[i]) == &values[i]);
+        }
+        if (tree.root || radix_tree_tagged(&tree, RADIX_TREE_TAG_DIRTY)) {
+            PANIC("Radix tree not empty after deleting everything!");
+        }
+        printk_debug("GOOD: radix tree passed");
+    }
+#endif
+
 #if 0 // Test ASA
     for (;;) {
         // Stress ASA
@@ -156,7 +396,8 @@ void kernel_main() {
     }
 #endif
 
-    for(;;);
+    // Nothing left to do on the boot thread, let the idle thread halt the CPU
+    kernel_thread_exit(NULL);
 }
 
 /**
@@ -170,14 +411,8 @@ void kernel_task() {
  * Prints a kernel DEBUG message
  */
 void printk_debug(char *fmt, ...) {
-    vga_textmode_setcolor(COLOR_RED);
-    vga_textmode_writestring("DEBUG: ");
-    vga_textmode_setcolor(make_color(COLOR_LIGHT_GREY, COLOR_BLACK));
-
     va_list args;
     va_start(args,fmt);
-    vprintf(fmt, args);
+    vprintk(LOG_DEBUG, "kernel", fmt, args);
     va_end(args);
-
-    putchar('\n');
 }
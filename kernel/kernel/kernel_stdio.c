@@ -1,5 +1,10 @@
 /**
  * Kernel STDIO buffers
+ *
+ * stdin is fed by the keyboard interrupt and drained by threads, stdout is
+ * fed by threads and drained by the terminal. Both are lock-free SPSC rings,
+ * so the interrupt side never waits on the thread side or the other way
+ * round. Writers to stdout serialize among themselves with a spinlock.
  */
 
 #include <stdint.h>
@@ -8,66 +13,142 @@
 
 #include <kernel/kernel.h>
 #include <kernel/kernel_stdio.h>
-
-char kernel_buffer_stdin[STDIN_MAX_BUFFER];
-char kernel_buffer_stdout[STDOUT_MAX_BUFFER];
-
-uint16_t kernel_buffer_stdin_length = 0;
-uint16_t kernel_buffer_stdout_length = 0;
+#include <kernel/kernel_thread.h>
+#include <kernel/mutex.h>
+#include <kernel/ringbuf.h>
+#include <kernel/sched.h>
+#include <kernel/spinlock.h>
+#include <kernel/wait.h>
+
+#include <arch/i386/cpu.h>
+
+static void kernel_buffer_wake(ringbuf_t *rb);
+
+static char kernel_buffer_stdin[STDIN_RING_SIZE];
+static char kernel_buffer_stdout[STDOUT_RING_SIZE];
+
+// Readers waiting for input
+static wait_queue_t kernel_stdin_wait = WAIT_QUEUE_INIT;
+// Writers waiting for the terminal to drain stdout
+static wait_queue_t kernel_stdout_wait = WAIT_QUEUE_INIT;
+
+static ringbuf_t kernel_stdin_ring = {
+    .data = (uint8_t *)kernel_buffer_stdin,
+    .mask = STDIN_RING_SIZE - 1,
+    .on_data = kernel_buffer_wake,
+    .on_space = NULL,
+    .priv = &kernel_stdin_wait,
+    .head = 0,
+    .tail = 0
+};
+
+static ringbuf_t kernel_stdout_ring = {
+    .data = (uint8_t *)kernel_buffer_stdout,
+    .mask = STDOUT_RING_SIZE - 1,
+    .on_data = NULL,
+    .on_space = kernel_buffer_wake,
+    .priv = &kernel_stdout_wait,
+    .head = 0,
+    .tail = 0
+};
+
+// Only one thread may consume stdin at a time
+static mutex_t kernel_stdin_lock = MUTEX_INIT;
+// Serializes producers of stdout
+static spinlock_t kernel_stdout_lock = SPINLOCK_INIT;
+
+// Bytes thrown away because a buffer was full and the writer couldn't wait
+uint32_t kernel_buffer_stdin_dropped = 0;
+uint32_t kernel_buffer_stdout_dropped = 0;
+
+static void kernel_buffer_wake(ringbuf_t *rb) {
+    wait_queue_wake_all((wait_queue_t *)rb->priv);
+}
 
 void kernel_buffer_stdin_flush() {
-    /*
-     * We don't actually need to wipe the buffer,
-     * we just need to set its length to 0 so it can be
-     * marked to be overwritten
-     */
-
-    kernel_buffer_stdin_length = 0;
+    mutex_lock(&kernel_stdin_lock);
+    ringbuf_discard(&kernel_stdin_ring);
+    mutex_unlock(&kernel_stdin_lock);
 }
 
+/**
+ * Throw away unprinted output. Must be called from the stdout consumer.
+ */
 void kernel_buffer_stdout_flush() {
-    /*
-     * We don't actually need to wipe the buffer,
-     * we just need to set its length to 0 so it can be
-     * marked to be overwritten
-     */
-
-    kernel_buffer_stdout_length = 0;
+    ringbuf_discard(&kernel_stdout_ring);
 }
 
+/**
+ * Add a character of input. Called from the keyboard interrupt, so if
+ * nobody has been reading and the buffer is full the character is dropped.
+ */
 void kernel_buffer_stdin_writechar(char c) {
-    if (kernel_buffer_stdin_length >= STDIN_MAX_BUFFER) {
-        kernel_buffer_stdin_flush();
+    if (!ringbuf_put(&kernel_stdin_ring, (uint8_t)c)) {
+        kernel_buffer_stdin_dropped++;
     }
+}
 
-    kernel_buffer_stdin[kernel_buffer_stdin_length++] = c;
+/**
+ * Read a character of input, blocking until one is available.
+ * Must be called from thread context.
+ * @return character read
+ */
+char kernel_buffer_stdin_getchar() {
+    uint8_t c;
+    mutex_lock(&kernel_stdin_lock);
+    wait_event(&kernel_stdin_wait, !ringbuf_empty(&kernel_stdin_ring));
+    ringbuf_get(&kernel_stdin_ring, &c);
+    mutex_unlock(&kernel_stdin_lock);
+    return (char)c;
 }
 
-void kernel_buffer_stdout_writechar(char c) {
-    if (kernel_buffer_stdout_length >= STDOUT_MAX_BUFFER) {
-        kernel_buffer_stdout_flush();
-    }
+/**
+ * Read whatever input is available without blocking.
+ * Must be called from thread context.
+ * @param buffer buffer to read into
+ * @param length size of buffer
+ * @return number of characters read
+ */
+size_t kernel_buffer_stdin_read(char *buffer, size_t length) {
+    mutex_lock(&kernel_stdin_lock);
+    size_t res = ringbuf_read(&kernel_stdin_ring, buffer, length);
+    mutex_unlock(&kernel_stdin_lock);
+    return res;
+}
 
-    kernel_buffer_stdout[kernel_buffer_stdout_length++] = c;
+void kernel_buffer_stdout_writechar(char c) {
+    kernel_buffer_stdout_writestring(&c, 1);
 }
 
+/**
+ * Queue output for the terminal. Threads wait for space when the buffer is
+ * full. Interrupt handlers and code running with interrupts disabled can't,
+ * so whatever doesn't fit is dropped.
+ * @param str    characters to write
+ * @param length number of characters to write
+ */
 void kernel_buffer_stdout_writestring(char *str, size_t length) {
-  size_t i;
-  for (i=0; i<length; i++) {
-    kernel_buffer_stdout_writechar(str[i]);
-  }
+    while (length) {
+        uint32_t eflags = spin_lock_irqsave(&kernel_stdout_lock);
+        uint32_t written = ringbuf_write(&kernel_stdout_ring, str, length);
+        spin_unlock_irqrestore(&kernel_stdout_lock, eflags);
+        str += written;
+        length -= written;
+        if (!length) break;
+
+        if (in_interrupt() || !(eflags & EFLAGS_IF) || !kernel_thread_current()) {
+            kernel_buffer_stdout_dropped += length;
+            break;
+        }
+        wait_event(&kernel_stdout_wait, ringbuf_space(&kernel_stdout_ring) > 0);
+    }
 }
 
 /**
- * Get stdout buffer and flush
- * @param char *buffer buffer to place stdout in
+ * Get stdout buffer and flush. Must only be called by one consumer at a time.
+ * @param char *buffer buffer to place stdout in, at least STDOUT_MAX_BUFFER long
  * @return uint16_t size of buffer
  */
 uint16_t kernel_buffer_stdout_get(char *buffer) {
-    strncpy(buffer, kernel_buffer_stdout, kernel_buffer_stdout_length);
-    uint16_t temp = kernel_buffer_stdout_length;
-
-    kernel_buffer_stdout_flush();
-
-    return temp;
+    return ringbuf_read(&kernel_stdout_ring, buffer, STDOUT_MAX_BUFFER);
 }
@@ -6,6 +6,7 @@
 #include <stdint.h>
 #include <stddef.h>
 #include <stdbool.h>
+#include <string.h>
 
 #include <kernel/kernel_terminal.h>
 #include <kernel/kernel_stdio.h>
@@ -38,19 +39,59 @@ uint8_t color;
 bool is_ansi_escape = false;
 uint8_t ansi_escape_length = 0;
 
+// Ring of screen rows, the top of the screen is row terminal_top. Scrolling
+// just advances terminal_top instead of moving every row.
 uint16_t terminal_buffer[VGA_HEIGHT * VGA_WIDTH];
+static size_t terminal_top = 0;
+
+// Index in terminal_buffer of the row shown at screen row y
+#define TERMINAL_ROW(y) ((terminal_top + (y)) % VGA_HEIGHT)
+
+// Columns [start, end) of each row of terminal_buffer that haven't been
+// copied to video memory yet. Empty when start >= end.
+static uint8_t terminal_dirty_start[VGA_HEIGHT];
+static uint8_t terminal_dirty_end[VGA_HEIGHT];
+
+/**
+ * Mark a run of cells in a row as changed
+ */
+static void kernel_terminal_mark_dirty(size_t x, size_t y, size_t count) {
+    size_t row = TERMINAL_ROW(y);
+    if (x < terminal_dirty_start[row])
+        terminal_dirty_start[row] = x;
+    if (x + count > terminal_dirty_end[row])
+        terminal_dirty_end[row] = x + count;
+}
+
+/**
+ * Copy the changed part of every row to video memory
+ */
+static void kernel_terminal_flush() {
+    for (size_t y = 0; y < VGA_HEIGHT; y++) {
+        size_t row = TERMINAL_ROW(y);
+        size_t start = terminal_dirty_start[row];
+        size_t end = terminal_dirty_end[row];
+        if (start < end) {
+            vga_textmode_writespan(&terminal_buffer[row * VGA_WIDTH + start], start, y, end - start);
+        }
+        terminal_dirty_start[row] = VGA_WIDTH;
+        terminal_dirty_end[row] = 0;
+    }
+}
 
 void kernel_terminal_init(uint16_t refresh_rate) {
     // Initalize driver for device to output to
     vga_textmode_initialize();
     color = make_color(COLOR_LIGHT_GREY, COLOR_BLACK);
 
-    // Initialize empty terminal_buffer
+    // Initialize empty terminal_buffer, the driver already cleared the screen
     for (size_t y = 0; y < VGA_HEIGHT; y++) {
         for (size_t x = 0; x < VGA_WIDTH; x++) {
             const size_t index = y * VGA_WIDTH + x;
             terminal_buffer[index] = make_vgaentry(' ', color);
         }
+        terminal_dirty_start[y] = VGA_WIDTH;
+        terminal_dirty_end[y] = 0;
     }
 
     // Install terminal update tick to timer
@@ -73,39 +114,26 @@ void kernel_terminal_update_tick() {
     uint16_t stdout_buffer_length = kernel_buffer_stdout_get(stdout_buffer);
 
     if(stdout_buffer_length != 0) {
-        // Refresh current console
-        vga_textmode_clear();
-
-
-
-
         for(i=0; i<stdout_buffer_length; i++) {
             char cur_char = stdout_buffer[i];
 
             // Parse char for terminal escape codes
-
-
             if (kernel_terminal_check_escapecode(cur_char) || is_ansi_escape) {
                 kernel_terminal_handle_escapecode(cur_char);
                 kernel_terminal_handle_scroll();
-                kernel_terminal_update_cursor();
             } else { // No escape codes
-
-                // Check for overflow and wrap text accordingly
-
+                // Check for overflow and wrap text accordingly, then
+                // check for need to scroll and handle
                 kernel_terminal_handle_overflow();
                 kernel_terminal_handle_scroll();
 
-                // Check for need to scroll and handle
-
-
                 kernel_terminal_putentry(cur_char, color, cur_xpos++, cur_ypos);
-                kernel_terminal_update_cursor();
             }
         }
-        // Restore old text from our buffer
-        vga_textmode_writebuffer(terminal_buffer, VGA_WIDTH*VGA_HEIGHT);
 
+        // Only the cells that changed since the last tick go to video memory
+        kernel_terminal_flush();
+        kernel_terminal_update_cursor();
     }
 }
 
@@ -115,28 +143,30 @@ void kernel_terminal_update_tick() {
  */
 void kernel_terminal_handle_scroll() {
     if (cur_ypos == VGA_HEIGHT) {
-        for(size_t y = 0; y < VGA_HEIGHT; y++) {
-            for(size_t x = 0; x < VGA_WIDTH; x++) {
-                const size_t index = y * VGA_WIDTH + x;
-                const size_t nextrow_index = index + VGA_WIDTH;
-
-                if(y == VGA_HEIGHT-1)
-                    kernel_terminal_putentry(' ', color, x, y);
-                else
-                    terminal_buffer[index] = terminal_buffer[nextrow_index];
-            }
+        // The driver scrolls video memory as it is, so bring it up to date
+        // first. That also puts the right text into the scrollback.
+        kernel_terminal_flush();
+        vga_textmode_scroll();
+
+        // The old top row becomes the new, blank, bottom row. The driver
+        // already blanked it on screen, so it isn't dirty.
+        uint16_t *row = &terminal_buffer[terminal_top * VGA_WIDTH];
+        for (size_t x = 0; x < VGA_WIDTH; x++) {
+            row[x] = make_vgaentry(' ', color);
         }
-        //vga_textmode_writebuffer(terminal_buffer, VGA_WIDTH*VGA_HEIGHT);
+        terminal_top = (terminal_top + 1) % VGA_HEIGHT;
         cur_ypos--;
     }
 }
 
+/**
+ * Move the hardware cursor to the current position
+ */
 void kernel_terminal_update_cursor() {
-    if(cur_xpos == 0)
-        kernel_terminal_putentry('_', color, cur_xpos, cur_ypos);
-    else {
-        kernel_terminal_putentry('_', color, cur_xpos, cur_ypos);
-    }
+    // After filling the last column the position stays past it until the
+    // next character wraps, keep the cursor on screen meanwhile
+    size_t x = cur_xpos < VGA_WIDTH ? cur_xpos : VGA_WIDTH - 1;
+    vga_textmode_set_cursor(x, cur_ypos);
 }
 
 
@@ -172,10 +202,8 @@ void kernel_terminal_handle_escapecode(char c) {
     // Handle normal escapes
     switch(c) {
         case '\n':
-            kernel_terminal_putentry(' ', color, cur_xpos, cur_ypos);
             cur_ypos++;
             cur_xpos = 0;
-            kernel_terminal_update_cursor();
             return;
         case '\b':
             kernel_terminal_backspace();
@@ -214,29 +242,23 @@ void kernel_terminal_handle_overflow() {
  * Removes the last printed character in display and terminal buffer
  */
 void kernel_terminal_backspace() {
-    kernel_terminal_putentry(' ', color, cur_xpos, cur_ypos);
-    if (cur_xpos == 0 && cur_ypos == 0) {
-        kernel_terminal_putentry(' ', color, 0, 0);
-    } else if(cur_xpos == 0) {
-        // do absolutely nothing! :D
-    }
-    else {
-        kernel_terminal_putentry(' ', color, cur_xpos, cur_ypos);
-        cur_xpos--;
+    if (cur_xpos == 0) {
+        // Don't go back past the start of the line
+        return;
     }
+    cur_xpos--;
+    kernel_terminal_putentry(' ', color, cur_xpos, cur_ypos);
 }
 
 /**
- * Put character in both display buffer and local terminal buffer
+ * Put character in local terminal buffer. It is copied to the display
+ * on the next update tick.
  * @param c     char to put
  * @param color color of char to put
  * @param x     x coordinate
  * @param y     y coordinate
 */
 void kernel_terminal_putentry(char c, uint8_t color, size_t x, size_t y) {
-    // Update actual VGA output
-    vga_textmode_putentryat(c, color, x, y);
-
-    // Update local buffer
-    terminal_buffer[y * VGA_WIDTH + x] = make_vgaentry(c, color);
+    terminal_buffer[TERMINAL_ROW(y) * VGA_WIDTH + x] = make_vgaentry(c, color);
+    kernel_terminal_mark_dirty(x, y, 1);
 }
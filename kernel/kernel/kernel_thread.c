@@ -5,11 +5,313 @@
  */
 
 #include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include <kernel/kernel.h>
+#include <kernel/kernel_thread.h>
+#include <kernel/sched.h>
+#include <kernel/atomic.h>
+#include <kernel/spinlock.h>
+#include <kernel/timer.h>
+#include <mm/alloc.h>
 
 /* Architecture specific includes */
-#include <drivers/pc/pit.h>
+#include <arch/i386/cpu.h>
+
+// Thread representing the boot context (kernel_early/kernel_main)
+static kthread_t kthread_boot;
+
+// Exited detached threads waiting to have their memory freed
+static kthread_t *kthread_zombies = NULL;
+
+// Protects joiner/detach bookkeeping and the zombie list
+static spinlock_t kthread_lock = SPINLOCK_INIT;
+
+static uint32_t kthread_next_tid = 0;
+
+/**
+ * Wait until no CPU is using a thread's context any more
+ */
+static void kernel_thread_wait_off_cpu(kthread_t *thread) {
+    while (thread->sched.on_cpu) {
+        cpu_relax();
+    }
+}
+
+/**
+ * Free the stacks and structures of exited detached threads.
+ * Must be called from thread context with interrupts enabled.
+ */
+static void kernel_thread_reap() {
+    uint32_t eflags = spin_lock_irqsave(&kthread_lock);
+    kthread_t *cur = kthread_zombies;
+    kthread_zombies = NULL;
+    spin_unlock_irqrestore(&kthread_lock, eflags);
+
+    while (cur) {
+        kthread_t *next = cur->next;
+        kernel_thread_wait_off_cpu(cur);
+        kfree((uintptr_t *)cur->stack);
+        kfree((uintptr_t *)cur);
+        cur = next;
+    }
+}
+
+/**
+ * First function executed by every new thread
+ */
+static void kernel_thread_start() {
+    // We were switched to with the run queue locked and interrupts disabled
+    sched_finish_switch();
+    __asm__ __volatile__ ("sti");
+
+    kthread_t *self = sched_current();
+    kernel_thread_exit(self->entry(self->arg));
+}
+
+static void *kernel_thread_idle(void *arg) {
+    arg = arg;
+    sched_idle();
+}
+
+/**
+ * Allocate a new thread and its stack without making it runnable
+ */
+static kthread_t *kernel_thread_alloc(const char *name, void *(*entry)(void *), void *arg) {
+    kthread_t *thread = (kthread_t *)kmalloc(sizeof(kthread_t), KALLOC_GENERAL);
+    if (!thread) return NULL;
+    void *stack = kmalloc(KTHREAD_STACK_SIZE, KALLOC_GENERAL);
+    if (!stack) {
+        kfree((uintptr_t *)thread);
+        return NULL;
+    }
+
+    memset(thread, 0, sizeof(kthread_t));
+    strncpy(thread->name, name, KTHREAD_NAME_LENGTH - 1);
+    thread->stack = stack;
+    thread->entry = entry;
+    thread->arg = arg;
+    sched_info_init(thread, SCHED_POLICY_FAIR, SCHED_DEFAULT_PRIO);
+
+    // Build the initial stack so that _thread_switch "returns" into
+    // kernel_thread_start. Layout must match switch.asm.
+    uint32_t *sp = (uint32_t *)((uintptr_t)stack + KTHREAD_STACK_SIZE);
+    *--sp = 0;                               // Fake return address for kernel_thread_start
+    *--sp = (uint32_t)kernel_thread_start;   // Return address of _thread_switch
+    *--sp = 0;                               // EFLAGS (interrupts disabled)
+    *--sp = 0;                               // ebp
+    *--sp = 0;                               // ebx
+    *--sp = 0;                               // esi
+    *--sp = 0;                               // edi
+    thread->esp = (uint32_t)sp;
+
+    thread->tid = atomic_fetch_add(&kthread_next_tid, 1);
+
+    return thread;
+}
+
+/**
+ * Interfaces for managing threads
+ */
+
+/**
+ * Set up threading. The calling context becomes the boot thread.
+ * Must be called after the kernel heap and kernel timers are installed.
+ */
+void kernel_thread_init() {
+    kthread_boot.tid = atomic_fetch_add(&kthread_next_tid, 1);
+    strcpy(kthread_boot.name, "boot");
+    sched_info_init(&kthread_boot, SCHED_POLICY_FAIR, SCHED_DEFAULT_PRIO);
+
+    // Create the idle thread. It never goes on the run queue and is only
+    // picked when nothing else is runnable
+    kthread_t *idle = kernel_thread_alloc("idle", kernel_thread_idle, NULL);
+    ASSERT(idle);
+    idle->flags |= KTHREAD_IDLE;
+    sched_info_init(idle, SCHED_POLICY_FAIR, SCHED_PRIO_MAX - 1);
+
+    sched_init(&kthread_boot, idle);
+}
+
+/**
+ * Set up threading on an application processor. The calling context
+ * becomes the CPU's idle thread. Called with interrupts disabled.
+ * @param cpu   logical index of the calling CPU
+ * @param stack stack the calling context runs on
+ */
+void kernel_thread_init_ap(uint32_t cpu, void *stack) {
+    kthread_t *idle = (kthread_t *)kmalloc(sizeof(kthread_t), KALLOC_GENERAL);
+    ASSERT(idle);
+
+    memset(idle, 0, sizeof(kthread_t));
+    strcpy(idle->name, "idle");
+    idle->tid = atomic_fetch_add(&kthread_next_tid, 1);
+    idle->flags = KTHREAD_IDLE;
+    idle->stack = stack;
+    sched_info_init(idle, SCHED_POLICY_FAIR, SCHED_PRIO_MAX - 1);
+
+    sched_init_cpu(cpu, idle, idle);
+    sched_idle();
+}
+
+/**
+ * Create a new kernel thread and make it runnable
+ * @param name  name of the thread, for debugging
+ * @param entry function to run in the new thread
+ * @param arg   argument to pass to entry
+ * @return pointer to new thread, or NULL if out of memory
+ */
+kthread_t *kernel_thread_create(const char *name, void *(*entry)(void *), void *arg) {
+    kernel_thread_reap();
+
+    kthread_t *thread = kernel_thread_alloc(name, entry, arg);
+    if (!thread) return NULL;
+
+    sched_enqueue(thread);
+    return thread;
+}
+
+/**
+ * Create a new kernel thread bound to a CPU and make it runnable
+ * @param cpu   logical index of the CPU to run the thread on
+ * @param name  name of the thread, for debugging
+ * @param entry function to run in the new thread
+ * @param arg   argument to pass to entry
+ * @return pointer to new thread, or NULL if out of memory
+ */
+kthread_t *kernel_thread_create_on(uint32_t cpu, const char *name, void *(*entry)(void *), void *arg) {
+    kernel_thread_reap();
+
+    kthread_t *thread = kernel_thread_alloc(name, entry, arg);
+    if (!thread) return NULL;
+
+    sched_enqueue_on(thread, cpu);
+    return thread;
+}
+
+/**
+ * Terminate the calling thread
+ * @param retval value to hand to the thread joining this one
+ */
+void kernel_thread_exit(void *retval) {
+    cpu_irq_save();
+
+    kthread_t *self = sched_current();
+    spin_lock(&kthread_lock);
+    self->retval = retval;
+    self->state = KTHREAD_ZOMBIE;
+
+    if (self->flags & KTHREAD_DETACHED) {
+        // Nobody will join us, let the next thread creation free our memory
+        self->next = kthread_zombies;
+        kthread_zombies = self;
+    } else if (self->joiner) {
+        kernel_thread_wake(self->joiner);
+    }
+    spin_unlock(&kthread_lock);
+
+    sched_schedule();
+    PANIC("Zombie thread was rescheduled!");
+    __builtin_unreachable();
+}
+
+/**
+ * Wait for a thread to exit and free it
+ * @param thread thread to wait for
+ * @param[out] retval pointer to store the thread's return value at, or NULL
+ * @return K_SUCCESS, or K_INVALOP if the thread is detached, the caller itself,
+ *         or already being joined
+ */
+k_return_t kernel_thread_join(kthread_t *thread, void **retval) {
+    uint32_t eflags = spin_lock_irqsave(&kthread_lock);
+    if (thread == sched_current() || (thread->flags & KTHREAD_DETACHED) || thread->joiner) {
+        spin_unlock_irqrestore(&kthread_lock, eflags);
+        return K_INVALOP;
+    }
+
+    thread->joiner = sched_current();
+    while (thread->state != KTHREAD_ZOMBIE) {
+        spin_unlock(&kthread_lock);
+        kernel_thread_block();
+        spin_lock(&kthread_lock);
+    }
+    spin_unlock_irqrestore(&kthread_lock, eflags);
+
+    // The thread may still be switching away on another CPU
+    kernel_thread_wait_off_cpu(thread);
+
+    if (retval) {
+        *retval = thread->retval;
+    }
+    kfree((uintptr_t *)thread->stack);
+    kfree((uintptr_t *)thread);
+    return K_SUCCESS;
+}
+
+/**
+ * Mark a thread as detached. Its resources will be freed automatically
+ * when it exits, and it can no longer be joined.
+ * @param thread thread to detach
+ */
+void kernel_thread_detach(kthread_t *thread) {
+    uint32_t eflags = spin_lock_irqsave(&kthread_lock);
+    if (thread->state == KTHREAD_ZOMBIE) {
+        // Already exited, hand it straight to the reaper
+        thread->next = kthread_zombies;
+        kthread_zombies = thread;
+    }
+    thread->flags |= KTHREAD_DETACHED;
+    spin_unlock_irqrestore(&kthread_lock, eflags);
+}
 
+/**
+ * Get the currently executing thread
+ */
+kthread_t *kernel_thread_current() {
+    return sched_current();
+}
+
+/**
+ * Give up the CPU to the next runnable thread, if any
+ */
+void kernel_thread_yield() {
+    sched_yield();
+}
+
+/**
+ * Block the current thread until kernel_thread_wake() is called on it.
+ * Must be called with interrupts disabled, after the thread has been
+ * made visible to whoever is going to wake it. May return spuriously.
+ */
+void kernel_thread_block() {
+    sched_block();
+}
+
+/**
+ * Make a blocked thread runnable again
+ * @param thread thread to wake
+ */
+void kernel_thread_wake(kthread_t *thread) {
+    sched_wake(thread);
+}
+
+/**
+ * Switch threads if a reschedule is pending.
+ * Called on the way out of every interrupt.
+ */
+void kernel_thread_preempt() {
+    sched_preempt();
+}
+
+/**
+ * Block the current thread for the given time, see also msleep()
+ */
 void kernel_thread_sleep(uint32_t seconds) {
-    // i386 implementation
-    pit_timer_wait(seconds);
+    nsleep(seconds * NSEC_PER_SEC);
+}
+
+void kernel_thread_sleep_ms(uint32_t ms) {
+    msleep(ms);
 }
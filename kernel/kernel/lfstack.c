@@ -0,0 +1,74 @@
+/**
+ * Lock-free stack with tagged top pointer
+ */
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#include <kernel/kernel.h>
+#include <kernel/lfstack.h>
+
+#include <arch/i386/cpu.h>
+
+/**
+ * Read the top and tag. The two halves may be torn, which just makes the
+ * following cmpxchg8b fail and hand back a consistent value.
+ */
+static inline lfstack_t lfstack_read(lfstack_t *stack) {
+    volatile lfstack_t *s = stack;
+    lfstack_t res;
+    res.tag = s->tag;
+    res.top = s->top;
+    return res;
+}
+
+void lfstack_init(lfstack_t *stack) {
+    stack->value = 0;
+}
+
+/**
+ * Push a node. Safe from any context.
+ * @param stack stack to act on
+ * @param node  node to push
+ */
+void lfstack_push(lfstack_t *stack, lfstack_node_t *node) {
+    lfstack_t old = lfstack_read(stack);
+    lfstack_t new;
+    do {
+        node->next = old.top;
+        new.top = node;
+        new.tag = old.tag + 1;
+    } while (!cpu_cmpxchg8b(&stack->value, &old.value, new.value));
+}
+
+/**
+ * Pop the most recently pushed node. Safe from any context.
+ * @param stack stack to act on
+ * @return node popped, or NULL if the stack is empty
+ */
+lfstack_node_t *lfstack_pop(lfstack_t *stack) {
+    lfstack_t old = lfstack_read(stack);
+    lfstack_t new;
+    do {
+        if (!old.top) return NULL;
+        new.top = old.top->next;
+        new.tag = old.tag + 1;
+    } while (!cpu_cmpxchg8b(&stack->value, &old.value, new.value));
+    return old.top;
+}
+
+/**
+ * Take every node off the stack at once
+ * @param stack stack to act on
+ * @return former top of the stack, linked through ->next, or NULL
+ */
+lfstack_node_t *lfstack_pop_all(lfstack_t *stack) {
+    lfstack_t old = lfstack_read(stack);
+    lfstack_t new;
+    do {
+        if (!old.top) return NULL;
+        new.top = NULL;
+        new.tag = old.tag + 1;
+    } while (!cpu_cmpxchg8b(&stack->value, &old.value, new.value));
+    return old.top;
+}
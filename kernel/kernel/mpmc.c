@@ -0,0 +1,106 @@
+/**
+ * Bounded lock-free multi-producer/multi-consumer queue
+ */
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#include <kernel/kernel.h>
+#include <kernel/atomic.h>
+#include <kernel/mpmc.h>
+#include <mm/alloc.h>
+
+/**
+ * Create an empty queue
+ * @param q    queue to act on
+ * @param size number of slots, must be a power of two
+ * @return K_SUCCESS, K_INVALOP if size isn't a power of two, or K_OOM
+ */
+k_return_t mpmc_queue_init(mpmc_queue_t *q, uint32_t size) {
+    if (size < 2 || (size & (size - 1))) return K_INVALOP;
+
+    q->cells = (struct mpmc_cell *)kmalloc(size * sizeof(struct mpmc_cell), KALLOC_GENERAL);
+    if (!q->cells) return K_OOM;
+
+    uint32_t i;
+    for (i=0; i<size; i++) {
+        q->cells[i].seq = i;
+        q->cells[i].data = NULL;
+    }
+    q->mask = size - 1;
+    q->enqueue_pos = 0;
+    q->dequeue_pos = 0;
+    return K_SUCCESS;
+}
+
+/**
+ * Free a queue's slots. Nobody may be using it any more.
+ * @param q queue to act on
+ */
+void mpmc_queue_destroy(mpmc_queue_t *q) {
+    kfree((uintptr_t *)q->cells);
+    q->cells = NULL;
+}
+
+/**
+ * Add an entry to the tail of the queue. Safe from any context.
+ * @param q    queue to act on
+ * @param data entry to add
+ * @return true if added, false if the queue is full
+ */
+bool mpmc_enqueue(mpmc_queue_t *q, void *data) {
+    struct mpmc_cell *cell;
+    uint32_t pos = atomic_load_relaxed(&q->enqueue_pos);
+
+    for (;;) {
+        cell = &q->cells[pos & q->mask];
+        uint32_t seq = atomic_load_acquire(&cell->seq);
+        int32_t diff = (int32_t)(seq - pos);
+
+        if (diff == 0) {
+            // Slot is free for this lap, try to claim it
+            if (atomic_cmpxchg(&q->enqueue_pos, &pos, pos + 1)) break;
+            // pos was updated to the current value, retry with it
+        } else if (diff < 0) {
+            // Slot still holds an entry from the previous lap
+            return false;
+        } else {
+            // Another producer claimed it first
+            pos = atomic_load_relaxed(&q->enqueue_pos);
+        }
+    }
+
+    cell->data = data;
+    atomic_store_release(&cell->seq, pos + 1);
+    return true;
+}
+
+/**
+ * Remove the entry at the head of the queue. Safe from any context.
+ * @param q queue to act on
+ * @param[out] out entry removed
+ * @return true if an entry was removed, false if the queue is empty
+ */
+bool mpmc_dequeue(mpmc_queue_t *q, void **out) {
+    struct mpmc_cell *cell;
+    uint32_t pos = atomic_load_relaxed(&q->dequeue_pos);
+
+    for (;;) {
+        cell = &q->cells[pos & q->mask];
+        uint32_t seq = atomic_load_acquire(&cell->seq);
+        int32_t diff = (int32_t)(seq - (pos + 1));
+
+        if (diff == 0) {
+            if (atomic_cmpxchg(&q->dequeue_pos, &pos, pos + 1)) break;
+        } else if (diff < 0) {
+            // Producer hasn't filled this slot yet
+            return false;
+        } else {
+            pos = atomic_load_relaxed(&q->dequeue_pos);
+        }
+    }
+
+    *out = cell->data;
+    atomic_store_release(&cell->seq, pos + q->mask + 1);
+    return true;
+}
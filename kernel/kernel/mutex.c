@@ -0,0 +1,139 @@
+/**
+ * Sleeping mutexes with adaptive spinning
+ */
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#include <kernel/kernel.h>
+#include <kernel/kernel_thread.h>
+#include <kernel/atomic.h>
+#include <kernel/mutex.h>
+#include <kernel/sched.h>
+#include <kernel/spinlock.h>
+#include <kernel/wait.h>
+
+#include <arch/i386/cpu.h>
+
+void mutex_init(mutex_t *mutex) {
+    mutex->owner = NULL;
+    wait_queue_init(&mutex->waiters);
+}
+
+static inline bool mutex_trylock_as(mutex_t *mutex, kthread_t *self) {
+    kthread_t *expected = NULL;
+    return atomic_cmpxchg_acquire(&mutex->owner, &expected, self);
+}
+
+#ifdef MUTEX_PRIO_INHERIT
+/**
+ * Raise the owner to the priority of its best waiter. Waiters lock must be held.
+ */
+static void mutex_boost_owner(mutex_t *mutex, kthread_t *owner) {
+    uint32_t prio = SCHED_PRIO_MAX;
+    wait_entry_t *cur;
+    for (cur = mutex->waiters.head; cur; cur = cur->next) {
+        if (cur->thread->sched.prio < prio) {
+            prio = cur->thread->sched.prio;
+        }
+    }
+    if (prio < owner->sched.prio) {
+        sched_boost_prio(owner, prio);
+    }
+}
+#endif
+
+/**
+ * Spin while the owner is running, hoping it releases the mutex soon
+ * @return true if the mutex was acquired
+ */
+static bool mutex_spin(mutex_t *mutex, kthread_t *self) {
+    uint32_t i;
+    for (i=0; i<MUTEX_SPIN_LIMIT; i++) {
+        kthread_t *owner = atomic_load_relaxed(&mutex->owner);
+        if (!owner) {
+            if (mutex_trylock_as(mutex, self)) return true;
+            continue;
+        }
+        // Sleeping owners won't release it any time soon. The owner can't
+        // exit (and be freed) while holding the mutex, but it may have
+        // released it and exited since we read it; threads are only freed
+        // after being switched out, so a stale read just ends the spin.
+        if (owner->state != KTHREAD_RUNNING) break;
+        cpu_relax();
+    }
+    return false;
+}
+
+/**
+ * Acquire a mutex, sleeping until it is available.
+ * Must be called from thread context.
+ * @param mutex mutex to acquire
+ */
+void mutex_lock(mutex_t *mutex) {
+    kthread_t *self = sched_current();
+    if (mutex_trylock_as(mutex, self)) return;
+    if (mutex_spin(mutex, self)) return;
+
+    uint32_t eflags = spin_lock_irqsave(&mutex->waiters.lock);
+    if (mutex_trylock_as(mutex, self)) {
+        spin_unlock_irqrestore(&mutex->waiters.lock, eflags);
+        return;
+    }
+
+    wait_entry_t wait;
+    wait_entry_init(&wait);
+    wait_queue_add_locked(&mutex->waiters, &wait);
+#ifdef MUTEX_PRIO_INHERIT
+    mutex_boost_owner(mutex, mutex->owner);
+#endif
+
+    // mutex_unlock hands the mutex to us before waking us
+    while (!wait.woken) {
+        spin_unlock(&mutex->waiters.lock);
+        sched_block();
+        spin_lock(&mutex->waiters.lock);
+    }
+    spin_unlock_irqrestore(&mutex->waiters.lock, eflags);
+}
+
+/**
+ * Acquire a mutex if it is available
+ * @param mutex mutex to acquire
+ * @return true if the mutex was acquired
+ */
+bool mutex_trylock(mutex_t *mutex) {
+    return mutex_trylock_as(mutex, sched_current());
+}
+
+/**
+ * Release a mutex held by the calling thread
+ * @param mutex mutex to release
+ */
+void mutex_unlock(mutex_t *mutex) {
+    kthread_t *self = sched_current();
+    ASSERT(mutex->owner == self);
+
+    uint32_t eflags = spin_lock_irqsave(&mutex->waiters.lock);
+    wait_entry_t *next = wait_queue_pop_locked(&mutex->waiters);
+    if (next) {
+        // Hand over directly, so nobody can take the mutex ahead of the waiter
+        atomic_store_release(&mutex->owner, next->thread);
+#ifdef MUTEX_PRIO_INHERIT
+        mutex_boost_owner(mutex, next->thread);
+#endif
+        wait_entry_wake(next);
+    } else {
+        atomic_store_release(&mutex->owner, NULL);
+    }
+    spin_unlock_irqrestore(&mutex->waiters.lock, eflags);
+
+#ifdef MUTEX_PRIO_INHERIT
+    // Drop any boost we got from the waiters
+    sched_boost_prio(self, SCHED_PRIO_MAX);
+#endif
+}
+
+bool mutex_is_locked(mutex_t *mutex) {
+    return atomic_load_relaxed(&mutex->owner) != NULL;
+}
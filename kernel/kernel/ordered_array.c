@@ -15,8 +15,9 @@
  * @param  b second object to compare
  * @return   negative int if a < b, 0 if a == b, positive int if a > b
  */
-inline int32_t comparator_default(void *a, void *b) {
-    return (int32_t)((uintptr_t)a - (uintptr_t)b);
+int32_t comparator_default(void *a, void *b) {
+    // Subtracting could overflow for addresses more than 2GiB apart
+    return ((uintptr_t)a > (uintptr_t)b) - ((uintptr_t)a < (uintptr_t)b);
 }
 
 /**
@@ -29,6 +30,7 @@ inline int32_t comparator_default(void *a, void *b) {
 ordered_array_t ordered_array_create(void *addr, uint32_t max_size, comparator_t comparator) {
     ordered_array_t new_array;
     new_array.array = (void **)addr;
+    new_array.size = 0;
     new_array.max_size = max_size;
     if (comparator)
         new_array.comparator = comparator;
@@ -40,7 +42,43 @@ ordered_array_t ordered_array_create(void *addr, uint32_t max_size, comparator_t
 }
 
 /**
- * Insert an object into an ordered array
+ * Find the index of the first object not less than a key
+ * @param array ordered array to act on
+ * @param key   object to compare against
+ * @return      index of first object >= key, or array->size if there is none
+ */
+uint32_t ordered_array_lower_bound(ordered_array_t *array, void *key) {
+    uint32_t low = 0, high = array->size;
+    while (low < high) {
+        uint32_t mid = low + (high - low) / 2;
+        if (array->comparator(array->array[mid], key) < 0) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    return low;
+}
+
+/**
+ * Find an object equal to a key
+ * @param array ordered array to act on
+ * @param key   object to compare against
+ * @param[out] index index of the first equal object, or NULL
+ * @return      true if found, otherwise false
+ */
+bool ordered_array_find(ordered_array_t *array, void *key, uint32_t *index) {
+    uint32_t i = ordered_array_lower_bound(array, key);
+    if (i == array->size || array->comparator(array->array[i], key) != 0)
+        return false;
+
+    if (index)
+        *index = i;
+    return true;
+}
+
+/**
+ * Insert an object into an ordered array, before any equal objects
  * @param array ordered array to act on
  * @param object  object to insert
  * @return        true if success, otherwise false
@@ -50,31 +88,12 @@ bool ordered_array_insert(ordered_array_t *array, void *object) {
     if (array->size >= array->max_size)
         return false;
 
-    uint32_t i = 0;
-    for (i=0; i<array->size; i++) {
-        // Loop through until we find an item that is greater than our object
-        if (array->comparator(array->array[i], object) >= 0)
-            break;
-    }
-
-    // Insert the object at the index we just got
-    if (i != array->size) {
-        // Insert in array at index
-        // Shift every object at or above the index up one
-        uint32_t j;
-        for (j=array->size-1; j <= i; j--) {
-            array->array[j+1] = array->array[j];
-        }
-        array->array[i] = object;
-        array->size++;
-        return true;
-    } else {
-        // Add to the end of the array
-        array->array[array->size] = object;
-        array->size++;
-        return true;
-    }
-
+    // Shift every object at or above the index up one
+    uint32_t i = ordered_array_lower_bound(array, object);
+    memmove(&array->array[i + 1], &array->array[i], (array->size - i) * sizeof(void *));
+    array->array[i] = object;
+    array->size++;
+    return true;
 }
 
 /**
@@ -83,8 +102,8 @@ bool ordered_array_insert(ordered_array_t *array, void *object) {
  * @param  index index of object to retrieve
  * @return       object at specified index
  */
-inline void *ordered_array_get(ordered_array_t *array, uint32_t index) {
-    if (index > array->size) return NULL;
+void *ordered_array_get(ordered_array_t *array, uint32_t index) {
+    if (index >= array->size) return NULL;
     return array->array[index];
 }
 
@@ -95,12 +114,10 @@ inline void *ordered_array_get(ordered_array_t *array, uint32_t index) {
  * @return      true on success, otherwise false
  */
 bool ordered_array_remove(ordered_array_t *array, uint32_t index) {
-    if (index > array->size) return false;
+    if (index >= array->size) return false;
     // Shift everything above index down one
-    while (index < array->size) {
-        array->array[index] = array->array[index+1];
-        ++index;
-    }
+    memmove(&array->array[index], &array->array[index + 1],
+            (array->size - index - 1) * sizeof(void *));
 
     // Lower size of array by one
     array->size = array->size - 1;
@@ -0,0 +1,320 @@
+/**
+ * Kernel log ring and console consumer
+ */
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <kernel/kernel.h>
+#include <kernel/kernel_thread.h>
+#include <kernel/atomic.h>
+#include <kernel/console.h>
+#include <kernel/spinlock.h>
+#include <kernel/timer.h>
+#include <kernel/printk.h>
+#include <drivers/vga/textmode.h>
+
+#include <arch/i386/cpu.h>
+#include <arch/i386/percpu.h>
+#include <arch/i386/smp.h>
+
+static DEFINE_PER_CPU(log_ring_t, log_rings);
+
+uint32_t printk_dropped = 0;
+uint32_t printk_suppressed = 0;
+
+// Only one context prints records at a time
+static spinlock_t printk_console_lock = SPINLOCK_INIT;
+
+// Next record of each CPU, staged by printk_drain(). Whoever holds
+// printk_console_lock uses the first set, printk_dump() and printk_flush()
+// after a panic print without the lock and use the second.
+static log_record_t printk_next[SMP_MAX_CPUS];
+static log_record_t printk_unlocked_next[SMP_MAX_CPUS];
+
+static volatile bool printk_consumer_running = false;
+static volatile bool printk_panic_mode = false;
+
+// Console rate limiting, a token bucket refilled at LOG_CONSOLE_RATE per second
+static uint32_t printk_tokens = LOG_CONSOLE_BURST;
+static ktime_t printk_tokens_refilled = 0;
+static uint32_t printk_suppressed_pending = 0;
+
+/**
+ * Log a message
+ * @param level  enum log_level of the message
+ * @param subsys short name of the subsystem logging the message
+ * @param fmt    printf style format string
+ */
+void printk(uint32_t level, const char *subsys, const char *fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    vprintk(level, subsys, fmt, args);
+    va_end(args);
+}
+
+void vprintk(uint32_t level, const char *subsys, const char *fmt, va_list args) {
+    // Interrupts off keeps us on this CPU and stops a handler from
+    // logging in the middle of our record
+    uint32_t eflags = cpu_irq_save();
+    log_ring_t *ring = this_cpu_ptr(log_rings);
+
+    // Reserve a slot. The record is marked as being written before the
+    // consumer can see the new head.
+    uint32_t slot = ring->head;
+    log_record_t *rec = &ring->records[slot & (LOG_RING_RECORDS - 1)];
+    atomic_store_relaxed(&rec->seq, 0);
+    atomic_store_release(&ring->head, slot + 1);
+
+    rec->level = level;
+    rec->cpu = smp_cpu_id();
+    rec->timestamp = ktime_get();
+    strncpy(rec->subsys, subsys ? subsys : "kernel", LOG_SUBSYS_MAX - 1);
+    rec->subsys[LOG_SUBSYS_MAX - 1] = '\0';
+
+    int length = vsnprintf(rec->text, LOG_TEXT_MAX, fmt, args);
+    if (length > LOG_TEXT_MAX - 1) {
+        length = LOG_TEXT_MAX - 1;
+    }
+    // The console ends every record with a newline itself
+    while (length > 0 && rec->text[length - 1] == '\n') {
+        rec->text[--length] = '\0';
+    }
+    rec->length = length;
+
+    // Publish
+    atomic_store_release(&rec->seq, slot + 1);
+    cpu_irq_restore(eflags);
+
+    if (!printk_consumer_running || printk_panic_mode) {
+        printk_flush();
+    }
+}
+
+/**
+ * Empty the log ring in a new CPU's per-CPU area. The area is a copy of the
+ * template, which holds whatever the boot CPU logged before percpu_init().
+ * @param offset offset from the template to the new area
+ */
+void printk_percpu_init(uintptr_t offset) {
+    log_ring_t *ring = (log_ring_t *)((uintptr_t)&log_rings + offset);
+    memset(ring, 0, sizeof(log_ring_t));
+}
+
+/**
+ * Copy the record at a ring position if it has been written
+ * @param ring    ring to read
+ * @param[in,out] cursor position to read, moved past records that were
+ *                overwritten before they could be read
+ * @param[out] out copy of the record
+ * @return true if a record was copied, false if the writer hasn't got there
+ */
+static bool printk_peek(log_ring_t *ring, uint32_t *cursor, log_record_t *out) {
+    for (;;) {
+        uint32_t head = atomic_load_acquire(&ring->head);
+        if (head == *cursor)
+            return false;
+
+        // The writer lapped us, skip what it overwrote
+        if (head - *cursor > LOG_RING_RECORDS) {
+            atomic_fetch_add(&printk_dropped, head - *cursor - LOG_RING_RECORDS);
+            *cursor = head - LOG_RING_RECORDS;
+        }
+
+        log_record_t *rec = &ring->records[*cursor & (LOG_RING_RECORDS - 1)];
+        uint32_t seq = atomic_load_acquire(&rec->seq);
+        if (seq == 0 || seq - 1 < *cursor) {
+            // Still being written, or not even started yet
+            return false;
+        }
+
+        if (seq - 1 == *cursor) {
+            memcpy(out, rec, sizeof(log_record_t));
+            smp_rmb();
+            if (atomic_load_relaxed(&rec->seq) == seq)
+                return true;
+        }
+
+        // Overwritten by a newer record before or while we copied it
+        atomic_inc(&printk_dropped);
+        (*cursor)++;
+    }
+}
+
+/**
+ * Print one record to the console, errors in red
+ */
+static void printk_print_record(log_record_t *rec) {
+    char line[LOG_TEXT_MAX + 48];
+    uint32_t sec = (uint32_t)(rec->timestamp / NSEC_PER_SEC);
+    uint32_t usec = (uint32_t)(rec->timestamp % NSEC_PER_SEC) / NSEC_PER_USEC;
+
+    int length = snprintf(line, sizeof(line), "[%5u.%06u] cpu%u %s: %s\n", sec, usec,
+                          (uint32_t)rec->cpu, rec->subsys, rec->text);
+    if (length > (int)sizeof(line) - 1) {
+        length = sizeof(line) - 1;
+    }
+    console_write_color(line, length, rec->level <= LOG_ERR ? make_color(COLOR_LIGHT_RED, COLOR_BLACK)
+                                                            : CONSOLE_COLOR_DEFAULT);
+}
+
+/**
+ * Check whether the rate limit lets another record through to the console
+ */
+static bool printk_ratelimit(log_record_t *rec) {
+    ktime_t now = ktime_get();
+    uint64_t refill = (now - printk_tokens_refilled) * LOG_CONSOLE_RATE / NSEC_PER_SEC;
+    if (refill) {
+        printk_tokens = refill + printk_tokens > LOG_CONSOLE_BURST ? LOG_CONSOLE_BURST
+                                                                   : printk_tokens + refill;
+        printk_tokens_refilled = now;
+    }
+
+    if (printk_tokens) {
+        printk_tokens--;
+        return true;
+    }
+    return rec->level <= LOG_ERR;
+}
+
+/**
+ * Print every readable record from cursor on, merged across CPUs in
+ * timestamp order
+ * @param cursors    position of each CPU's ring to start at, advanced
+ * @param next       buffer to stage the next record of each CPU in
+ * @param ratelimit  skip records beyond the console rate limit
+ */
+static void printk_drain(uint32_t *cursors, log_record_t *next, bool ratelimit) {
+    bool valid[SMP_MAX_CPUS] = { false };
+    uint32_t cpu;
+
+    for (;;) {
+        int32_t best = -1;
+        for (cpu=0; cpu<smp_num_cpus; cpu++) {
+            if (cpu && !percpu_offsets[cpu]) continue;
+            if (!valid[cpu]) {
+                valid[cpu] = printk_peek(per_cpu_ptr(log_rings, cpu), &cursors[cpu], &next[cpu]);
+            }
+            if (valid[cpu] && (best < 0 || next[cpu].timestamp < next[best].timestamp)) {
+                best = cpu;
+            }
+        }
+        if (best < 0)
+            return;
+
+        log_record_t *rec = &next[best];
+        valid[best] = false;
+        cursors[best]++;
+
+        if (ratelimit && !printk_ratelimit(rec)) {
+            printk_suppressed++;
+            printk_suppressed_pending++;
+            continue;
+        }
+        if (printk_suppressed_pending) {
+            printf("[printk] %u messages suppressed\n", printk_suppressed_pending);
+            printk_suppressed_pending = 0;
+        }
+        printk_print_record(rec);
+    }
+}
+
+/**
+ * Print the records the console hasn't shown yet, without rate limiting
+ */
+void printk_flush() {
+    uint32_t cursors[SMP_MAX_CPUS];
+    uint32_t cpu;
+
+    // After a panic, whoever holds the lock may never release it
+    bool locked = spin_trylock(&printk_console_lock);
+    if (!locked && !printk_panic_mode)
+        return;
+
+    for (cpu=0; cpu<smp_num_cpus; cpu++) {
+        if (cpu && !percpu_offsets[cpu]) continue;
+        cursors[cpu] = per_cpu_ptr(log_rings, cpu)->tail;
+    }
+    printk_drain(cursors, locked ? printk_next : printk_unlocked_next, false);
+    for (cpu=0; cpu<smp_num_cpus; cpu++) {
+        if (cpu && !percpu_offsets[cpu]) continue;
+        per_cpu_ptr(log_rings, cpu)->tail = cursors[cpu];
+    }
+
+    if (locked) {
+        spin_unlock(&printk_console_lock);
+    }
+}
+
+/**
+ * Print every record still in the rings, including those already shown
+ */
+void printk_dump() {
+    uint32_t cursors[SMP_MAX_CPUS];
+    uint32_t cpu;
+
+    for (cpu=0; cpu<smp_num_cpus; cpu++) {
+        if (cpu && !percpu_offsets[cpu]) continue;
+        uint32_t head = atomic_load_acquire(&per_cpu_ptr(log_rings, cpu)->head);
+        cursors[cpu] = head > LOG_RING_RECORDS ? head - LOG_RING_RECORDS : 0;
+    }
+
+    printf("--- kernel log (%u dropped, %u suppressed) ---\n", printk_dropped, printk_suppressed);
+    // The console thread may be in the middle of printing with printk_next
+    printk_drain(cursors, printk_unlocked_next, false);
+    printf("--- end of kernel log ---\n");
+}
+
+/**
+ * Switch to synchronous output and dump the log. Called when the kernel
+ * is about to stop.
+ */
+void printk_panic() {
+    if (printk_panic_mode)
+        return;
+    printk_panic_mode = true;
+    console_panic();
+    printk_dump();
+}
+
+static void *printk_consumer(void *arg) {
+    arg = arg;
+    for (;;) {
+        if (spin_trylock(&printk_console_lock)) {
+            uint32_t cursors[SMP_MAX_CPUS];
+            uint32_t cpu;
+            for (cpu=0; cpu<smp_num_cpus; cpu++) {
+                if (cpu && !percpu_offsets[cpu]) continue;
+                cursors[cpu] = per_cpu_ptr(log_rings, cpu)->tail;
+            }
+            printk_drain(cursors, printk_next, true);
+            for (cpu=0; cpu<smp_num_cpus; cpu++) {
+                if (cpu && !percpu_offsets[cpu]) continue;
+                per_cpu_ptr(log_rings, cpu)->tail = cursors[cpu];
+            }
+            spin_unlock(&printk_console_lock);
+        }
+        msleep(LOG_CONSOLE_POLL_MS);
+    }
+    return NULL;
+}
+
+/**
+ * Start draining the log to the console from a kernel thread, after which
+ * printk() no longer waits for the console. Must be called once threading
+ * and the kernel timers are up.
+ */
+void printk_start_consumer() {
+    printk_tokens_refilled = ktime_get();
+
+    kthread_t *thread = kernel_thread_create("printk", printk_consumer, NULL);
+    if (!thread) {
+        printk(LOG_ERR, "printk", "Can't start console thread, staying synchronous");
+        return;
+    }
+    kernel_thread_detach(thread);
+    printk_consumer_running = true;
+}
@@ -0,0 +1,441 @@
+/**
+ * Radix tree mapping 32-bit indices to pointers
+ */
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include <kernel/kernel.h>
+#include <kernel/atomic.h>
+#include <kernel/rcu.h>
+#include <kernel/spinlock.h>
+#include <kernel/radix_tree.h>
+#include <mm/alloc.h>
+
+/**
+ * Get the largest index that fits under a node
+ */
+static uint32_t radix_tree_maxindex(radix_tree_node_t *node) {
+    uint32_t bits = node->shift + RADIX_TREE_MAP_SHIFT;
+    return bits >= 32 ? UINT32_MAX : (1u << bits) - 1;
+}
+
+static radix_tree_node_t *radix_tree_node_alloc(uint32_t shift, radix_tree_node_t *parent,
+                                                uint32_t offset) {
+    radix_tree_node_t *node = (radix_tree_node_t *)kmalloc(sizeof(radix_tree_node_t), KALLOC_GENERAL);
+    if (!node) return NULL;
+
+    memset(node, 0, sizeof(radix_tree_node_t));
+    node->shift = shift;
+    node->parent = parent;
+    node->offset = offset;
+    return node;
+}
+
+static void radix_tree_node_free_rcu(rcu_head_t *head) {
+    kfree((uintptr_t *)container_of(head, radix_tree_node_t, rcu));
+}
+
+/**
+ * Initialize an empty tree
+ * @param tree tree to initialize
+ */
+void radix_tree_init(radix_tree_t *tree) {
+    spin_lock_init(&tree->lock);
+    tree->root = NULL;
+}
+
+/**
+ * Find the leaf node that holds an index. Called with the lock held.
+ * @return leaf node, or NULL if there is none
+ */
+static radix_tree_node_t *radix_tree_find_leaf_locked(radix_tree_t *tree, uint32_t index) {
+    radix_tree_node_t *node = tree->root;
+    if (!node || index > radix_tree_maxindex(node))
+        return NULL;
+
+    while (node && node->shift) {
+        node = node->slots[(index >> node->shift) & RADIX_TREE_MAP_MASK];
+    }
+    return node;
+}
+
+/**
+ * Free empty nodes from node upwards, then drop root levels that only
+ * lead to slot 0. Called with the lock held.
+ */
+static void radix_tree_shrink_locked(radix_tree_t *tree, radix_tree_node_t *node) {
+    while (node && !node->count) {
+        radix_tree_node_t *parent = node->parent;
+        if (parent) {
+            rcu_assign_pointer(parent->slots[node->offset], NULL);
+            parent->count--;
+        } else {
+            rcu_assign_pointer(tree->root, NULL);
+        }
+        call_rcu(&node->rcu, radix_tree_node_free_rcu);
+        node = parent;
+    }
+
+    // Readers still on the old root find the same child in its slot 0
+    radix_tree_node_t *root = tree->root;
+    while (root && root->shift && root->count == 1 && root->slots[0]) {
+        radix_tree_node_t *child = root->slots[0];
+        child->parent = NULL;
+        rcu_assign_pointer(tree->root, child);
+        call_rcu(&root->rcu, radix_tree_node_free_rcu);
+        root = child;
+    }
+}
+
+/**
+ * Add an entry to a tree
+ * @param tree  tree to act on
+ * @param index index to store the entry at
+ * @param entry entry to store, must not be NULL
+ * @return K_SUCCESS, K_INVALOP if the index is already in use or entry is
+ *         NULL, or K_OOM
+ */
+k_return_t radix_tree_insert(radix_tree_t *tree, uint32_t index, void *entry) {
+    k_return_t ret = K_SUCCESS;
+    if (!entry) return K_INVALOP;
+
+    // Find how tall the tree has to be to reach the index
+    uint32_t shift = 0;
+    while (shift + RADIX_TREE_MAP_SHIFT < 32 && (index >> (shift + RADIX_TREE_MAP_SHIFT))) {
+        shift += RADIX_TREE_MAP_SHIFT;
+    }
+
+    uint32_t eflags = spin_lock_irqsave(&tree->lock);
+
+    radix_tree_node_t *node = tree->root;
+    if (!node) {
+        node = radix_tree_node_alloc(shift, NULL, 0);
+        if (!node) {
+            ret = K_OOM;
+            goto out;
+        }
+        rcu_assign_pointer(tree->root, node);
+    }
+
+    // Add levels on top until the root covers the index. The old root
+    // becomes slot 0 of the new one, so its indices don't change.
+    while (node->shift < shift) {
+        radix_tree_node_t *root = radix_tree_node_alloc(node->shift + RADIX_TREE_MAP_SHIFT, NULL, 0);
+        if (!root) {
+            radix_tree_shrink_locked(tree, node);
+            ret = K_OOM;
+            goto out;
+        }
+        uint32_t tag;
+        for (tag=0; tag<RADIX_TREE_MAX_TAGS; tag++) {
+            if (node->tags[tag]) {
+                root->tags[tag] = 1;
+            }
+        }
+        root->slots[0] = node;
+        root->count = 1;
+        node->parent = root;
+        rcu_assign_pointer(tree->root, root);
+        node = root;
+    }
+
+    // Walk down, filling in missing nodes on the way
+    while (node->shift) {
+        uint32_t offset = (index >> node->shift) & RADIX_TREE_MAP_MASK;
+        radix_tree_node_t *child = node->slots[offset];
+        if (!child) {
+            child = radix_tree_node_alloc(node->shift - RADIX_TREE_MAP_SHIFT, node, offset);
+            if (!child) {
+                // Don't leave the nodes allocated so far behind empty
+                radix_tree_shrink_locked(tree, node);
+                ret = K_OOM;
+                goto out;
+            }
+            rcu_assign_pointer(node->slots[offset], child);
+            node->count++;
+        }
+        node = child;
+    }
+
+    uint32_t offset = index & RADIX_TREE_MAP_MASK;
+    if (node->slots[offset]) {
+        ret = K_INVALOP;
+        goto out;
+    }
+    rcu_assign_pointer(node->slots[offset], entry);
+    node->count++;
+
+out:
+    spin_unlock_irqrestore(&tree->lock, eflags);
+    return ret;
+}
+
+/**
+ * Look up the entry at an index. Safe to call without any locks, but the
+ * entry is only guaranteed to stay valid inside rcu_read_lock().
+ * @param tree  tree to search
+ * @param index index to look up
+ * @return entry, or NULL if the index is empty
+ */
+void *radix_tree_lookup(radix_tree_t *tree, uint32_t index) {
+    void *entry = NULL;
+    rcu_read_lock();
+
+    radix_tree_node_t *node = rcu_dereference(tree->root);
+    if (!node || index > radix_tree_maxindex(node))
+        goto out;
+
+    while (node->shift) {
+        node = rcu_dereference(node->slots[(index >> node->shift) & RADIX_TREE_MAP_MASK]);
+        if (!node)
+            goto out;
+    }
+    entry = rcu_dereference(node->slots[index & RADIX_TREE_MAP_MASK]);
+
+out:
+    rcu_read_unlock();
+    return entry;
+}
+
+/**
+ * Clear a tag on a slot, and on the way up for every node that no longer
+ * has any entry below it carrying the tag. Called with the lock held.
+ */
+static void radix_tree_clear_tag_locked(radix_tree_node_t *node, uint32_t offset, uint32_t tag) {
+    for (;;) {
+        node->tags[tag] &= ~(1ULL << offset);
+        if (node->tags[tag] || !node->parent)
+            break;
+        offset = node->offset;
+        node = node->parent;
+    }
+}
+
+/**
+ * Remove the entry at an index
+ * @param tree  tree to act on
+ * @param index index to clear
+ * @return removed entry, or NULL if the index was empty
+ */
+void *radix_tree_delete(radix_tree_t *tree, uint32_t index) {
+    uint32_t eflags = spin_lock_irqsave(&tree->lock);
+
+    void *entry = NULL;
+    radix_tree_node_t *node = radix_tree_find_leaf_locked(tree, index);
+    if (!node)
+        goto out;
+
+    uint32_t offset = index & RADIX_TREE_MAP_MASK;
+    entry = node->slots[offset];
+    if (!entry)
+        goto out;
+
+    uint32_t tag;
+    for (tag=0; tag<RADIX_TREE_MAX_TAGS; tag++) {
+        radix_tree_clear_tag_locked(node, offset, tag);
+    }
+    rcu_assign_pointer(node->slots[offset], NULL);
+    node->count--;
+    radix_tree_shrink_locked(tree, node);
+
+out:
+    spin_unlock_irqrestore(&tree->lock, eflags);
+    return entry;
+}
+
+/**
+ * Set a tag on an entry
+ * @param tree  tree to act on
+ * @param index index of the entry
+ * @param tag   tag to set, less than RADIX_TREE_MAX_TAGS
+ * @return the entry, or NULL if the index is empty
+ */
+void *radix_tree_tag_set(radix_tree_t *tree, uint32_t index, uint32_t tag) {
+    uint32_t eflags = spin_lock_irqsave(&tree->lock);
+
+    void *entry = NULL;
+    radix_tree_node_t *node = radix_tree_find_leaf_locked(tree, index);
+    uint32_t offset = index & RADIX_TREE_MAP_MASK;
+    if (!node || !(entry = node->slots[offset]))
+        goto out;
+
+    // Stop as soon as a node already knows about a tagged entry below it
+    while (node && !(node->tags[tag] & (1ULL << offset))) {
+        node->tags[tag] |= 1ULL << offset;
+        offset = node->offset;
+        node = node->parent;
+    }
+
+out:
+    spin_unlock_irqrestore(&tree->lock, eflags);
+    return entry;
+}
+
+/**
+ * Clear a tag on an entry
+ * @param tree  tree to act on
+ * @param index index of the entry
+ * @param tag   tag to clear, less than RADIX_TREE_MAX_TAGS
+ * @return the entry, or NULL if the index is empty
+ */
+void *radix_tree_tag_clear(radix_tree_t *tree, uint32_t index, uint32_t tag) {
+    uint32_t eflags = spin_lock_irqsave(&tree->lock);
+
+    void *entry = NULL;
+    radix_tree_node_t *node = radix_tree_find_leaf_locked(tree, index);
+    uint32_t offset = index & RADIX_TREE_MAP_MASK;
+    if (node && (entry = node->slots[offset])) {
+        radix_tree_clear_tag_locked(node, offset, tag);
+    }
+
+    spin_unlock_irqrestore(&tree->lock, eflags);
+    return entry;
+}
+
+/**
+ * Check whether the entry at an index carries a tag. Safe to call without
+ * any locks, but may miss a concurrent change to the tag.
+ * @param tree  tree to search
+ * @param index index of the entry
+ * @param tag   tag to check, less than RADIX_TREE_MAX_TAGS
+ * @return true if the entry exists and is tagged
+ */
+bool radix_tree_tag_get(radix_tree_t *tree, uint32_t index, uint32_t tag) {
+    bool ret = false;
+    rcu_read_lock();
+
+    radix_tree_node_t *node = rcu_dereference(tree->root);
+    if (!node || index > radix_tree_maxindex(node))
+        goto out;
+
+    while (node->shift) {
+        node = rcu_dereference(node->slots[(index >> node->shift) & RADIX_TREE_MAP_MASK]);
+        if (!node)
+            goto out;
+    }
+    ret = (node->tags[tag] >> (index & RADIX_TREE_MAP_MASK)) & 1;
+
+out:
+    rcu_read_unlock();
+    return ret;
+}
+
+/**
+ * Check whether any entry in a tree carries a tag
+ * @param tree tree to check
+ * @param tag  tag to check for, less than RADIX_TREE_MAX_TAGS
+ */
+bool radix_tree_tagged(radix_tree_t *tree, uint32_t tag) {
+    rcu_read_lock();
+    radix_tree_node_t *root = rcu_dereference(tree->root);
+    bool ret = root && root->tags[tag];
+    rcu_read_unlock();
+    return ret;
+}
+
+/**
+ * Find the first slot at or after offset in a node that holds something,
+ * or that has the tag set if tag < RADIX_TREE_MAX_TAGS
+ * @return slot offset, or RADIX_TREE_MAP_SIZE if there is none
+ */
+static uint32_t radix_tree_scan(radix_tree_node_t *node, uint32_t offset, uint32_t tag) {
+    if (tag < RADIX_TREE_MAX_TAGS) {
+        uint64_t mask = node->tags[tag] & (~0ULL << offset);
+        return mask ? (uint32_t)__builtin_ctzll(mask) : RADIX_TREE_MAP_SIZE;
+    }
+
+    for (; offset<RADIX_TREE_MAP_SIZE; offset++) {
+        if (atomic_load_relaxed(&node->slots[offset]))
+            break;
+    }
+    return offset;
+}
+
+/**
+ * Common part of radix_tree_next and radix_tree_next_tagged. Pass
+ * RADIX_TREE_MAX_TAGS as the tag to find any entry.
+ */
+static void *radix_tree_find_next(radix_tree_t *tree, uint32_t *indexp, uint32_t last, uint32_t tag) {
+    uint32_t index = *indexp;
+    void *entry = NULL;
+    rcu_read_lock();
+
+restart:
+    if (index > last)
+        goto out;
+
+    radix_tree_node_t *node = rcu_dereference(tree->root);
+    if (!node || index > radix_tree_maxindex(node))
+        goto out;
+
+    for (;;) {
+        uint32_t shift = node->shift;
+        uint32_t offset = (index >> shift) & RADIX_TREE_MAP_MASK;
+        uint32_t found = radix_tree_scan(node, offset, tag);
+
+        if (found != offset) {
+            // Nothing more in this subtree, continue right after it. The
+            // search starts over from the root, which keeps this correct
+            // even if the tree changes shape underneath us.
+            uint32_t span = shift + RADIX_TREE_MAP_SHIFT;
+            if (found == RADIX_TREE_MAP_SIZE) {
+                if (span >= 32 || !((index >> span) + 1 < (1u << (32 - span))))
+                    goto out;
+                index = ((index >> span) + 1) << span;
+                goto restart;
+            }
+
+            // Jump to the start of the next populated slot
+            index &= ~(((uint32_t)RADIX_TREE_MAP_MASK << shift) | ((1u << shift) - 1));
+            index |= found << shift;
+        }
+
+        void *slot = rcu_dereference(node->slots[found]);
+        if (!slot) {
+            // Raced with a removal, skip the slot
+            uint32_t next = (index & ~((1u << shift) - 1)) + (1u << shift);
+            if (!next)
+                goto out;
+            index = next;
+            goto restart;
+        }
+
+        if (!shift) {
+            if (index <= last) {
+                entry = slot;
+                *indexp = index;
+            }
+            goto out;
+        }
+        node = slot;
+    }
+
+out:
+    rcu_read_unlock();
+    return entry;
+}
+
+/**
+ * Find the first entry at or after an index
+ * @param tree tree to search
+ * @param[in,out] index index to start at, set to the index of the entry found
+ * @param last last index to consider
+ * @return entry, or NULL if there is none in [*index, last]
+ */
+void *radix_tree_next(radix_tree_t *tree, uint32_t *index, uint32_t last) {
+    return radix_tree_find_next(tree, index, last, RADIX_TREE_MAX_TAGS);
+}
+
+/**
+ * Find the first entry carrying a tag at or after an index
+ * @param tree tree to search
+ * @param[in,out] index index to start at, set to the index of the entry found
+ * @param last last index to consider
+ * @param tag  tag to look for, less than RADIX_TREE_MAX_TAGS
+ * @return entry, or NULL if there is none in [*index, last]
+ */
+void *radix_tree_next_tagged(radix_tree_t *tree, uint32_t *index, uint32_t last, uint32_t tag) {
+    return radix_tree_find_next(tree, index, last, tag);
+}
@@ -0,0 +1,372 @@
+/**
+ * Intrusive red-black tree
+ *
+ * Rebalancing follows the usual formulation: a new node starts out red and
+ * red-red conflicts are pushed up the tree by recoloring or resolved by
+ * rotation, and removing a black node leaves an extra black on the node that
+ * replaced it, which is pushed up until it can be absorbed.
+ */
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#include <kernel/kernel.h>
+#include <kernel/rbtree.h>
+
+/**
+ * Internal functions
+ */
+
+static inline bool rb_is_red(const rb_node_t *node) {
+    return node && node->red;
+}
+
+/**
+ * Point whatever referenced old at new instead
+ */
+static inline void rb_replace_child(rb_root_t *root, rb_node_t *parent, rb_node_t *old, rb_node_t *new) {
+    if (!parent) {
+        root->node = new;
+    } else if (parent->left == old) {
+        parent->left = new;
+    } else {
+        parent->right = new;
+    }
+}
+
+/**
+ * Rotate node down to the left, its right child takes its place.
+ * The set of nodes below the pair doesn't change, so only the two rotated
+ * nodes need their augmented values recomputed.
+ */
+static void rb_rotate_left(rb_root_t *root, rb_node_t *node, rb_augment_t augment) {
+    rb_node_t *right = node->right;
+
+    node->right = right->left;
+    if (right->left) {
+        right->left->parent = node;
+    }
+    right->parent = node->parent;
+    rb_replace_child(root, node->parent, node, right);
+    right->left = node;
+    node->parent = right;
+
+    if (augment) {
+        augment(node);
+        augment(right);
+    }
+}
+
+static void rb_rotate_right(rb_root_t *root, rb_node_t *node, rb_augment_t augment) {
+    rb_node_t *left = node->left;
+
+    node->left = left->right;
+    if (left->right) {
+        left->right->parent = node;
+    }
+    left->parent = node->parent;
+    rb_replace_child(root, node->parent, node, left);
+    left->right = node;
+    node->parent = left;
+
+    if (augment) {
+        augment(node);
+        augment(left);
+    }
+}
+
+/**
+ * Restore the red-black properties after removing a black node
+ * @param node   node that took the removed node's place, may be NULL
+ * @param parent its parent
+ */
+static void rb_erase_fixup(rb_root_t *root, rb_node_t *node, rb_node_t *parent, rb_augment_t augment) {
+    while (node != root->node && !rb_is_red(node)) {
+        if (node == parent->left) {
+            rb_node_t *sibling = parent->right;
+            if (sibling->red) {
+                sibling->red = false;
+                parent->red = true;
+                rb_rotate_left(root, parent, augment);
+                sibling = parent->right;
+            }
+            if (!rb_is_red(sibling->left) && !rb_is_red(sibling->right)) {
+                sibling->red = true;
+                node = parent;
+                parent = node->parent;
+            } else {
+                if (!rb_is_red(sibling->right)) {
+                    sibling->left->red = false;
+                    sibling->red = true;
+                    rb_rotate_right(root, sibling, augment);
+                    sibling = parent->right;
+                }
+                sibling->red = parent->red;
+                parent->red = false;
+                sibling->right->red = false;
+                rb_rotate_left(root, parent, augment);
+                node = root->node;
+                break;
+            }
+        } else {
+            rb_node_t *sibling = parent->left;
+            if (sibling->red) {
+                sibling->red = false;
+                parent->red = true;
+                rb_rotate_right(root, parent, augment);
+                sibling = parent->left;
+            }
+            if (!rb_is_red(sibling->left) && !rb_is_red(sibling->right)) {
+                sibling->red = true;
+                node = parent;
+                parent = node->parent;
+            } else {
+                if (!rb_is_red(sibling->left)) {
+                    sibling->right->red = false;
+                    sibling->red = true;
+                    rb_rotate_left(root, sibling, augment);
+                    sibling = parent->left;
+                }
+                sibling->red = parent->red;
+                parent->red = false;
+                sibling->left->red = false;
+                rb_rotate_right(root, parent, augment);
+                node = root->node;
+                break;
+            }
+        }
+    }
+    if (node) {
+        node->red = false;
+    }
+}
+
+/**
+ * Check a subtree for rb_verify()
+ * @param low  node every node in the subtree must order at or after, or NULL
+ * @param high node every node in the subtree must order at or before, or NULL
+ * @return black height of the subtree, or -1 if it is broken
+ */
+static int32_t rb_verify_subtree(const rb_node_t *node, const rb_node_t *parent,
+                                 const rb_node_t *low, const rb_node_t *high,
+                                 rb_cmp_t cmp, rb_augment_t augment) {
+    if (!node) return 1;
+
+    if (node->parent != parent) return -1;
+    if (node->red && rb_is_red(node->left)) return -1;
+    if (node->red && rb_is_red(node->right)) return -1;
+    if (cmp && low && cmp(node, low) < 0) return -1;
+    if (cmp && high && cmp(node, high) > 0) return -1;
+
+    int32_t left = rb_verify_subtree(node->left, node, low, node, cmp, augment);
+    int32_t right = rb_verify_subtree(node->right, node, node, high, cmp, augment);
+    if (left < 0 || right < 0 || left != right) return -1;
+
+    // Children are correct by now, so a change means this one was stale
+    if (augment && augment((rb_node_t *)node)) return -1;
+
+    return left + !node->red;
+}
+
+/**
+ * Interfaces
+ */
+
+/**
+ * Rebalance the tree after linking in a new node with rb_link_node().
+ * The new node's own augmented fields must be initialized.
+ * @param root    tree to act on
+ * @param node    node just linked
+ * @param augment function maintaining augmented values, or NULL
+ */
+void rb_insert_color(rb_root_t *root, rb_node_t *node, rb_augment_t augment) {
+    if (augment) {
+        rb_augment_propagate(node, augment);
+    }
+
+    rb_node_t *parent;
+    while ((parent = node->parent) && parent->red) {
+        // A red parent is never the root, so the grandparent exists
+        rb_node_t *gparent = parent->parent;
+
+        if (parent == gparent->left) {
+            rb_node_t *uncle = gparent->right;
+            if (rb_is_red(uncle)) {
+                // Recolor and continue the check further up
+                parent->red = false;
+                uncle->red = false;
+                gparent->red = true;
+                node = gparent;
+                continue;
+            }
+            if (node == parent->right) {
+                rb_rotate_left(root, parent, augment);
+                node = parent;
+                parent = node->parent;
+            }
+            parent->red = false;
+            gparent->red = true;
+            rb_rotate_right(root, gparent, augment);
+        } else {
+            rb_node_t *uncle = gparent->left;
+            if (rb_is_red(uncle)) {
+                parent->red = false;
+                uncle->red = false;
+                gparent->red = true;
+                node = gparent;
+                continue;
+            }
+            if (node == parent->left) {
+                rb_rotate_right(root, parent, augment);
+                node = parent;
+                parent = node->parent;
+            }
+            parent->red = false;
+            gparent->red = true;
+            rb_rotate_left(root, gparent, augment);
+        }
+    }
+    root->node->red = false;
+}
+
+/**
+ * Remove a node from the tree
+ * @param root    tree to act on
+ * @param node    node to remove
+ * @param augment function maintaining augmented values, or NULL
+ */
+void rb_erase(rb_root_t *root, rb_node_t *node, rb_augment_t augment) {
+    rb_node_t *child, *parent;
+    bool removed_red;
+
+    if (!node->left || !node->right) {
+        // At most one child, which takes the node's place
+        child = node->left ? node->left : node->right;
+        parent = node->parent;
+        removed_red = node->red;
+        if (child) {
+            child->parent = parent;
+        }
+        rb_replace_child(root, parent, node, child);
+    } else {
+        // Two children. The successor has no left child, unlink it from
+        // where it is and put it in the node's place.
+        rb_node_t *successor = node->right;
+        while (successor->left) {
+            successor = successor->left;
+        }
+        child = successor->right;
+        removed_red = successor->red;
+
+        if (successor->parent == node) {
+            parent = successor;
+        } else {
+            parent = successor->parent;
+            parent->left = child;
+            if (child) {
+                child->parent = parent;
+            }
+            successor->right = node->right;
+            node->right->parent = successor;
+        }
+        successor->left = node->left;
+        node->left->parent = successor;
+        successor->parent = node->parent;
+        successor->red = node->red;
+        rb_replace_child(root, node->parent, node, successor);
+    }
+
+    // Everything from the lowest changed node up has a different subtree now
+    if (augment && parent) {
+        rb_augment_propagate(parent, augment);
+    }
+
+    if (!removed_red) {
+        rb_erase_fixup(root, child, parent, augment);
+    }
+}
+
+/**
+ * Recompute the augmented values from a node up to the root, e.g. after
+ * changing a value the augmentation depends on
+ * @param node    lowest node whose value may be stale
+ * @param augment function maintaining augmented values
+ */
+void rb_augment_propagate(rb_node_t *node, rb_augment_t augment) {
+    while (node) {
+        augment(node);
+        node = node->parent;
+    }
+}
+
+/**
+ * Get the first node of a tree in order
+ * @return first node, or NULL if the tree is empty
+ */
+rb_node_t *rb_first(const rb_root_t *root) {
+    rb_node_t *node = root->node;
+    if (!node) return NULL;
+    while (node->left) {
+        node = node->left;
+    }
+    return node;
+}
+
+rb_node_t *rb_last(const rb_root_t *root) {
+    rb_node_t *node = root->node;
+    if (!node) return NULL;
+    while (node->right) {
+        node = node->right;
+    }
+    return node;
+}
+
+/**
+ * Get the node following another in order
+ * @return next node, or NULL if node is the last one
+ */
+rb_node_t *rb_next(const rb_node_t *node) {
+    if (node->right) {
+        node = node->right;
+        while (node->left) {
+            node = node->left;
+        }
+        return (rb_node_t *)node;
+    }
+
+    // Go up until we come from a left child
+    while (node->parent && node == node->parent->right) {
+        node = node->parent;
+    }
+    return node->parent;
+}
+
+rb_node_t *rb_prev(const rb_node_t *node) {
+    if (node->left) {
+        node = node->left;
+        while (node->right) {
+            node = node->right;
+        }
+        return (rb_node_t *)node;
+    }
+
+    while (node->parent && node == node->parent->left) {
+        node = node->parent;
+    }
+    return node->parent;
+}
+
+/**
+ * Check a tree for consistency: parent links, no red node with a red child,
+ * the same number of black nodes on every path, ordering and augmented
+ * values. Meant for debugging and tests, takes O(n).
+ * @param root    tree to check
+ * @param cmp     function ordering nodes, or NULL to skip the ordering check
+ * @param augment function maintaining augmented values, or NULL
+ * @return K_SUCCESS or K_INVALOP if the tree is inconsistent
+ */
+k_return_t rb_verify(const rb_root_t *root, rb_cmp_t cmp, rb_augment_t augment) {
+    if (rb_is_red(root->node)) return K_INVALOP;
+    if (rb_verify_subtree(root->node, NULL, NULL, NULL, cmp, augment) < 0) return K_INVALOP;
+    return K_SUCCESS;
+}
@@ -0,0 +1,182 @@
+/**
+ * Read-copy-update
+ *
+ * Grace periods are numbered. When callbacks are waiting and no grace period
+ * is running, a new one is started and every online CPU has to report a
+ * quiescent state for it. Each CPU notices the new grace period on its next
+ * timer tick, and reports the first quiescent state it passes after that.
+ * When the last CPU reports, the grace period is complete and the callbacks
+ * waiting for it are run from the timer tick of the CPU that queued them.
+ */
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#include <kernel/kernel.h>
+#include <kernel/atomic.h>
+#include <kernel/rcu.h>
+#include <kernel/semaphore.h>
+#include <kernel/spinlock.h>
+
+#include <arch/i386/cpu.h>
+#include <arch/i386/percpu.h>
+#include <arch/i386/smp.h>
+
+/**
+ * Global grace period state
+ */
+static struct {
+    spinlock_t lock;
+    uint32_t cur;          // Number of the last grace period started
+    uint32_t completed;    // Number of the last grace period completed
+    bool next_pending;     // Another grace period is needed after the current one
+    uint32_t cpus_pending; // Bitmap of CPUs yet to report for the current grace period
+} rcu_ctrl = { .lock = SPINLOCK_INIT };
+
+/**
+ * Per-CPU callback lists and quiescent state tracking
+ */
+struct rcu_data {
+    uint32_t qs_gp;         // Grace period this CPU is reporting for
+    bool qs_pending;        // CPU still has to report for qs_gp
+
+    rcu_head_t *next_list;  // Callbacks not yet assigned to a grace period
+    rcu_head_t **next_tail;
+    rcu_head_t *cur_list;   // Callbacks waiting for grace period cur_gp to complete
+    uint32_t cur_gp;
+};
+
+static DEFINE_PER_CPU(struct rcu_data, rcu_data);
+
+DEFINE_PER_CPU(uint32_t, rcu_passed_qs);
+
+/**
+ * Start a new grace period if one is needed and none is running.
+ * rcu_ctrl.lock must be held.
+ */
+static void rcu_start_gp() {
+    if (!rcu_ctrl.next_pending || rcu_ctrl.completed != rcu_ctrl.cur) return;
+
+    uint32_t mask = 0;
+    uint32_t i;
+    for (i=0; i<smp_num_cpus; i++) {
+        if (smp_cpus[i].online) mask |= 1 << i;
+    }
+
+    rcu_ctrl.next_pending = false;
+    rcu_ctrl.cpus_pending = mask;
+    atomic_store_release(&rcu_ctrl.cur, rcu_ctrl.cur + 1);
+}
+
+/**
+ * Report a quiescent state of the calling CPU for a grace period.
+ * rcu_ctrl.lock must be held.
+ */
+static void rcu_report_qs(uint32_t gp) {
+    if (gp != rcu_ctrl.cur) return;
+
+    rcu_ctrl.cpus_pending &= ~(1 << smp_cpu_id());
+    if (!rcu_ctrl.cpus_pending) {
+        rcu_ctrl.completed = rcu_ctrl.cur;
+        rcu_start_gp();
+    }
+}
+
+/**
+ * Timer tick handler. Advances this CPU's callbacks and grace period state,
+ * and runs callbacks whose grace period has completed.
+ * Called from sched_tick() with interrupts disabled.
+ * @param quiescent true if the interrupted context was outside any
+ *                  read-side critical section
+ */
+void rcu_tick(bool quiescent) {
+    struct rcu_data *rdp = this_cpu_ptr(rcu_data);
+    rcu_head_t *done = NULL;
+
+    if (quiescent) {
+        rcu_note_qs();
+    }
+
+    // Nothing to do unless we have callbacks or a grace period needs us
+    if (!rdp->cur_list && !rdp->next_list && !rdp->qs_pending &&
+            rdp->qs_gp == atomic_load_acquire(&rcu_ctrl.cur)) {
+        return;
+    }
+
+    spin_lock(&rcu_ctrl.lock);
+
+    // Callbacks whose grace period is over can run
+    if (rdp->cur_list && (int32_t)(rcu_ctrl.completed - rdp->cur_gp) >= 0) {
+        done = rdp->cur_list;
+        rdp->cur_list = NULL;
+    }
+
+    // Assign new callbacks to the next grace period
+    if (!rdp->cur_list && rdp->next_list) {
+        rdp->cur_list = rdp->next_list;
+        rdp->cur_gp = rcu_ctrl.cur + 1;
+        rdp->next_list = NULL;
+        rdp->next_tail = &rdp->next_list;
+        rcu_ctrl.next_pending = true;
+        rcu_start_gp();
+    }
+
+    if (rdp->qs_gp != rcu_ctrl.cur) {
+        // A new grace period started. Only quiescent states from now on count.
+        rdp->qs_gp = rcu_ctrl.cur;
+        rdp->qs_pending = true;
+        this_cpu_write(rcu_passed_qs, 0);
+    } else if (rdp->qs_pending && this_cpu_read(rcu_passed_qs)) {
+        rdp->qs_pending = false;
+        rcu_report_qs(rdp->qs_gp);
+    }
+
+    spin_unlock(&rcu_ctrl.lock);
+
+    while (done) {
+        rcu_head_t *next = done->next;
+        done->func(done);
+        done = next;
+    }
+}
+
+/**
+ * Call a function once all current read-side critical sections have ended.
+ * The callback runs from a timer interrupt, so it must not block.
+ * @param head rcu_head to queue, usually embedded in the object to free
+ * @param func function to call with head
+ */
+void call_rcu(rcu_head_t *head, void (*func)(rcu_head_t *head)) {
+    head->func = func;
+    head->next = NULL;
+
+    uint32_t eflags = cpu_irq_save();
+    struct rcu_data *rdp = this_cpu_ptr(rcu_data);
+    if (!rdp->next_tail) {
+        rdp->next_tail = &rdp->next_list;
+    }
+    *rdp->next_tail = head;
+    rdp->next_tail = &head->next;
+    cpu_irq_restore(eflags);
+}
+
+struct rcu_synchronize {
+    rcu_head_t head;
+    semaphore_t done;
+};
+
+static void rcu_synchronize_cb(rcu_head_t *head) {
+    struct rcu_synchronize *sync = container_of(head, struct rcu_synchronize, head);
+    sem_up(&sync->done);
+}
+
+/**
+ * Wait until all current read-side critical sections have ended.
+ * Must be called from thread context.
+ */
+void synchronize_rcu() {
+    struct rcu_synchronize sync;
+    sem_init(&sync.done, 0);
+    call_rcu(&sync.head, rcu_synchronize_cb);
+    sem_down(&sync.done);
+}
@@ -0,0 +1,126 @@
+/**
+ * Lock-free single-producer/single-consumer ring buffer
+ */
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include <kernel/kernel.h>
+#include <kernel/atomic.h>
+#include <kernel/ringbuf.h>
+
+/**
+ * Initialize a ring buffer
+ * @param rb     ring buffer to act on
+ * @param buffer storage for the data
+ * @param size   size of buffer in bytes, must be a power of two
+ * @return K_SUCCESS or K_INVALOP if size isn't a power of two
+ */
+k_return_t ringbuf_init(ringbuf_t *rb, void *buffer, uint32_t size) {
+    if (!size || (size & (size - 1))) return K_INVALOP;
+
+    rb->data = (uint8_t *)buffer;
+    rb->mask = size - 1;
+    rb->on_data = NULL;
+    rb->on_space = NULL;
+    rb->priv = NULL;
+    rb->head = 0;
+    rb->tail = 0;
+    return K_SUCCESS;
+}
+
+/**
+ * Set the functions called when data or space becomes available. They run
+ * in the context of the producer or consumer respectively, so they must be
+ * safe to call from wherever that is, e.g. an interrupt handler.
+ * @param rb       ring buffer to act on
+ * @param on_data  called after the producer adds data, or NULL
+ * @param on_space called after the consumer removes data, or NULL
+ * @param priv     pointer stored in rb->priv for the hooks
+ */
+void ringbuf_set_hooks(ringbuf_t *rb, ringbuf_notify_t on_data, ringbuf_notify_t on_space, void *priv) {
+    rb->on_data = on_data;
+    rb->on_space = on_space;
+    rb->priv = priv;
+}
+
+/**
+ * Write as much of the data as fits. Producer side only.
+ * @param rb  ring buffer to act on
+ * @param src data to write
+ * @param len number of bytes to write
+ * @return number of bytes written
+ */
+uint32_t ringbuf_write(ringbuf_t *rb, const void *src, uint32_t len) {
+    uint32_t head = rb->head;
+    // Acquire so we don't overwrite bytes the consumer is still copying out
+    uint32_t tail = atomic_load_acquire(&rb->tail);
+    uint32_t space = ringbuf_size(rb) - (head - tail);
+    if (len > space) {
+        len = space;
+    }
+    if (!len) return 0;
+
+    // Copy in at most two pieces, up to the end of the buffer and from its start
+    uint32_t off = head & rb->mask;
+    uint32_t first = ringbuf_size(rb) - off;
+    if (first > len) {
+        first = len;
+    }
+    memcpy(rb->data + off, src, first);
+    memcpy(rb->data, (const uint8_t *)src + first, len - first);
+
+    // Publish the data before the new head
+    atomic_store_release(&rb->head, head + len);
+
+    if (rb->on_data) {
+        rb->on_data(rb);
+    }
+    return len;
+}
+
+/**
+ * Read up to len bytes. Consumer side only.
+ * @param rb  ring buffer to act on
+ * @param dst buffer to read into
+ * @param len maximum number of bytes to read
+ * @return number of bytes read
+ */
+uint32_t ringbuf_read(ringbuf_t *rb, void *dst, uint32_t len) {
+    uint32_t tail = rb->tail;
+    uint32_t head = atomic_load_acquire(&rb->head);
+    uint32_t count = head - tail;
+    if (len > count) {
+        len = count;
+    }
+    if (!len) return 0;
+
+    uint32_t off = tail & rb->mask;
+    uint32_t first = ringbuf_size(rb) - off;
+    if (first > len) {
+        first = len;
+    }
+    memcpy(dst, rb->data + off, first);
+    memcpy((uint8_t *)dst + first, rb->data, len - first);
+
+    // Done with the bytes, hand the space back to the producer
+    atomic_store_release(&rb->tail, tail + len);
+
+    if (rb->on_space) {
+        rb->on_space(rb);
+    }
+    return len;
+}
+
+/**
+ * Throw away everything currently in the buffer. Consumer side only.
+ * @param rb ring buffer to act on
+ */
+void ringbuf_discard(ringbuf_t *rb) {
+    atomic_store_release(&rb->tail, atomic_load_acquire(&rb->head));
+
+    if (rb->on_space) {
+        rb->on_space(rb);
+    }
+}
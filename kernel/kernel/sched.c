@@ -0,0 +1,745 @@
+/**
+ * O(1) priority scheduler for ShawnOS kernel threads
+ *
+ * Runnable threads live on per-priority FIFO queues. A bitmap of the
+ * non-empty queues is kept next to them so the highest priority thread is
+ * found with a single bsf. Scheduling classes are consulted in order,
+ * real-time first, then fair, and the idle thread runs when both are empty.
+ *
+ * Each CPU has its own run queue, protected by a lock that is held across
+ * the context switch and released by the incoming thread in
+ * sched_finish_switch().
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+#include <kernel/kernel.h>
+#include <kernel/kernel_thread.h>
+#include <kernel/rcu.h>
+#include <kernel/sched.h>
+
+/* Architecture specific includes */
+#include <arch/i386/cpu.h>
+#include <arch/i386/percpu.h>
+#include <arch/i386/smp.h>
+#include <drivers/pc/pit.h>
+
+/**
+ * Save the current context on its stack, store the stack pointer to *old_esp
+ * and resume the context saved on the stack at new_esp.
+ * Implemented in arch/i386/switch.asm
+ */
+extern void _thread_switch(uint32_t *old_esp, uint32_t new_esp);
+
+// Each CPU's run queue lives in its per-CPU area
+static DEFINE_PER_CPU(sched_rq_t, sched_rq);
+
+// Context switches performed by each CPU
+static DEFINE_PER_CPU_COUNTER(sched_nr_switches);
+
+DEFINE_PER_CPU(uint32_t, sched_preempt_count);
+
+// Highest priority class, the rest are reached through ->next
+static const sched_class_t *sched_classes = &sched_rt_class;
+
+// Idle threads wait with MONITOR/MWAIT instead of HLT
+static bool sched_idle_mwait = false;
+
+/**
+ * Priority array helpers
+ */
+
+static void sched_prio_array_push(sched_prio_array_t *array, kthread_t *thread) {
+    struct sched_queue *q = &array->queues[thread->sched.prio];
+    thread->next = NULL;
+    if (q->tail) {
+        q->tail->next = thread;
+    } else {
+        q->head = thread;
+    }
+    q->tail = thread;
+    array->bitmap |= 1 << thread->sched.prio;
+    array->nr_running++;
+}
+
+static kthread_t *sched_prio_array_pop(sched_prio_array_t *array) {
+    if (!array->bitmap) return NULL;
+
+    uint32_t prio = cpu_bsf(array->bitmap);
+    struct sched_queue *q = &array->queues[prio];
+    kthread_t *thread = q->head;
+    q->head = thread->next;
+    if (!q->head) {
+        q->tail = NULL;
+        array->bitmap &= ~(1 << prio);
+    }
+    thread->next = NULL;
+    array->nr_running--;
+    return thread;
+}
+
+static void sched_prio_array_remove(sched_prio_array_t *array, kthread_t *thread) {
+    struct sched_queue *q = &array->queues[thread->sched.prio];
+    kthread_t *prev = NULL;
+    kthread_t *cur;
+    for (cur = q->head; cur; prev = cur, cur = cur->next) {
+        if (cur != thread) continue;
+
+        if (prev) {
+            prev->next = cur->next;
+        } else {
+            q->head = cur->next;
+        }
+        if (q->tail == cur) {
+            q->tail = prev;
+        }
+        if (!q->head) {
+            array->bitmap &= ~(1 << thread->sched.prio);
+        }
+        thread->next = NULL;
+        array->nr_running--;
+        return;
+    }
+}
+
+/**
+ * Real-time class. FIFO threads run until they block or yield, RR threads
+ * are additionally rotated among their priority every SCHED_RR_TIMESLICE ticks.
+ */
+
+static void sched_rt_enqueue(sched_rq_t *rq, kthread_t *thread) {
+    sched_prio_array_push(&rq->rt, thread);
+}
+
+static kthread_t *sched_rt_pick_next(sched_rq_t *rq) {
+    return sched_prio_array_pop(&rq->rt);
+}
+
+static void sched_rt_dequeue(sched_rq_t *rq, kthread_t *thread) {
+    sched_prio_array_remove(&rq->rt, thread);
+}
+
+static bool sched_rt_tick(sched_rq_t *rq, kthread_t *thread) {
+    rq = rq;
+    if (thread->sched.policy != SCHED_POLICY_RR) return false;
+
+    if (--thread->sched.timeslice == 0) {
+        thread->sched.timeslice = SCHED_RR_TIMESLICE;
+        return true;
+    }
+    return false;
+}
+
+const sched_class_t sched_rt_class = {
+    "rt",
+    &sched_fair_class,
+    sched_rt_enqueue,
+    sched_rt_pick_next,
+    sched_rt_dequeue,
+    sched_rt_tick
+};
+
+/**
+ * Fair class. Threads that use up their slice move to the expired array and
+ * don't run again until every other thread in the active array has had its
+ * turn, at which point the two arrays are swapped.
+ */
+
+static void sched_fair_enqueue(sched_rq_t *rq, kthread_t *thread) {
+    sched_prio_array_push(thread->sched.expired ? rq->fair_expired : rq->fair_active, thread);
+}
+
+static kthread_t *sched_fair_pick_next(sched_rq_t *rq) {
+    if (!rq->fair_active->bitmap && rq->fair_expired->bitmap) {
+        sched_prio_array_t *tmp = rq->fair_active;
+        rq->fair_active = rq->fair_expired;
+        rq->fair_expired = tmp;
+    }
+
+    kthread_t *thread = sched_prio_array_pop(rq->fair_active);
+    if (thread) {
+        thread->sched.expired = false;
+    }
+    return thread;
+}
+
+static void sched_fair_dequeue(sched_rq_t *rq, kthread_t *thread) {
+    sched_prio_array_remove(thread->sched.expired ? rq->fair_expired : rq->fair_active, thread);
+    thread->sched.expired = false;
+}
+
+static bool sched_fair_tick(sched_rq_t *rq, kthread_t *thread) {
+    rq = rq;
+    if (--thread->sched.timeslice == 0) {
+        thread->sched.timeslice = SCHED_FAIR_TIMESLICE(thread->sched.prio);
+        thread->sched.expired = true;
+        return true;
+    }
+    return false;
+}
+
+const sched_class_t sched_fair_class = {
+    "fair",
+    NULL,
+    sched_fair_enqueue,
+    sched_fair_pick_next,
+    sched_fair_dequeue,
+    sched_fair_tick
+};
+
+/**
+ * Internal functions. All of these must be called with interrupts disabled.
+ */
+
+static inline sched_rq_t *sched_this_rq() {
+    return this_cpu_ptr(sched_rq);
+}
+
+static inline sched_rq_t *sched_cpu_rq(uint32_t cpu) {
+    return per_cpu_ptr(sched_rq, cpu);
+}
+
+static void sched_enqueue_locked(sched_rq_t *rq, kthread_t *thread) {
+    thread->state = KTHREAD_READY;
+    thread->sched.class->enqueue(rq, thread);
+    rq->nr_running++;
+}
+
+static kthread_t *sched_pick_next(sched_rq_t *rq) {
+    const sched_class_t *class;
+    for (class = sched_classes; class; class = class->next) {
+        kthread_t *thread = class->pick_next(rq);
+        if (thread) {
+            rq->nr_running--;
+            return thread;
+        }
+    }
+    return rq->idle;
+}
+
+/**
+ * Check whether a newly runnable thread should preempt the current one
+ * @return true if the run queue's CPU needs to be told to reschedule
+ */
+static bool sched_check_preempt(sched_rq_t *rq, kthread_t *thread) {
+    if ((rq->current->flags & KTHREAD_IDLE) || thread->sched.prio < rq->current->sched.prio) {
+        rq->need_resched = true;
+        if (rq->cpu == smp_cpu_id()) return false;
+
+        // An idle CPU sitting in MWAIT is woken by the store itself. Pairs
+        // with the barrier in sched_idle().
+        smp_mb();
+        return !rq->polling;
+    }
+    return false;
+}
+
+/**
+ * Number of threads wanting to run on a CPU, including the running one
+ */
+static inline uint32_t sched_load(sched_rq_t *rq) {
+    return rq->nr_running + !(rq->current->flags & KTHREAD_IDLE);
+}
+
+/**
+ * Pick a CPU for a new thread. Loads are read without locking, an
+ * occasionally stale value only makes the placement slightly worse.
+ */
+static uint32_t sched_select_cpu() {
+    uint32_t best = smp_cpu_id();
+    uint32_t i;
+    for (i=0; i<smp_num_cpus; i++) {
+        if (sched_cpu_rq(i)->idle && sched_load(sched_cpu_rq(i)) < sched_load(sched_cpu_rq(best))) {
+            best = i;
+        }
+    }
+    return best;
+}
+
+/**
+ * Pick the next thread to run and switch to it.
+ * If the current thread is still RUNNING it is put back on the run queue.
+ * Must be called with interrupts disabled and rq->lock held, which is
+ * released before returning.
+ */
+static void sched_schedule_locked(sched_rq_t *rq) {
+    kthread_t *prev = rq->current;
+    bool runnable = prev->state == KTHREAD_RUNNING;
+    uint64_t now = cpu_rdtsc();
+
+    prev->sched.runtime += now - prev->sched.last_ts;
+    prev->sched.last_ts = now;
+
+    if (!runnable) {
+        // Blocked threads start a fresh round when they wake
+        prev->sched.expired = false;
+    } else if (!(prev->flags & KTHREAD_IDLE)) {
+        sched_enqueue_locked(rq, prev);
+    }
+
+    kthread_t *next = sched_pick_next(rq);
+    next->state = KTHREAD_RUNNING;
+    rq->need_resched = false;
+
+    // Read-side critical sections can't span a call into the scheduler
+    rcu_note_qs();
+
+    if (next == prev) {
+        spin_unlock(&rq->lock);
+        return;
+    }
+
+    next->sched.wait_time += now - next->sched.last_ts;
+    next->sched.last_ts = now;
+    next->sched.nr_switches++;
+    next->sched.on_cpu = true;
+    if (runnable) {
+        prev->sched.nr_involuntary++;
+    } else {
+        prev->sched.nr_voluntary++;
+    }
+    this_cpu_counter_inc(sched_nr_switches);
+
+    rq->current = next;
+    rq->prev = prev;
+    _thread_switch(&prev->esp, next->esp);
+    sched_finish_switch();
+}
+
+/**
+ * Interfaces
+ */
+
+/**
+ * Set up the run queue of a CPU
+ * @param cpu     logical index of the CPU
+ * @param current thread representing the calling context
+ * @param idle    thread to run when nothing else is runnable, may equal current
+ */
+void sched_init_cpu(uint32_t cpu, kthread_t *current, kthread_t *idle) {
+    sched_rq_t *rq = sched_cpu_rq(cpu);
+    rq->cpu = cpu;
+    rq->fair_active = &rq->fair[0];
+    rq->fair_expired = &rq->fair[1];
+
+    idle->sched.cpu = cpu;
+    current->sched.cpu = cpu;
+    current->state = KTHREAD_RUNNING;
+    current->sched.on_cpu = true;
+    current->sched.last_ts = cpu_rdtsc();
+    rq->current = current;
+    rq->start_ts = current->sched.last_ts;
+
+    // Publish the idle thread last, it marks the run queue as usable
+    __sync_synchronize();
+    rq->idle = idle;
+}
+
+/**
+ * Set up scheduling on the boot CPU
+ * @param boot thread representing the calling context
+ * @param idle thread to run when nothing else is runnable
+ */
+void sched_init(kthread_t *boot, kthread_t *idle) {
+    sched_init_cpu(0, boot, idle);
+
+    // All CPUs are assumed to share the boot CPU's features
+    uint32_t regs[4];
+    cpu_cpuid(0, regs);
+    if (regs[0] >= 1) {
+        cpu_cpuid(1, regs);
+        sched_idle_mwait = regs[2] & CPUID_1_ECX_MONITOR;
+    }
+
+    // Have the timer drive time slices. The other CPUs are ticked by
+    // their local APIC timers.
+    struct pit_routine sched_pit_routine = {
+        1, // Call sched_tick on every tick
+        sched_tick
+    };
+    pit_install_scheduler_routine(sched_pit_routine);
+}
+
+/**
+ * Set the policy and priority a thread is currently scheduled under
+ */
+static void sched_info_apply(kthread_t *thread, enum sched_policy policy, uint32_t prio) {
+    thread->sched.policy = policy;
+    thread->sched.prio = prio;
+    thread->sched.expired = false;
+    if (policy == SCHED_POLICY_FAIR) {
+        thread->sched.class = &sched_fair_class;
+        thread->sched.timeslice = SCHED_FAIR_TIMESLICE(prio);
+    } else {
+        thread->sched.class = &sched_rt_class;
+        thread->sched.timeslice = SCHED_RR_TIMESLICE;
+    }
+}
+
+/**
+ * Move a thread to a new policy and priority, requeueing it if needed
+ * @param thread thread to act on
+ * @param policy SCHED_POLICY_* to schedule the thread under
+ * @param prio   priority, must be valid for the policy
+ * @param normal true to also make this the thread's normal policy and priority
+ */
+static void sched_change(kthread_t *thread, enum sched_policy policy, uint32_t prio, bool normal) {
+    uint32_t eflags = cpu_irq_save();
+    sched_rq_t *rq = sched_cpu_rq(thread->sched.cpu);
+    bool kick = false;
+
+    spin_lock(&rq->lock);
+    if (normal) {
+        thread->sched.normal_policy = policy;
+        thread->sched.normal_prio = prio;
+    }
+    if (thread->state == KTHREAD_READY) {
+        // Requeue under the new priority
+        thread->sched.class->dequeue(rq, thread);
+        sched_info_apply(thread, policy, prio);
+        thread->sched.class->enqueue(rq, thread);
+        kick = sched_check_preempt(rq, thread);
+    } else {
+        sched_info_apply(thread, policy, prio);
+        if (thread == rq->current) {
+            // It may no longer be the highest priority runnable thread
+            rq->need_resched = true;
+            kick = rq->cpu != smp_cpu_id();
+        }
+    }
+    spin_unlock(&rq->lock);
+
+    if (kick) {
+        smp_send_reschedule(rq->cpu);
+    }
+    cpu_irq_restore(eflags);
+}
+
+/**
+ * Initialize the scheduling state of a new thread
+ * @param thread thread to act on
+ * @param policy SCHED_POLICY_* to schedule the thread under
+ * @param prio   priority, must be valid for the policy
+ */
+void sched_info_init(kthread_t *thread, enum sched_policy policy, uint32_t prio) {
+    thread->sched.normal_policy = policy;
+    thread->sched.normal_prio = prio;
+    sched_info_apply(thread, policy, prio);
+}
+
+/**
+ * Get the currently executing thread
+ */
+kthread_t *sched_current() {
+    uint32_t eflags = cpu_irq_save();
+    kthread_t *cur = sched_this_rq()->current;
+    cpu_irq_restore(eflags);
+    return cur;
+}
+
+/**
+ * Make a new thread runnable on the least loaded CPU
+ * @param thread thread to act on
+ */
+void sched_enqueue(kthread_t *thread) {
+    uint32_t eflags = cpu_irq_save();
+    sched_enqueue_on(thread, sched_select_cpu());
+    cpu_irq_restore(eflags);
+}
+
+/**
+ * Make a new thread runnable on a given CPU, where it will stay
+ * @param thread thread to act on
+ * @param cpu    logical index of an online CPU
+ */
+void sched_enqueue_on(kthread_t *thread, uint32_t cpu) {
+    uint32_t eflags = cpu_irq_save();
+    sched_rq_t *rq = sched_cpu_rq(cpu);
+
+    spin_lock(&rq->lock);
+    thread->sched.cpu = rq->cpu;
+    thread->sched.last_ts = cpu_rdtsc();
+    sched_enqueue_locked(rq, thread);
+    bool kick = sched_check_preempt(rq, thread);
+    spin_unlock(&rq->lock);
+
+    if (kick) {
+        smp_send_reschedule(rq->cpu);
+    }
+    cpu_irq_restore(eflags);
+}
+
+/**
+ * Pick the next thread to run and switch to it.
+ * Must be called with interrupts disabled.
+ */
+void sched_schedule() {
+    sched_rq_t *rq = sched_this_rq();
+    spin_lock(&rq->lock);
+    sched_schedule_locked(rq);
+}
+
+/**
+ * Complete a context switch. Called by the incoming thread, on the new stack.
+ */
+void sched_finish_switch() {
+    sched_rq_t *rq = sched_this_rq();
+    kthread_t *prev = rq->prev;
+
+    // prev's context has been saved, whoever frees it may go ahead
+    __sync_synchronize();
+    prev->sched.on_cpu = false;
+
+    spin_unlock(&rq->lock);
+}
+
+/**
+ * Give up the CPU to the next runnable thread, if any
+ */
+void sched_yield() {
+    uint32_t eflags = cpu_irq_save();
+    sched_schedule();
+    cpu_irq_restore(eflags);
+}
+
+/**
+ * Block the current thread until sched_wake() is called on it.
+ * Must be called with interrupts disabled, after the thread has been
+ * made visible to whoever is going to wake it. May return spuriously,
+ * so callers must re-check the condition they are waiting for.
+ */
+void sched_block() {
+    sched_rq_t *rq = sched_this_rq();
+    kthread_t *cur = rq->current;
+
+    spin_lock(&rq->lock);
+    if (cur->sched.wakeup_pending) {
+        // Someone already woke us after we made ourselves visible
+        cur->sched.wakeup_pending = false;
+        spin_unlock(&rq->lock);
+        return;
+    }
+    cur->state = KTHREAD_BLOCKED;
+    sched_schedule_locked(rq);
+}
+
+/**
+ * Make a blocked thread runnable again
+ * @param thread thread to wake
+ */
+void sched_wake(kthread_t *thread) {
+    uint32_t eflags = cpu_irq_save();
+    sched_rq_t *rq = sched_cpu_rq(thread->sched.cpu);
+    bool kick = false;
+
+    spin_lock(&rq->lock);
+    if (thread->state == KTHREAD_BLOCKED) {
+        thread->sched.last_ts = cpu_rdtsc();
+        sched_enqueue_locked(rq, thread);
+        kick = sched_check_preempt(rq, thread);
+    } else if (thread->state == KTHREAD_RUNNING) {
+        // Still on its way to blocking, don't let it
+        thread->sched.wakeup_pending = true;
+    }
+    spin_unlock(&rq->lock);
+
+    if (kick) {
+        smp_send_reschedule(rq->cpu);
+    }
+    cpu_irq_restore(eflags);
+}
+
+/**
+ * Timer tick handler. Charges the tick to the current thread's class.
+ * Called from the PIT interrupt on the boot CPU and the local APIC timer
+ * interrupt on the others.
+ */
+void sched_tick() {
+    sched_rq_t *rq = sched_this_rq();
+
+    spin_lock(&rq->lock);
+    kthread_t *cur = rq->current;
+    if (cur->flags & KTHREAD_IDLE) {
+        if (rq->nr_running) {
+            rq->need_resched = true;
+        }
+    } else if (cur->sched.class->tick(rq, cur)) {
+        rq->need_resched = true;
+    }
+    spin_unlock(&rq->lock);
+
+    // The interrupted context was outside any read-side critical section
+    // if it could have been preempted
+    rcu_tick(!(this_cpu_read(sched_preempt_count) & SCHED_PREEMPT_MASK));
+}
+
+/**
+ * Switch threads if a reschedule is pending.
+ * Called on the way out of every interrupt.
+ */
+void sched_preempt() {
+    sched_rq_t *rq = sched_this_rq();
+    if (this_cpu_read(sched_preempt_count)) {
+        // Picked up by preempt_enable() instead
+        return;
+    }
+    if (rq->need_resched && rq->current) {
+        spin_lock(&rq->lock);
+        sched_schedule_locked(rq);
+    }
+}
+
+/**
+ * Switch threads if a reschedule became pending while preemption was
+ * disabled. Called by preempt_enable().
+ */
+void sched_preempt_resume() {
+    if (!sched_this_rq()->need_resched) return;
+
+    uint32_t eflags = cpu_irq_save();
+    // Callers with interrupts disabled can't be preempted either
+    if (eflags & EFLAGS_IF) {
+        sched_preempt();
+    }
+    cpu_irq_restore(eflags);
+}
+
+/**
+ * Change the scheduling policy and priority of a thread
+ * @param thread thread to act on
+ * @param policy SCHED_POLICY_* to schedule the thread under
+ * @param prio   priority, 0-15 for real-time policies or 16-31 for SCHED_POLICY_FAIR
+ * @return K_SUCCESS or K_INVALOP if the priority isn't valid for the policy
+ */
+k_return_t sched_set_policy(kthread_t *thread, enum sched_policy policy, uint32_t prio) {
+    if (policy == SCHED_POLICY_FAIR) {
+        if (prio < SCHED_FAIR_PRIO_MIN || prio >= SCHED_PRIO_MAX) return K_INVALOP;
+    } else if (prio >= SCHED_RT_PRIO_MAX) {
+        return K_INVALOP;
+    }
+    if (thread->flags & KTHREAD_IDLE) return K_INVALOP;
+
+    sched_change(thread, policy, prio, true);
+    return K_SUCCESS;
+}
+
+/**
+ * Temporarily raise a thread's priority, e.g. because a higher priority
+ * thread is waiting on a lock it holds. A fair thread boosted into the
+ * real-time range runs as SCHED_POLICY_FIFO until the boost is dropped.
+ * @param thread thread to act on
+ * @param prio   priority to run at, or SCHED_PRIO_MAX to drop the boost.
+ *               Priorities below the thread's normal one drop the boost too.
+ */
+void sched_boost_prio(kthread_t *thread, uint32_t prio) {
+    enum sched_policy policy = thread->sched.normal_policy;
+
+    if (prio >= thread->sched.normal_prio) {
+        prio = thread->sched.normal_prio;
+    } else if (prio < SCHED_RT_PRIO_MAX && policy == SCHED_POLICY_FAIR) {
+        policy = SCHED_POLICY_FIFO;
+    }
+
+    if (prio == thread->sched.prio && policy == thread->sched.policy) return;
+    sched_change(thread, policy, prio, false);
+}
+
+/**
+ * Print the scheduling statistics of a thread to the console
+ * @param thread thread to act on
+ */
+void sched_dump_thread(kthread_t *thread) {
+    static const char *policy_names[] = { "fifo", "rr", "fair" };
+    sched_info_t info;
+
+    uint32_t eflags = cpu_irq_save();
+    info = thread->sched;
+    cpu_irq_restore(eflags);
+
+    printf("thread %u (%s): cpu %u, %s prio %u, runtime %u cycles, wait %u cycles, switches %u (%u voluntary, %u involuntary)\n",
+           thread->tid, thread->name, info.cpu, policy_names[info.policy], info.prio,
+           (uint32_t)info.runtime, (uint32_t)info.wait_time, info.nr_switches,
+           info.nr_voluntary, info.nr_involuntary);
+}
+
+/**
+ * Body of every CPU's idle thread. Puts the CPU to sleep until an interrupt
+ * arrives or, with MWAIT, until another CPU makes a thread runnable here.
+ * The idle thread's runtime is the CPU's idle time.
+ */
+void sched_idle() {
+    sched_rq_t *rq = sched_this_rq();
+
+    for (;;) {
+        cpu_irq_save();
+        if (sched_idle_mwait) {
+            rq->polling = true;
+            smp_mb();
+            cpu_monitor(&rq->need_resched);
+            if (!rq->need_resched) {
+                cpu_mwait_irq_enable(0);
+                __asm__ __volatile__ ("cli");
+            }
+            rq->polling = false;
+        } else if (!rq->need_resched) {
+            cpu_halt_irq_enable();
+            __asm__ __volatile__ ("cli");
+        }
+
+        // Woken by a store to need_resched rather than an interrupt,
+        // nothing else will switch threads for us
+        if (rq->need_resched) {
+            sched_schedule();
+        }
+        __asm__ __volatile__ ("sti");
+    }
+}
+
+/**
+ * Get how a CPU has spent its time since it started scheduling. Time spent
+ * in interrupt handlers is charged to whatever was running.
+ * @param cpu logical index of the CPU
+ * @param[out] idle cycles spent in the idle thread
+ * @param[out] busy cycles spent running other threads
+ */
+void sched_cpu_times(uint32_t cpu, uint64_t *idle, uint64_t *busy) {
+    sched_rq_t *rq = sched_cpu_rq(cpu);
+
+    uint32_t eflags = spin_lock_irqsave(&rq->lock);
+    uint64_t now = cpu_rdtsc();
+    uint64_t idle_time = rq->idle->sched.runtime;
+    if (rq->current == rq->idle) {
+        idle_time += now - rq->idle->sched.last_ts;
+    }
+    *idle = idle_time;
+    *busy = now - rq->start_ts - idle_time;
+    spin_unlock_irqrestore(&rq->lock, eflags);
+}
+
+/**
+ * Print the idle and busy time of every CPU to the console
+ */
+void sched_dump_cpus() {
+    uint32_t cpu;
+    for (cpu=0; cpu<smp_num_cpus; cpu++) {
+        if (!sched_cpu_rq(cpu)->idle) continue;
+
+        uint64_t idle, busy;
+        sched_cpu_times(cpu, &idle, &busy);
+        uint64_t total = idle + busy;
+        printf("cpu %u: idle %u%%, busy %u Mcycles, idle %u Mcycles, %s\n", cpu,
+               total ? (uint32_t)(idle * 100 / total) : 0,
+               (uint32_t)(busy >> 20), (uint32_t)(idle >> 20),
+               sched_idle_mwait ? "mwait" : "hlt");
+    }
+}
+
+/**
+ * Get the number of context switches performed by all CPUs since boot
+ */
+uint64_t sched_total_switches() {
+    return percpu_counter_sum(sched_nr_switches);
+}
@@ -0,0 +1,84 @@
+/**
+ * Counting semaphores
+ */
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#include <kernel/kernel.h>
+#include <kernel/atomic.h>
+#include <kernel/semaphore.h>
+#include <kernel/sched.h>
+#include <kernel/spinlock.h>
+#include <kernel/wait.h>
+
+#include <arch/i386/cpu.h>
+
+void sem_init(semaphore_t *sem, int32_t count) {
+    sem->count = count;
+    wait_queue_init(&sem->waiters);
+}
+
+/**
+ * Take a unit if one is available
+ * @param sem semaphore to act on
+ * @return true if a unit was taken
+ */
+bool sem_trydown(semaphore_t *sem) {
+    int32_t count = atomic_load_relaxed(&sem->count);
+    while (count > 0) {
+        if (atomic_cmpxchg_acquire(&sem->count, &count, count - 1)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * Take a unit, sleeping until one is available.
+ * Must be called from thread context.
+ * @param sem semaphore to act on
+ */
+void sem_down(semaphore_t *sem) {
+    uint32_t i;
+    for (i=0; i<SEMAPHORE_SPIN_LIMIT; i++) {
+        if (sem_trydown(sem)) return;
+        // Don't spin past threads that are already queued
+        if (atomic_load_relaxed(&sem->waiters.head)) break;
+        cpu_relax();
+    }
+
+    uint32_t eflags = spin_lock_irqsave(&sem->waiters.lock);
+    if (sem_trydown(sem)) {
+        spin_unlock_irqrestore(&sem->waiters.lock, eflags);
+        return;
+    }
+
+    wait_entry_t wait;
+    wait_entry_init(&wait);
+    wait_queue_add_locked(&sem->waiters, &wait);
+
+    // sem_up hands its unit to us before waking us
+    while (!wait.woken) {
+        spin_unlock(&sem->waiters.lock);
+        sched_block();
+        spin_lock(&sem->waiters.lock);
+    }
+    spin_unlock_irqrestore(&sem->waiters.lock, eflags);
+}
+
+/**
+ * Release a unit, handing it to the longest waiting thread if there is one.
+ * May be called from interrupt context.
+ * @param sem semaphore to act on
+ */
+void sem_up(semaphore_t *sem) {
+    uint32_t eflags = spin_lock_irqsave(&sem->waiters.lock);
+    wait_entry_t *next = wait_queue_pop_locked(&sem->waiters);
+    if (next) {
+        wait_entry_wake(next);
+    } else {
+        atomic_inc(&sem->count);
+    }
+    spin_unlock_irqrestore(&sem->waiters.lock, eflags);
+}
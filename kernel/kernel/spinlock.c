@@ -0,0 +1,297 @@
+/**
+ * Spinning locks: ticket spinlocks, MCS queue locks and reader-writer locks
+ *
+ * None of these disable interrupts by themselves. A lock that is also taken
+ * from an interrupt handler must be taken with the *_irqsave variants
+ * everywhere else, or the handler can spin forever on its own CPU.
+ *
+ * They don't disable preemption either. The plain variants must be called
+ * with interrupts or preemption already disabled, otherwise the holder can
+ * be switched out and leave every other CPU spinning until it runs again.
+ */
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+
+#include <kernel/kernel.h>
+#include <kernel/atomic.h>
+#include <kernel/spinlock.h>
+
+#include <arch/i386/cpu.h>
+
+#ifdef SPINLOCK_STATS
+static inline void lock_stats_acquired(lock_stats_t *stats, bool contended) {
+    stats->acquisitions++;
+    if (contended) {
+        stats->contentions++;
+    }
+    stats->hold_start = cpu_rdtsc();
+}
+
+static inline void lock_stats_released(lock_stats_t *stats) {
+    uint64_t held = cpu_rdtsc() - stats->hold_start;
+    if (held > stats->max_hold) {
+        stats->max_hold = held;
+    }
+}
+#define LOCK_STATS_ACQUIRED(lock, contended) lock_stats_acquired(&(lock)->stats, (contended))
+#define LOCK_STATS_RELEASED(lock) lock_stats_released(&(lock)->stats)
+#else
+#define LOCK_STATS_ACQUIRED(lock, contended) ((void)(contended))
+#define LOCK_STATS_RELEASED(lock)
+#endif
+
+/**
+ * Ticket spinlocks
+ */
+
+void spin_lock_init(spinlock_t *lock) {
+    spinlock_t init = SPINLOCK_INIT;
+    *lock = init;
+}
+
+/**
+ * Take a spinlock, waiting for every earlier taker to release it first.
+ * The caller must have interrupts or preemption disabled.
+ * @param lock lock to take
+ */
+void spin_lock(spinlock_t *lock) {
+    uint16_t ticket = atomic_fetch_add(&lock->tickets.next, 1);
+    bool contended = false;
+
+    while (atomic_load_acquire(&lock->tickets.owner) != ticket) {
+        contended = true;
+        cpu_relax();
+    }
+    LOCK_STATS_ACQUIRED(lock, contended);
+}
+
+/**
+ * Take a spinlock if it is free
+ * @param lock lock to take
+ * @return true if the lock was taken
+ */
+bool spin_trylock(spinlock_t *lock) {
+    uint32_t old = atomic_load_relaxed(&lock->value);
+    // Free if the owner ticket (low half) equals the next ticket (high half)
+    if ((old & 0xFFFF) != (old >> 16)) {
+        return false;
+    }
+    if (!atomic_cmpxchg_acquire(&lock->value, &old, old + 0x10000)) {
+        return false;
+    }
+    LOCK_STATS_ACQUIRED(lock, false);
+    return true;
+}
+
+/**
+ * Release a spinlock and hand it to the next waiter, if any
+ * @param lock lock to release
+ */
+void spin_unlock(spinlock_t *lock) {
+    LOCK_STATS_RELEASED(lock);
+    // Only the holder writes the owner ticket, no atomic increment needed
+    atomic_store_release(&lock->tickets.owner, lock->tickets.owner + 1);
+}
+
+bool spin_is_locked(spinlock_t *lock) {
+    uint32_t val = atomic_load_relaxed(&lock->value);
+    return (val & 0xFFFF) != (val >> 16);
+}
+
+/**
+ * Disable interrupts and take a spinlock
+ * @param lock lock to take
+ * @return EFLAGS to pass to spin_unlock_irqrestore
+ */
+uint32_t spin_lock_irqsave(spinlock_t *lock) {
+    uint32_t flags = cpu_irq_save();
+    spin_lock(lock);
+    return flags;
+}
+
+/**
+ * Release a spinlock and restore the interrupt state from spin_lock_irqsave
+ * @param lock  lock to release
+ * @param flags EFLAGS returned by spin_lock_irqsave
+ */
+void spin_unlock_irqrestore(spinlock_t *lock, uint32_t flags) {
+    spin_unlock(lock);
+    cpu_irq_restore(flags);
+}
+
+/**
+ * MCS queue locks
+ */
+
+void mcs_lock_init(mcs_lock_t *lock) {
+    mcs_lock_t init = MCS_LOCK_INIT;
+    *lock = init;
+}
+
+/**
+ * Take an MCS lock
+ * @param lock lock to take
+ * @param node queue node owned by the caller, must stay valid until mcs_unlock
+ */
+void mcs_lock(mcs_lock_t *lock, mcs_node_t *node) {
+    node->next = NULL;
+    node->locked = true;
+
+    mcs_node_t *prev = atomic_xchg(&lock->tail, node);
+    if (prev) {
+        // Queue behind the previous tail and spin on our own node
+        atomic_store_release(&prev->next, node);
+        while (atomic_load_acquire(&node->locked)) {
+            cpu_relax();
+        }
+    }
+    LOCK_STATS_ACQUIRED(lock, prev != NULL);
+}
+
+/**
+ * Take an MCS lock if it is free
+ * @param lock lock to take
+ * @param node queue node owned by the caller
+ * @return true if the lock was taken
+ */
+bool mcs_trylock(mcs_lock_t *lock, mcs_node_t *node) {
+    mcs_node_t *expected = NULL;
+    node->next = NULL;
+    node->locked = false;
+
+    if (!atomic_cmpxchg_acquire(&lock->tail, &expected, node)) {
+        return false;
+    }
+    LOCK_STATS_ACQUIRED(lock, false);
+    return true;
+}
+
+/**
+ * Release an MCS lock and hand it to the next waiter, if any
+ * @param lock lock to release
+ * @param node node the lock was taken with
+ */
+void mcs_unlock(mcs_lock_t *lock, mcs_node_t *node) {
+    LOCK_STATS_RELEASED(lock);
+
+    mcs_node_t *next = atomic_load_acquire(&node->next);
+    if (!next) {
+        // No known successor, try to mark the lock free
+        mcs_node_t *expected = node;
+        if (atomic_cmpxchg(&lock->tail, &expected, NULL)) {
+            return;
+        }
+        // Someone is enqueueing, wait for them to link in
+        while (!(next = atomic_load_acquire(&node->next))) {
+            cpu_relax();
+        }
+    }
+    atomic_store_release(&next->locked, false);
+}
+
+/**
+ * Reader-writer locks
+ */
+
+void rwlock_init(rwlock_t *lock) {
+    rwlock_t init = RWLOCK_INIT;
+    *lock = init;
+}
+
+/**
+ * Take a reader-writer lock for reading
+ * @param lock lock to take
+ */
+void read_lock(rwlock_t *lock) {
+    bool contended = false;
+    uint32_t old = atomic_load_relaxed(&lock->value);
+
+    for (;;) {
+        if (old & RWLOCK_WRITER) {
+            contended = true;
+            cpu_relax();
+            old = atomic_load_relaxed(&lock->value);
+            continue;
+        }
+        if (atomic_cmpxchg_acquire(&lock->value, &old, old + 1)) {
+            break;
+        }
+    }
+
+#ifdef SPINLOCK_STATS
+    // Readers overlap, so only count them; hold times are tracked for writers
+    __atomic_fetch_add(&lock->stats.acquisitions, 1, __ATOMIC_RELAXED);
+    if (contended) {
+        __atomic_fetch_add(&lock->stats.contentions, 1, __ATOMIC_RELAXED);
+    }
+#else
+    (void)contended;
+#endif
+}
+
+void read_unlock(rwlock_t *lock) {
+    __atomic_fetch_sub(&lock->value, 1, __ATOMIC_RELEASE);
+}
+
+/**
+ * Take a reader-writer lock for writing
+ * @param lock lock to take
+ */
+void write_lock(rwlock_t *lock) {
+    bool contended = false;
+
+    // Claim the writer bit, which keeps new readers out
+    while (atomic_fetch_or(&lock->value, RWLOCK_WRITER) & RWLOCK_WRITER) {
+        contended = true;
+        while (atomic_load_relaxed(&lock->value) & RWLOCK_WRITER) {
+            cpu_relax();
+        }
+    }
+
+    // Wait for the readers already inside to leave
+    while (atomic_load_acquire(&lock->value) != RWLOCK_WRITER) {
+        contended = true;
+        cpu_relax();
+    }
+    LOCK_STATS_ACQUIRED(lock, contended);
+}
+
+void write_unlock(rwlock_t *lock) {
+    LOCK_STATS_RELEASED(lock);
+    // Readers can't have registered while the writer bit was set
+    atomic_store_release(&lock->value, 0);
+}
+
+uint32_t read_lock_irqsave(rwlock_t *lock) {
+    uint32_t flags = cpu_irq_save();
+    read_lock(lock);
+    return flags;
+}
+
+void read_unlock_irqrestore(rwlock_t *lock, uint32_t flags) {
+    read_unlock(lock);
+    cpu_irq_restore(flags);
+}
+
+uint32_t write_lock_irqsave(rwlock_t *lock) {
+    uint32_t flags = cpu_irq_save();
+    write_lock(lock);
+    return flags;
+}
+
+void write_unlock_irqrestore(rwlock_t *lock, uint32_t flags) {
+    write_unlock(lock);
+    cpu_irq_restore(flags);
+}
+
+/**
+ * Print the statistics of a lock to the console
+ * @param name  name to print for the lock
+ * @param stats statistics of the lock, e.g. &lock->stats
+ */
+void lock_stats_print(const char *name, lock_stats_t *stats) {
+    printf("lock %s: %u acquisitions, %u contended, max hold %u cycles\n", name,
+           stats->acquisitions, stats->contentions, (uint32_t)stats->max_hold);
+}
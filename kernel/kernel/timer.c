@@ -0,0 +1,284 @@
+/**
+ * One-shot kernel timers, kept in a red-black tree ordered by expiry, and
+ * blocking sleep built on top of them
+ */
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#include <kernel/kernel.h>
+#include <kernel/kernel_thread.h>
+#include <kernel/rbtree.h>
+#include <kernel/sched.h>
+#include <kernel/spinlock.h>
+#include <kernel/timer.h>
+
+#include <arch/i386/cpu.h>
+#include <drivers/pc/pit.h>
+
+/**
+ * A thread sleeping until its timer fires. Lives on the sleeper's stack.
+ */
+struct ksleeper {
+    ktimer_t timer;
+    kthread_t *thread;
+    volatile bool done;
+};
+
+// Armed timers ordered by expiry, timers expiring together in arming order
+static rb_root_t ktimer_tree = RB_ROOT_INIT;
+// Soonest timer, or NULL if none are armed
+static ktimer_t *ktimer_first = NULL;
+static spinlock_t ktimer_lock = SPINLOCK_INIT;
+// Timer whose callback ktimer_tick() is running, or NULL
+static ktimer_t *volatile ktimer_running = NULL;
+
+static inline ktimer_t *ktimer_entry(rb_node_t *rb) {
+    return rb ? rb_entry(rb, ktimer_t, rb) : NULL;
+}
+
+/**
+ * Remove an armed timer from the tree. ktimer_lock must be held.
+ */
+static void ktimer_remove_locked(ktimer_t *timer) {
+    if (timer == ktimer_first) {
+        ktimer_first = ktimer_entry(rb_next(&timer->rb));
+    }
+    rb_erase(&ktimer_tree, &timer->rb, NULL);
+    timer->pending = false;
+}
+
+/**
+ * Insert an unarmed timer into the tree. ktimer_lock must be held.
+ */
+static void ktimer_insert_locked(ktimer_t *timer, ktime_t expires) {
+    rb_node_t **link = &ktimer_tree.node;
+    rb_node_t *parent = NULL;
+    bool leftmost = true;
+
+    timer->expires = expires;
+    while (*link) {
+        parent = *link;
+        if (expires < ktimer_entry(parent)->expires) {
+            link = &parent->left;
+        } else {
+            link = &parent->right;
+            leftmost = false;
+        }
+    }
+    rb_link_node(&timer->rb, parent, link);
+    rb_insert_color(&ktimer_tree, &timer->rb, NULL);
+
+    if (leftmost) {
+        ktimer_first = timer;
+    }
+    timer->pending = true;
+}
+
+/**
+ * Find the first armed timer expiring at or after a time. ktimer_lock must be held.
+ */
+static ktimer_t *ktimer_lower_bound_locked(ktime_t time) {
+    rb_node_t *rb = ktimer_tree.node;
+    ktimer_t *res = NULL;
+    while (rb) {
+        ktimer_t *cur = ktimer_entry(rb);
+        if (cur->expires >= time) {
+            res = cur;
+            rb = rb->left;
+        } else {
+            rb = rb->right;
+        }
+    }
+    return res;
+}
+
+static void ksleeper_wake(ktimer_t *timer) {
+    struct ksleeper *sleeper = container_of(timer, struct ksleeper, timer);
+
+    // The sleeper may return as soon as done is set
+    kthread_t *thread = sleeper->thread;
+    sleeper->done = true;
+    sched_wake(thread);
+}
+
+/**
+ * Have the PIT drive the timers. Must be called after the PIT is installed.
+ */
+void ktimer_install() {
+    struct pit_routine ktimer_pit_routine = {
+        1, // Call ktimer_tick on every tick
+        ktimer_tick
+    };
+    pit_install_scheduler_routine(ktimer_pit_routine);
+}
+
+/**
+ * Get the current time
+ * @return nanoseconds since the timer was installed, with tick resolution
+ */
+ktime_t ktime_get() {
+    return (ktime_t)pit_get_total_ticks() * NSEC_PER_TICK;
+}
+
+/**
+ * Initialize a timer
+ * @param timer timer to act on
+ * @param func  function to call when the timer fires
+ */
+void ktimer_init(ktimer_t *timer, void (*func)(ktimer_t *timer)) {
+    timer->expires = 0;
+    timer->func = func;
+    timer->pending = false;
+}
+
+/**
+ * Arm a timer, moving it if it is already armed
+ * @param timer   timer to act on
+ * @param expires time to fire at, see ktime_get()
+ */
+void ktimer_add(ktimer_t *timer, ktime_t expires) {
+    uint32_t eflags = spin_lock_irqsave(&ktimer_lock);
+    if (timer->pending) {
+        ktimer_remove_locked(timer);
+    }
+    ktimer_insert_locked(timer, expires);
+    spin_unlock_irqrestore(&ktimer_lock, eflags);
+}
+
+/**
+ * Arm a timer to fire anywhere between two times. If another timer already
+ * expires in that window, this one is lined up with it so that both are
+ * handled by the same wakeup.
+ * @param timer    timer to act on
+ * @param earliest time to fire at the earliest
+ * @param latest   time to fire at the latest
+ * @return time the timer was armed for
+ */
+ktime_t ktimer_add_range(ktimer_t *timer, ktime_t earliest, ktime_t latest) {
+    uint32_t eflags = spin_lock_irqsave(&ktimer_lock);
+    if (timer->pending) {
+        ktimer_remove_locked(timer);
+    }
+
+    ktime_t expires = earliest;
+    ktimer_t *cur = ktimer_lower_bound_locked(earliest);
+    if (cur && cur->expires <= latest) {
+        expires = cur->expires;
+    }
+    ktimer_insert_locked(timer, expires);
+    spin_unlock_irqrestore(&ktimer_lock, eflags);
+    return expires;
+}
+
+/**
+ * Disarm a timer. Its callback may still be running on return.
+ * @param timer timer to act on
+ * @return true if the timer was armed
+ */
+bool ktimer_cancel(ktimer_t *timer) {
+    uint32_t eflags = spin_lock_irqsave(&ktimer_lock);
+    bool pending = timer->pending;
+    if (pending) {
+        ktimer_remove_locked(timer);
+    }
+    spin_unlock_irqrestore(&ktimer_lock, eflags);
+    return pending;
+}
+
+/**
+ * Disarm a timer and wait for its callback to return if it is running.
+ * Must not be called from the callback, or holding a lock it takes.
+ * @param timer timer to act on
+ * @return true if the timer was armed
+ */
+bool ktimer_cancel_sync(ktimer_t *timer) {
+    bool pending = ktimer_cancel(timer);
+    while (ktimer_running == timer) {
+        cpu_relax();
+    }
+    return pending;
+}
+
+bool ktimer_pending(ktimer_t *timer) {
+    return timer->pending;
+}
+
+/**
+ * Fire every timer that has expired. Called from the PIT interrupt.
+ */
+void ktimer_tick() {
+    ktime_t now = ktime_get();
+
+    spin_lock(&ktimer_lock);
+    while (ktimer_first && ktimer_first->expires <= now) {
+        ktimer_t *timer = ktimer_first;
+        ktimer_remove_locked(timer);
+        ktimer_running = timer;
+
+        // The callback may re-arm the timer
+        spin_unlock(&ktimer_lock);
+        timer->func(timer);
+        spin_lock(&ktimer_lock);
+        ktimer_running = NULL;
+    }
+    spin_unlock(&ktimer_lock);
+}
+
+/**
+ * Interfaces for sleeping. All of these must be called from thread context.
+ */
+
+/**
+ * Block the calling thread until some time between two deadlines, letting
+ * the wakeup be shared with other timers in the window
+ * @param earliest absolute time to sleep until at least, see ktime_get()
+ * @param latest   absolute time to wake by
+ */
+void sleep_until_range(ktime_t earliest, ktime_t latest) {
+    struct ksleeper sleeper;
+    ktimer_init(&sleeper.timer, ksleeper_wake);
+    sleeper.thread = sched_current();
+    sleeper.done = false;
+
+    uint32_t eflags = cpu_irq_save();
+    ktimer_add_range(&sleeper.timer, earliest, latest);
+    while (!sleeper.done) {
+        sched_block();
+    }
+    cpu_irq_restore(eflags);
+}
+
+/**
+ * Block the calling thread until a deadline
+ * @param deadline absolute time to sleep until, see ktime_get()
+ */
+void sleep_until(ktime_t deadline) {
+    sleep_until_range(deadline, deadline);
+}
+
+/**
+ * Block the calling thread for at least the given time
+ * @param ns nanoseconds to sleep
+ */
+void nsleep(uint64_t ns) {
+    sleep_until(ktime_get() + ns);
+}
+
+void msleep(uint32_t ms) {
+    nsleep(ms * NSEC_PER_MSEC);
+}
+
+/**
+ * Block the calling thread for between min_us and max_us microseconds.
+ * A wider range lets more sleepers share a wakeup.
+ * @param min_us microseconds to sleep at least
+ * @param max_us microseconds to sleep at most
+ */
+void usleep_range(uint32_t min_us, uint32_t max_us) {
+    ktime_t now = ktime_get();
+    if (max_us < min_us) {
+        max_us = min_us;
+    }
+    sleep_until_range(now + min_us * NSEC_PER_USEC, now + max_us * NSEC_PER_USEC);
+}
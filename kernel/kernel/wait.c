@@ -0,0 +1,153 @@
+/**
+ * Wait queues
+ */
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#include <kernel/kernel.h>
+#include <kernel/kernel_thread.h>
+#include <kernel/atomic.h>
+#include <kernel/sched.h>
+#include <kernel/spinlock.h>
+#include <kernel/wait.h>
+
+void wait_queue_init(wait_queue_t *wq) {
+    spin_lock_init(&wq->lock);
+    wq->head = NULL;
+    wq->tail = NULL;
+}
+
+/**
+ * Prepare a wait entry for the calling thread
+ * @param entry entry to initialize
+ */
+void wait_entry_init(wait_entry_t *entry) {
+    entry->thread = sched_current();
+    entry->woken = false;
+    entry->queued = false;
+    entry->next = NULL;
+}
+
+/**
+ * Append an entry to a wait queue. wq->lock must be held.
+ */
+void wait_queue_add_locked(wait_queue_t *wq, wait_entry_t *entry) {
+    entry->next = NULL;
+    entry->woken = false;
+    entry->queued = true;
+    if (wq->tail) {
+        wq->tail->next = entry;
+    } else {
+        wq->head = entry;
+    }
+    wq->tail = entry;
+}
+
+/**
+ * Remove an entry from anywhere in a wait queue. wq->lock must be held.
+ */
+void wait_queue_remove_locked(wait_queue_t *wq, wait_entry_t *entry) {
+    wait_entry_t *prev = NULL;
+    wait_entry_t *cur;
+    for (cur = wq->head; cur; prev = cur, cur = cur->next) {
+        if (cur != entry) continue;
+
+        if (prev) {
+            prev->next = cur->next;
+        } else {
+            wq->head = cur->next;
+        }
+        if (wq->tail == cur) {
+            wq->tail = prev;
+        }
+        break;
+    }
+    entry->next = NULL;
+    entry->queued = false;
+}
+
+/**
+ * Remove the longest waiting entry. wq->lock must be held.
+ * @return removed entry, or NULL if nobody is waiting
+ */
+wait_entry_t *wait_queue_pop_locked(wait_queue_t *wq) {
+    wait_entry_t *entry = wq->head;
+    if (!entry) return NULL;
+
+    wq->head = entry->next;
+    if (!wq->head) {
+        wq->tail = NULL;
+    }
+    entry->next = NULL;
+    entry->queued = false;
+    return entry;
+}
+
+/**
+ * Wake the thread of an entry taken off its queue.
+ * The entry may go away as soon as woken is set, so it isn't touched after.
+ */
+void wait_entry_wake(wait_entry_t *entry) {
+    kthread_t *thread = entry->thread;
+    atomic_store_release(&entry->woken, true);
+    sched_wake(thread);
+}
+
+/**
+ * Put the calling thread's entry on a wait queue if it isn't already
+ * @param wq    queue to wait on
+ * @param entry entry of the calling thread
+ */
+void wait_queue_prepare(wait_queue_t *wq, wait_entry_t *entry) {
+    uint32_t eflags = spin_lock_irqsave(&wq->lock);
+    if (!entry->queued) {
+        wait_queue_add_locked(wq, entry);
+    }
+    spin_unlock_irqrestore(&wq->lock, eflags);
+}
+
+/**
+ * Take the calling thread's entry off a wait queue once it's done waiting
+ * @param wq    queue the thread waited on
+ * @param entry entry of the calling thread
+ */
+void wait_queue_finish(wait_queue_t *wq, wait_entry_t *entry) {
+    uint32_t eflags = spin_lock_irqsave(&wq->lock);
+    if (entry->queued) {
+        wait_queue_remove_locked(wq, entry);
+    }
+    spin_unlock_irqrestore(&wq->lock, eflags);
+}
+
+/**
+ * Wake the longest waiting thread on a wait queue
+ * @param wq queue to act on
+ * @return true if a thread was woken
+ */
+bool wait_queue_wake_one(wait_queue_t *wq) {
+    uint32_t eflags = spin_lock_irqsave(&wq->lock);
+    wait_entry_t *entry = wait_queue_pop_locked(wq);
+    if (entry) {
+        wait_entry_wake(entry);
+    }
+    spin_unlock_irqrestore(&wq->lock, eflags);
+    return entry != NULL;
+}
+
+/**
+ * Wake every thread on a wait queue, in the order they arrived
+ * @param wq queue to act on
+ * @return number of threads woken
+ */
+uint32_t wait_queue_wake_all(wait_queue_t *wq) {
+    uint32_t n = 0;
+    uint32_t eflags = spin_lock_irqsave(&wq->lock);
+    wait_entry_t *entry;
+    while ((entry = wait_queue_pop_locked(wq))) {
+        wait_entry_wake(entry);
+        n++;
+    }
+    spin_unlock_irqrestore(&wq->lock, eflags);
+    return n;
+}
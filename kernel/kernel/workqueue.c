@@ -0,0 +1,505 @@
+/**
+ * Workqueues backed by per-CPU pools of worker threads
+ */
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include <kernel/kernel.h>
+#include <kernel/kernel_thread.h>
+#include <kernel/atomic.h>
+#include <kernel/sched.h>
+#include <kernel/spinlock.h>
+#include <kernel/timer.h>
+#include <kernel/wait.h>
+#include <kernel/workqueue.h>
+#include <mm/alloc.h>
+
+#include <arch/i386/percpu.h>
+#include <arch/i386/smp.h>
+
+static DEFINE_PER_CPU(worker_pool_t, worker_pools);
+
+// Default workqueue for general use
+workqueue_t *system_wq = NULL;
+
+/**
+ * Internal functions
+ */
+
+/**
+ * Append an item to a pool and hand it to an idle worker, if any.
+ * pool->lock must be held.
+ */
+static void pool_insert_locked(worker_pool_t *pool, work_t *work) {
+    work->next = NULL;
+    if (pool->tail) {
+        pool->tail->next = work;
+    } else {
+        pool->head = work;
+    }
+    pool->tail = work;
+    atomic_fetch_or(&work->flags, WORK_QUEUED);
+
+    worker_t *worker = pool->idle;
+    if (worker) {
+        pool->idle = worker->next;
+        pool->nr_idle--;
+        worker->idle = false;
+        sched_wake(worker->thread);
+    }
+}
+
+/**
+ * Drop a workqueue's count of active items, waking flushers when it hits 0
+ */
+static void workqueue_put(workqueue_t *wq) {
+    if (atomic_dec_and_test(&wq->nr_active)) {
+        wait_queue_wake_all(&wq->flush_wait);
+    }
+}
+
+/**
+ * Take a queued item off a pool without running it. pool->lock must be held.
+ * @return true if the item was queued
+ */
+static bool pool_remove_locked(worker_pool_t *pool, work_t *work) {
+    if (!(work->flags & WORK_QUEUED)) return false;
+
+    work_t *prev = NULL;
+    work_t *cur;
+    for (cur = pool->head; cur; prev = cur, cur = cur->next) {
+        if (cur != work) continue;
+
+        if (prev) {
+            prev->next = cur->next;
+        } else {
+            pool->head = cur->next;
+        }
+        if (pool->tail == cur) {
+            pool->tail = prev;
+        }
+        break;
+    }
+    atomic_fetch_and(&work->flags, ~(WORK_QUEUED | WORK_PENDING));
+    workqueue_put(work->wq);
+    return true;
+}
+
+/**
+ * Check whether an item is queued or being run by one of a pool's workers
+ */
+static bool pool_work_busy(worker_pool_t *pool, work_t *work) {
+    uint32_t eflags = spin_lock_irqsave(&pool->lock);
+    bool busy = work->flags & WORK_PENDING;
+    worker_t *worker;
+    for (worker = pool->workers; worker && !busy; worker = worker->next_all) {
+        busy = worker->current == work;
+    }
+    spin_unlock_irqrestore(&pool->lock, eflags);
+    return busy;
+}
+
+static void *worker_thread(void *arg) {
+    worker_t *self = (worker_t *)arg;
+    worker_pool_t *pool = self->pool;
+    self->thread = sched_current();
+
+    uint32_t eflags = spin_lock_irqsave(&pool->lock);
+    for (;;) {
+        // Run everything that's queued
+        while (pool->head) {
+            work_t *work = pool->head;
+            pool->head = work->next;
+            if (!pool->head) {
+                pool->tail = NULL;
+            }
+            workqueue_t *wq = work->wq;
+            self->current = work;
+
+            // The item may be queued again (or freed) as soon as it starts
+            atomic_fetch_and(&work->flags, ~(WORK_QUEUED | WORK_PENDING));
+            spin_unlock_irqrestore(&pool->lock, eflags);
+
+            work->func(work);
+
+            eflags = spin_lock_irqsave(&pool->lock);
+            self->current = NULL;
+            pool->nr_completed++;
+            wait_queue_wake_all(&pool->done_wait);
+            workqueue_put(wq);
+        }
+
+        if (self->exit) break;
+
+        // Go idle until there's work again or the watchdog retires us
+        self->idle = true;
+        self->idle_since = ktime_get();
+        self->next = pool->idle;
+        pool->idle = self;
+        pool->nr_idle++;
+        while (self->idle) {
+            spin_unlock(&pool->lock);
+            sched_block();
+            spin_lock(&pool->lock);
+        }
+    }
+
+    // Unlink ourselves and exit. The thread is detached and gets reaped.
+    worker_t **cur = &pool->workers;
+    while (*cur != self) {
+        cur = &(*cur)->next_all;
+    }
+    *cur = self->next_all;
+    pool->nr_workers--;
+    spin_unlock_irqrestore(&pool->lock, eflags);
+
+    kfree((uintptr_t *)self);
+    return NULL;
+}
+
+/**
+ * Start a new worker in a pool. Must be called from thread context.
+ * @return K_SUCCESS or K_OOM
+ */
+static k_return_t worker_create(worker_pool_t *pool) {
+    worker_t *worker = (worker_t *)kmalloc(sizeof(worker_t), KALLOC_GENERAL);
+    if (!worker) return K_OOM;
+    memset(worker, 0, sizeof(worker_t));
+    worker->pool = pool;
+
+    uint32_t eflags = spin_lock_irqsave(&pool->lock);
+    worker->next_all = pool->workers;
+    pool->workers = worker;
+    pool->nr_workers++;
+    spin_unlock_irqrestore(&pool->lock, eflags);
+
+    kthread_t *thread = kernel_thread_create_on(pool->cpu, "kworker", worker_thread, worker);
+    if (!thread) {
+        eflags = spin_lock_irqsave(&pool->lock);
+        worker_t **cur = &pool->workers;
+        while (*cur != worker) {
+            cur = &(*cur)->next_all;
+        }
+        *cur = worker->next_all;
+        pool->nr_workers--;
+        spin_unlock_irqrestore(&pool->lock, eflags);
+
+        kfree((uintptr_t *)worker);
+        return K_OOM;
+    }
+    kernel_thread_detach(thread);
+    return K_SUCCESS;
+}
+
+/**
+ * Starts workers for a pool when the watchdog asks for them
+ */
+static void *worker_manager_thread(void *arg) {
+    worker_pool_t *pool = (worker_pool_t *)arg;
+    for (;;) {
+        wait_event(&pool->manager_wait, pool->need_worker);
+        // If this fails the watchdog asks again on its next check
+        worker_create(pool);
+
+        uint32_t eflags = spin_lock_irqsave(&pool->lock);
+        pool->need_worker = false;
+        spin_unlock_irqrestore(&pool->lock, eflags);
+    }
+    return NULL;
+}
+
+/**
+ * Periodic check of a pool. Starts another worker if queued work hasn't
+ * made progress since the last check, and retires a worker that has been
+ * idle for too long.
+ */
+static void worker_pool_watchdog(ktimer_t *timer) {
+    worker_pool_t *pool = container_of(timer, worker_pool_t, watchdog);
+    ktime_t now = ktime_get();
+
+    spin_lock(&pool->lock);
+    if (pool->head && !pool->nr_idle && pool->nr_completed == pool->watchdog_completed &&
+            pool->nr_workers < WQ_MAX_WORKERS && !pool->need_worker) {
+        // Every worker is busy or blocked, add one
+        pool->need_worker = true;
+        wait_queue_wake_one(&pool->manager_wait);
+    }
+    pool->watchdog_completed = pool->nr_completed;
+
+    if (pool->nr_workers > WQ_MIN_WORKERS && pool->nr_idle) {
+        // Idle list is most recent first, so the last one has idled longest
+        worker_t **cur = &pool->idle;
+        while ((*cur)->next) {
+            cur = &(*cur)->next;
+        }
+        worker_t *worker = *cur;
+        if (now - worker->idle_since >= WQ_IDLE_TIMEOUT * NSEC_PER_MSEC) {
+            *cur = NULL;
+            pool->nr_idle--;
+            worker->idle = false;
+            worker->exit = true;
+            sched_wake(worker->thread);
+        }
+    }
+    spin_unlock(&pool->lock);
+
+    ktimer_add(timer, now + WQ_WATCHDOG_MS * NSEC_PER_MSEC);
+}
+
+static void delayed_work_timer(ktimer_t *timer) {
+    delayed_work_t *dwork = container_of(timer, delayed_work_t, timer);
+    worker_pool_t *pool = dwork->work.pool;
+
+    spin_lock(&pool->lock);
+    // Skip if cancelled, or queued again while we were waiting for the lock
+    if ((dwork->work.flags & WORK_PENDING) && !(dwork->work.flags & WORK_QUEUED) &&
+            !ktimer_pending(timer)) {
+        pool_insert_locked(pool, &dwork->work);
+    }
+    spin_unlock(&pool->lock);
+}
+
+static void worker_pool_init(uint32_t cpu) {
+    worker_pool_t *pool = per_cpu_ptr(worker_pools, cpu);
+    spin_lock_init(&pool->lock);
+    pool->cpu = cpu;
+    wait_queue_init(&pool->manager_wait);
+    wait_queue_init(&pool->done_wait);
+    ktimer_init(&pool->watchdog, worker_pool_watchdog);
+
+    pool->manager = kernel_thread_create_on(cpu, "kworker-mgr", worker_manager_thread, pool);
+    ASSERT(pool->manager);
+    while (pool->nr_workers < WQ_MIN_WORKERS) {
+        if (K_FAILED(worker_create(pool))) {
+            PANIC("Unable to start workqueue workers!");
+        }
+    }
+
+    pool->ready = true;
+    ktimer_add(&pool->watchdog, ktime_get() + WQ_WATCHDOG_MS * NSEC_PER_MSEC);
+}
+
+/**
+ * Interfaces for using workqueues
+ */
+
+/**
+ * Set up a worker pool on every online CPU and the system workqueue.
+ * Must be called from thread context after SMP bring-up.
+ */
+void workqueue_init() {
+    system_wq = workqueue_create("events");
+    if (!system_wq) {
+        PANIC("Unable to allocate system workqueue!");
+    }
+
+    uint32_t i;
+    for (i=0; i<smp_num_cpus; i++) {
+        if (smp_cpus[i].online) {
+            worker_pool_init(i);
+        }
+    }
+}
+
+/**
+ * Create a new workqueue
+ * @param name name of the workqueue, for debugging
+ * @return new workqueue, or NULL if out of memory
+ */
+workqueue_t *workqueue_create(const char *name) {
+    workqueue_t *wq = (workqueue_t *)kmalloc(sizeof(workqueue_t), KALLOC_GENERAL);
+    if (!wq) return NULL;
+    wq->name = name;
+    wq->nr_active = 0;
+    wait_queue_init(&wq->flush_wait);
+    return wq;
+}
+
+/**
+ * Initialize a work item
+ * @param work item to act on
+ * @param func function to run
+ */
+void work_init(work_t *work, work_func_t func) {
+    work->func = func;
+    work->flags = 0;
+    work->pool = NULL;
+    work->wq = NULL;
+    work->next = NULL;
+}
+
+void delayed_work_init(delayed_work_t *dwork, work_func_t func) {
+    work_init(&dwork->work, func);
+    ktimer_init(&dwork->timer, delayed_work_timer);
+}
+
+/**
+ * Queue a work item on the calling CPU
+ * @param wq   workqueue to account the item to
+ * @param work item to queue
+ * @return true if queued, false if it was already pending
+ */
+bool queue_work(workqueue_t *wq, work_t *work) {
+    return queue_work_on(smp_cpu_id(), wq, work);
+}
+
+/**
+ * Queue a work item on a given CPU. May be called from interrupt context.
+ * @param cpu  logical index of the CPU to run the item on
+ * @param wq   workqueue to account the item to
+ * @param work item to queue
+ * @return true if queued, false if it was already pending
+ */
+bool queue_work_on(uint32_t cpu, workqueue_t *wq, work_t *work) {
+    return queue_delayed_work_on(cpu, wq, container_of(work, delayed_work_t, work), 0);
+}
+
+/**
+ * Queue a work item on the calling CPU after a delay
+ * @param wq       workqueue to account the item to
+ * @param dwork    item to queue
+ * @param delay_ms milliseconds to wait before queueing it
+ * @return true if queued, false if it was already pending
+ */
+bool queue_delayed_work(workqueue_t *wq, delayed_work_t *dwork, uint32_t delay_ms) {
+    return queue_delayed_work_on(smp_cpu_id(), wq, dwork, delay_ms);
+}
+
+/**
+ * Queue a work item on a given CPU after a delay.
+ * May be called from interrupt context.
+ * @param cpu      logical index of the CPU to run the item on
+ * @param wq       workqueue to account the item to
+ * @param dwork    item to queue. If delay_ms is 0 this may be a plain work_t
+ *                 passed through container_of, its timer isn't touched.
+ * @param delay_ms milliseconds to wait before queueing it
+ * @return true if queued, false if it was already pending
+ */
+bool queue_delayed_work_on(uint32_t cpu, workqueue_t *wq, delayed_work_t *dwork, uint32_t delay_ms) {
+    worker_pool_t *pool = per_cpu_ptr(worker_pools, cpu);
+    work_t *work = &dwork->work;
+    ASSERT(pool->ready);
+
+    if (atomic_fetch_or(&work->flags, WORK_PENDING) & WORK_PENDING) {
+        return false;
+    }
+
+    uint32_t eflags = spin_lock_irqsave(&pool->lock);
+    work->pool = pool;
+    work->wq = wq;
+    atomic_inc(&wq->nr_active);
+    if (delay_ms) {
+        ktimer_add(&dwork->timer, ktime_get() + delay_ms * NSEC_PER_MSEC);
+    } else {
+        pool_insert_locked(pool, work);
+    }
+    spin_unlock_irqrestore(&pool->lock, eflags);
+    return true;
+}
+
+/**
+ * Remove a queued work item before it runs. It may still be running on return.
+ * @param work item to act on
+ * @return true if the item was pending and won't run
+ */
+bool cancel_work(work_t *work) {
+    worker_pool_t *pool = work->pool;
+    if (!pool) return false;
+
+    uint32_t eflags = spin_lock_irqsave(&pool->lock);
+    bool ret = pool_remove_locked(pool, work);
+    spin_unlock_irqrestore(&pool->lock, eflags);
+    return ret;
+}
+
+/**
+ * Remove a queued work item and wait for it to finish if it is running.
+ * Must be called from thread context.
+ * @param work item to act on
+ * @return true if the item was pending and won't run
+ */
+bool cancel_work_sync(work_t *work) {
+    bool ret = cancel_work(work);
+    flush_work(work);
+    return ret;
+}
+
+/**
+ * Cancel a delayed work item, whether it is still waiting for its delay or
+ * already queued. It may still be running on return.
+ * @param dwork item to act on
+ * @return true if the item was pending and won't run
+ */
+bool cancel_delayed_work(delayed_work_t *dwork) {
+    worker_pool_t *pool = dwork->work.pool;
+    if (!pool) return false;
+
+    uint32_t eflags = spin_lock_irqsave(&pool->lock);
+    bool ret = pool_remove_locked(pool, &dwork->work);
+    if (!ret && (dwork->work.flags & WORK_PENDING)) {
+        // Either still waiting, or the timer fired and its callback is
+        // waiting for the pool lock, which makes it see the item cancelled
+        ktimer_cancel(&dwork->timer);
+        atomic_fetch_and(&dwork->work.flags, ~WORK_PENDING);
+        workqueue_put(dwork->work.wq);
+        ret = true;
+    }
+    spin_unlock_irqrestore(&pool->lock, eflags);
+    return ret;
+}
+
+/**
+ * Cancel a delayed work item and wait for it to finish if it is running.
+ * The item isn't touched again once this returns, so it may be freed.
+ * Must be called from thread context.
+ * @param dwork item to act on
+ * @return true if the item was pending and won't run
+ */
+bool cancel_delayed_work_sync(delayed_work_t *dwork) {
+    bool ret = cancel_delayed_work(dwork);
+    // The timer may have fired already, with its callback still to see
+    // the item cancelled
+    ktimer_cancel_sync(&dwork->timer);
+    flush_work(&dwork->work);
+    return ret;
+}
+
+/**
+ * Wait until a work item is neither pending nor running.
+ * Must be called from thread context.
+ * @param work item to act on
+ */
+void flush_work(work_t *work) {
+    worker_pool_t *pool = work->pool;
+    if (!pool) return;
+    wait_event(&pool->done_wait, !pool_work_busy(pool, work));
+}
+
+/**
+ * Queue a delayed work item immediately if it is waiting for its delay,
+ * then wait for it to finish
+ * @param dwork item to act on
+ */
+void flush_delayed_work(delayed_work_t *dwork) {
+    worker_pool_t *pool = dwork->work.pool;
+    if (!pool) return;
+
+    uint32_t eflags = spin_lock_irqsave(&pool->lock);
+    if (ktimer_cancel(&dwork->timer)) {
+        pool_insert_locked(pool, &dwork->work);
+    }
+    spin_unlock_irqrestore(&pool->lock, eflags);
+    flush_work(&dwork->work);
+}
+
+/**
+ * Wait until every item queued on a workqueue has run.
+ * Items queued while waiting are waited for as well.
+ * Must be called from thread context.
+ * @param wq workqueue to act on
+ */
+void flush_workqueue(workqueue_t *wq) {
+    wait_event(&wq->flush_wait, atomic_load_acquire(&wq->nr_active) == 0);
+}
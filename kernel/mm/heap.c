@@ -10,6 +10,7 @@
 #include <kernel/kernel.h>
 #include <kernel/kernel_thread.h>
 #include <kernel/bitset.h>
+#include <kernel/spinlock.h>
 #include <mm/paging.h>
 #include <mm/alloc.h>
 #include <mm/heap.h>
@@ -18,6 +19,10 @@
 // Default kheap for kernel general allocations
 kheap_t kheap_default;
 
+// Serializes the default heap. Heap expansion edits the page tables through
+// the paging window page, so this also keeps other CPUs off the window.
+static spinlock_t kheap_lock = SPINLOCK_INIT;
+
 static inline bool __check_kheap_integrity(kheap_t *heap) {
 #ifdef KHEAP_DEBUG
     kheap_block_t *cur = heap->first;
@@ -188,22 +193,26 @@ uintptr_t __kheap_kalloc_malloc_real(size_t size, uintptr_t *phys, uint32_t flag
     k_return_t ret;
     uintptr_t res;
 
+    // The heap may be used by any thread, keep the scheduler out while it's modified
+    uint32_t eflags = spin_lock_irqsave(&kheap_lock);
     ret = kheap_malloc(&kheap_default, size,
                        (flags & KALLOC_PAGE_ALIGN) ? kpaging_data.page_size : 0, &res);
+    if (!K_FAILED(ret) && phys) {
+        *phys = kpage_get_phys(res);
+    }
+    spin_unlock_irqrestore(&kheap_lock, eflags);
 
     if (K_FAILED(ret)) {
         PANIC("kheap OOM!");
     }
 
-    if (phys) {
-        *phys = kpage_get_phys(res);
-    }
-
     return res;
 }
 
 void __kheap_kalloc_free(uintptr_t addr) {
+    uint32_t eflags = spin_lock_irqsave(&kheap_lock);
     kheap_free(&kheap_default, addr);
+    spin_unlock_irqrestore(&kheap_lock, eflags);
 }
 
 k_return_t kheap_malloc(kheap_t *heap, size_t size, size_t align, uintptr_t *out) {
@@ -0,0 +1,262 @@
+; i386 versions of memcpy, memmove, memset and memset32
+;
+; Copies and fills use rep movsd/stosd once the destination is dword
+; aligned, with rep movsb/stosb for the unaligned head and the tail.
+; At STRING_NT_THRESHOLD bytes and above, and if string_init() found SSE2,
+; the bulk is written with MOVNTI instead. Non-temporal stores bypass the
+; cache, so a page-sized copy or clear doesn't evict the working set.
+; MOVNTI works on general purpose registers, so no FPU/SSE state is touched.
+;
+; All functions follow cdecl and leave DF clear on return.
+
+STRING_NT_THRESHOLD equ 4096
+CPUID_1_EDX_SSE2    equ 1 << 26
+
+section .data
+; Set by string_init() if non-temporal stores may be used
+string_nt_stores: db 0
+
+section .text
+
+; void string_init(void)
+; Choose the variants to use from CPUID. Safe to skip, everything works
+; without it.
+global string_init
+string_init:
+    push ebx
+    mov eax, 1
+    cpuid
+    test edx, CPUID_1_EDX_SSE2
+    setnz byte [string_nt_stores]
+    pop ebx
+    ret
+
+; void *memcpy(void *dst, const void *src, size_t n)
+global memcpy
+memcpy:
+    push edi
+    push esi
+    mov edi, [esp+12]   ; dst
+    mov esi, [esp+16]   ; src
+    mov ecx, [esp+20]   ; n
+
+; Copy ecx bytes from esi to edi, front to back, then return the saved dst.
+; Entered with edi and esi pushed.
+copy_forward:
+    cmp ecx, 16
+    jb .bytes
+    cmp ecx, STRING_NT_THRESHOLD
+    jae .large
+
+.dwords:
+    ; Bytes up to the next dword boundary of dst
+    mov edx, edi
+    neg edx
+    and edx, 3
+    sub ecx, edx
+    xchg ecx, edx
+    rep movsb
+    mov ecx, edx
+    shr ecx, 2
+    rep movsd
+    mov ecx, edx
+    and ecx, 3
+.bytes:
+    rep movsb
+    mov eax, [esp+12]
+    pop esi
+    pop edi
+    ret
+
+.large:
+    cmp byte [string_nt_stores], 0
+    je .dwords
+
+    mov edx, edi
+    neg edx
+    and edx, 3
+    sub ecx, edx
+    xchg ecx, edx
+    rep movsb
+    mov ecx, edx
+    shr ecx, 4          ; 16 bytes per iteration
+    push ebx
+.nt_loop:
+    mov eax, [esi]
+    mov ebx, [esi+4]
+    movnti [edi], eax
+    movnti [edi+4], ebx
+    mov eax, [esi+8]
+    mov ebx, [esi+12]
+    movnti [edi+8], eax
+    movnti [edi+12], ebx
+    add esi, 16
+    add edi, 16
+    dec ecx
+    jnz .nt_loop
+    pop ebx
+    sfence              ; Order the non-temporal stores before anything after us
+    mov ecx, edx
+    and ecx, 15
+    jmp .bytes
+
+; void *memmove(void *dst, const void *src, size_t n)
+global memmove
+memmove:
+    push edi
+    push esi
+    mov edi, [esp+12]   ; dst
+    mov esi, [esp+16]   ; src
+    mov ecx, [esp+20]   ; n
+
+    ; A forward copy is safe unless dst starts inside [src, src + n)
+    mov eax, edi
+    sub eax, esi
+    cmp eax, ecx
+    jae copy_forward
+
+    ; Copy back to front, starting with the last byte
+    std
+    lea esi, [esi+ecx-1]
+    lea edi, [edi+ecx-1]
+    cmp ecx, 16
+    jb .bytes
+
+    ; Bytes after the last dword boundary of dst
+    lea edx, [edi+1]
+    and edx, 3
+    sub ecx, edx
+    xchg ecx, edx
+    rep movsb
+    ; Point at the first byte of the last whole dword
+    sub esi, 3
+    sub edi, 3
+    mov ecx, edx
+    shr ecx, 2
+    rep movsd
+    add esi, 3
+    add edi, 3
+    mov ecx, edx
+    and ecx, 3
+.bytes:
+    rep movsb
+    cld
+    mov eax, [esp+12]
+    pop esi
+    pop edi
+    ret
+
+; void *memset(void *dst, int value, size_t n)
+global memset
+memset:
+    push edi
+    mov edi, [esp+8]    ; dst
+    movzx eax, byte [esp+12]
+    mov ecx, [esp+16]   ; n
+    imul eax, eax, 0x01010101
+
+    cmp ecx, 16
+    jb .bytes
+    cmp ecx, STRING_NT_THRESHOLD
+    jae .large
+
+.dwords:
+    mov edx, edi
+    neg edx
+    and edx, 3
+    sub ecx, edx
+    xchg ecx, edx
+    rep stosb
+    mov ecx, edx
+    shr ecx, 2
+    rep stosd
+    mov ecx, edx
+    and ecx, 3
+.bytes:
+    rep stosb
+    mov eax, [esp+8]
+    pop edi
+    ret
+
+.large:
+    cmp byte [string_nt_stores], 0
+    je .dwords
+
+    mov edx, edi
+    neg edx
+    and edx, 3
+    sub ecx, edx
+    xchg ecx, edx
+    rep stosb
+    mov ecx, edx
+    shr ecx, 4
+.nt_loop:
+    movnti [edi], eax
+    movnti [edi+4], eax
+    movnti [edi+8], eax
+    movnti [edi+12], eax
+    add edi, 16
+    dec ecx
+    jnz .nt_loop
+    sfence
+    mov ecx, edx
+    and ecx, 15
+    jmp .bytes
+
+; void *memset32(void *dst, uint32_t value, size_t n)
+; Fill n dwords
+global memset32
+memset32:
+    push edi
+    mov edi, [esp+8]    ; dst
+    mov eax, [esp+12]   ; value
+    mov ecx, [esp+16]   ; n
+
+    cmp ecx, STRING_NT_THRESHOLD / 4
+    jb .dwords
+    cmp byte [string_nt_stores], 0
+    je .dwords
+
+    mov edx, ecx
+    shr ecx, 2          ; 4 dwords per iteration
+.nt_loop:
+    movnti [edi], eax
+    movnti [edi+4], eax
+    movnti [edi+8], eax
+    movnti [edi+12], eax
+    add edi, 16
+    dec ecx
+    jnz .nt_loop
+    sfence
+    mov ecx, edx
+    and ecx, 3
+.dwords:
+    rep stosd
+    mov eax, [esp+8]
+    pop edi
+    ret
+
+; void *memcpy_toio(volatile void *dst, const void *src, size_t n)
+; void *memcpy_fromio(void *dst, const volatile void *src, size_t n)
+; Copy to or from device memory. Device memory must be accessed in order
+; with accesses no wider than the device expects, so these never use
+; non-temporal stores and only ever make dword and byte accesses.
+global memcpy_toio
+global memcpy_fromio
+memcpy_toio:
+memcpy_fromio:
+    push edi
+    push esi
+    mov edi, [esp+12]   ; dst
+    mov esi, [esp+16]   ; src
+    mov ecx, [esp+20]   ; n
+    mov edx, ecx
+    shr ecx, 2
+    rep movsd
+    mov ecx, edx
+    and ecx, 3
+    rep movsb
+    mov eax, [esp+12]
+    pop esi
+    pop edi
+    ret
@@ -2,6 +2,7 @@
 #define _STDIO_H 1
 
 #include <stdarg.h>
+#include <stddef.h>
 
 #include <sys/cdefs.h>
 
@@ -9,7 +10,15 @@
 extern "C" {
 #endif
 
+/**
+ * Destination of printf() output, given whole messages at a time
+ */
+typedef void (*printf_sink_t)(const char *data, size_t length);
+
+void printf_set_sink(printf_sink_t sink);
 int vprintf(const char* restrict, va_list);
+int vsnprintf(char *str, size_t size, const char* __restrict, va_list);
+int snprintf(char *str, size_t size, const char* __restrict, ...);
 int sprintf(char *str, const char* __restrict, ...);
 int printf(const char* __restrict, ...);
 int putchar(int);
@@ -15,6 +15,9 @@ void* memcpy(void* __restrict, const void* __restrict, size_t);
 void* memmove(void*, const void*, size_t);
 void* memset(void*, int, size_t);
 void* memset32(void*, uint32_t, size_t);
+void* memcpy_toio(volatile void*, const void*, size_t);
+void* memcpy_fromio(void*, const volatile void*, size_t);
+void string_init(void);
 size_t strlen(const char*);
 char *strcpy(char * restrict dest, const char * restrict src);
 char *strncpy(char *restrict dest, const char *restrict src, size_t n);
@@ -1,24 +1,254 @@
 #include <stdbool.h>
 #include <stdarg.h>
+#include <stddef.h>
 #include <stdio.h>
 #include <string.h>
 #include <stdint.h>
 
-static void print(const char* data, size_t data_length)
+#if defined(__is_shawnos_kernel)
+#include <kernel/console.h>
+#endif
+
+/**
+ * Function the formatter hands its output to, piece by piece
+ */
+typedef void (*printf_emit_t)(void *ctx, const char *data, size_t length);
+
+// Send a piece of output to the destination and count it
+#define print(data, length) do {           \
+		size_t __length = (length);        \
+		emit(ctx, (data), __length);       \
+		written += __length;               \
+	} while (0)
+
+// Send n copies of a padding character
+#define print_pad(c, n) do {                                         \
+		int __n = (n);                                               \
+		const char *__pad = (c) == '0' ? printf_zeros : printf_spaces; \
+		while ( __n > 0 )                                            \
+		{                                                            \
+			int __chunk = __n > 16 ? 16 : __n;                       \
+			print(__pad, __chunk);                                   \
+			__n -= __chunk;                                          \
+		}                                                            \
+	} while (0)
+
+#define PRINTF_BUFFER_SIZE 128 // Output printf() collects before passing it to the sink
+
+static const char printf_spaces[16] = "                ";
+static const char printf_zeros[16] = "0000000000000000";
+static const char printf_lower_digits[16] = "0123456789abcdef";
+static const char printf_upper_digits[16] = "0123456789ABCDEF";
+
+// "00" to "99", so decimal conversion needs one division per two digits
+static const char printf_digit_pairs[200] =
+	"0001020304050607080910111213141516171819"
+	"2021222324252627282930313233343536373839"
+	"4041424344454647484950515253545556575859"
+	"6061626364656667686970717273747576777879"
+	"8081828384858687888990919293949596979899";
+
+static void putchar_sink(const char *data, size_t length)
 {
-	for ( size_t i = 0; i < data_length; i++ )
+	for ( size_t i = 0; i < length; i++ )
 		putchar((int) ((const unsigned char*) data)[i]);
 }
 
+#if defined(__is_shawnos_kernel)
+static printf_sink_t printf_sink = console_write;
+#else
+static printf_sink_t printf_sink = putchar_sink;
+#endif
+
+/**
+ * Choose where printf() output goes
+ * @param sink function given each formatted message, NULL for putchar()
+ */
+void printf_set_sink(printf_sink_t sink)
+{
+	printf_sink = sink ? sink : putchar_sink;
+}
+
+/**
+ * Output buffer of vprintf
+ */
+struct printf_ctx {
+	char buffer[PRINTF_BUFFER_SIZE];
+	size_t pos;
+};
+
+static void sink_emit(void *ctx, const char *data, size_t length)
+{
+	struct printf_ctx *b = (struct printf_ctx *)ctx;
+	while ( length )
+	{
+		if ( b->pos == PRINTF_BUFFER_SIZE )
+		{
+			printf_sink(b->buffer, b->pos);
+			b->pos = 0;
+		}
+		size_t room = PRINTF_BUFFER_SIZE - b->pos;
+		size_t amount = length < room ? length : room;
+		memcpy(b->buffer + b->pos, data, amount);
+		b->pos += amount;
+		data += amount;
+		length -= amount;
+	}
+}
+
+/**
+ * Output buffer of vsnprintf
+ */
+struct snprintf_ctx {
+	char *buffer;
+	size_t size;   // Space in buffer, including the terminating NUL
+	size_t pos;    // Characters stored so far
+};
+
+static void buffer_emit(void *ctx, const char *data, size_t length)
+{
+	struct snprintf_ctx *b = (struct snprintf_ctx *)ctx;
+	if ( b->pos + 1 < b->size )
+	{
+		size_t room = b->size - 1 - b->pos;
+		if ( length > room )
+			length = room;
+		memcpy(b->buffer + b->pos, data, length);
+		b->pos += length;
+	}
+}
+
+static int vformat(printf_emit_t emit, void *ctx, const char* restrict format, va_list parameters);
+
 int printf(const char* restrict format, ...)
 {
     va_list args;
     va_start(args, format);
-    vprintf(format, args);
+    int written = vprintf(format, args);
     va_end(args);
+    return written;
 }
 
+/**
+ * Format and pass the output to the sink, in one piece unless it is longer
+ * than PRINTF_BUFFER_SIZE
+ */
 int vprintf(const char* restrict format, va_list parameters)
+{
+	struct printf_ctx b;
+	b.pos = 0;
+	int written = vformat(sink_emit, &b, format, parameters);
+	if ( b.pos )
+		printf_sink(b.buffer, b.pos);
+	return written;
+}
+
+/**
+ * Format into a buffer, truncating to its size
+ * @param str    buffer to write to, always NUL terminated if size > 0
+ * @param size   size of buffer
+ * @param format format string
+ * @return number of characters the whole output has, excluding the NUL
+ */
+int vsnprintf(char *str, size_t size, const char* restrict format, va_list parameters)
+{
+	struct snprintf_ctx b = { str, size, 0 };
+	int written = vformat(buffer_emit, &b, format, parameters);
+	if ( size )
+		str[b.pos] = '\0';
+	return written;
+}
+
+int snprintf(char *str, size_t size, const char* restrict format, ...)
+{
+	va_list args;
+	va_start(args, format);
+	int written = vsnprintf(str, size, format, args);
+	va_end(args);
+	return written;
+}
+
+int sprintf(char *str, const char* restrict format, ...)
+{
+	va_list args;
+	va_start(args, format);
+	int written = vsnprintf(str, (size_t)-1 >> 1, format, args);
+	va_end(args);
+	return written;
+}
+
+/**
+ * Write the decimal digits of a value so that they end just before end
+ * @return first digit written
+ */
+static char *format_u32(char *end, uint32_t value)
+{
+	while ( value >= 100 )
+	{
+		uint32_t pair = value % 100;
+		value /= 100;
+		end -= 2;
+		end[0] = printf_digit_pairs[pair * 2];
+		end[1] = printf_digit_pairs[pair * 2 + 1];
+	}
+	if ( value >= 10 )
+	{
+		end -= 2;
+		end[0] = printf_digit_pairs[value * 2];
+		end[1] = printf_digit_pairs[value * 2 + 1];
+	}
+	else
+		*--end = '0' + value;
+	return end;
+}
+
+static char *format_u64(char *end, uint64_t value)
+{
+	// Peel off 8 digits at a time until the rest fits 32-bit arithmetic
+	while ( value > UINT32_MAX )
+	{
+		uint64_t high = value / 100000000;
+		char *chunk = end - 8;
+		char *digit = format_u32(end, (uint32_t)(value - high * 100000000));
+		while ( digit > chunk )
+			*--digit = '0';
+		end = chunk;
+		value = high;
+	}
+	return format_u32(end, (uint32_t)value);
+}
+
+/**
+ * Write the digits of a value in a power of two base
+ * @param shift  log2 of the base
+ * @param digits digit characters to use
+ */
+static char *format_pow2(char *end, uint64_t value, uint32_t shift, const char *digits)
+{
+	uint32_t mask = (1 << shift) - 1;
+	do
+	{
+		*--end = digits[value & mask];
+		value >>= shift;
+	} while ( value );
+	return end;
+}
+
+enum printf_length {
+	LENGTH_DEFAULT,
+	LENGTH_CHAR,   // hh
+	LENGTH_SHORT,  // h
+	LENGTH_LONG,   // l
+	LENGTH_LLONG,  // ll, j
+	LENGTH_SIZE,   // z, t
+};
+
+/**
+ * Format a string. Supports the flags "-0+ #", widths and precisions
+ * (including '*'), the length modifiers hh, h, l, ll, j, z and t and the
+ * conversions %c %s %d %i %u %x %X %o %p and %%.
+ */
+static int vformat(printf_emit_t emit, void *ctx, const char* restrict format, va_list parameters)
 {
 	int written = 0;
 	size_t amount;
@@ -34,7 +264,6 @@ int vprintf(const char* restrict format, va_list parameters)
 				amount++;
 			print(format, amount);
 			format += amount;
-			written += amount;
 			continue;
 		}
 
@@ -51,168 +280,177 @@ int vprintf(const char* restrict format, va_list parameters)
 			goto print_c;
 		}
 
-		if ( *format == 'c' )
+		// Flags
+		bool left = false, plus = false, space = false, alternate = false;
+		char pad = ' ';
+		for ( ;; format++ )
+		{
+			if ( *format == '-' ) left = true;
+			else if ( *format == '0' ) pad = '0';
+			else if ( *format == '+' ) plus = true;
+			else if ( *format == ' ' ) space = true;
+			else if ( *format == '#' ) alternate = true;
+			else break;
+		}
+
+		// Width and precision
+		int width = 0;
+		if ( *format == '*' )
 		{
 			format++;
+			width = va_arg(parameters, int);
+			if ( width < 0 )
+			{
+				left = true;
+				width = -width;
+			}
+		}
+		else
+		{
+			while ( *format >= '0' && *format <= '9' )
+				width = width * 10 + (*format++ - '0');
+		}
+
+		int precision = -1;
+		if ( *format == '.' )
+		{
+			format++;
+			precision = 0;
+			if ( *format == '*' )
+			{
+				format++;
+				precision = va_arg(parameters, int);
+			}
+			else
+			{
+				while ( *format >= '0' && *format <= '9' )
+					precision = precision * 10 + (*format++ - '0');
+			}
+		}
+		if ( left )
+			pad = ' ';
+
+		// Length
+		enum printf_length length = LENGTH_DEFAULT;
+		if ( *format == 'h' )
+		{
+			format++;
+			length = LENGTH_SHORT;
+			if ( *format == 'h' ) { format++; length = LENGTH_CHAR; }
+		}
+		else if ( *format == 'l' )
+		{
+			format++;
+			length = LENGTH_LONG;
+			if ( *format == 'l' ) { format++; length = LENGTH_LLONG; }
+		}
+		else if ( *format == 'j' ) { format++; length = LENGTH_LLONG; }
+		else if ( *format == 'z' || *format == 't' ) { format++; length = LENGTH_SIZE; }
+
+		char conversion = *format++;
+		if ( conversion == 'c' )
+		{
 			char c = (char) va_arg(parameters, int /* char promotes to int */);
+			if ( !left ) print_pad(' ', width - 1);
 			print(&c, sizeof(c));
+			if ( left ) print_pad(' ', width - 1);
+			continue;
 		}
-        else if ( *format == 'd' )
-        {
-            format++;
-            int d = (int) va_arg(parameters, int);
-            int size = 0;
-
-            //Zero override
-            if (d==0) {
-                char buffer[1];
-                buffer[0] = '0';
-                print(buffer, 1);
-            }
-
-            /* Determine size of buffer */
-            int temp = d;
-            while(temp) { ++size; temp /= 10; }
-            //if (temp == 0) {size = 1;}
-            char buffer[size];
-
-
-            /* Get each individual digit and add to buffer as char*/
-            int i;
-            for(i=0; d; i++)
-            {
-                buffer[size-i-1] = (d % 10) + '0';
-                d /= 10;
-            }
-
-            print(buffer, size);
-        }
-        else if ( *format == 'u' )
-        {
-            format++;
-            uint32_t d = (uint32_t) va_arg(parameters, uint32_t);
-            uint32_t size = 0;
-
-            //Zero override
-            if (d==0) {
-                char buffer[1];
-                buffer[0] = '0';
-                print(buffer, 1);
-            }
-
-            /* Determine size of buffer */
-            uint32_t temp = d;
-            while(temp) { ++size; temp /= 10; }
-            //if (temp == 0) {size = 1;}
-            char buffer[size];
-
-
-            /* Get each individual digit and add to buffer as char*/
-            uint32_t i;
-            for(i=0; d; i++)
-            {
-                buffer[size-i-1] = (d % 10) + '0';
-                d /= 10;
-            }
-
-            print(buffer, size);
-        }
-        else if ( *format == 'x' )
-        {
-            format++;
-            uint32_t d = (uint32_t) va_arg(parameters, uint32_t);
-            uint32_t size = 0;
-            uint32_t divisor = 16;
-            //Zero override
-            if(d == 0) {
-                char buffer[1];
-                buffer[0] = '0';
-                print(buffer, 1);
-            }
-
-            // deterine size!
-            uint32_t temp = d;
-            while(temp) { ++size; temp /= 16; }
-            char buffer[size];
-
-            int loop = 0;
-            do {
-                uint32_t remainder = d % divisor;
-
-                buffer[loop++] = (char) ((remainder < 10) ? remainder + '0' : remainder + 'a' - 10);
-
-            } while (d /= divisor);
-
-            buffer[loop] = 0;
-
-            // reverse array
-            char tmp;
-            char start = 0;
-            char end = size - 1;
-            while(start < end) {
-                tmp = buffer[start];
-                buffer[start] = buffer[end];
-                buffer[end] = tmp;
-                start++;
-                end--;
-            }
-
-            print(buffer, size);
-        }
-        else if ( *format == 'l' && *(format+1) == 'x')
-        {
-            format = format + 2;
-            uint64_t d = (uint64_t) va_arg(parameters, uint64_t);
-            uint64_t size = 0;
-            uint64_t divisor = 16;
-            //Zero override
-            if(d == 0) {
-                char buffer[1];
-                buffer[0] = '0';
-                print(buffer, 1);
-            }
-
-            // deterine size!
-            uint64_t temp = d;
-            while(temp) { ++size; temp /= 16; }
-            char buffer[size];
-
-            int loop = 0;
-            do {
-                uint64_t remainder = d % divisor;
-
-                buffer[loop++] = (char) ((remainder < 10) ? remainder + '0' : remainder + 'a' - 10);
-
-            } while (d /= divisor);
-
-            buffer[loop] = 0;
-
-            // reverse array
-            char tmp;
-            char start = 0;
-            char end = size - 1;
-            while(start < end) {
-                tmp = buffer[start];
-                buffer[start] = buffer[end];
-                buffer[end] = tmp;
-                start++;
-                end--;
-            }
-
-            print(buffer, size);
-        }
-		else if ( *format == 's' )
+		if ( conversion == 's' )
 		{
-			format++;
 			const char* s = va_arg(parameters, const char*);
-			print(s, strlen(s));
+			if ( !s )
+				s = "(null)";
+			size_t len = 0;
+			if ( precision >= 0 )
+				while ( len < (size_t)precision && s[len] ) len++;
+			else
+				len = strlen(s);
+			if ( !left ) print_pad(' ', width - (int)len);
+			print(s, len);
+			if ( left ) print_pad(' ', width - (int)len);
+			continue;
+		}
+
+		// Integers
+		uint64_t value;
+		bool negative = false, pointer = false;
+		if ( conversion == 'd' || conversion == 'i' )
+		{
+			int64_t s;
+			switch ( length )
+			{
+				case LENGTH_CHAR:  s = (signed char) va_arg(parameters, int); break;
+				case LENGTH_SHORT: s = (short) va_arg(parameters, int); break;
+				case LENGTH_LONG:  s = va_arg(parameters, long); break;
+				case LENGTH_LLONG: s = va_arg(parameters, long long); break;
+				case LENGTH_SIZE:  s = va_arg(parameters, ptrdiff_t); break;
+				default:           s = va_arg(parameters, int); break;
+			}
+			negative = s < 0;
+			value = negative ? -(uint64_t)s : (uint64_t)s;
+		}
+		else if ( conversion == 'u' || conversion == 'x' || conversion == 'X' || conversion == 'o' )
+		{
+			switch ( length )
+			{
+				case LENGTH_CHAR:  value = (unsigned char) va_arg(parameters, unsigned int); break;
+				case LENGTH_SHORT: value = (unsigned short) va_arg(parameters, unsigned int); break;
+				case LENGTH_LONG:  value = va_arg(parameters, unsigned long); break;
+				case LENGTH_LLONG: value = va_arg(parameters, unsigned long long); break;
+				case LENGTH_SIZE:  value = va_arg(parameters, size_t); break;
+				default:           value = va_arg(parameters, unsigned int); break;
+			}
+		}
+		else if ( conversion == 'p' )
+		{
+			value = (uintptr_t) va_arg(parameters, void*);
+			pointer = true;
+			conversion = 'x';
 		}
 		else
 		{
 			goto incomprehensible_conversion;
 		}
-	}
 
+		char digits[24];
+		char *end = digits + sizeof(digits);
+		char *start;
+		if ( precision == 0 && value == 0 )
+			start = end;
+		else if ( conversion == 'x' )
+			start = format_pow2(end, value, 4, printf_lower_digits);
+		else if ( conversion == 'X' )
+			start = format_pow2(end, value, 4, printf_upper_digits);
+		else if ( conversion == 'o' )
+			start = format_pow2(end, value, 3, printf_lower_digits);
+		else if ( value <= UINT32_MAX )
+			start = format_u32(end, (uint32_t)value);
+		else
+			start = format_u64(end, value);
+		int len = end - start;
+
+		const char *prefix = "";
+		if ( negative ) prefix = "-";
+		else if ( plus && (conversion == 'd' || conversion == 'i') ) prefix = "+";
+		else if ( space && (conversion == 'd' || conversion == 'i') ) prefix = " ";
+		else if ( pointer || (alternate && value != 0 && conversion == 'x') ) prefix = "0x";
+		else if ( alternate && value != 0 && conversion == 'X' ) prefix = "0X";
+		else if ( alternate && conversion == 'o' && (value != 0 || len == 0) && precision <= len ) prefix = "0";
+		int prefix_len = strlen(prefix);
+
+		// Precision gives the minimum number of digits, and turns off '0'
+		int zeros = precision > len ? precision - len : 0;
+		if ( pad == '0' && precision < 0 && width > prefix_len + len )
+			zeros = width - prefix_len - len;
+
+		int padding = width - prefix_len - zeros - len;
+		if ( !left ) print_pad(' ', padding);
+		print(prefix, prefix_len);
+		print_pad('0', zeros);
+		print(start, len);
+		if ( left ) print_pad(' ', padding);
+	}
 
 	return written;
 }
@@ -2,7 +2,7 @@
 
 
 #if defined(__is_shawnos_kernel)
-#include <kernel/kernel_stdio.h>
+#include <kernel/console.h>
 #endif
 
 int putchar(int ic)
@@ -10,7 +10,7 @@ int putchar(int ic)
 #if defined(__is_shawnos_kernel)
 	char c = (char) ic;
 	//kernel_buffer_stdout_writechar(c);
-    vga_textmode_putchar(c);
+    console_write(&c, 1);
 #else
 	// TODO: You need to implement a write system call.
 #endif
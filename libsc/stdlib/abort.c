@@ -1,14 +1,21 @@
 #include <stdio.h>
 #include <stdlib.h>
 
+#if defined(__is_shawnos_kernel)
+#include <kernel/console.h>
+#endif
+
 __attribute__((__noreturn__))
 void abort(void)
 {
 #if defined(__is_shawnos_kernel)
 	// TODO: Add proper kernel panic.
+	// Interrupts are going away, so queued console output must be pushed out now
+	console_panic();
 	printf("Kernel Panic: abort()\n");
     asm("cli");
-	while ( 1 ) { }
+	// Halt instead of spinning, only an NMI can get us out of here
+	while ( 1 ) { asm("hlt"); }
 	__builtin_unreachable();
 #else
 	// TODO: implement proper hosted abort
@@ -8,3 +8,33 @@ void* memcpy(void* restrict dstptr, const void* restrict srcptr, size_t size)
 		dst[i] = src[i];
 	return dstptr;
 }
+
+/**
+ * Copy to or from device memory, in order and without wider accesses than
+ * the device sees from a byte copy
+ */
+void* memcpy_toio(volatile void* dstptr, const void* srcptr, size_t size)
+{
+	volatile unsigned char* dst = (volatile unsigned char*) dstptr;
+	const unsigned char* src = (const unsigned char*) srcptr;
+	for ( size_t i = 0; i < size; i++ )
+		dst[i] = src[i];
+	return (void*) dstptr;
+}
+
+void* memcpy_fromio(void* dstptr, const volatile void* srcptr, size_t size)
+{
+	unsigned char* dst = (unsigned char*) dstptr;
+	const volatile unsigned char* src = (const volatile unsigned char*) srcptr;
+	for ( size_t i = 0; i < size; i++ )
+		dst[i] = src[i];
+	return dstptr;
+}
+
+/**
+ * Pick the fastest variants for this CPU. The generic versions have no
+ * variants to pick from.
+ */
+void string_init(void)
+{
+}